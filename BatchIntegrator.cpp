@@ -0,0 +1,34 @@
+#include "BatchIntegrator.h"
+
+using namespace std;
+using namespace DirectX;
+
+size_t BodyBatch::Add(FXMVECTOR pos, FXMVECTOR vel, FXMVECTOR orientation, GXMVECTOR spin)
+{
+    XMFLOAT3 p, v, s;
+    XMFLOAT4 q;
+    XMStoreFloat3(&p, pos);
+    XMStoreFloat3(&v, vel);
+    XMStoreFloat4(&q, XMQuaternionNormalize(orientation));
+    XMStoreFloat3(&s, spin);
+
+    PosX.push_back(p.x); PosY.push_back(p.y); PosZ.push_back(p.z);
+    VelX.push_back(v.x); VelY.push_back(v.y); VelZ.push_back(v.z);
+    RotX.push_back(q.x); RotY.push_back(q.y); RotZ.push_back(q.z); RotW.push_back(q.w);
+    SpinX.push_back(s.x); SpinY.push_back(s.y); SpinZ.push_back(s.z);
+
+    return PosX.size() - 1;
+}
+
+void BodyBatch::Clear()
+{
+    for (auto* a : { &PosX, &PosY, &PosZ, &VelX, &VelY, &VelZ, &RotX, &RotY, &RotZ, &RotW, &SpinX, &SpinY, &SpinZ })
+        a->clear();
+}
+
+XMMATRIX BodyBatch::World(size_t i) const
+{
+    XMMATRIX world = XMMatrixRotationQuaternion(Orientation(i));
+    world.r[3] = Position(i);
+    return world;
+}
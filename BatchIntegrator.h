@@ -0,0 +1,228 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <xmmintrin.h>
+#include <cstddef>
+#include <vector>
+
+/*
+State of many simulated bodies (AI aircraft, debris, projectiles) as a structure of arrays, one array per component,
+so BatchIntegrator can load the same component of BatchIntegrator::LANES bodies with a single instruction.
+*/
+struct BodyBatch
+{
+    std::vector<float> PosX, PosY, PosZ;
+    std::vector<float> VelX, VelY, VelZ;
+
+    // Orientation quaternion, and angular velocity in world space (radians per second)
+    std::vector<float> RotX, RotY, RotZ, RotW;
+    std::vector<float> SpinX, SpinY, SpinZ;
+
+    size_t Count() const { return PosX.size(); }
+
+    // Appends a body, returns its index
+    size_t Add(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, DirectX::FXMVECTOR orientation,
+        DirectX::GXMVECTOR spin = DirectX::XMVectorZero());
+
+    void Clear();
+
+    DirectX::XMVECTOR Position(size_t i) const { return DirectX::XMVectorSet(PosX[i], PosY[i], PosZ[i], 1.0f); }
+    DirectX::XMVECTOR Velocity(size_t i) const { return DirectX::XMVectorSet(VelX[i], VelY[i], VelZ[i], 0.0f); }
+    DirectX::XMVECTOR Orientation(size_t i) const { return DirectX::XMVectorSet(RotX[i], RotY[i], RotZ[i], RotW[i]); }
+    DirectX::XMVECTOR Spin(size_t i) const { return DirectX::XMVectorSet(SpinX[i], SpinY[i], SpinZ[i], 0.0f); }
+
+    // World matrix of body i, for its render item instance
+    DirectX::XMMATRIX World(size_t i) const;
+};
+
+/*
+Steps every body of a BodyBatch at once, LANES at a time in SSE registers. Bodies past the last whole group go through
+the same code, copied into a group of their own, so they step exactly as they would have in a full one.
+
+Forces is the force model, called for LANES bodies at a time with their velocities and axes:
+
+    void operator()(const BatchIntegrator::Float3& vel, const BatchIntegrator::Float3& forward,
+        const BatchIntegrator::Float3& up, BatchIntegrator::Float3& acc) const;
+
+PlaneForces is Plane's (lift, gravity, thrust and drag).
+*/
+class BatchIntegrator
+{
+public:
+    static const size_t LANES = 4;
+
+    // x, y and z of LANES vectors
+    struct Float3
+    {
+        __m128 X, Y, Z;
+    };
+
+    // Semi-implicit Euler: velocity, then position with the new velocity, then orientation with the spin.
+    // Orientations are renormalized every step.
+    template<typename Forces>
+    static void Step(BodyBatch& bodies, const Forces& forces, float dt);
+
+private:
+    // Pointers to the components of one group of LANES bodies
+    struct Group
+    {
+        float* Pos[3];
+        float* Vel[3];
+        float* Rot[4];
+        const float* Spin[3];
+    };
+
+    template<typename Forces>
+    static void StepGroup(const Group& group, const Forces& forces, __m128 dt);
+};
+
+// Plane's force model (see Plane::Plane), for LANES bodies at a time. Forward and up are the body's z and y axes.
+struct PlaneForces
+{
+    float Mass = 1.0f;
+    float LiftCoef = 1.0f;
+    float DragCoef = 1.0f;
+    float Gravity = 1.0f;
+    float Thrust = 1.0f;
+
+    void operator()(const BatchIntegrator::Float3& vel, const BatchIntegrator::Float3& forward,
+        const BatchIntegrator::Float3& up, BatchIntegrator::Float3& acc) const
+    {
+        // lift = liftCoef / mass * dot(forward, vel) * up
+        __m128 forwardSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(forward.X, vel.X), _mm_mul_ps(forward.Y, vel.Y)),
+            _mm_mul_ps(forward.Z, vel.Z));
+        __m128 lift = _mm_mul_ps(_mm_set1_ps(LiftCoef / Mass), forwardSpeed);
+
+        // drag = -dragCoef / mass * |vel| * vel
+        __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vel.X, vel.X), _mm_mul_ps(vel.Y, vel.Y)),
+            _mm_mul_ps(vel.Z, vel.Z)));
+        __m128 drag = _mm_mul_ps(_mm_set1_ps(-DragCoef / Mass), speed);
+
+        __m128 thrust = _mm_set1_ps(Thrust);
+
+        acc.X = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lift, up.X), _mm_mul_ps(thrust, forward.X)), _mm_mul_ps(drag, vel.X));
+        acc.Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lift, up.Y), _mm_mul_ps(thrust, forward.Y)), _mm_mul_ps(drag, vel.Y));
+        acc.Z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lift, up.Z), _mm_mul_ps(thrust, forward.Z)), _mm_mul_ps(drag, vel.Z));
+        acc.Y = _mm_sub_ps(acc.Y, _mm_set1_ps(Gravity));
+    }
+};
+
+template<typename Forces>
+void BatchIntegrator::Step(BodyBatch& bodies, const Forces& forces, float dt)
+{
+    const size_t count = bodies.Count();
+    const size_t whole = count / LANES * LANES;
+    const __m128 dtv = _mm_set1_ps(dt);
+
+    for (size_t i = 0; i < whole; i += LANES)
+    {
+        Group group = {
+            { &bodies.PosX[i], &bodies.PosY[i], &bodies.PosZ[i] },
+            { &bodies.VelX[i], &bodies.VelY[i], &bodies.VelZ[i] },
+            { &bodies.RotX[i], &bodies.RotY[i], &bodies.RotZ[i], &bodies.RotW[i] },
+            { &bodies.SpinX[i], &bodies.SpinY[i], &bodies.SpinZ[i] } };
+        StepGroup(group, forces, dtv);
+    }
+
+    if (whole == count)
+        return;
+
+    // The tail: padded with resting bodies at the identity orientation, which step without producing NaNs
+    float pos[3][LANES] = {}, vel[3][LANES] = {}, rot[4][LANES] = {}, spin[3][LANES] = {};
+    std::vector<float>* posArrays[3] = { &bodies.PosX, &bodies.PosY, &bodies.PosZ };
+    std::vector<float>* velArrays[3] = { &bodies.VelX, &bodies.VelY, &bodies.VelZ };
+    std::vector<float>* rotArrays[4] = { &bodies.RotX, &bodies.RotY, &bodies.RotZ, &bodies.RotW };
+    std::vector<float>* spinArrays[3] = { &bodies.SpinX, &bodies.SpinY, &bodies.SpinZ };
+
+    for (size_t lane = 0; lane < LANES; ++lane)
+        rot[3][lane] = 1.0f;
+
+    for (size_t lane = 0; whole + lane < count; ++lane)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            pos[c][lane] = (*posArrays[c])[whole + lane];
+            vel[c][lane] = (*velArrays[c])[whole + lane];
+            spin[c][lane] = (*spinArrays[c])[whole + lane];
+        }
+        for (int c = 0; c < 4; ++c)
+            rot[c][lane] = (*rotArrays[c])[whole + lane];
+    }
+
+    Group group = {
+        { pos[0], pos[1], pos[2] },
+        { vel[0], vel[1], vel[2] },
+        { rot[0], rot[1], rot[2], rot[3] },
+        { spin[0], spin[1], spin[2] } };
+    StepGroup(group, forces, dtv);
+
+    for (size_t lane = 0; whole + lane < count; ++lane)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            (*posArrays[c])[whole + lane] = pos[c][lane];
+            (*velArrays[c])[whole + lane] = vel[c][lane];
+        }
+        for (int c = 0; c < 4; ++c)
+            (*rotArrays[c])[whole + lane] = rot[c][lane];
+    }
+}
+
+template<typename Forces>
+void BatchIntegrator::StepGroup(const Group& group, const Forces& forces, __m128 dt)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    __m128 x = _mm_loadu_ps(group.Rot[0]), y = _mm_loadu_ps(group.Rot[1]);
+    __m128 z = _mm_loadu_ps(group.Rot[2]), w = _mm_loadu_ps(group.Rot[3]);
+
+    // Rows 2 and 1 of the rotation matrix of the quaternion (as XMMatrixRotationQuaternion): the z and y axes
+    Float3 forward, up;
+    forward.X = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, z), _mm_mul_ps(y, w)));
+    forward.Y = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(y, z), _mm_mul_ps(x, w)));
+    forward.Z = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+    up.X = _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(x, y), _mm_mul_ps(z, w)));
+    up.Y = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z))));
+    up.Z = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(y, z), _mm_mul_ps(x, w)));
+
+    Float3 vel = { _mm_loadu_ps(group.Vel[0]), _mm_loadu_ps(group.Vel[1]), _mm_loadu_ps(group.Vel[2]) };
+
+    Float3 acc;
+    forces(vel, forward, up, acc);
+
+    vel.X = _mm_add_ps(vel.X, _mm_mul_ps(acc.X, dt));
+    vel.Y = _mm_add_ps(vel.Y, _mm_mul_ps(acc.Y, dt));
+    vel.Z = _mm_add_ps(vel.Z, _mm_mul_ps(acc.Z, dt));
+    _mm_storeu_ps(group.Vel[0], vel.X);
+    _mm_storeu_ps(group.Vel[1], vel.Y);
+    _mm_storeu_ps(group.Vel[2], vel.Z);
+
+    _mm_storeu_ps(group.Pos[0], _mm_add_ps(_mm_loadu_ps(group.Pos[0]), _mm_mul_ps(vel.X, dt)));
+    _mm_storeu_ps(group.Pos[1], _mm_add_ps(_mm_loadu_ps(group.Pos[1]), _mm_mul_ps(vel.Y, dt)));
+    _mm_storeu_ps(group.Pos[2], _mm_add_ps(_mm_loadu_ps(group.Pos[2]), _mm_mul_ps(vel.Z, dt)));
+
+    // q += dt / 2 * (spin, 0) * q, spin in world space
+    __m128 sx = _mm_loadu_ps(group.Spin[0]), sy = _mm_loadu_ps(group.Spin[1]), sz = _mm_loadu_ps(group.Spin[2]);
+    __m128 h = _mm_mul_ps(_mm_set1_ps(0.5f), dt);
+
+    __m128 dx = _mm_add_ps(_mm_mul_ps(sx, w), _mm_sub_ps(_mm_mul_ps(sy, z), _mm_mul_ps(sz, y)));
+    __m128 dy = _mm_add_ps(_mm_mul_ps(sy, w), _mm_sub_ps(_mm_mul_ps(sz, x), _mm_mul_ps(sx, z)));
+    __m128 dz = _mm_add_ps(_mm_mul_ps(sz, w), _mm_sub_ps(_mm_mul_ps(sx, y), _mm_mul_ps(sy, x)));
+    __m128 dw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, x), _mm_mul_ps(sy, y)), _mm_mul_ps(sz, z));
+
+    x = _mm_add_ps(x, _mm_mul_ps(h, dx));
+    y = _mm_add_ps(y, _mm_mul_ps(h, dy));
+    z = _mm_add_ps(z, _mm_mul_ps(h, dz));
+    w = _mm_sub_ps(w, _mm_mul_ps(h, dw));
+
+    // A full precision square root; _mm_rsqrt_ps is too coarse to renormalize with every step
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+        _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+    __m128 scale = _mm_div_ps(one, length);
+
+    _mm_storeu_ps(group.Rot[0], _mm_mul_ps(x, scale));
+    _mm_storeu_ps(group.Rot[1], _mm_mul_ps(y, scale));
+    _mm_storeu_ps(group.Rot[2], _mm_mul_ps(z, scale));
+    _mm_storeu_ps(group.Rot[3], _mm_mul_ps(w, scale));
+}
@@ -0,0 +1,2685 @@
+#include "Benchmarks.h"
+#include "Utilities.h"
+#include "ObjReader.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshClusters.h"
+#include "MeshSimplifier.h"
+#include "MeshChunker.h"
+#include "GeometryGenerator.h"
+#include "GeometryBatchBuilder.h"
+#include "Integrator.h"
+#include "BatchIntegrator.h"
+#include "TriangleBvh.h"
+#include "SceneBvh.h"
+#include "ViewVolume.h"
+#include "MathF.h"
+#include "Simulation.h"
+#include "FrameResource.h" // for Vertex, PackedVertex
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <map>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring> // memcmp
+#include <cfloat> // FLT_EPSILON
+#include <random>
+
+using namespace std;
+
+namespace
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    double ElapsedMs(Clock::time_point start)
+    {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    /*
+    Runs f until at least minMs have passed (and at least once), returns the average time per run in ms.
+    The result of every run is summed into sink, so the work can't be optimized away.
+    */
+    template<typename F>
+    double TimeIt(F f, size_t& sink, double minMs = 200.0)
+    {
+        size_t runs = 0;
+        auto start = Clock::now();
+        do
+        {
+            sink += f();
+            ++runs;
+        } while (ElapsedMs(start) < minMs);
+
+        return ElapsedMs(start) / runs;
+    }
+
+    struct Corner
+    {
+        int V, VT, VN;
+    };
+
+    // The resolved (0-based) face corners of an OBJ file, in the order LoadOBJ sees them
+    bool ReadCorners(const wstring& filename, vector<Corner>& corners)
+    {
+        MappedFile file(filename);
+        if (!file.Data())
+            return false;
+
+        int posCount = 0, texCount = 0, normCount = 0;
+
+        ObjReader reader(file.Data(), file.Data() + file.Size());
+        while (reader.NextLine())
+        {
+            switch (reader.Element())
+            {
+            case ObjReader::ELEMENT::POSITION: ++posCount; break;
+            case ObjReader::ELEMENT::TEXCOORD: ++texCount; break;
+            case ObjReader::ELEMENT::NORMAL: ++normCount; break;
+            case ObjReader::ELEMENT::FACE:
+            {
+                int v, vt, vn;
+                while (reader.ReadFaceVertex(v, vt, vn))
+                {
+                    Corner c;
+                    c.V = v < 0 ? posCount + v : v - 1;
+                    c.VT = vt < 0 ? texCount + vt : vt - 1;
+                    c.VN = vn < 0 ? normCount + vn : vn - 1;
+                    corners.push_back(c);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    /*
+    The loop LoadOBJ parsed OBJ files with before ObjReader: getline, split into strings, atof/atoi, and a map<string, int>
+    keyed on the corner text. Kept for ObjParse to measure against. Returns -1 if the file can't be opened.
+    */
+    int ParseObjByLine(const wstring& filename, vector<Vertex>& vertices, vector<uint32_t>& indices,
+        unordered_map<string, SubmeshGeometry>& drawArgs, size_t& lineCount)
+    {
+        using namespace DirectX;
+
+        ifstream obj(filename, ios::in);
+        if (!obj.is_open())
+            return -1;
+
+        vector<XMFLOAT3> positions;
+        vector<XMFLOAT2> texcoords;
+        vector<XMFLOAT3> normals;
+        map<string, int> verts_added;
+
+        XMVECTOR mn = XMVectorReplicate(FLT_MAX), mx = XMVectorReplicate(-FLT_MAX);
+        string lastObject;
+
+        auto closeObject = [&]()
+        {
+            auto& sg = drawArgs[lastObject];
+            sg.IndexCount = (UINT)indices.size() - sg.StartIndexLocation;
+            BoundingBox::CreateFromPoints(sg.Bounds, mn, mx);
+            mn = XMVectorReplicate(FLT_MAX);
+            mx = XMVectorReplicate(-FLT_MAX);
+        };
+
+        string line;
+        lineCount = 0;
+        while (getline(obj, line))
+        {
+            ++lineCount;
+            if (line.empty())
+                continue;
+
+            switch (line[0])
+            {
+            case 'v':
+            case 'f':
+            case 'o':
+                break;
+            default:
+                continue;
+            }
+
+            auto tokens = split(line, ' ');
+            if (tokens[0] == "o")
+            {
+                if (!lastObject.empty())
+                    closeObject();
+
+                SubmeshGeometry sg;
+                sg.StartIndexLocation = (UINT)indices.size();
+                drawArgs[tokens[1]] = sg;
+                lastObject = tokens[1];
+            }
+            else if (tokens[0] == "v")
+            {
+                XMFLOAT3 p((float)::atof(tokens[1].c_str()), (float)::atof(tokens[2].c_str()), (float)::atof(tokens[3].c_str()));
+                mn = XMVectorMin(mn, XMLoadFloat3(&p));
+                mx = XMVectorMax(mx, XMLoadFloat3(&p));
+                positions.push_back(p);
+            }
+            else if (tokens[0] == "vt")
+                texcoords.push_back(XMFLOAT2((float)::atof(tokens[1].c_str()), (float)::atof(tokens[2].c_str())));
+            else if (tokens[0] == "vn")
+                normals.push_back(XMFLOAT3((float)::atof(tokens[1].c_str()), (float)::atof(tokens[2].c_str()), (float)::atof(tokens[3].c_str())));
+            else if (tokens[0] == "f")
+            {
+                for (size_t i = 1; i < tokens.size(); ++i)
+                {
+                    int vertex_id;
+                    if (verts_added.count(tokens[i]))
+                        vertex_id = verts_added[tokens[i]];
+                    else
+                    {
+                        auto inds = split(tokens[i], '/');
+
+                        Vertex v;
+                        v.Pos = positions[::atoi(inds[0].c_str()) - 1];
+                        v.TexC = texcoords[::atoi(inds[1].c_str()) - 1];
+                        v.Normal = normals[::atoi(inds[2].c_str()) - 1];
+
+                        verts_added[tokens[i]] = vertex_id = (int)vertices.size();
+                        vertices.push_back(v);
+                    }
+                    indices.push_back(vertex_id);
+                }
+            }
+        }
+
+        if (!lastObject.empty())
+            closeObject();
+
+        return 0;
+    }
+
+    // File names of all the OBJ files in Models/, sorted
+    vector<wstring> ListModels(const wstring& projectPath)
+    {
+        vector<wstring> models;
+
+        WIN32_FIND_DATAW found;
+        HANDLE find = FindFirstFileW((projectPath + L"Models\\*.obj").c_str(), &found);
+        if (find != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                models.push_back(found.cFileName);
+            } while (FindNextFileW(find, &found));
+            FindClose(find);
+        }
+
+        sort(models.begin(), models.end());
+        return models;
+    }
+
+    // Angle between two directions in degrees; neither needs to be normalized.
+    // acos of the dot product can't resolve the tiny angles we are after in float precision, atan2 can.
+    float AngleDegrees(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+    {
+        auto u = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&a));
+        auto v = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&b));
+        float sine = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVector3Cross(u, v)));
+        float cosine = DirectX::XMVectorGetX(DirectX::XMVector3Dot(u, v));
+        return atan2f(sine, cosine) * 180.0f / DirectX::XM_PI;
+    }
+
+    // Quantization error bound for a unorm16 value that decodes as offset + scale * q / 65535, plus float rounding
+    float Unorm16Bound(float offset, float scale)
+    {
+        return 0.5f * scale / 65535.0f + 4.0f * FLT_EPSILON * (fabsf(offset) + fabsf(scale));
+    }
+
+    // Box around all the (non empty) submeshes
+    DirectX::BoundingBox MeshBounds(const std::unordered_map<string, SubmeshGeometry>& drawArgs)
+    {
+        DirectX::BoundingBox bounds;
+        bool first = true;
+        for (auto& kv : drawArgs)
+        {
+            if (kv.second.IndexCount == 0)
+                continue;
+            if (first)
+                bounds = kv.second.Bounds;
+            else
+                DirectX::BoundingBox::CreateMerged(bounds, bounds, kv.second.Bounds);
+            first = false;
+        }
+        return bounds;
+    }
+
+    // A TriangleBvh over each submesh with triangles, in object space, as Mesh::BuildBvhs makes them
+    vector<TriangleBvh> SubmeshBvhs(const Mesh& mesh, const vector<Vertex>& vertices, const vector<uint32_t>& indices)
+    {
+        using namespace DirectX;
+
+        vector<TriangleBvh> bvhs;
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            if (sg.IndexCount == 0)
+                continue;
+
+            TriangleBvh bvh;
+            for (UINT i = sg.StartIndexLocation; i + 2 < sg.StartIndexLocation + sg.IndexCount; i += 3)
+            {
+                bvh.Add(XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos),
+                    XMLoadFloat3(&vertices[indices[i + 1] + sg.BaseVertexLocation].Pos),
+                    XMLoadFloat3(&vertices[indices[i + 2] + sg.BaseVertexLocation].Pos));
+            }
+            bvh.Build();
+            bvhs.push_back(move(bvh));
+        }
+        return bvhs;
+    }
+
+    // count views from random points inside bounds, looking in random directions. The same every run.
+    void RandomViews(const DirectX::BoundingBox& bounds, int count, vector<DirectX::BoundingFrustum>& frustums,
+        vector<DirectX::XMFLOAT3>& eyes)
+    {
+        using namespace DirectX;
+
+        mt19937 rng(1234);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        normal_distribution<float> gauss;
+
+        BoundingFrustum projFrustum;
+        BoundingFrustum::CreateFromMatrix(projFrustum, XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 1.0f, 10000.0f));
+
+        frustums.resize(count);
+        eyes.resize(count);
+        for (int v = 0; v < count; ++v)
+        {
+            XMVECTOR eye = XMVectorSet(
+                bounds.Center.x + unit(rng) * bounds.Extents.x,
+                bounds.Center.y + unit(rng) * bounds.Extents.y,
+                bounds.Center.z + unit(rng) * bounds.Extents.z, 1.0f);
+            XMVECTOR dir = XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f));
+            XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+            XMMATRIX view = XMMatrixLookAtLH(eye, eye + dir, up);
+            XMVECTOR det = XMMatrixDeterminant(view);
+            projFrustum.Transform(frustums[v], XMMatrixInverse(&det, view));
+            XMStoreFloat3(&eyes[v], eye);
+        }
+    }
+
+    // Distance from p to the triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+    float PointTriangleDistance(DirectX::FXMVECTOR p, DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::GXMVECTOR c)
+    {
+        using namespace DirectX;
+
+        auto dot = [](FXMVECTOR u, FXMVECTOR v) { return XMVectorGetX(XMVector3Dot(u, v)); };
+        auto distance = [&](FXMVECTOR q) { return XMVectorGetX(XMVector3Length(p - q)); };
+
+        XMVECTOR ab = b - a, ac = c - a, ap = p - a;
+        float d1 = dot(ab, ap), d2 = dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+            return distance(a);
+
+        XMVECTOR bp = p - b;
+        float d3 = dot(ab, bp), d4 = dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+            return distance(b);
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return distance(a + ab * (d1 / (d1 - d3)));
+
+        XMVECTOR cp = p - c;
+        float d5 = dot(ab, cp), d6 = dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+            return distance(c);
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return distance(a + ac * (d2 / (d2 - d6)));
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            return distance(b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+
+        float denom = va + vb + vc;
+        if (denom <= 0.0f) // degenerate
+            return (std::min)((std::min)(distance(a), distance(b)), distance(c));
+
+        return distance(a + ab * (vb / denom) + ac * (vc / denom));
+    }
+
+    // The force model of Plane (lift along the up axis, gravity, thrust, quadratic drag) for a plane climbing at 16
+    // degrees. Not flying level, so no component of the velocity decays towards zero and into denormals.
+    struct PlaneAcceleration
+    {
+        DirectX::XMVECTOR Forward = DirectX::XMVectorSet(0.0f, 0.28f, 0.96f, 0.0f);
+        DirectX::XMVECTOR Up = DirectX::XMVectorSet(0.0f, 0.96f, -0.28f, 0.0f);
+        float Mass = 1.0f, LiftCoef = 1.0f, DragCoef = 1.0f, Gravity = 1.0f, Thrust = 1.0f;
+
+        DirectX::XMVECTOR XM_CALLCONV operator()(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t) const
+        {
+            using namespace DirectX;
+
+            auto lift = 1.0f / Mass * LiftCoef * XMVector3Dot(Forward, vel) * Up;
+            auto gravity = -Gravity * XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+            auto accel = Thrust * Forward;
+            auto drag = -DragCoef / Mass * vel * XMVector3Length(vel);
+            return lift + gravity + accel + drag;
+        }
+    };
+
+    /*
+    Plane's force model (unit mass and coefficients) through a pull-up: level flight at the speed where lift, thrust and
+    drag balance, then, between 4 and 4.2 s, the nose comes up 60 degrees with a burst of thrust. Scalar and templated
+    on the precision, so the reference path can be computed in double.
+    */
+    template<typename Real>
+    void ManoeuvreAcceleration(Real t, const Real vel[3], Real acc[3])
+    {
+        Real s = (std::min)(Real(1), (std::max)(Real(0), (t - Real(4)) / Real(0.2)));
+        const Real pitch = Real(1.0471976) * s * s * (Real(3) - Real(2) * s);
+        const Real thrust = Real(1) + Real(16) * s * (Real(1) - s);
+
+        const Real forward[3] = { Real(0), sin(pitch), cos(pitch) };
+        const Real up[3] = { Real(0), cos(pitch), -sin(pitch) };
+
+        const Real forwardSpeed = forward[0] * vel[0] + forward[1] * vel[1] + forward[2] * vel[2];
+        const Real speed = sqrt(vel[0] * vel[0] + vel[1] * vel[1] + vel[2] * vel[2]);
+        for (int i = 0; i < 3; ++i)
+            acc[i] = forwardSpeed * up[i] + thrust * forward[i] - speed * vel[i];
+        acc[1] -= Real(1);
+    }
+
+    struct Manoeuvre
+    {
+        DirectX::XMVECTOR XM_CALLCONV operator()(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t) const
+        {
+            DirectX::XMFLOAT3 v, a;
+            DirectX::XMStoreFloat3(&v, vel);
+            ManoeuvreAcceleration(t, &v.x, &a.x);
+            return DirectX::XMVectorSet(a.x, a.y, a.z, 0.0f);
+        }
+    };
+}
+
+void Benchmarks::Run(const wstring& projectPath)
+{
+    Report("---- Benchmarks ----\n");
+
+    ObjParse(projectPath);
+    ObjDedup(projectPath);
+    MeshOptimization(projectPath);
+    VertexCompression(projectPath);
+    MeshClustering(projectPath);
+    MeshSimplification(projectPath);
+    MeshChunking(projectPath);
+    GeosphereGeneration();
+    GeometryBatching();
+    IntegratorSchemes();
+    AdaptiveIntegration();
+    BatchIntegration();
+    TerrainCollision(projectPath);
+    PickRays(projectPath);
+    SceneQueries(projectPath);
+    TriangleKernels(projectPath);
+    SceneRefit(projectPath);
+    InstanceCulling(projectPath);
+}
+
+void Benchmarks::Report(const char* format, ...)
+{
+    char buffer[512];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    OutputDebugStringA(buffer);
+
+    ofstream out("bench_output.txt", ios::app);
+    out << buffer;
+}
+
+/*
+Parses each file with the old getline/split/atof loop and with Mesh::ParseOBJ (ObjReader and ObjCornerMap, serial),
+reading the file included in both. The two have to build the same vertices, indices and submeshes; positions may
+differ in the last bit, as ObjReader parses floats itself. Reports FAIL otherwise.
+*/
+void Benchmarks::ObjParse(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const char* models[] = { "Level1", "Level8" };
+
+    for (auto model : models)
+    {
+        const string name(model);
+        const wstring filename = projectPath + L"Models\\" + wstring(name.begin(), name.end()) + L".obj";
+
+        vector<Vertex> lineVertices;
+        vector<uint32_t> lineIndices;
+        unordered_map<string, SubmeshGeometry> lineArgs;
+        size_t lines = 0;
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (ParseObjByLine(filename, lineVertices, lineIndices, lineArgs, lines) < 0 ||
+            mesh.ParseOBJ(filename, OBJ_LOAD_MODE::SERIAL, vertices, indices) < 0)
+        {
+            Report("ObjParse: could not read %s.obj\n", model);
+            continue;
+        }
+
+        // Relative to the magnitude, at least 1
+        float worst = 0.0f;
+        auto compare = [&worst](const float* a, const float* b, int n)
+        {
+            for (int i = 0; i < n; ++i)
+                worst = (std::max)(worst, fabsf(a[i] - b[i]) / (std::max)(1.0f, fabsf(a[i])));
+        };
+
+        bool pass = vertices.size() == lineVertices.size() && indices == lineIndices && mesh.DrawArgs.size() == lineArgs.size();
+        for (size_t i = 0; pass && i < vertices.size(); ++i)
+        {
+            compare(&vertices[i].Pos.x, &lineVertices[i].Pos.x, 3);
+            compare(&vertices[i].Normal.x, &lineVertices[i].Normal.x, 3);
+            compare(&vertices[i].TexC.x, &lineVertices[i].TexC.x, 2);
+        }
+        for (auto& kv : lineArgs)
+        {
+            auto found = mesh.DrawArgs.find(kv.first);
+            pass &= found != mesh.DrawArgs.end() && found->second.StartIndexLocation == kv.second.StartIndexLocation &&
+                found->second.IndexCount == kv.second.IndexCount;
+            if (found != mesh.DrawArgs.end())
+            {
+                compare(&found->second.Bounds.Center.x, &kv.second.Bounds.Center.x, 3);
+                compare(&found->second.Bounds.Extents.x, &kv.second.Bounds.Extents.x, 3);
+            }
+        }
+        pass &= worst < 1e-6f;
+
+        size_t sink = 0;
+        double lineMs = TimeIt([&]()
+        {
+            vector<Vertex> v;
+            vector<uint32_t> i;
+            unordered_map<string, SubmeshGeometry> args;
+            size_t n;
+            ParseObjByLine(filename, v, i, args, n);
+            return v.size();
+        }, sink);
+
+        double readerMs = TimeIt([&]()
+        {
+            Mesh m;
+            vector<Vertex> v;
+            vector<uint32_t> i;
+            m.ParseOBJ(filename, OBJ_LOAD_MODE::SERIAL, v, i);
+            return v.size();
+        }, sink);
+
+        const double n = (double)lines;
+        Report("ObjParse %s: %zu lines, %zu vertices | getline+split+atof %.3f ms (%.2f M lines/s) | ObjReader %.3f ms "
+            "(%.2f M lines/s) | %.1fx, worst difference %.1e | %s\n", model, lines, vertices.size(), lineMs,
+            n / lineMs / 1000.0, readerMs, n / readerMs / 1000.0, lineMs / readerMs, worst, pass ? "PASS" : "FAIL");
+    }
+}
+
+/*
+Compares the old map<string, int> keyed on the "v/vt/vn" text (count() followed by operator[], so two searches)
+with ObjCornerMap. The strings are built up front, so only the lookups are timed.
+*/
+void Benchmarks::ObjDedup(const wstring& projectPath)
+{
+    const char* models[] = { "Scythe1", "Level8" };
+
+    for (auto model : models)
+    {
+        vector<Corner> corners;
+        string name(model);
+        if (!ReadCorners(projectPath + L"Models\\" + wstring(name.begin(), name.end()) + L".obj", corners))
+        {
+            Report("ObjDedup: could not read %s.obj\n", model);
+            continue;
+        }
+
+        vector<string> keys;
+        keys.reserve(corners.size());
+        for (auto& c : corners)
+            keys.push_back(to_string(c.V + 1) + "/" + to_string(c.VT + 1) + "/" + to_string(c.VN + 1));
+
+        size_t sink = 0;
+
+        double mapMs = TimeIt([&]()
+        {
+            map<string, int> verts_added;
+            int next = 0;
+            for (auto& key : keys)
+            {
+                int vertex_id;
+                if (verts_added.count(key))
+                    vertex_id = verts_added[key];
+                else
+                    verts_added[key] = vertex_id = next++;
+                sink += vertex_id;
+            }
+            return verts_added.size();
+        }, sink);
+
+        double hashMs = TimeIt([&]()
+        {
+            ObjCornerMap verts_added(corners.size());
+            UINT next = 0;
+            for (auto& c : corners)
+            {
+                bool isNew = false;
+                sink += verts_added.FindOrInsert(c.V, c.VT, c.VN, next, isNew);
+                if (isNew)
+                    ++next;
+            }
+            return verts_added.Size();
+        }, sink);
+
+        const double n = (double)corners.size();
+        Report("ObjDedup %s: %zu corners | map<string,int> %.3f ms (%.1f M corners/s) | ObjCornerMap %.3f ms (%.1f M corners/s) | %.1fx (sink %zu)\n",
+            model, corners.size(), mapMs, n / mapMs / 1000.0, hashMs, n / hashMs / 1000.0, mapMs / hashMs, sink);
+    }
+}
+
+void Benchmarks::MeshOptimization(const wstring& projectPath)
+{
+    auto models = ListModels(projectPath);
+
+    const MESH_OPTIMIZATION modes[] = { MESH_OPTIMIZATION::VERTEX_CACHE, MESH_OPTIMIZATION::VERTEX_CACHE_AND_OVERDRAW };
+    const char* modeNames[] = { "vertex cache", "vertex cache + overdraw" };
+
+    for (auto& model : models)
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh source;
+        vector<Vertex> sourceVertices;
+        vector<uint32_t> sourceIndices;
+        if (source.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::SERIAL, sourceVertices, sourceIndices) < 0)
+        {
+            Report("MeshOptimization: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        for (int m = 0; m < 2; ++m)
+        {
+            auto vertices = sourceVertices;
+            auto indices = sourceIndices;
+            auto drawArgs = source.DrawArgs;
+
+            auto start = Clock::now();
+            MeshOptimizer::Optimize(vertices, indices, drawArgs, modes[m]);
+            double ms = ElapsedMs(start);
+
+            Report("MeshOptimization %s (%s): %zu triangles, %zu -> %zu vertices in %.2f ms\n",
+                name.c_str(), modeNames[m], indices.size() / 3, sourceVertices.size(), vertices.size(), ms);
+
+            // Submeshes in index buffer order, so runs are easy to compare
+            vector<pair<UINT, string>> order;
+            for (auto& kv : drawArgs)
+                order.push_back(make_pair(kv.second.StartIndexLocation, kv.first));
+            sort(order.begin(), order.end());
+
+            for (auto& o : order)
+            {
+                auto& before = source.DrawArgs[o.second];
+                auto& after = drawArgs[o.second];
+
+                auto b = MeshOptimizer::AnalyzeVertexCache(sourceIndices.data() + before.StartIndexLocation, before.IndexCount);
+                auto a = MeshOptimizer::AnalyzeVertexCache(indices.data() + after.StartIndexLocation, after.IndexCount);
+
+                Report("    %-24s %6u triangles | ACMR %.3f -> %.3f | ATVR %.3f -> %.3f\n",
+                    o.second.c_str(), a.Triangles, b.ACMR(), a.ACMR(), b.ATVR(), a.ATVR());
+            }
+        }
+    }
+}
+
+/*
+The error bound test for VERTEX_FORMAT::PACKED. Every model is loaded the way the level is (parallel, vertex cache
+optimized), packed, and decoded again with the CPU decoder; the result is compared against the float vertices.
+Normals are also checked over a large set of random directions, as models tend to contain few distinct ones.
+*/
+void Benchmarks::VertexCompression(const wstring& projectPath)
+{
+    // What octahedral encoding with 2x16 bits and plain rounding can guarantee, see VertexPacking.h
+    const float NORMAL_BOUND_DEGREES = 0.004f;
+
+    {
+        mt19937 rng(1234);
+        normal_distribution<float> gauss;
+
+        float maxAngle = 0.0f;
+        for (int i = 0; i < 1000000; ++i)
+        {
+            Vertex v = {};
+            v.Normal = DirectX::XMFLOAT3(gauss(rng), gauss(rng), gauss(rng));
+
+            auto decoded = VertexPacking::UnpackVertex(VertexPacking::PackVertex(v, VertexQuantization()), VertexQuantization());
+            maxAngle = (std::max)(maxAngle, AngleDegrees(v.Normal, decoded.Normal));
+        }
+
+        Report("VertexCompression random normals: max error %.5f deg (bound %.5f) %s\n",
+            maxAngle, NORMAL_BOUND_DEGREES, maxAngle <= NORMAL_BOUND_DEGREES ? "PASS" : "FAIL");
+    }
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("VertexCompression: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        MeshOptimizer::Optimize(vertices, indices, mesh.DrawArgs, MESH_OPTIMIZATION::VERTEX_CACHE);
+
+        auto start = Clock::now();
+        vector<PackedVertex> packed;
+        VertexPacking::Pack(vertices, indices, mesh.DrawArgs, packed);
+        double ms = ElapsedMs(start);
+
+        // Worst error relative to its bound, so 1 is the limit; and the worst absolute errors, for reference
+        float posRatio = 0.0f, texRatio = 0.0f;
+        float posError = 0.0f, texError = 0.0f, normalError = 0.0f;
+
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            auto& q = sg.Quantization;
+
+            for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
+            {
+                const UINT v = indices[i] + sg.BaseVertexLocation;
+                const Vertex& original = vertices[v];
+                const Vertex decoded = VertexPacking::UnpackVertex(packed[v], q);
+
+                const float pos[3][4] =
+                {
+                    { original.Pos.x, decoded.Pos.x, q.PosOffset.x, q.PosScale.x },
+                    { original.Pos.y, decoded.Pos.y, q.PosOffset.y, q.PosScale.y },
+                    { original.Pos.z, decoded.Pos.z, q.PosOffset.z, q.PosScale.z },
+                };
+                for (auto& c : pos)
+                {
+                    float e = fabsf(c[0] - c[1]);
+                    posError = (std::max)(posError, e);
+                    posRatio = (std::max)(posRatio, e / Unorm16Bound(c[2], c[3]));
+                }
+
+                const float tex[2][4] =
+                {
+                    { original.TexC.x, decoded.TexC.x, q.TexOffset.x, q.TexScale.x },
+                    { original.TexC.y, decoded.TexC.y, q.TexOffset.y, q.TexScale.y },
+                };
+                for (auto& c : tex)
+                {
+                    float e = fabsf(c[0] - c[1]);
+                    texError = (std::max)(texError, e);
+                    texRatio = (std::max)(texRatio, e / Unorm16Bound(c[2], c[3]));
+                }
+
+                // Zero normals (missing in the file) have no direction to preserve
+                if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMLoadFloat3(&original.Normal))) > 0.0f)
+                    normalError = (std::max)(normalError, AngleDegrees(original.Normal, decoded.Normal));
+            }
+        }
+
+        const bool pass = posRatio <= 1.0f && texRatio <= 1.0f && normalError <= NORMAL_BOUND_DEGREES;
+
+        Report("VertexCompression %s: %zu vertices, %zu -> %zu KB in %.2f ms | max error pos %.2e (%.2f of bound), uv %.2e (%.2f of bound), normal %.5f deg | %s\n",
+            name.c_str(), vertices.size(), vertices.size() * sizeof(Vertex) / 1024, packed.size() * sizeof(PackedVertex) / 1024, ms,
+            posError, posRatio, texError, texRatio, normalError, pass ? "PASS" : "FAIL");
+    }
+}
+
+/*
+Clusters every model the way the level loads it, then looks at it from random views inside its bounds and compares how
+many triangles survive culling per submesh (one box), per cluster (frustum) and per cluster with the normal cones.
+
+Also checks that the clusters are a reordering of the submesh's triangles, that their spheres contain them, and that
+every cluster the cones reject really faces away. Reports FAIL otherwise.
+*/
+void Benchmarks::MeshClustering(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int VIEWS = 64;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("MeshClustering: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        MeshOptimizer::Optimize(vertices, indices, mesh.DrawArgs, MESH_OPTIMIZATION::VERTEX_CACHE_AND_OVERDRAW);
+        const auto sourceIndices = indices;
+
+        auto start = Clock::now();
+        MeshClusters::Build(vertices, indices, mesh.DrawArgs, mesh.Clusters);
+        double ms = ElapsedMs(start);
+
+        bool pass = true;
+
+        auto position = [&](const SubmeshGeometry& sg, UINT i) { return XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos); };
+
+        size_t cones = 0;
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            const UINT end = sg.StartIndexLocation + sg.IndexCount / 3 * 3;
+
+            // Same triangles (corners in the same winding order), just reordered
+            vector<array<uint32_t, 3>> before, after;
+            for (UINT i = sg.StartIndexLocation; i < end; i += 3)
+            {
+                before.push_back({ { sourceIndices[i], sourceIndices[i + 1], sourceIndices[i + 2] } });
+                after.push_back({ { indices[i], indices[i + 1], indices[i + 2] } });
+            }
+            sort(before.begin(), before.end());
+            sort(after.begin(), after.end());
+            pass &= before == after;
+
+            UINT next = sg.StartIndexLocation;
+            for (UINT c = sg.FirstCluster; c < sg.FirstCluster + sg.ClusterCount; ++c)
+            {
+                auto& cluster = mesh.Clusters[c];
+                pass &= cluster.StartIndexLocation == next && cluster.IndexCount > 0 && cluster.IndexCount <= 3 * MeshClusters::MAX_TRIANGLES;
+                next += cluster.IndexCount;
+
+                if (cluster.ConeCutoff < 1.0f)
+                    ++cones;
+
+                auto center = XMLoadFloat3(&cluster.Bounds.Center);
+                for (UINT i = cluster.StartIndexLocation; i < cluster.StartIndexLocation + cluster.IndexCount; ++i)
+                {
+                    float d = XMVectorGetX(XMVector3Length(position(sg, i) - center));
+                    pass &= d <= cluster.Bounds.Radius * (1.0f + 1e-4f) + 1e-5f;
+                }
+            }
+            pass &= sg.ClusterCount == 0 ? end == sg.StartIndexLocation : next == end;
+        }
+
+        // Random views from inside the model, looking anywhere
+        vector<BoundingFrustum> frustums;
+        vector<XMFLOAT3> eyes;
+        RandomViews(MeshBounds(mesh.DrawArgs), VIEWS, frustums, eyes);
+
+        const double total = (double)indices.size() * VIEWS;
+        double boxes = 0.0, frustum = 0.0, frustumCones = 0.0;
+        double queryUs = 0.0;
+        vector<IndexRange> visible;
+
+        for (int v = 0; v < VIEWS; ++v)
+        {
+            const XMVECTOR eye = XMLoadFloat3(&eyes[v]);
+            const BoundingFrustum& viewFrustum = frustums[v];
+
+            for (auto& kv : mesh.DrawArgs)
+            {
+                if (viewFrustum.Contains(kv.second.Bounds) != DISJOINT)
+                    boxes += kv.second.IndexCount;
+            }
+
+            auto countVisible = [&](bool backfaceCulling)
+            {
+                visible.clear();
+                for (auto& kv : mesh.DrawArgs)
+                    mesh.VisibleRanges(kv.second, viewFrustum, eye, backfaceCulling, visible);
+
+                size_t count = 0;
+                for (auto& r : visible)
+                    count += r.IndexCount;
+                return count;
+            };
+
+            frustum += countVisible(false);
+
+            size_t sink = 0;
+            queryUs += 1000.0 * TimeIt([&]() { return countVisible(true); }, sink, 5.0);
+            frustumCones += countVisible(true);
+
+            // Whatever the cones rejected must face away from the eye, triangle by triangle
+            for (auto& kv : mesh.DrawArgs)
+            {
+                auto& sg = kv.second;
+                for (UINT c = sg.FirstCluster; c < sg.FirstCluster + sg.ClusterCount; ++c)
+                {
+                    auto& cluster = mesh.Clusters[c];
+                    if (!MeshClusters::IsBackfacing(cluster, eye))
+                        continue;
+
+                    for (UINT i = cluster.StartIndexLocation; i < cluster.StartIndexLocation + cluster.IndexCount; i += 3)
+                    {
+                        auto p0 = position(sg, i);
+                        auto n = XMVector3Cross(position(sg, i + 1) - p0, position(sg, i + 2) - p0);
+                        pass &= XMVectorGetX(XMVector3Dot(n, p0 - eye)) >= -1e-3f * XMVectorGetX(XMVector3Length(n)) * XMVectorGetX(XMVector3Length(p0 - eye));
+                    }
+                }
+            }
+        }
+
+        Report("MeshClustering %s: %zu triangles, %zu clusters (%.1f triangles each, %.0f%% with a cone) in %.2f ms\n",
+            name.c_str(), indices.size() / 3, mesh.Clusters.size(), mesh.Clusters.empty() ? 0.0 : indices.size() / 3.0 / mesh.Clusters.size(),
+            mesh.Clusters.empty() ? 0.0 : 100.0 * cones / mesh.Clusters.size(), ms);
+        Report("    triangles drawn over %d views: submesh boxes %.1f%% | cluster frustum %.1f%% | + cones %.1f%% | query %.2f us | %s\n",
+            VIEWS, 100.0 * boxes / total, 100.0 * frustum / total, 100.0 * frustumCones / total, queryUs / VIEWS, pass ? "PASS" : "FAIL");
+    }
+}
+
+/*
+Builds MeshSimplifier::MAX_LODS levels of detail for every model and reports, per level, how many triangles are left
+and how far the surface moved: the LodError the simplifier promises, and the measured distance from every full
+resolution vertex to the nearest triangle of the level. Both relative to the submesh's bounding box diagonal.
+
+Also checks that the levels only use vertices of their own submesh, have no degenerate triangles, and get coarser
+level by level. Reports FAIL otherwise.
+*/
+void Benchmarks::MeshSimplification(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("MeshSimplification: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        MeshOptimizer::Optimize(vertices, indices, mesh.DrawArgs, MESH_OPTIMIZATION::VERTEX_CACHE);
+        const size_t baseTriangles = indices.size() / 3;
+
+        auto start = Clock::now();
+        MeshSimplifier::BuildLods(vertices, indices, mesh.DrawArgs, MeshSimplifier::MAX_LODS);
+        double ms = ElapsedMs(start);
+
+        bool pass = true;
+
+        size_t triangles[MeshSimplifier::MAX_LODS + 1] = {};
+        float promised[MeshSimplifier::MAX_LODS + 1] = {};
+        float measured[MeshSimplifier::MAX_LODS + 1] = {};
+        UINT submeshes = 0, lodSubmeshes = 0;
+
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& base = kv.second;
+            if (base.LodLevel > 0)
+                continue;
+
+            ++submeshes;
+            triangles[0] += base.IndexCount / 3;
+            if (base.LodCount == 0)
+                continue;
+            ++lodSubmeshes;
+
+            auto position = [&](int baseVertex, uint32_t i) { return XMLoadFloat3(&vertices[i + baseVertex].Pos); };
+
+            const UINT baseEnd = base.StartIndexLocation + base.IndexCount / 3 * 3;
+            vector<uint32_t> used(indices.begin() + base.StartIndexLocation, indices.begin() + baseEnd);
+            sort(used.begin(), used.end());
+            used.erase(unique(used.begin(), used.end()), used.end());
+
+            const float diagonal = 2.0f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&base.Bounds.Extents)));
+
+            UINT previousCount = base.IndexCount / 3 * 3;
+            float previousError = 0.0f;
+            for (UINT level = 1; level <= base.LodCount; ++level)
+            {
+                auto found = mesh.DrawArgs.find(Mesh::LodName(kv.first, level));
+                if (found == mesh.DrawArgs.end())
+                {
+                    pass = false;
+                    break;
+                }
+
+                auto& lod = found->second;
+                pass &= lod.LodLevel == level && lod.BaseVertexLocation == base.BaseVertexLocation;
+                pass &= lod.IndexCount % 3 == 0 && lod.IndexCount > 0 && lod.IndexCount < previousCount;
+                pass &= lod.LodError >= previousError;
+                previousCount = lod.IndexCount;
+                previousError = lod.LodError;
+
+                const UINT end = lod.StartIndexLocation + lod.IndexCount;
+                for (UINT i = lod.StartIndexLocation; i < end; i += 3)
+                {
+                    uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+                    pass &= a != b && b != c && c != a;
+                    pass &= binary_search(used.begin(), used.end(), a) && binary_search(used.begin(), used.end(), b) &&
+                        binary_search(used.begin(), used.end(), c);
+                }
+
+                // How far the full resolution vertices ended up from the simplified surface
+                float worst = 0.0f;
+                for (auto v : used)
+                {
+                    auto p = position(base.BaseVertexLocation, v);
+                    float nearest = FLT_MAX;
+                    for (UINT i = lod.StartIndexLocation; i < end && nearest > 0.0f; i += 3)
+                    {
+                        nearest = (std::min)(nearest, PointTriangleDistance(p,
+                            position(base.BaseVertexLocation, indices[i]),
+                            position(base.BaseVertexLocation, indices[i + 1]),
+                            position(base.BaseVertexLocation, indices[i + 2])));
+                    }
+                    worst = (std::max)(worst, nearest);
+                }
+
+                triangles[level] += lod.IndexCount / 3;
+                if (diagonal > 0.0f)
+                {
+                    promised[level] = (std::max)(promised[level], lod.LodError / diagonal);
+                    measured[level] = (std::max)(measured[level], worst / diagonal);
+                }
+            }
+        }
+
+        Report("MeshSimplification %s: %zu triangles, LODs for %u of %u submeshes in %.2f ms | %s\n",
+            name.c_str(), baseTriangles, lodSubmeshes, submeshes, ms, pass ? "PASS" : "FAIL");
+        for (UINT level = 1; level <= MeshSimplifier::MAX_LODS && triangles[level] > 0; ++level)
+        {
+            Report("    LOD%u: %zu triangles (%.1f%%) | worst LodError %.3f%% | measured vertex distance %.3f%% of diagonal\n",
+                level, triangles[level], 100.0 * triangles[level] / triangles[0], 100.0f * promised[level], 100.0f * measured[level]);
+        }
+    }
+}
+
+/*
+Splits the large submeshes of every model into chunks as the level loads them, and compares how many triangles are in
+submeshes whose box the view frustum touches, before and after, from random views inside the model.
+
+Also checks that every split submesh became chunks covering exactly its index range, with the same triangles, at most
+MeshChunker::MAX_TRIANGLES each, inside their bounds. Reports FAIL otherwise.
+*/
+void Benchmarks::MeshChunking(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int VIEWS = 256;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("MeshChunking: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        const auto sourceArgs = mesh.DrawArgs;
+        const auto sourceIndices = indices;
+
+        auto start = Clock::now();
+        MeshChunker::Split(vertices, indices, mesh.DrawArgs);
+        double ms = ElapsedMs(start);
+
+        bool pass = true;
+        size_t split = 0, chunks = 0;
+
+        for (auto& kv : sourceArgs)
+        {
+            auto& whole = kv.second;
+            auto found = mesh.DrawArgs.find(kv.first);
+            if (found != mesh.DrawArgs.end())
+            {
+                pass &= whole.IndexCount / 3 <= MeshChunker::MAX_TRIANGLES &&
+                    found->second.StartIndexLocation == whole.StartIndexLocation && found->second.IndexCount == whole.IndexCount;
+                continue;
+            }
+
+            ++split;
+
+            UINT next = whole.StartIndexLocation;
+            for (UINT c = 0;; ++c)
+            {
+                auto chunk = mesh.DrawArgs.find(Mesh::ChunkName(kv.first, c));
+                if (chunk == mesh.DrawArgs.end())
+                    break;
+
+                auto& sg = chunk->second;
+                ++chunks;
+                pass &= sg.StartIndexLocation == next && sg.BaseVertexLocation == whole.BaseVertexLocation &&
+                    sg.IndexCount / 3 <= MeshChunker::MAX_TRIANGLES && sg.IndexCount > 0;
+                next += sg.IndexCount;
+
+                // Within rounding of center +- extents
+                const XMVECTOR center = XMLoadFloat3(&sg.Bounds.Center);
+                const XMVECTOR extents = XMLoadFloat3(&sg.Bounds.Extents) * (1.0f + 1e-5f) + XMVectorReplicate(1e-5f);
+                for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
+                {
+                    XMVECTOR p = XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos);
+                    pass &= XMVector3LessOrEqual(XMVectorAbs(p - center), extents);
+                }
+            }
+            pass &= next == whole.StartIndexLocation + whole.IndexCount;
+
+            // Same triangles, just reordered
+            const UINT end = whole.StartIndexLocation + whole.IndexCount / 3 * 3;
+            vector<array<uint32_t, 3>> before, after;
+            for (UINT i = whole.StartIndexLocation; i < end; i += 3)
+            {
+                before.push_back({ { sourceIndices[i], sourceIndices[i + 1], sourceIndices[i + 2] } });
+                after.push_back({ { indices[i], indices[i + 1], indices[i + 2] } });
+            }
+            sort(before.begin(), before.end());
+            sort(after.begin(), after.end());
+            pass &= before == after;
+        }
+
+        if (split == 0)
+        {
+            Report("MeshChunking %s: %zu triangles, nothing to split | %s\n", name.c_str(), indices.size() / 3, pass ? "PASS" : "FAIL");
+            continue;
+        }
+
+        vector<BoundingFrustum> frustums;
+        vector<XMFLOAT3> eyes;
+        RandomViews(MeshBounds(sourceArgs), VIEWS, frustums, eyes);
+
+        auto trianglesInView = [&](const unordered_map<string, SubmeshGeometry>& drawArgs)
+        {
+            double count = 0.0;
+            for (auto& frustum : frustums)
+            {
+                for (auto& kv : drawArgs)
+                {
+                    if (frustum.Contains(kv.second.Bounds) != DISJOINT)
+                        count += kv.second.IndexCount / 3;
+                }
+            }
+            return count;
+        };
+
+        const double total = indices.size() / 3.0 * VIEWS;
+        Report("MeshChunking %s: %zu triangles, %zu of %zu submeshes split into %zu chunks in %.3f ms | %s\n",
+            name.c_str(), indices.size() / 3, split, sourceArgs.size(), chunks, ms, pass ? "PASS" : "FAIL");
+        Report("    triangles in boxes the frustum touches over %d views: submeshes %.1f%% | chunks %.1f%% | render items %zu -> %zu\n",
+            VIEWS, 100.0 * trianglesInView(sourceArgs) / total, 100.0 * trianglesInView(mesh.DrawArgs) / total,
+            sourceArgs.size(), mesh.DrawArgs.size());
+    }
+}
+
+/*
+Generates a geosphere at every subdivision level CreateGeosphere allows. Subdividing shares edge midpoints between
+triangles, so the result must be the closed icosphere: 10 * 4^n + 2 vertices, all on the sphere, and 20 * 4^n
+triangles. Reports FAIL otherwise.
+*/
+void Benchmarks::GeosphereGeneration()
+{
+    using namespace DirectX;
+
+    GeometryGenerator geo;
+
+    for (UINT n = 0; n <= 6; ++n)
+    {
+        GeometryGenerator::MeshData mesh;
+
+        size_t sink = 0;
+        double ms = TimeIt([&]()
+        {
+            mesh = geo.CreateGeosphere(2.0f, n);
+            return mesh.Vertices.size();
+        }, sink, 50.0);
+
+        const size_t triangles = (size_t)20 << (2 * n);
+        const size_t vertices = (size_t)10 << (2 * n);
+
+        bool pass = mesh.Vertices.size() == vertices + 2 && mesh.Indices32.size() == triangles * 3;
+        for (auto& v : mesh.Vertices)
+            pass &= fabsf(XMVectorGetX(XMVector3Length(XMLoadFloat3(&v.Position))) - 2.0f) < 1e-5f;
+        for (auto i : mesh.Indices32)
+            pass &= i < mesh.Vertices.size();
+
+        // Each triangle of the level before emitted six vertices of its own
+        const size_t unshared = n == 0 ? 12 : triangles / 4 * 6;
+
+        Report("GeosphereGeneration level %u: %zu vertices (%zu unshared), %zu triangles in %.3f ms | %s\n",
+            n, mesh.Vertices.size(), unshared, triangles, ms, pass ? "PASS" : "FAIL");
+    }
+}
+
+void Benchmarks::GeometryBatching()
+{
+    using namespace DirectX;
+
+    GeometryGenerator geo;
+
+    // The shapes TestApp::BuildStaticGeometry batches, plus a large one so the copies show
+    auto generate = [&geo](vector<pair<string, GeometryGenerator::MeshData>>& shapes)
+    {
+        shapes.clear();
+        shapes.emplace_back("debugBoxes", geo.CreateBox(1.0f, 1.0f, 1.0f, 0));
+        shapes.emplace_back("grid", geo.CreateGrid(10.0f, 10.0f, 2, 2));
+        shapes.emplace_back("sphere", geo.CreateSphere(1.0f, 20, 20));
+        shapes.emplace_back("sphere2", geo.CreateSphere(0.5f, 10, 10));
+        shapes.emplace_back("dbgQuad", geo.CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f));
+        shapes.emplace_back("terrain", geo.CreateGrid(100.0f, 100.0f, 256, 256));
+    };
+
+    vector<pair<string, GeometryGenerator::MeshData>> shapes;
+
+    // The way BuildStaticGeometry did it: offsets by hand, a zero filled vertex array overwritten field by field, indices
+    // grown one shape at a time
+    vector<Vertex> handVertices;
+    vector<uint32_t> handIndices;
+    unordered_map<string, SubmeshGeometry> handArgs;
+    size_t sink = 0;
+    double handMs = TimeIt([&]()
+    {
+        generate(shapes);
+
+        size_t totalVertices = 0;
+        for (auto& s : shapes)
+            totalVertices += s.second.Vertices.size();
+
+        handVertices.clear();
+        handVertices.resize(totalVertices);
+        handIndices.clear();
+        handArgs.clear();
+
+        UINT k = 0;
+        for (auto& s : shapes)
+        {
+            SubmeshGeometry sg;
+            sg.IndexCount = (UINT)s.second.Indices32.size();
+            sg.StartIndexLocation = (UINT)handIndices.size();
+            sg.BaseVertexLocation = (INT)k;
+            handArgs[s.first] = sg;
+
+            for (size_t i = 0; i < s.second.Vertices.size(); ++i, ++k)
+            {
+                handVertices[k].Pos = s.second.Vertices[i].Position;
+                handVertices[k].Normal = s.second.Vertices[i].Normal;
+                handVertices[k].TexC = s.second.Vertices[i].TexC;
+            }
+            handIndices.insert(handIndices.end(), s.second.Indices32.begin(), s.second.Indices32.end());
+        }
+        return handIndices.size();
+    }, sink);
+
+    vector<Vertex> vertices;
+    vector<uint32_t> indices;
+    unordered_map<string, SubmeshGeometry> drawArgs;
+    double batchMs = TimeIt([&]()
+    {
+        generate(shapes);
+
+        GeometryBatchBuilder batch;
+        for (auto& s : shapes)
+            batch.Add(s.first, move(s.second));
+
+        drawArgs.clear();
+        batch.Build(vertices, indices, drawArgs);
+        return indices.size();
+    }, sink);
+
+    bool pass = vertices.size() == handVertices.size() && indices == handIndices && drawArgs.size() == handArgs.size();
+    for (size_t i = 0; pass && i < vertices.size(); ++i)
+        pass = memcmp(&vertices[i], &handVertices[i], sizeof(Vertex)) == 0;
+
+    for (auto& kv : drawArgs)
+    {
+        auto& sg = kv.second;
+        auto hand = handArgs.find(kv.first);
+        if (hand == handArgs.end())
+        {
+            pass = false;
+            continue;
+        }
+
+        pass &= sg.IndexCount == hand->second.IndexCount && sg.StartIndexLocation == hand->second.StartIndexLocation &&
+            sg.BaseVertexLocation == hand->second.BaseVertexLocation;
+
+        // The bounds must hold every vertex the submesh uses (and only be as large as they need to be)
+        XMVECTOR center = XMLoadFloat3(&sg.Bounds.Center), extents = XMLoadFloat3(&sg.Bounds.Extents);
+        XMVECTOR lo = XMVectorReplicate(FLT_MAX), hi = XMVectorReplicate(-FLT_MAX);
+        for (UINT i = sg.StartIndexLocation; pass && i < sg.StartIndexLocation + sg.IndexCount; ++i)
+        {
+            XMVECTOR p = XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos);
+            pass &= XMVector3LessOrEqual(XMVectorAbs(p - center), extents * 1.00001f + XMVectorReplicate(1e-5f));
+            lo = XMVectorMin(lo, p);
+            hi = XMVectorMax(hi, p);
+        }
+        pass &= XMVector3NearEqual(hi - lo, extents * 2.0f, XMVectorReplicate(1e-4f));
+    }
+
+    Report("GeometryBatching: %zu shapes, %zu vertices, %zu indices: hand copied %.3f ms, GeometryBatchBuilder (bounds included) %.3f ms | %s\n",
+        drawArgs.size(), vertices.size(), indices.size(), handMs, batchMs, pass ? "PASS" : "FAIL");
+}
+
+void Benchmarks::IntegratorSchemes()
+{
+    using namespace DirectX;
+
+    const float dt = 1.0f / 60.0f;
+    const int steps = 100000;
+
+    struct Result
+    {
+        const char* Name;
+        int Evaluations;
+        double StepsPerSecond;
+        float OscillatorError;
+    };
+    vector<Result> results;
+
+    // Steps/s flying the plane model, then the position error after 10 s of a unit spring (x'' = -x, x(t) = cos t),
+    // which has an exact answer to compare against
+    auto measure = [&](const char* name, int evaluations, auto makePlane, auto makeSpring)
+    {
+        auto plane = makePlane(PlaneAcceleration(), dt);
+
+        // A different start every run, so the compiler can't work out the path ahead of time
+        size_t sink = 0, runs = 0;
+        double ms = TimeIt([&]()
+        {
+            XMVECTOR pos = XMVectorZero(), vel = XMVectorSet(0.0f, 0.0f, 0.5f + 0.001f * (runs++ % 100), 0.0f);
+            for (int i = 0; i < steps; ++i)
+                plane.Step(pos, vel, i * dt, pos, vel);
+            return (size_t)XMVectorGetZ(pos);
+        }, sink);
+
+        auto spring = makeSpring([](FXMVECTOR pos, FXMVECTOR vel, float t) { return -pos; }, 0.01f);
+        XMVECTOR pos = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), vel = XMVectorZero();
+        for (int i = 0; i < 1000; ++i)
+            spring.Step(pos, vel, i * 0.01f, pos, vel);
+
+        results.push_back({ name, evaluations, steps / ms * 1000.0, fabsf(XMVectorGetX(pos) - cosf(10.0f)) });
+    };
+
+    // Integrator takes any callable through its std::function; that is what's being measured
+    auto makeFunction = [](auto acceleration, float timestep) { return Integrator(acceleration, timestep); };
+    measure("Integrator (RK4, std::function)", 4, makeFunction, makeFunction);
+
+    measure("RK4", IntegrationScheme::RK4::Evaluations,
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::RK4>(a, ts); },
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::RK4>(a, ts); });
+    measure("VelocityVerlet", IntegrationScheme::VelocityVerlet::Evaluations,
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::VelocityVerlet>(a, ts); },
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::VelocityVerlet>(a, ts); });
+    measure("SemiImplicitEuler", IntegrationScheme::SemiImplicitEuler::Evaluations,
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::SemiImplicitEuler>(a, ts); },
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::SemiImplicitEuler>(a, ts); });
+    measure("ExplicitEuler", IntegrationScheme::ExplicitEuler::Evaluations,
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::ExplicitEuler>(a, ts); },
+        [](auto a, float ts) { return MakeIntegrator<IntegrationScheme::ExplicitEuler>(a, ts); });
+
+    // The templated RK4 has to fly the same path as Integrator
+    Integrator reference(PlaneAcceleration(), dt);
+    auto templated = MakeIntegrator<IntegrationScheme::RK4>(PlaneAcceleration(), dt);
+    XMVECTOR refPos = XMVectorZero(), refVel = XMVectorSet(0.0f, 0.0f, 0.5f, 0.0f);
+    XMVECTOR pos = refPos, vel = refVel;
+    float maxDifference = 0.0f;
+    for (int i = 0; i < 1000; ++i)
+    {
+        reference.Step(refPos, refVel, i * dt, refPos, refVel);
+        templated.Step(pos, vel, i * dt, pos, vel);
+        maxDifference = (std::max)(maxDifference, XMVectorGetX(XMVector3Length(pos - refPos)) / (std::max)(1.0f, XMVectorGetX(XMVector3Length(refPos))));
+    }
+
+    // Higher order has to mean more accurate
+    const bool pass = maxDifference < 1e-5f && results[1].OscillatorError < results[2].OscillatorError &&
+        results[2].OscillatorError < results[3].OscillatorError && results[2].OscillatorError < results[4].OscillatorError;
+
+    for (auto& r : results)
+    {
+        Report("IntegratorSchemes %s: %d evaluations/step, %.1f M steps/s (%.2fx Integrator), spring error after 10 s %.2e\n",
+            r.Name, r.Evaluations, r.StepsPerSecond / 1e6, r.StepsPerSecond / results[0].StepsPerSecond, r.OscillatorError);
+    }
+    Report("IntegratorSchemes: RK4 vs Integrator path difference %.2e | %s\n", maxDifference, pass ? "PASS" : "FAIL");
+}
+
+void Benchmarks::AdaptiveIntegration()
+{
+    using namespace DirectX;
+
+    const float sampleInterval = 1.0f;
+    const UINT sampleCount = 30;
+    const float duration = sampleInterval * sampleCount;
+    const float targetError = 1e-3f;
+
+    // Reference path: RK4 in double at a tiny step, sampled every sampleInterval
+    vector<XMFLOAT3> reference(sampleCount);
+    {
+        const int substeps = 8192;
+        const double h = (double)sampleInterval / substeps;
+        double x[6] = { 0, 0, 0, 0, 0, 1 }; // pos, vel
+        auto derivative = [](double t, const double* y, double* dy)
+        {
+            dy[0] = y[3]; dy[1] = y[4]; dy[2] = y[5];
+            ManoeuvreAcceleration(t, y + 3, dy + 3);
+        };
+        for (UINT sample = 0; sample < sampleCount; ++sample)
+        {
+            for (int i = 0; i < substeps; ++i)
+            {
+                const double t = ((double)sample * substeps + i) * h;
+                double k[4][6], y[6];
+                derivative(t, x, k[0]);
+                for (int j = 0; j < 6; ++j) y[j] = x[j] + h / 2 * k[0][j];
+                derivative(t + h / 2, y, k[1]);
+                for (int j = 0; j < 6; ++j) y[j] = x[j] + h / 2 * k[1][j];
+                derivative(t + h / 2, y, k[2]);
+                for (int j = 0; j < 6; ++j) y[j] = x[j] + h * k[2][j];
+                derivative(t + h, y, k[3]);
+                for (int j = 0; j < 6; ++j) x[j] += h / 6 * (k[0][j] + 2 * k[1][j] + 2 * k[2][j] + k[3][j]);
+            }
+            reference[sample] = XMFLOAT3((float)x[0], (float)x[1], (float)x[2]);
+        }
+    }
+
+    auto errorAt = [&](FXMVECTOR pos, UINT sample)
+    {
+        return XMVectorGetX(XMVector3Length(pos - XMLoadFloat3(&reference[sample])));
+    };
+
+    const XMVECTOR startPos = XMVectorZero(), startVel = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+
+    // Fixed step RK4: the longest step (the sample interval halved n times) that stays within targetError at every sample
+    UINT rk4StepsPerSample = 0;
+    size_t rk4Evaluations = 0;
+    for (UINT n = 1; n <= 4096 && rk4Evaluations == 0; n *= 2)
+    {
+        const float h = sampleInterval / n;
+        auto rk4 = MakeIntegrator<IntegrationScheme::RK4>(Manoeuvre(), h);
+
+        XMVECTOR pos = startPos, vel = startVel;
+        float maxError = 0.0f;
+        for (UINT sample = 0; sample < sampleCount; ++sample)
+        {
+            for (UINT i = 0; i < n; ++i)
+                rk4.Step(pos, vel, sample * sampleInterval + i * h, pos, vel);
+            maxError = (std::max)(maxError, errorAt(pos, sample));
+        }
+
+        if (maxError <= targetError)
+        {
+            rk4StepsPerSample = n;
+            rk4Evaluations = (size_t)4 * n * sampleCount;
+        }
+    }
+
+    // Adaptive: the loosest tolerance (in steps of 10^(1/2)) that stays within targetError at every sample
+    float tolerance = 0.0f;
+    size_t evaluations = 0, accepted = 0, rejected = 0;
+    bool fsal = true;
+    for (float tol = 1e-2f; tol >= 1e-7f; tol *= 0.31622777f)
+    {
+        AdaptiveIntegrator<Manoeuvre> adaptive(Manoeuvre(), tol);
+
+        XMVECTOR pos = startPos, vel = startVel;
+        float maxError = 0.0f;
+        for (UINT sample = 0; sample < sampleCount; ++sample)
+        {
+            adaptive.Advance(pos, vel, sample * sampleInterval, sampleInterval);
+            maxError = (std::max)(maxError, errorAt(pos, sample));
+        }
+
+        if (maxError <= targetError)
+        {
+            tolerance = tol;
+            evaluations = adaptive.Evaluations();
+            accepted = adaptive.AcceptedSteps();
+            rejected = adaptive.RejectedSteps();
+
+            // Every step after the first starts from the end of the one before, so only the very first evaluation
+            // isn't reused
+            fsal = evaluations == 1 + 6 * (accepted + rejected);
+            break;
+        }
+    }
+
+    // Trajectory prediction at that tolerance: one call, steps as long as the tolerance allows, samples interpolated
+    vector<XMFLOAT3> predicted;
+    AdaptiveIntegrator<Manoeuvre> predictor(Manoeuvre(), tolerance > 0.0f ? tolerance : 1e-6f);
+    size_t sink = 0;
+    double predictMs = TimeIt([&]()
+    {
+        predictor.Predict(startPos, startVel, 0.0f, sampleInterval, sampleCount, predicted);
+        return predicted.size();
+    }, sink, 50.0);
+
+    float predictError = 0.0f;
+    for (UINT sample = 0; sample < sampleCount; ++sample)
+        predictError = (std::max)(predictError, errorAt(XMLoadFloat3(&predicted[sample]), sample));
+
+    const bool pass = rk4Evaluations > 0 && evaluations > 0 && evaluations < rk4Evaluations && fsal &&
+        predictError <= 2.0f * targetError;
+
+    Report("AdaptiveIntegration: %.0f s pull-up within %.0e of the reference at every %.1f s sample\n",
+        duration, targetError, sampleInterval);
+    Report("AdaptiveIntegration RK4: %u steps per sample, %zu evaluations\n", rk4StepsPerSample, rk4Evaluations);
+    Report("AdaptiveIntegration Dormand-Prince 5(4): tolerance %.1e, %zu steps (%zu rejected), %zu evaluations (%.0f%% fewer), FSAL %s\n",
+        tolerance, accepted, rejected, evaluations, rk4Evaluations ? 100.0 * (1.0 - (double)evaluations / rk4Evaluations) : 0.0,
+        fsal ? "reused" : "NOT reused");
+    Report("AdaptiveIntegration Predict: %u samples in %.3f ms, worst error %.2e | %s\n",
+        sampleCount, predictMs, predictError, pass ? "PASS" : "FAIL");
+}
+
+void Benchmarks::BatchIntegration()
+{
+    using namespace DirectX;
+
+    const float dt = 1.0f / 60.0f;
+
+    // The same bodies as an array of structures, stepped one at a time with DirectXMath: what running a Plane each
+    // would cost
+    struct Body
+    {
+        XMFLOAT3 Pos, Vel;
+        XMFLOAT4 Rot;
+        XMFLOAT3 Spin;
+    };
+
+    const PlaneForces forces;
+    auto stepBody = [&](Body& b)
+    {
+        XMVECTOR vel = XMLoadFloat3(&b.Vel), rot = XMLoadFloat4(&b.Rot);
+        XMMATRIX axes = XMMatrixRotationQuaternion(rot);
+        XMVECTOR forward = axes.r[2], up = axes.r[1];
+
+        auto lift = forces.LiftCoef / forces.Mass * XMVector3Dot(forward, vel) * up;
+        auto gravity = XMVectorSet(0.0f, -forces.Gravity, 0.0f, 0.0f);
+        auto drag = -forces.DragCoef / forces.Mass * vel * XMVector3Length(vel);
+        vel += (lift + gravity + forces.Thrust * forward + drag) * dt;
+
+        XMStoreFloat3(&b.Vel, vel);
+        XMStoreFloat3(&b.Pos, XMLoadFloat3(&b.Pos) + vel * dt);
+
+        XMVECTOR spin = XMVectorSetW(XMLoadFloat3(&b.Spin), 0.0f);
+        rot += 0.5f * dt * XMQuaternionMultiply(rot, spin); // spin * rot
+        XMStoreFloat4(&b.Rot, XMQuaternionNormalize(rot));
+    };
+
+    // Bodies scattered over a few km, flying and tumbling in random directions
+    auto makeBodies = [](size_t count, BodyBatch& batch, vector<Body>& bodies)
+    {
+        mt19937 rng(7);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        batch.Clear();
+        bodies.resize(count);
+        for (auto& b : bodies)
+        {
+            XMVECTOR pos = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f) * 2000.0f;
+            XMVECTOR vel = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f) * 2.0f;
+            XMVECTOR rot = XMQuaternionNormalize(XMVectorSet(unit(rng), unit(rng), unit(rng), unit(rng) + 2.0f));
+            XMVECTOR spin = XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f) * 0.5f;
+
+            batch.Add(pos, vel, rot, spin);
+            XMStoreFloat3(&b.Pos, pos);
+            XMStoreFloat3(&b.Vel, vel);
+            XMStoreFloat4(&b.Rot, XMQuaternionNormalize(rot));
+            XMStoreFloat3(&b.Spin, spin);
+        }
+    };
+
+    BodyBatch batch;
+    vector<Body> bodies;
+
+    for (size_t count : { 1000, 10000, 100000 })
+    {
+        makeBodies(count, batch, bodies);
+
+        size_t sink = 0;
+        double scalarMs = TimeIt([&]()
+        {
+            for (auto& b : bodies)
+                stepBody(b);
+            return (size_t)bodies[0].Pos.x;
+        }, sink);
+        double batchMs = TimeIt([&]()
+        {
+            BatchIntegrator::Step(batch, forces, dt);
+            return (size_t)batch.PosX[0];
+        }, sink);
+
+        Report("BatchIntegration %zu bodies: per body %.1f M body-steps/s, BatchIntegrator (%zu lanes) %.1f M body-steps/s (%.2fx)\n",
+            count, count / scalarMs / 1000.0, BatchIntegrator::LANES, count / batchMs / 1000.0, scalarMs / batchMs);
+    }
+
+    // 10 s of flight both ways, with a count that leaves a partial group at the end
+    const size_t checkCount = 1000 + BatchIntegrator::LANES - 1;
+    makeBodies(checkCount, batch, bodies);
+    for (int step = 0; step < 600; ++step)
+    {
+        BatchIntegrator::Step(batch, forces, dt);
+        for (auto& b : bodies)
+            stepBody(b);
+    }
+
+    float maxPosError = 0.0f, maxRotError = 0.0f, maxNormError = 0.0f;
+    for (size_t i = 0; i < checkCount; ++i)
+    {
+        XMVECTOR pos = XMLoadFloat3(&bodies[i].Pos), rot = XMLoadFloat4(&bodies[i].Rot);
+        maxPosError = (std::max)(maxPosError, XMVectorGetX(XMVector3Length(batch.Position(i) - pos)) /
+            (std::max)(1.0f, XMVectorGetX(XMVector3Length(pos))));
+        maxRotError = (std::max)(maxRotError, XMVectorGetX(XMVector4Length(batch.Orientation(i) - rot)));
+        maxNormError = (std::max)(maxNormError, fabsf(XMVectorGetX(XMVector4Length(batch.Orientation(i))) - 1.0f));
+    }
+
+    const bool pass = maxPosError < 1e-4f && maxRotError < 1e-4f && maxNormError < 1e-5f;
+
+    Report("BatchIntegration: %zu bodies for 10 s vs per body, worst position difference %.2e (relative), orientation %.2e, "
+        "quaternion length error %.2e | %s\n", checkCount, maxPosError, maxRotError, maxNormError, pass ? "PASS" : "FAIL");
+}
+
+/*
+One sweep is what Simulation does for the plane every tick. Half the sweeps start near a random point of the terrain and
+head for it, so there is something to hit; the rest go anywhere in the level, as most ticks of flying do.
+
+Also checks that the terrain TestApp and HeadlessRunner load with Simulation::LoadTerrain is the level as ParseOBJ reads
+it, less the spinning cubes: the same triangles, and a body for every cube. Reports FAIL otherwise.
+*/
+void Benchmarks::TerrainCollision(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int SWEEPS = 4096;
+    const int CHECKED = 512;
+    const float radius = 1.0f;
+
+    size_t checked = 0, mismatches = 0;
+    float worstTime = 0.0f, worstDistance = 0.0f;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+        if (name.compare(0, 5, "Level") != 0)
+            continue;
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("TerrainCollision: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        TriangleBvh bvh;
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            auto position = [&](UINT i) { return XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos); };
+            for (UINT i = sg.StartIndexLocation; i + 2 < sg.StartIndexLocation + sg.IndexCount; i += 3)
+                bvh.Add(position(i), position(i + 1), position(i + 2));
+        }
+
+        auto start = Clock::now();
+        bvh.Build();
+        double buildMs = ElapsedMs(start);
+
+        if (bvh.TriangleCount() == 0)
+            continue;
+
+        {
+            // In any order; the objects of DrawArgs come in no particular one
+            typedef array<float, 9> Corners;
+            auto corners = [](const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+            {
+                return Corners{ { a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z } };
+            };
+
+            vector<Corners> parsed, loaded;
+            size_t cubes = 0;
+            for (auto& kv : mesh.DrawArgs)
+            {
+                if (Simulation::IsSpinning(kv.first))
+                {
+                    ++cubes;
+                    continue;
+                }
+
+                auto& sg = kv.second;
+                auto position = [&](UINT i) -> const XMFLOAT3& { return vertices[indices[i] + sg.BaseVertexLocation].Pos; };
+                for (UINT i = sg.StartIndexLocation; i + 2 < sg.StartIndexLocation + sg.IndexCount; i += 3)
+                    parsed.push_back(corners(position(i), position(i + 1), position(i + 2)));
+            }
+
+            const wstring filename = projectPath + L"Models\\" + model;
+            TriangleBvh terrain;
+            size_t bodyCount = 0;
+            int result = Simulation::LoadTerrain(string(filename.begin(), filename.end()), terrain, bodyCount);
+            for (auto& t : terrain.Triangles())
+                loaded.push_back(corners(t.V0, t.V1, t.V2));
+
+            sort(parsed.begin(), parsed.end());
+            sort(loaded.begin(), loaded.end());
+            const bool same = result == 0 && loaded == parsed && bodyCount == cubes;
+
+            Report("TerrainCollision %s: Simulation::LoadTerrain gives %zu triangles and %zu bodies, ParseOBJ %zu and %zu "
+                "| %s\n", name.c_str(), loaded.size(), bodyCount, parsed.size(), cubes, same ? "PASS" : "FAIL");
+        }
+
+        // Ticks of the plane flying at up to 4 times its thrust speed
+        mt19937 rng(11);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f), fraction(0.0f, 1.0f);
+        auto bounds = bvh.Bounds();
+        auto& triangles = bvh.Triangles();
+
+        vector<XMFLOAT3> from(SWEEPS), to(SWEEPS);
+        for (int i = 0; i < SWEEPS; ++i)
+        {
+            XMVECTOR dir = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f));
+            float length = 4.4f * fraction(rng);
+            XMVECTOR a;
+            if (i % 2 == 0)
+            {
+                auto& t = triangles[rng() % triangles.size()];
+                float u = fraction(rng), v = fraction(rng);
+                if (u + v > 1.0f)
+                {
+                    u = 1.0f - u;
+                    v = 1.0f - v;
+                }
+                XMVECTOR target = XMLoadFloat3(&t.V0) + u * (XMLoadFloat3(&t.V1) - XMLoadFloat3(&t.V0)) +
+                    v * (XMLoadFloat3(&t.V2) - XMLoadFloat3(&t.V0));
+                a = target - (radius + length * fraction(rng)) * dir;
+            }
+            else
+            {
+                a = XMLoadFloat3(&bounds.Center) + XMLoadFloat3(&bounds.Extents) *
+                    XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f);
+            }
+            XMStoreFloat3(&from[i], a);
+            XMStoreFloat3(&to[i], a + length * dir);
+        }
+
+        size_t hits = 0, sink = 0;
+        double bvhMs = TimeIt([&]()
+        {
+            hits = 0;
+            TriangleBvh::Contact c;
+            for (int i = 0; i < SWEEPS; ++i)
+                hits += bvh.SweepSphere(XMLoadFloat3(&from[i]), XMLoadFloat3(&to[i]), radius, c) ? 1 : 0;
+            return hits;
+        }, sink);
+        double bruteMs = TimeIt([&]()
+        {
+            size_t count = 0;
+            TriangleBvh::Contact c;
+            for (int i = 0; i < CHECKED; ++i)
+                count += bvh.SweepSphereBruteForce(XMLoadFloat3(&from[i]), XMLoadFloat3(&to[i]), radius, c) ? 1 : 0;
+            return count;
+        }, sink) * SWEEPS / CHECKED;
+
+        // The same contacts as against every triangle, and each a radius from the sphere's center at its time
+        for (int i = 0; i < CHECKED; ++i)
+        {
+            XMVECTOR a = XMLoadFloat3(&from[i]), b = XMLoadFloat3(&to[i]);
+            TriangleBvh::Contact fast, slow;
+            bool hitFast = bvh.SweepSphere(a, b, radius, fast);
+            bool hitSlow = bvh.SweepSphereBruteForce(a, b, radius, slow);
+            ++checked;
+            if (hitFast != hitSlow)
+            {
+                ++mismatches;
+                continue;
+            }
+            if (!hitFast)
+                continue;
+
+            worstTime = (std::max)(worstTime, fabsf(fast.Time - slow.Time));
+            XMVECTOR center = XMVectorLerp(a, b, fast.Time);
+            float distance = XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&fast.Point)));
+            float normal = XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&fast.Point) - radius * XMLoadFloat3(&fast.Normal)));
+            // Sweeps that start out touching stop at once, wherever the sphere is
+            if (fast.Time > 0.0f)
+                worstDistance = (std::max)(worstDistance, (std::max)(fabsf(distance - radius), normal));
+        }
+
+        Report("TerrainCollision %s: %zu triangles, %zu nodes, depth %u, built in %.2f ms | %.2f M sweeps/s (%.2f us each, %.0f%% hit) vs every triangle %.3f M sweeps/s (%.0fx)\n",
+            name.c_str(), bvh.TriangleCount(), bvh.NodeCount(), bvh.Depth(), buildMs, SWEEPS / bvhMs / 1000.0,
+            bvhMs * 1000.0 / SWEEPS, 100.0 * hits / SWEEPS, SWEEPS / bruteMs / 1000.0, bruteMs / bvhMs);
+    }
+
+    const bool pass = checked > 0 && mismatches == 0 && worstTime < 1e-4f && worstDistance < 1e-3f;
+
+    Report("TerrainCollision: %zu sweeps vs every triangle, %zu disagree on hitting, worst time of impact difference %.2e, "
+        "worst contact distance error %.2e | %s\n", checked, mismatches, worstTime, worstDistance, pass ? "PASS" : "FAIL");
+}
+
+/*
+Rays as Pick casts them, from random points inside each model in random directions, against every submesh. The old
+path is Pick as it was: the submesh's box, then every triangle through TriangleTests.
+*/
+void Benchmarks::PickRays(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int RAYS = 2048;
+
+    size_t checked = 0, mismatches = 0;
+    float worstDistance = 0.0f;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("PickRays: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        struct Item
+        {
+            const SubmeshGeometry* Submesh;
+            TriangleBvh Bvh;
+        };
+        vector<Item> items;
+
+        size_t triangles = 0, nodes = 0;
+        UINT depth = 0;
+        auto start = Clock::now();
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            if (sg.IndexCount == 0)
+                continue;
+
+            Item item;
+            item.Submesh = &sg;
+            for (UINT i = sg.StartIndexLocation; i + 2 < sg.StartIndexLocation + sg.IndexCount; i += 3)
+            {
+                item.Bvh.Add(XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos),
+                    XMLoadFloat3(&vertices[indices[i + 1] + sg.BaseVertexLocation].Pos),
+                    XMLoadFloat3(&vertices[indices[i + 2] + sg.BaseVertexLocation].Pos));
+            }
+            item.Bvh.Build();
+            triangles += item.Bvh.TriangleCount();
+            nodes += item.Bvh.NodeCount();
+            depth = (std::max)(depth, item.Bvh.Depth());
+            items.push_back(move(item));
+        }
+        double buildMs = ElapsedMs(start);
+
+        mt19937 rng(5);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        normal_distribution<float> gauss;
+        auto bounds = MeshBounds(mesh.DrawArgs);
+
+        vector<XMFLOAT3> origins(RAYS), directions(RAYS);
+        for (int i = 0; i < RAYS; ++i)
+        {
+            origins[i] = { bounds.Center.x + unit(rng) * bounds.Extents.x, bounds.Center.y + unit(rng) * bounds.Extents.y,
+                bounds.Center.z + unit(rng) * bounds.Extents.z };
+            XMStoreFloat3(&directions[i], XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f)));
+        }
+
+        auto scalarPick = [&](int i)
+        {
+            XMVECTOR o = XMLoadFloat3(&origins[i]), d = XMLoadFloat3(&directions[i]);
+            float closest = FLT_MAX;
+            for (auto& item : items)
+            {
+                auto& sg = *item.Submesh;
+                float t;
+                if (!sg.Bounds.Intersects(o, d, t))
+                    continue;
+
+                for (UINT k = sg.StartIndexLocation; k + 2 < sg.StartIndexLocation + sg.IndexCount; k += 3)
+                {
+                    if (TriangleTests::Intersects(o, d, XMLoadFloat3(&vertices[indices[k] + sg.BaseVertexLocation].Pos),
+                        XMLoadFloat3(&vertices[indices[k + 1] + sg.BaseVertexLocation].Pos),
+                        XMLoadFloat3(&vertices[indices[k + 2] + sg.BaseVertexLocation].Pos), t) && t < closest)
+                        closest = t;
+                }
+            }
+            return closest;
+        };
+
+        auto bvhPick = [&](int i)
+        {
+            XMVECTOR o = XMLoadFloat3(&origins[i]), d = XMLoadFloat3(&directions[i]);
+            float closest = FLT_MAX, t;
+            UINT triangle;
+            for (auto& item : items)
+            {
+                if (item.Bvh.Intersects(o, d, closest, t, triangle))
+                    closest = t;
+            }
+            return closest;
+        };
+
+        // The distances go to memory: the picks are pure functions of the rays, and the compiler would otherwise be
+        // free to move them out from between TimeIt's clock readings
+        vector<float> found(RAYS);
+        size_t sink = 0, hits = 0;
+        double scalarMs = TimeIt([&]()
+        {
+            for (int i = 0; i < RAYS; ++i)
+                found[i] = scalarPick(i);
+            return (size_t)found[0];
+        }, sink);
+        double bvhMs = TimeIt([&]()
+        {
+            for (int i = 0; i < RAYS; ++i)
+                found[i] = bvhPick(i);
+            return (size_t)found[0];
+        }, sink);
+        for (float f : found)
+            hits += f < FLT_MAX ? 1 : 0;
+
+        for (int i = 0; i < RAYS; ++i)
+        {
+            float a = scalarPick(i), b = bvhPick(i);
+            ++checked;
+            if ((a < FLT_MAX) != (b < FLT_MAX))
+                ++mismatches;
+            else if (a < FLT_MAX)
+                worstDistance = (std::max)(worstDistance, fabsf(a - b) / (std::max)(1.0f, a));
+        }
+
+        Report("PickRays %s: %zu submeshes, %zu triangles, %zu nodes (depth %u), built in %.2f ms | %.2f M rays/s per triangle, %.2f M rays/s BVH (%.1fx), %.0f%% hit\n",
+            name.c_str(), items.size(), triangles, nodes, depth, buildMs, RAYS / scalarMs / 1000.0, RAYS / bvhMs / 1000.0,
+            scalarMs / bvhMs, 100.0 * hits / RAYS);
+    }
+
+    const bool pass = checked > 0 && mismatches == 0 && worstDistance < 1e-4f;
+
+    Report("PickRays: %zu rays vs every triangle, %zu disagree on hitting, worst distance difference %.2e (relative) | %s\n",
+        checked, mismatches, worstDistance, pass ? "PASS" : "FAIL");
+}
+
+/*
+Each model's submeshes placed as instances in a grid of copies, each turned about y at random, then ray casts, line of
+sight and ground distance queries through SceneBvh vs visiting every instance, as Pick did before. The checks are repeated
+after every other copy has moved (a refit) and after a quarter of the instances are removed (a rebuild).
+*/
+void Benchmarks::SceneQueries(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int GRID = 4;
+    const int RAYS = 2048;
+
+    size_t checked = 0, mismatches = 0;
+    float worstDistance = 0.0f;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("SceneQueries: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        auto blases = SubmeshBvhs(mesh, vertices, indices);
+
+        mt19937 rng(9);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        normal_distribution<float> gauss;
+        auto bounds = MeshBounds(mesh.DrawArgs);
+        const float spacing = 2.5f * (std::max)(bounds.Extents.x, bounds.Extents.z);
+
+        // Every submesh of a copy shares the copy's world
+        struct Instance
+        {
+            const TriangleBvh* Blas;
+            XMFLOAT4X4 World;
+            UINT Handle;
+        };
+        vector<Instance> instances;
+        vector<XMFLOAT4X4> copies;
+        for (int gx = 0; gx < GRID; ++gx)
+        {
+            for (int gz = 0; gz < GRID; ++gz)
+            {
+                XMFLOAT4X4 world;
+                XMStoreFloat4x4(&world, XMMatrixRotationY(unit(rng) * XM_PI) *
+                    XMMatrixTranslation(gx * spacing, 0.0f, gz * spacing));
+                copies.push_back(world);
+                for (auto& blas : blases)
+                    instances.push_back({ &blas, world, 0 });
+            }
+        }
+
+        SceneBvh scene;
+        auto start = Clock::now();
+        for (auto& instance : instances)
+            instance.Handle = scene.Add(instance.Blas, XMLoadFloat4x4(&instance.World));
+        scene.Update();
+        double buildMs = ElapsedMs(start);
+
+        // Rays start anywhere in the grid's box and go anywhere
+        const XMFLOAT3 gridMin = { bounds.Center.x - bounds.Extents.x - spacing, bounds.Center.y - bounds.Extents.y,
+            bounds.Center.z - bounds.Extents.z - spacing };
+        const XMFLOAT3 gridSize = { GRID * spacing + 2.0f * bounds.Extents.x, 2.0f * bounds.Extents.y,
+            GRID * spacing + 2.0f * bounds.Extents.z };
+        vector<XMFLOAT3> origins(RAYS), directions(RAYS);
+        for (int i = 0; i < RAYS; ++i)
+        {
+            origins[i] = { gridMin.x + 0.5f * (unit(rng) + 1.0f) * gridSize.x,
+                gridMin.y + 0.5f * (unit(rng) + 1.0f) * gridSize.y, gridMin.z + 0.5f * (unit(rng) + 1.0f) * gridSize.z };
+            XMStoreFloat3(&directions[i], XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f)));
+        }
+
+        // The closest hit for t in [0, maxT), visiting every instance
+        auto linearCast = [&](FXMVECTOR o, FXMVECTOR d, float maxT)
+        {
+            float closest = maxT, t;
+            UINT triangle;
+            for (auto& instance : instances)
+            {
+                if (!instance.Blas)
+                    continue;
+
+                auto invWorld = Math::AffineInverse(XMLoadFloat4x4(&instance.World));
+                if (instance.Blas->Intersects(XMVector3TransformCoord(o, invWorld), XMVector3TransformNormal(d, invWorld),
+                    closest, t, triangle))
+                    closest = t;
+            }
+            return closest;
+        };
+
+        auto sceneCast = [&](FXMVECTOR o, FXMVECTOR d, float maxT)
+        {
+            SceneBvh::Hit hit;
+            return scene.RayCast(o, d, maxT, hit) ? hit.Distance : maxT;
+        };
+
+        // Ray casts, and line of sight to and ground distance from points along them, both ways
+        auto check = [&]()
+        {
+            for (int i = 0; i < RAYS; ++i)
+            {
+                XMVECTOR o = XMLoadFloat3(&origins[i]), d = XMLoadFloat3(&directions[i]);
+                float a = linearCast(o, d, FLT_MAX), b = sceneCast(o, d, FLT_MAX);
+                ++checked;
+                if ((a < FLT_MAX) != (b < FLT_MAX))
+                    ++mismatches;
+                else if (a < FLT_MAX)
+                    worstDistance = (std::max)(worstDistance, fabsf(a - b) / (std::max)(1.0f, a));
+
+                XMVECTOR to = o + d * (0.5f * gridSize.x);
+                ++checked;
+                if (scene.LineOfSight(o, to) != !(linearCast(o, to - o, 1.0f) < 1.0f))
+                    ++mismatches;
+
+                const float maxGround = gridSize.y;
+                float ground = maxGround;
+                bool below = scene.GroundDistance(o, maxGround, ground);
+                float expected = linearCast(o, XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), maxGround);
+                ++checked;
+                if (below != (expected < maxGround))
+                    ++mismatches;
+                else if (below)
+                    worstDistance = (std::max)(worstDistance, fabsf(ground - expected) / (std::max)(1.0f, expected));
+            }
+        };
+
+        vector<float> found(RAYS);
+        size_t sink = 0, hits = 0;
+        double linearMs = TimeIt([&]()
+        {
+            for (int i = 0; i < RAYS; ++i)
+                found[i] = linearCast(XMLoadFloat3(&origins[i]), XMLoadFloat3(&directions[i]), FLT_MAX);
+            return (size_t)found[0];
+        }, sink);
+        double sceneMs = TimeIt([&]()
+        {
+            for (int i = 0; i < RAYS; ++i)
+                found[i] = sceneCast(XMLoadFloat3(&origins[i]), XMLoadFloat3(&directions[i]), FLT_MAX);
+            return (size_t)found[0];
+        }, sink);
+        for (float f : found)
+            hits += f < FLT_MAX ? 1 : 0;
+
+        check();
+
+        // Every other copy moves up and turns, as the simulated cubes do
+        start = Clock::now();
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            if ((i / blases.size()) % 2 == 0)
+                continue;
+
+            XMStoreFloat4x4(&instances[i].World, XMMatrixRotationX(0.3f) * XMLoadFloat4x4(&instances[i].World) *
+                XMMatrixTranslation(0.0f, 0.25f * bounds.Extents.y, 0.0f));
+            scene.SetWorld(instances[i].Handle, XMLoadFloat4x4(&instances[i].World));
+        }
+        scene.Update();
+        double refitMs = ElapsedMs(start);
+        check();
+
+        // And a quarter of the instances go
+        start = Clock::now();
+        for (size_t i = 0; i < instances.size(); i += 4)
+        {
+            scene.Remove(instances[i].Handle);
+            instances[i].Blas = nullptr;
+        }
+        scene.Update();
+        double rebuildMs = ElapsedMs(start);
+        check();
+
+        Report("SceneQueries %s: %zu instances, %zu nodes (depth %u), built in %.3f ms, refit %.3f ms, rebuilt %.3f ms | "
+            "%.2f M rays/s every instance, %.2f M rays/s SceneBvh (%.1fx), %.0f%% hit\n",
+            name.c_str(), instances.size(), scene.NodeCount(), scene.Depth(), buildMs, refitMs, rebuildMs,
+            RAYS / linearMs / 1000.0, RAYS / sceneMs / 1000.0, linearMs / sceneMs, 100.0 * hits / RAYS);
+    }
+
+    const bool pass = checked > 0 && mismatches == 0 && worstDistance < 1e-4f;
+
+    Report("SceneQueries: %zu queries vs every instance, %zu disagree on hitting, worst distance difference %.2e "
+        "(relative) | %s\n", checked, mismatches, worstDistance, pass ? "PASS" : "FAIL");
+}
+
+/*
+The level's triangles, as TerrainCollision builds them, against random rays: every triangle through TriangleTests (the
+old Pick), through the scalar test of TriangleBvh::IntersectsBruteForce, and a block at a time through TriangleSimd.
+Then a view of the level, 2x2 pixels at a time, through the BVH one ray at a time and as packets.
+*/
+void Benchmarks::TriangleKernels(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int RAYS = 256;
+    const int WIDTH = 64, HEIGHT = 32;
+    const UINT LANES = TriangleSimd::LANES;
+
+    size_t checked = 0, mismatches = 0;
+    float worstDistance = 0.0f;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+        if (name.compare(0, 5, "Level") != 0)
+            continue;
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("TriangleKernels: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        TriangleBvh bvh;
+        for (auto& kv : mesh.DrawArgs)
+        {
+            auto& sg = kv.second;
+            auto position = [&](UINT i) { return XMLoadFloat3(&vertices[indices[i] + sg.BaseVertexLocation].Pos); };
+            for (UINT i = sg.StartIndexLocation; i + 2 < sg.StartIndexLocation + sg.IndexCount; i += 3)
+                bvh.Add(position(i), position(i + 1), position(i + 2));
+        }
+        bvh.Build();
+        if (bvh.TriangleCount() == 0)
+            continue;
+
+        auto& triangles = bvh.Triangles();
+        auto& blocks = bvh.Blocks();
+        auto bounds = bvh.Bounds();
+
+        mt19937 rng(13);
+        uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        normal_distribution<float> gauss;
+        vector<XMFLOAT3> origins(RAYS), directions(RAYS);
+        for (int i = 0; i < RAYS; ++i)
+        {
+            origins[i] = { bounds.Center.x + unit(rng) * bounds.Extents.x, bounds.Center.y + unit(rng) * bounds.Extents.y,
+                bounds.Center.z + unit(rng) * bounds.Extents.z };
+            XMStoreFloat3(&directions[i], XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f)));
+        }
+
+        auto directXCast = [&](int i)
+        {
+            XMVECTOR o = XMLoadFloat3(&origins[i]), d = XMLoadFloat3(&directions[i]);
+            float closest = FLT_MAX, t;
+            for (auto& tri : triangles)
+            {
+                if (TriangleTests::Intersects(o, d, XMLoadFloat3(&tri.V0), XMLoadFloat3(&tri.V1), XMLoadFloat3(&tri.V2), t)
+                    && t < closest)
+                    closest = t;
+            }
+            return closest;
+        };
+
+        auto scalarCast = [&](int i)
+        {
+            float t = FLT_MAX;
+            UINT triangle;
+            bvh.IntersectsBruteForce(XMLoadFloat3(&origins[i]), XMLoadFloat3(&directions[i]), FLT_MAX, t, triangle);
+            return t;
+        };
+
+        auto blockCast = [&](int i)
+        {
+            XMVECTOR o = XMLoadFloat3(&origins[i]), d = XMLoadFloat3(&directions[i]);
+            float closest = FLT_MAX;
+            for (auto& block : blocks)
+            {
+                __m128 times;
+                int mask = TriangleSimd::Intersect(block, o, d, closest, times);
+                if (mask == 0)
+                    continue;
+
+                float laneTimes[LANES];
+                _mm_storeu_ps(laneTimes, times);
+                for (UINT lane = 0; lane < LANES; ++lane)
+                {
+                    if (mask & (1 << lane))
+                        closest = (std::min)(closest, laneTimes[lane]);
+                }
+            }
+            return closest;
+        };
+
+        vector<float> found(RAYS);
+        size_t sink = 0;
+        auto timeCasts = [&](auto cast)
+        {
+            return TimeIt([&]()
+            {
+                for (int i = 0; i < RAYS; ++i)
+                    found[i] = cast(i);
+                return (size_t)found[0];
+            }, sink);
+        };
+        double directXMs = timeCasts(directXCast);
+        double scalarMs = timeCasts(scalarCast);
+        double blockMs = timeCasts(blockCast);
+
+        for (int i = 0; i < RAYS; ++i)
+        {
+            float a = scalarCast(i), b = blockCast(i);
+            ++checked;
+            if ((a < FLT_MAX) != (b < FLT_MAX))
+                ++mismatches;
+            else if (a < FLT_MAX)
+                worstDistance = (std::max)(worstDistance, fabsf(a - b) / (std::max)(1.0f, a));
+        }
+
+        // A 60 degree view of the whole level from above one corner
+        auto eye = XMLoadFloat3(&bounds.Center) + XMVectorSet(-1.5f * bounds.Extents.x, 2.0f * bounds.Extents.y + 10.0f,
+            -1.5f * bounds.Extents.z, 0.0f);
+        auto invView = XMMatrixInverse(nullptr, XMMatrixLookAtLH(eye, XMLoadFloat3(&bounds.Center),
+            XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)));
+        const float tanHalf = tanf(XM_PI / 6.0f);
+
+        // Packet p holds pixels (2x, 2y), (2x + 1, 2y), (2x, 2y + 1) and (2x + 1, 2y + 1), one per lane
+        const int PACKETS = WIDTH * HEIGHT / LANES;
+        vector<XMFLOAT3> pixelOrigins(WIDTH * HEIGHT), pixelDirections(WIDTH * HEIGHT);
+        for (int p = 0; p < PACKETS; ++p)
+        {
+            int px = p % (WIDTH / 2), py = p / (WIDTH / 2);
+            for (UINT lane = 0; lane < LANES; ++lane)
+            {
+                float x = (2 * px + (lane & 1) + 0.5f) / WIDTH * 2.0f - 1.0f;
+                float y = 1.0f - (2 * py + (lane >> 1) + 0.5f) / HEIGHT * 2.0f;
+                auto dir = XMVector3TransformNormal(XMVectorSet(x * tanHalf * WIDTH / HEIGHT, y * tanHalf, 1.0f, 0.0f),
+                    invView);
+                XMStoreFloat3(&pixelOrigins[p * LANES + lane], eye);
+                XMStoreFloat3(&pixelDirections[p * LANES + lane], XMVector3Normalize(dir));
+            }
+        }
+
+        vector<float> pixels(WIDTH * HEIGHT);
+        double singleMs = TimeIt([&]()
+        {
+            for (int i = 0; i < WIDTH * HEIGHT; ++i)
+            {
+                float t = FLT_MAX;
+                UINT triangle;
+                bvh.Intersects(XMLoadFloat3(&pixelOrigins[i]), XMLoadFloat3(&pixelDirections[i]), FLT_MAX, t, triangle);
+                pixels[i] = t;
+            }
+            return (size_t)pixels[0];
+        }, sink);
+        double packetMs = TimeIt([&]()
+        {
+            for (int p = 0; p < PACKETS; ++p)
+            {
+                auto rays = TriangleSimd::MakeRays(&pixelOrigins[p * LANES], &pixelDirections[p * LANES]);
+                __m128 t;
+                UINT triangle[LANES];
+                bvh.Intersects(rays, _mm_set1_ps(FLT_MAX), t, triangle);
+                _mm_storeu_ps(&pixels[p * LANES], t);
+            }
+            return (size_t)pixels[0];
+        }, sink);
+
+        size_t hits = 0;
+        for (int p = 0; p < PACKETS; ++p)
+        {
+            auto rays = TriangleSimd::MakeRays(&pixelOrigins[p * LANES], &pixelDirections[p * LANES]);
+            __m128 times;
+            UINT packetTriangles[LANES];
+            int mask = bvh.Intersects(rays, _mm_set1_ps(FLT_MAX), times, packetTriangles);
+            float packetTimes[LANES];
+            _mm_storeu_ps(packetTimes, times);
+
+            for (UINT lane = 0; lane < LANES; ++lane)
+            {
+                float t = FLT_MAX;
+                UINT triangle = 0;
+                bool hit = bvh.Intersects(XMLoadFloat3(&pixelOrigins[p * LANES + lane]),
+                    XMLoadFloat3(&pixelDirections[p * LANES + lane]), FLT_MAX, t, triangle);
+                bool packetHit = (mask & (1 << lane)) != 0;
+                ++checked;
+                hits += hit ? 1 : 0;
+                if (hit != packetHit)
+                    ++mismatches;
+                else if (hit)
+                    worstDistance = (std::max)(worstDistance, fabsf(t - packetTimes[lane]) / (std::max)(1.0f, t));
+            }
+        }
+
+        const double tests = double(RAYS) * triangles.size();
+        Report("TriangleKernels %s: %zu triangles in %zu blocks | every triangle: %.1f M tests/s TriangleTests, "
+            "%.1f M tests/s scalar, %.1f M tests/s SIMD (%.1fx TriangleTests) | %dx%d view: %.2f M rays/s one by one, "
+            "%.2f M rays/s packets (%.1fx), %.0f%% hit\n",
+            name.c_str(), triangles.size(), blocks.size(), tests / directXMs / 1000.0, tests / scalarMs / 1000.0,
+            tests / blockMs / 1000.0, directXMs / blockMs, WIDTH, HEIGHT, WIDTH * HEIGHT / singleMs / 1000.0,
+            WIDTH * HEIGHT / packetMs / 1000.0, singleMs / packetMs, 100.0 * hits / (WIDTH * HEIGHT));
+    }
+
+    const bool pass = checked > 0 && mismatches == 0 && worstDistance < 1e-4f;
+
+    Report("TriangleKernels: %zu rays vs the scalar test, %zu disagree on hitting, worst distance difference %.2e "
+        "(relative) | %s\n", checked, mismatches, worstDistance, pass ? "PASS" : "FAIL");
+}
+
+/*
+The grid of copies of SceneQueries, over 240 frames in which every fourth copy spins and flies across the grid, as the
+level's cubes would if they went somewhere. SceneBvh::Update refits, and rebuilds when the tree gets too costly, vs
+rebuilding every frame. The refit tree is checked against visiting every instance at the end.
+*/
+void Benchmarks::SceneRefit(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int GRID = 4;
+    const int FRAMES = 240;
+    const int RAYS = 1024;
+
+    size_t checked = 0, mismatches = 0;
+    float worstDistance = 0.0f;
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("SceneRefit: could not read %s\n", name.c_str());
+            continue;
+        }
+
+        auto blases = SubmeshBvhs(mesh, vertices, indices);
+        auto bounds = MeshBounds(mesh.DrawArgs);
+        const float spacing = 2.5f * (std::max)(bounds.Extents.x, bounds.Extents.z);
+
+        // Refit as it goes, and rebuilt every frame (any cost is too much)
+        SceneBvh refit, rebuilt;
+        rebuilt.RebuildCost = 0.0f;
+
+        struct Instance
+        {
+            const TriangleBvh* Blas;
+            int Copy;
+            UINT Handle;
+            XMFLOAT4X4 World;
+        };
+        vector<Instance> instances;
+        for (int copy = 0; copy < GRID * GRID; ++copy)
+        {
+            for (auto& blas : blases)
+            {
+                Instance instance = { &blas, copy, 0 };
+                XMStoreFloat4x4(&instance.World, XMMatrixTranslation((copy % GRID) * spacing, 0.0f, (copy / GRID) * spacing));
+                instance.Handle = refit.Add(instance.Blas, XMLoadFloat4x4(&instance.World));
+                rebuilt.Add(instance.Blas, XMLoadFloat4x4(&instance.World));
+                instances.push_back(instance);
+            }
+        }
+        refit.Update();
+        rebuilt.Update();
+
+        double refitMs = 0.0, rebuiltMs = 0.0, worstRefitMs = 0.0, rebuildsMs = 0.0;
+        size_t rebuilds = 0, moved = 0, nodes = 0;
+        float worstCost = 1.0f;
+        for (int frame = 1; frame <= FRAMES; ++frame)
+        {
+            for (auto& instance : instances)
+            {
+                if (instance.Copy % 4 != 1)
+                    continue;
+
+                // Across the grid along x over the frames, and back along z
+                float s = static_cast<float>(frame) / FRAMES;
+                XMStoreFloat4x4(&instance.World, XMMatrixRotationY(0.05f * frame) *
+                    XMMatrixTranslation(((instance.Copy % GRID) + s * GRID) * spacing, 0.0f, ((instance.Copy / GRID) - s * GRID) * spacing));
+                refit.SetWorld(instance.Handle, XMLoadFloat4x4(&instance.World));
+                rebuilt.SetWorld(instance.Handle, XMLoadFloat4x4(&instance.World));
+            }
+
+            auto start = Clock::now();
+            refit.Update();
+            double ms = ElapsedMs(start);
+            refitMs += ms;
+            worstRefitMs = (std::max)(worstRefitMs, ms);
+
+            start = Clock::now();
+            rebuilt.Update();
+            rebuiltMs += ElapsedMs(start);
+
+            auto& stats = refit.LastUpdate();
+            moved += stats.Moved;
+            nodes += stats.Refit;
+            worstCost = (std::max)(worstCost, stats.Cost);
+            if (stats.Rebuilt)
+            {
+                ++rebuilds;
+                rebuildsMs += stats.RebuildMs;
+            }
+        }
+
+        mt19937 rng(17);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        normal_distribution<float> gauss;
+        for (int i = 0; i < RAYS; ++i)
+        {
+            XMVECTOR o = XMVectorSet(bounds.Center.x + (unit(rng) * (GRID + 2) - 1.0f) * spacing,
+                bounds.Center.y + (2.0f * unit(rng) - 1.0f) * bounds.Extents.y,
+                bounds.Center.z + (unit(rng) * (GRID + 2) * 2.0f - GRID - 1.0f) * spacing, 1.0f);
+            XMVECTOR d = XMVector3Normalize(XMVectorSet(gauss(rng), gauss(rng), gauss(rng), 0.0f));
+
+            float expected = FLT_MAX, t;
+            UINT triangle;
+            for (auto& instance : instances)
+            {
+                auto invWorld = Math::AffineInverse(XMLoadFloat4x4(&instance.World));
+                if (instance.Blas->Intersects(XMVector3TransformCoord(o, invWorld), XMVector3TransformNormal(d, invWorld),
+                    expected, t, triangle))
+                    expected = t;
+            }
+
+            SceneBvh::Hit hit;
+            bool found = refit.RayCast(o, d, FLT_MAX, hit);
+            ++checked;
+            if (found != (expected < FLT_MAX))
+                ++mismatches;
+            else if (found)
+                worstDistance = (std::max)(worstDistance, fabsf(hit.Distance - expected) / (std::max)(1.0f, expected));
+        }
+
+        Report("SceneRefit %s: %zu instances, %.1f moving | refit %.4f ms/frame (worst %.4f, %.1f nodes), %zu rebuilds "
+            "(%.4f ms each, cost up to %.2fx) vs rebuilt %.4f ms/frame (%.1fx)\n",
+            name.c_str(), instances.size(), double(moved) / FRAMES, refitMs / FRAMES, worstRefitMs, double(nodes) / FRAMES,
+            rebuilds, rebuilds > 0 ? rebuildsMs / rebuilds : 0.0, worstCost, rebuiltMs / FRAMES, rebuiltMs / refitMs);
+    }
+
+    const bool pass = checked > 0 && mismatches == 0 && worstDistance < 1e-4f;
+
+    Report("SceneRefit: %zu rays after the last frame vs every instance, %zu disagree on hitting, worst distance "
+        "difference %.2e (relative) | %s\n", checked, mismatches, worstDistance, pass ? "PASS" : "FAIL");
+}
+
+/*
+A grid of copies of each model, its submeshes chunked as TestApp loads a level and each copy turned and scaled: the
+instances a ViewVolume keeps for camera views, for a directional light's orthographic view of the whole grid (as
+UpdateLights fits it) and for the six faces of point lights' cubes, and the time it takes per pass. Checked against
+transforming each box's eight corners to clip space, where a box is out if all of them are outside one plane.
+*/
+void Benchmarks::InstanceCulling(const wstring& projectPath)
+{
+    using namespace DirectX;
+
+    const int GRID = 3;
+    const int CAMERAS = 64;
+    const int LIGHTS = 16;
+    const float POINT_NEAR = 1.0f, POINT_FAR = 50.0f; // LightPovData's
+
+    size_t checked = 0, culledInView = 0, keptOutOfView = 0, disagree = 0;
+
+    // Whether all corners of box are outside one of the planes, by more than slack times w. Near the far plane of a
+    // perspective projection z and w agree to a few digits, so rounding there is relative to w.
+    auto cornersOut = [](const BoundingBox& box, FXMMATRIX world, CXMMATRIX viewProj, float slack)
+    {
+        XMMATRIX m = world * viewProj;
+        XMVECTOR center = XMLoadFloat3(&box.Center);
+        XMVECTOR extents = XMLoadFloat3(&box.Extents);
+
+        int out = 0x3f;
+        for (int c = 0; c < 8 && out; ++c)
+        {
+            XMVECTOR sign = XMVectorSet(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f, 0.0f);
+            XMFLOAT4 p;
+            XMStoreFloat4(&p, XMVector3Transform(center + sign * extents, m));
+            float w = p.w + slack * fabsf(p.w);
+            out &= (p.x < -w) | (p.x > w) << 1 | (p.y < -w) << 2 | (p.y > w) << 3 | (p.z < w - p.w) << 4 |
+                (p.z > w) << 5;
+        }
+        return out != 0;
+    };
+
+    for (auto& model : ListModels(projectPath))
+    {
+        const string name(model.begin(), model.end());
+
+        Mesh mesh;
+        vector<Vertex> vertices;
+        vector<uint32_t> indices;
+        if (mesh.ParseOBJ(projectPath + L"Models\\" + model, OBJ_LOAD_MODE::PARALLEL, vertices, indices) < 0)
+        {
+            Report("InstanceCulling: could not read %s\n", name.c_str());
+            continue;
+        }
+        MeshChunker::Split(vertices, indices, mesh.DrawArgs);
+
+        // Render items, each with an instance per copy
+        vector<BoundingBox> items;
+        for (auto& kv : mesh.DrawArgs)
+            items.push_back(kv.second.Bounds);
+
+        auto bounds = MeshBounds(mesh.DrawArgs);
+        const float spacing = 2.5f * (std::max)(bounds.Extents.x, bounds.Extents.z);
+
+        mt19937 rng(99);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        normal_distribution<float> gauss;
+
+        vector<XMFLOAT4X4> copies(GRID * GRID);
+        for (int copy = 0; copy < GRID * GRID; ++copy)
+        {
+            XMStoreFloat4x4(&copies[copy], XMMatrixScaling(0.5f + unit(rng), 0.5f + unit(rng), 0.5f + unit(rng)) *
+                XMMatrixRotationY(XM_2PI * unit(rng)) * XMMatrixTranslation((copy % GRID) * spacing, 0.0f, (copy / GRID) * spacing));
+        }
+
+        // The grid's box and bounding sphere
+        BoundingBox grid;
+        XMStoreFloat3(&grid.Center, XMLoadFloat3(&bounds.Center) + XMVectorSet(0.5f * (GRID - 1) * spacing, 0.0f, 0.5f * (GRID - 1) * spacing, 0.0f));
+        XMStoreFloat3(&grid.Extents, XMLoadFloat3(&bounds.Extents) * 1.5f + XMVectorSet(0.5f * (GRID - 1) * spacing, 0.0f, 0.5f * (GRID - 1) * spacing, 0.0f));
+        const XMVECTOR gridCenter = XMLoadFloat3(&grid.Center);
+        const float gridRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&grid.Extents)));
+
+        auto randomPoint = [&]()
+        {
+            return XMVectorSet(grid.Center.x + (2.0f * unit(rng) - 1.0f) * grid.Extents.x,
+                grid.Center.y + (2.0f * unit(rng) - 1.0f) * grid.Extents.y,
+                grid.Center.z + (2.0f * unit(rng) - 1.0f) * grid.Extents.z, 1.0f);
+        };
+        auto lookAt = [](FXMVECTOR eye, FXMVECTOR dir)
+        {
+            XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+            return XMMatrixLookAtLH(eye, eye + dir, up);
+        };
+
+        struct Passes
+        {
+            const char* Name;
+            vector<XMFLOAT4X4> ViewProj;
+        };
+        Passes passes[3] = { { "camera" }, { "directional light" }, { "point light faces" } };
+
+        // TestApp's camera projection, at 16:9
+        const XMMATRIX cameraProj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 3000.0f);
+        for (int i = 0; i < CAMERAS; ++i)
+        {
+            XMVECTOR dir = XMVector3Normalize(XMVectorSet(gauss(rng), 0.25f * gauss(rng), gauss(rng), 0.0f));
+            XMFLOAT4X4 viewProj;
+            XMStoreFloat4x4(&viewProj, lookAt(randomPoint(), dir) * cameraProj);
+            passes[0].ViewProj.push_back(viewProj);
+        }
+
+        for (int i = 0; i < LIGHTS; ++i)
+        {
+            XMVECTOR dir = XMVector3Normalize(XMVectorSet(gauss(rng), -1.0f - fabsf(gauss(rng)), gauss(rng), 0.0f));
+            XMMATRIX view = lookAt(gridCenter - gridRadius * dir, dir);
+            XMFLOAT3 c;
+            XMStoreFloat3(&c, XMVector3TransformCoord(gridCenter, view));
+            XMFLOAT4X4 viewProj;
+            XMStoreFloat4x4(&viewProj, view * XMMatrixOrthographicOffCenterLH(c.x - gridRadius, c.x + gridRadius,
+                c.y - gridRadius, c.y + gridRadius, c.z - gridRadius, c.z + gridRadius));
+            passes[1].ViewProj.push_back(viewProj);
+        }
+
+        const XMVECTOR faces[6] = { XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(-1.0f, 0.0f, 0.0f, 0.0f),
+            XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f),
+            XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f) };
+        const XMMATRIX faceProj = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, POINT_NEAR, POINT_FAR);
+        for (int i = 0; i < LIGHTS; ++i)
+        {
+            XMVECTOR position = randomPoint();
+            for (auto& face : faces)
+            {
+                XMFLOAT4X4 viewProj;
+                XMStoreFloat4x4(&viewProj, lookAt(position, face) * faceProj);
+                passes[2].ViewProj.push_back(viewProj);
+            }
+        }
+
+        const size_t instances = items.size() * copies.size();
+        Report("InstanceCulling %s: %zu render items x %zu copies\n", name.c_str(), items.size(), copies.size());
+
+        for (auto& kind : passes)
+        {
+            // Visible instances, and render items none of whose instances are, over the passes
+            size_t visible = 0, skipped = 0;
+            for (auto& vp : kind.ViewProj)
+            {
+                ViewVolume volume(XMLoadFloat4x4(&vp));
+                for (auto& item : items)
+                {
+                    size_t itemVisible = 0;
+                    for (auto& copy : copies)
+                    {
+                        XMMATRIX world = XMLoadFloat4x4(&copy);
+                        bool kept = volume.Intersects(item, world);
+                        itemVisible += kept;
+
+                        ++checked;
+                        bool out = cornersOut(item, world, XMLoadFloat4x4(&vp), 0.0f);
+                        disagree += kept == out;
+                        if (!kept && !cornersOut(item, world, XMLoadFloat4x4(&vp), -1e-4f))
+                            ++culledInView;
+                        if (kept && cornersOut(item, world, XMLoadFloat4x4(&vp), 1e-4f))
+                            ++keptOutOfView;
+                    }
+                    visible += itemVisible;
+                    skipped += itemVisible == 0;
+                }
+            }
+
+            // Both write the compacted list of visible copies, as TestApp::CullPass does
+            size_t sink = 0;
+            vector<UINT> list(copies.size());
+            double volumeMs = TimeIt([&]()
+            {
+                size_t kept = 0;
+                for (auto& vp : kind.ViewProj)
+                {
+                    ViewVolume volume(XMLoadFloat4x4(&vp));
+                    for (auto& item : items)
+                    {
+                        UINT count = 0;
+                        for (UINT i = 0; i < copies.size(); ++i)
+                        {
+                            if (volume.Intersects(item, XMLoadFloat4x4(&copies[i])))
+                                list[count++] = i;
+                        }
+                        kept += count;
+                    }
+                }
+                return kept;
+            }, sink);
+            double cornersMs = TimeIt([&]()
+            {
+                size_t kept = 0;
+                for (auto& vp : kind.ViewProj)
+                {
+                    XMMATRIX viewProj = XMLoadFloat4x4(&vp);
+                    for (auto& item : items)
+                    {
+                        UINT count = 0;
+                        for (UINT i = 0; i < copies.size(); ++i)
+                        {
+                            if (!cornersOut(item, XMLoadFloat4x4(&copies[i]), viewProj, 0.0f))
+                                list[count++] = i;
+                        }
+                        kept += count;
+                    }
+                }
+                return kept;
+            }, sink);
+
+            const double count = static_cast<double>(kind.ViewProj.size());
+            Report("    %s (%zu passes): %.1f%% of %zu instances visible, %.1f of %zu draws skipped | %.1f us/pass vs "
+                "corners %.1f us/pass (%.1fx)\n", kind.Name, kind.ViewProj.size(), 100.0 * visible / (instances * count),
+                instances, skipped / count, items.size(), 1000.0 * volumeMs / count, 1000.0 * cornersMs / count,
+                cornersMs / volumeMs);
+        }
+    }
+
+    const bool pass = checked > 0 && culledInView == 0 && keptOutOfView == 0;
+
+    Report("InstanceCulling: %zu boxes vs their corners in clip space, %zu disagree at the planes, %zu culled in view, "
+        "%zu kept out of view | %s\n", checked, disagree, culledInView, keptOutOfView, pass ? "PASS" : "FAIL");
+}
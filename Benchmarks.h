@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+
+/*
+CPU micro benchmarks, for the hot paths that don't need the GPU.
+
+Run the app with -bench on the command line; it runs every suite and exits without opening a window.
+Results go to the debug output and are appended to bench_output.txt in the working directory.
+*/
+class Benchmarks
+{
+public:
+    static void Run(const std::wstring& projectPath);
+
+    // Lines/s of the old getline/split/atof OBJ loop vs Mesh::ParseOBJ (ObjReader) on Level1 and Level8. Reports FAIL if
+    // they build different geometry.
+    static void ObjParse(const std::wstring& projectPath);
+
+    // Face corner deduplication as done by Mesh::LoadOBJ
+    static void ObjDedup(const std::wstring& projectPath);
+
+    // Vertex cache (ACMR/ATVR) before and after MeshOptimizer, for every model in Models/
+    static void MeshOptimization(const std::wstring& projectPath);
+
+    // Size of VERTEX_FORMAT::PACKED vs FLOAT, and the worst decoding error against the bounds VertexPacking promises.
+    // Reports FAIL if any bound is exceeded.
+    static void VertexCompression(const std::wstring& projectPath);
+
+    // Triangles left after per submesh vs per cluster frustum and normal cone culling, from random views. Reports FAIL
+    // if the clusters don't cover their submesh exactly, or a cone rejects a cluster that has a front facing triangle.
+    static void MeshClustering(const std::wstring& projectPath);
+
+    // Triangles per level of detail from MeshSimplifier, with the error it promises vs the measured surface distance.
+    // Reports FAIL if a level uses vertices outside its submesh, has degenerate triangles or isn't coarser than the last.
+    static void MeshSimplification(const std::wstring& projectPath);
+
+    // Triangles in frustum-touching boxes per submesh vs per MeshChunker chunk, from random views. Reports FAIL if the
+    // chunks don't cover their submesh exactly or are too large.
+    static void MeshChunking(const std::wstring& projectPath);
+
+    // GeometryGenerator::CreateGeosphere at subdivision levels 0-6: vertex count and time. Reports FAIL if the vertices
+    // aren't shared (10 * 4^n + 2 of them) or not on the sphere.
+    static void GeosphereGeneration();
+
+    // Packing generated shapes into one vertex/index array by hand, as TestApp used to, vs GeometryBatchBuilder (the
+    // generator calls included in both). Reports FAIL if the arrays or offsets differ, or a submesh's bounds are wrong.
+    static void GeometryBatching();
+
+    // Steps/s of Integrator (RK4 through a std::function) vs the SchemeIntegrator schemes on Plane's force model, and
+    // their accuracy on a spring. Reports FAIL if the templated RK4 strays from Integrator or higher order isn't more
+    // accurate.
+    static void IntegratorSchemes();
+
+    // Acceleration evaluations fixed step RK4 vs AdaptiveIntegrator need to fly a pull-up within the same error of a
+    // double precision reference. Reports FAIL if the adaptive one needs more, doesn't reuse its last stage, or
+    // Predict strays from the path.
+    static void AdaptiveIntegration();
+
+    // Body-steps/s of BatchIntegrator vs stepping the same bodies one at a time with DirectXMath, at 1k, 10k and 100k
+    // bodies. Reports FAIL if the two drift apart over 10 s of flight (the last, partial group of lanes included) or
+    // orientations stop being unit quaternions.
+    static void BatchIntegration();
+
+    // Swept sphere queries/s against a TriangleBvh over each level vs testing every triangle, as the plane does each
+    // tick. Reports FAIL if the two disagree on whether or when the sphere hits, or a contact isn't a radius away.
+    static void TerrainCollision(const std::wstring& projectPath);
+
+    // Closest hit rays/s over all the submeshes of each model, as Pick casts them: a TriangleBvh per submesh vs testing
+    // every triangle in the submeshes whose box the ray hits. Reports FAIL if the two find different hits.
+    static void PickRays(const std::wstring& projectPath);
+
+    // Closest hit rays/s over a grid of copies of each model, each submesh an instance: SceneBvh vs visiting every
+    // instance. Reports FAIL if they find different hits, or line of sight or ground distance disagree, before and
+    // after instances move (a refit) and are removed (a rebuild).
+    static void SceneQueries(const std::wstring& projectPath);
+
+    // Ray/triangle tests/s over each level's triangles: TriangleTests and the scalar test one triangle at a time vs
+    // TriangleSimd a block at a time; and rays/s through a TriangleBvh one by one vs 2x2 packets, for a view of the
+    // level. Reports FAIL if the SIMD kernels find different hits from the scalar test.
+    static void TriangleKernels(const std::wstring& projectPath);
+
+    // SceneBvh per frame while a quarter of the instances move: refit (and rebuilt when the tree gets too costly) vs
+    // rebuilt every frame, in ms per frame. Reports FAIL if the refit tree finds different hits from every instance.
+    static void SceneRefit(const std::wstring& projectPath);
+
+    // Instances a ViewVolume keeps per pass, for camera, directional light and point light cube face views of a grid
+    // of copies of each model, and the time it takes. Reports FAIL if it culls a box that is in view, or keeps one
+    // that isn't, by more than rounding, against testing the box's corners in clip space.
+    static void InstanceCulling(const std::wstring& projectPath);
+
+private:
+    static void Report(const char* format, ...);
+};
@@ -0,0 +1,230 @@
+#include "BvhTree.h"
+
+#include <algorithm>
+#include <cfloat> // FLT_MAX
+#include <cmath>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+    typedef BvhTree::Node Node;
+    typedef BvhTree::Primitive Primitive;
+
+    struct Bin
+    {
+        XMVECTOR Min = XMVectorReplicate(FLT_MAX);
+        XMVECTOR Max = XMVectorReplicate(-FLT_MAX);
+        UINT Count = 0;
+    };
+
+    float XM_CALLCONV HalfArea(FXMVECTOR mn, FXMVECTOR mx)
+    {
+        XMFLOAT3 e;
+        XMStoreFloat3(&e, XMVectorMax(mx - mn, XMVectorZero()));
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    const int SAH_BINS = 16;
+
+    // Below this, nodes are split at their median instead, which bounds the depth (and the traversal stacks) however
+    // badly the heuristic takes to the primitives
+    const UINT MAX_SAH_DEPTH = 40;
+
+    // Fills out node over primitives [first, first + count) and everything below it; maxDepth tracks the deepest leaf
+    void BuildNode(vector<Node>& nodes, vector<Primitive>& primitives, UINT maxLeafSize, UINT node, UINT first,
+        UINT count, UINT depth, UINT& maxDepth)
+    {
+        maxDepth = (std::max)(maxDepth, depth);
+
+        XMVECTOR mn = XMVectorReplicate(FLT_MAX), mx = XMVectorReplicate(-FLT_MAX);
+        XMVECTOR cmn = mn, cmx = mx;
+        for (UINT i = first; i < first + count; ++i)
+        {
+            auto& p = primitives[i];
+            mn = XMVectorMin(mn, XMLoadFloat3(&p.Min));
+            mx = XMVectorMax(mx, XMLoadFloat3(&p.Max));
+            cmn = XMVectorMin(cmn, XMLoadFloat3(&p.Centroid));
+            cmx = XMVectorMax(cmx, XMLoadFloat3(&p.Centroid));
+        }
+        XMStoreFloat3(&nodes[node].Min, mn);
+        XMStoreFloat3(&nodes[node].Max, mx);
+
+        if (count <= maxLeafSize)
+        {
+            nodes[node].First = first;
+            nodes[node].Count = count;
+            return;
+        }
+
+        XMFLOAT3 lo, extent;
+        XMStoreFloat3(&lo, cmn);
+        XMStoreFloat3(&extent, cmx - cmn);
+
+        // Cost of a split: primitives on either side, weighted by the chance a ray through the node goes through that side
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; ++axis)
+        {
+            float axisExtent = (&extent.x)[axis];
+            if (axisExtent <= 0.0f)
+                continue;
+
+            const float scale = SAH_BINS / axisExtent;
+            Bin bins[SAH_BINS];
+            for (UINT i = first; i < first + count; ++i)
+            {
+                auto& p = primitives[i];
+                int b = (std::min)(SAH_BINS - 1, static_cast<int>(((&p.Centroid.x)[axis] - (&lo.x)[axis]) * scale));
+                bins[b].Min = XMVectorMin(bins[b].Min, XMLoadFloat3(&p.Min));
+                bins[b].Max = XMVectorMax(bins[b].Max, XMLoadFloat3(&p.Max));
+                ++bins[b].Count;
+            }
+
+            // Everything left of boundary i, swept from the left; then from the right, pricing each boundary
+            float leftArea[SAH_BINS];
+            UINT leftCount[SAH_BINS];
+            Bin left;
+            for (int i = 0; i < SAH_BINS - 1; ++i)
+            {
+                left.Min = XMVectorMin(left.Min, bins[i].Min);
+                left.Max = XMVectorMax(left.Max, bins[i].Max);
+                left.Count += bins[i].Count;
+                leftArea[i + 1] = HalfArea(left.Min, left.Max);
+                leftCount[i + 1] = left.Count;
+            }
+
+            Bin right;
+            for (int i = SAH_BINS - 1; i > 0; --i)
+            {
+                right.Min = XMVectorMin(right.Min, bins[i].Min);
+                right.Max = XMVectorMax(right.Max, bins[i].Max);
+                right.Count += bins[i].Count;
+                if (leftCount[i] == 0 || right.Count == 0)
+                    continue;
+
+                float cost = leftCount[i] * leftArea[i] + right.Count * HalfArea(right.Min, right.Max);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        UINT half = count / 2;
+        if (bestAxis >= 0)
+        {
+            const float scale = SAH_BINS / (&extent.x)[bestAxis];
+            auto middle = partition(primitives.begin() + first, primitives.begin() + first + count,
+                [&](const Primitive& p)
+            {
+                int b = (std::min)(SAH_BINS - 1, static_cast<int>(((&p.Centroid.x)[bestAxis] - (&lo.x)[bestAxis]) * scale));
+                return b < bestSplit;
+            });
+            half = static_cast<UINT>(middle - (primitives.begin() + first));
+        }
+        else
+        {
+            // Median along the longest axis; if all the centroids coincide, any split is as good as another
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            nth_element(primitives.begin() + first, primitives.begin() + first + half, primitives.begin() + first + count,
+                [axis](const Primitive& a, const Primitive& b) { return (&a.Centroid.x)[axis] < (&b.Centroid.x)[axis]; });
+        }
+
+        UINT left = static_cast<UINT>(nodes.size());
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[node].First = left;
+        nodes[node].Count = 0;
+
+        BuildNode(nodes, primitives, maxLeafSize, left, first, half, depth + 1, maxDepth);
+        BuildNode(nodes, primitives, maxLeafSize, left + 1, first + half, count - half, depth + 1, maxDepth);
+    }
+}
+
+UINT BvhTree::Build(vector<Node>& nodes, vector<Primitive>& primitives, UINT maxLeafSize)
+{
+    nodes.clear();
+    if (primitives.empty())
+        return 0;
+
+    // A binary tree with leaves of at least one primitive has fewer than twice as many nodes as primitives
+    nodes.reserve(2 * primitives.size());
+    nodes.push_back(Node());
+
+    UINT depth = 0;
+    BuildNode(nodes, primitives, (std::max)(maxLeafSize, 1u), 0, 0, static_cast<UINT>(primitives.size()), 0, depth);
+    return depth;
+}
+
+bool BvhTree::RayBox(const float p[3], const float invD[3], const XMFLOAT3& mn, const XMFLOAT3& mx, float r, float maxT,
+    float& entry)
+{
+    const float lo[3] = { mn.x - r, mn.y - r, mn.z - r };
+    const float hi[3] = { mx.x + r, mx.y + r, mx.z + r };
+
+    float t0 = 0.0f, t1 = maxT;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (isinf(invD[i]))
+        {
+            // Parallel to the slab
+            if (p[i] < lo[i] || p[i] > hi[i])
+                return false;
+            continue;
+        }
+
+        float tLo = (lo[i] - p[i]) * invD[i];
+        float tHi = (hi[i] - p[i]) * invD[i];
+        if (tLo > tHi)
+            swap(tLo, tHi);
+        t0 = (std::max)(t0, tLo);
+        t1 = (std::min)(t1, tHi);
+        if (t0 > t1)
+            return false;
+    }
+
+    entry = t0;
+    return true;
+}
+
+float BvhTree::HalfArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+{
+    return ::HalfArea(XMLoadFloat3(&mn), XMLoadFloat3(&mx));
+}
+
+const UINT BvhTree::NO_PARENT;
+
+void BvhTree::Parents(const vector<Node>& nodes, vector<UINT>& parents)
+{
+    parents.assign(nodes.size(), NO_PARENT);
+    for (UINT i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].Count == 0)
+        {
+            parents[nodes[i].First] = i;
+            parents[nodes[i].First + 1] = i;
+        }
+    }
+}
+
+float BvhTree::NodeCost(const Node& node)
+{
+    return HalfArea(node.Min, node.Max) * (node.Count > 0 ? node.Count : 1);
+}
+
+float BvhTree::Cost(const vector<Node>& nodes)
+{
+    if (nodes.empty())
+        return 0.0f;
+
+    double sum = 0.0;
+    for (auto& node : nodes)
+        sum += NodeCost(node);
+
+    float rootArea = HalfArea(nodes[0].Min, nodes[0].Max);
+    return rootArea > 0.0f ? static_cast<float>(sum / rootArea) : 0.0f;
+}
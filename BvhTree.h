@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+/*
+The node layout, builder and box test shared by the bounding volume hierarchies: TriangleBvh over the triangles of a
+submesh, SceneBvh over the instances that reference them.
+
+A tree is one flat array of nodes, the root first. The children of an interior node are next to each other, and
+always come after it in the array, so walking it backwards visits every child before its parent.
+*/
+class BvhTree
+{
+public:
+    struct Node
+    {
+        DirectX::XMFLOAT3 Min;
+        UINT First;     // Leaf: first primitive. Interior: left child; the right child is First + 1.
+        DirectX::XMFLOAT3 Max;
+        UINT Count;     // Primitives in a leaf, 0 for an interior node
+    };
+
+    // A box to build over, and what it stands for
+    struct Primitive
+    {
+        DirectX::XMFLOAT3 Min, Max, Centroid;
+        UINT Index;
+    };
+
+    /*
+    Builds nodes over primitives, top down, and reorders primitives into leaf order. Nodes are split where the surface
+    area heuristic says rays will visit the fewest primitives: they are binned by centroid along each axis and every
+    boundary between bins is a candidate. Leaves hold at most maxLeafSize primitives. Returns the depth of the deepest
+    leaf, which stays within TRAVERSAL_STACK.
+    */
+    static UINT Build(std::vector<Node>& nodes, std::vector<Primitive>& primitives, UINT maxLeafSize);
+
+    // Deep enough for any tree Build makes of up to 2^24 primitives
+    static const int TRAVERSAL_STACK = 64;
+
+    /*
+    Whether p + t d enters the box [mn - r, mx + r] for some t in [0, maxT], and when. invD is 1 / d, component by
+    component, infinities and all.
+    */
+    static bool RayBox(const float p[3], const float invD[3], const DirectX::XMFLOAT3& mn, const DirectX::XMFLOAT3& mx,
+        float r, float maxT, float& entry);
+
+    /*
+    Visits the leaves of nodes whose boxes, grown by r, the segment origin + t direction enters for t in [0, maxT],
+    nearest box first. leaf(first, count) tests the primitives of a leaf. It lowers maxT to whatever it hits, so that
+    boxes entered later are skipped, and returns true to end the walk there (for queries that take any hit).
+    */
+    template<typename F>
+    static void XM_CALLCONV Traverse(const std::vector<Node>& nodes, DirectX::FXMVECTOR origin,
+        DirectX::FXMVECTOR direction, float r, float& maxT, F leaf)
+    {
+        if (nodes.empty())
+            return;
+
+        DirectX::XMFLOAT3 o, d;
+        DirectX::XMStoreFloat3(&o, origin);
+        DirectX::XMStoreFloat3(&d, direction);
+        const float p[3] = { o.x, o.y, o.z };
+        const float invD[3] = { 1.0f / d.x, 1.0f / d.y, 1.0f / d.z };
+
+        struct Entry
+        {
+            UINT Node;
+            float Time;
+        } stack[TRAVERSAL_STACK];
+        int top = 0;
+
+        float entry;
+        if (!RayBox(p, invD, nodes[0].Min, nodes[0].Max, r, maxT, entry))
+            return;
+        stack[top++] = { 0, entry };
+
+        while (top > 0)
+        {
+            auto next = stack[--top];
+            if (next.Time > maxT)
+                continue;
+
+            auto& node = nodes[next.Node];
+            if (node.Count > 0)
+            {
+                if (leaf(node.First, node.Count))
+                    return;
+                continue;
+            }
+
+            float entryL, entryR;
+            bool hitL = RayBox(p, invD, nodes[node.First].Min, nodes[node.First].Max, r, maxT, entryL);
+            bool hitR = RayBox(p, invD, nodes[node.First + 1].Min, nodes[node.First + 1].Max, r, maxT, entryR);
+            if (hitL && hitR)
+            {
+                // The nearer one on top
+                bool leftFirst = entryL <= entryR;
+                stack[top++] = leftFirst ? Entry{ node.First + 1, entryR } : Entry{ node.First, entryL };
+                stack[top++] = leftFirst ? Entry{ node.First, entryL } : Entry{ node.First + 1, entryR };
+            }
+            else if (hitL)
+                stack[top++] = { node.First, entryL };
+            else if (hitR)
+                stack[top++] = { node.First + 1, entryR };
+        }
+    }
+
+    // Half the surface area of a box, which is all the heuristic compares
+    static float HalfArea(const DirectX::XMFLOAT3& mn, const DirectX::XMFLOAT3& mx);
+
+    static const UINT NO_PARENT = ~0u;
+
+    // The parent of every node of nodes, NO_PARENT for the root, for walking up from a leaf
+    static void Parents(const std::vector<Node>& nodes, std::vector<UINT>& parents);
+
+    /*
+    What the surface area heuristic expects a ray through the root to cost: a box test for every interior node and a
+    primitive test for every primitive in a leaf, each weighted by the chance that the ray goes through the node, which
+    is its area over the root's. Cost is the sum of NodeCost over the nodes, over the root's HalfArea. Refitting moving
+    primitives grows it, as their boxes drift apart from those the tree was built over.
+    */
+    static float Cost(const std::vector<Node>& nodes);
+    static float NodeCost(const Node& node);
+};
@@ -98,6 +98,7 @@ int D3Base::Run()
 			if (!mAppPaused)
 			{
 				CalculateFrameStats();
+				StepSimulation(mLockstep ? mSimulationStep : mTimer.DeltaTime());
 				Update(mTimer);
 				Draw(mTimer);
 			}
@@ -596,6 +597,44 @@ D3D12_CPU_DESCRIPTOR_HANDLE D3Base::DepthStencilView() const
 	return mDsvHeap->GetCPUDescriptorHandleForHeapStart();
 }
 
+void D3Base::SetSimulationRate(float stepsPerSecond, UINT maxStepsPerFrame)
+{
+	assert(stepsPerSecond > 0.0f && maxStepsPerFrame > 0);
+
+	mSimulationStep = 1.0f / stepsPerSecond;
+	mMaxSimulationSteps = maxStepsPerFrame;
+	mSimulationAccumulator = 0.0f;
+}
+
+void D3Base::SetLockstep(bool lockstep)
+{
+	mLockstep = lockstep;
+	mSimulationAccumulator = 0.0f;
+}
+
+/*
+Runs as many fixed steps as the time since the last frame adds up to; the remainder carries over to the next frame. If
+a frame would need more than mMaxSimulationSteps (a long hitch, or steps that take longer than they simulate), the
+backlog is dropped: otherwise every frame would run more steps than the last, and take longer still.
+*/
+void D3Base::StepSimulation(float frameTime)
+{
+	mSimulationAccumulator += frameTime;
+
+	UINT steps = 0;
+	while (mSimulationAccumulator >= mSimulationStep && steps < mMaxSimulationSteps)
+	{
+		Simulate(mSimulationStep);
+		mSimulationAccumulator -= mSimulationStep;
+		++steps;
+	}
+
+	if (mSimulationAccumulator >= mSimulationStep)
+		mSimulationAccumulator = fmodf(mSimulationAccumulator, mSimulationStep);
+
+	mSimulationAlpha = mSimulationAccumulator / mSimulationStep;
+}
+
 void D3Base::CalculateFrameStats()
 {
 	// Code computes the average frames per second, and also the 
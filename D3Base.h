@@ -34,6 +34,14 @@ public:
 
 	int Run();
 
+	// Rate at which Simulate is called, independent of the frame rate, and how many steps a single frame may take
+	// before the simulation gives up on catching up and runs slow instead
+	void SetSimulationRate(float stepsPerSecond, UINT maxStepsPerFrame = 8);
+
+	// One simulation step per frame, however long the frame took, so every run draws the same steps in the same
+	// frames. For replays that compare performance.
+	void SetLockstep(bool lockstep);
+
 	virtual bool Initialize();
 	virtual LRESULT MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
@@ -41,6 +49,8 @@ protected:
 
 	virtual void CreateRtvAndDsvDescriptorHeaps();
 	virtual void OnResize();
+	// Advances the simulation by one fixed step of dt seconds. Called zero or more times per frame, before Update.
+	virtual void Simulate(float dt) {};
 	virtual void Update(const Timer&) {};
 	virtual void Draw(const Timer&) {};
 
@@ -61,6 +71,7 @@ protected:
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView() const;
 
 	void CalculateFrameStats();
+	void StepSimulation(float frameTime);
 
 	void LogAdapters() const;
 	void LogAdapterOutputs(IDXGIAdapter* adapter) const;
@@ -79,6 +90,14 @@ protected:
 	bool mAppPaused = false;
 	Timer mTimer;
 
+	// Fixed step simulation, see Simulate. mSimulationAlpha is how far the frame is between the previous step and the
+	// latest one (in [0, 1)), for interpolating what's drawn.
+	float mSimulationStep = 1.0f / 120.0f;
+	UINT mMaxSimulationSteps = 8;
+	float mSimulationAccumulator = 0.0f;
+	float mSimulationAlpha = 0.0f;
+	bool mLockstep = false;
+
 	// Multisampling support
 	bool m4xMsaaEnabled = false;
 	UINT m4xMsaaQuality = 0;
@@ -3,6 +3,7 @@
 #include "Utilities.h"
 #include "UploadBuffer.h"
 #include "Light.h"
+#include "Vertex.h"
 #include <map>
 
 struct InstanceData
@@ -51,13 +52,6 @@ struct PassConstants
     Light Lights[MaxLights];
 };
 
-struct Vertex
-{
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT3 Normal;
-    DirectX::XMFLOAT2 TexC;
-};
-
 
 // Idea is to store everything needed to submit a command list for a frame in this class
 struct FrameResource
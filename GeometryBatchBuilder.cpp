@@ -0,0 +1,69 @@
+#include "GeometryBatchBuilder.h"
+#include "FrameResource.h" // for Vertex
+#include "MeshOptimizer.h"
+
+#include <cfloat> // FLT_MAX
+
+using namespace std;
+using namespace DirectX;
+
+void GeometryBatchBuilder::Add(const string& name, GeometryGenerator::MeshData&& shape)
+{
+    mVertexCount += shape.Vertices.size();
+    mIndexCount += shape.Indices32.size();
+    mShapes.push_back({ name, move(shape) });
+}
+
+void GeometryBatchBuilder::Build(vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs)
+{
+    vertices.resize(mVertexCount);
+    indices.resize(mIndexCount);
+
+    Vertex* vertexOut = vertices.data();
+    uint32_t* indexOut = indices.data();
+    for (auto& shape : mShapes)
+    {
+        SubmeshGeometry sg;
+        sg.IndexCount = (UINT)shape.Data.Indices32.size();
+        sg.StartIndexLocation = (UINT)(indexOut - indices.data());
+        sg.BaseVertexLocation = (INT)(vertexOut - vertices.data());
+
+        // Generator indices are already relative to the shape's first vertex
+        indexOut = copy(shape.Data.Indices32.begin(), shape.Data.Indices32.end(), indexOut);
+
+        XMVECTOR lo = XMVectorReplicate(FLT_MAX), hi = XMVectorReplicate(-FLT_MAX);
+        for (auto& v : shape.Data.Vertices)
+        {
+            vertexOut->Pos = v.Position;
+            vertexOut->Normal = v.Normal;
+            vertexOut->TexC = v.TexC;
+            ++vertexOut;
+
+            XMVECTOR p = XMLoadFloat3(&v.Position);
+            lo = XMVectorMin(lo, p);
+            hi = XMVectorMax(hi, p);
+        }
+        if (!shape.Data.Vertices.empty())
+            BoundingBox::CreateFromPoints(sg.Bounds, lo, hi);
+
+        drawArgs[shape.Name] = sg;
+    }
+
+    mShapes.clear();
+    mVertexCount = 0;
+    mIndexCount = 0;
+}
+
+void GeometryBatchBuilder::Build(Mesh& mesh, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+    MESH_OPTIMIZATION optimization, VERTEX_FORMAT format)
+{
+    vector<Vertex> vertices;
+    vector<uint32_t> indices;
+    Build(vertices, indices, mesh.DrawArgs);
+
+    MeshOptimizer::Optimize(vertices, indices, mesh.DrawArgs, optimization);
+
+    // Picks 16 or 32 bit indices, depending on what the submeshes need
+    mesh.CreateBuffers(device, cmdList, vertices, indices, format);
+}
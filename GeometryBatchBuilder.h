@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GeometryGenerator.h"
+#include "Mesh.h"
+
+/*
+Packs generated shapes into the buffers of one Mesh, each shape a submesh of its own.
+
+Shapes are handed over straight from the generator calls and kept as they are until Build, which knows the final sizes
+and so writes every vertex and index exactly once, into arrays already laid out as the buffers will be. Submesh offsets
+and bounds come out of that same pass.
+
+    GeometryBatchBuilder batch;
+    batch.Add("box", geo.CreateBox(1.0f, 1.0f, 1.0f, 0));
+    batch.Add("grid", geo.CreateGrid(10.0f, 10.0f, 2, 2));
+    batch.Build(mesh, device, cmdList, MESH_OPTIMIZATION::VERTEX_CACHE);
+*/
+class GeometryBatchBuilder
+{
+public:
+    // Adds shape as submesh name. The builder takes the shape over; nothing is copied until Build.
+    void Add(const std::string& name, GeometryGenerator::MeshData&& shape);
+
+    // Vertex and index counts of everything added so far
+    size_t VertexCount() const { return mVertexCount; }
+    size_t IndexCount() const { return mIndexCount; }
+
+    /*
+    Writes the shapes into vertices and indices in the order they were added, and their submeshes into drawArgs. The
+    arrays end up in the form Mesh::CreateBuffers takes. Leaves the builder empty.
+    */
+    void Build(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs);
+
+    // As above, then optimizes the arrays and creates mesh's buffers from them
+    void Build(Mesh& mesh, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+        MESH_OPTIMIZATION optimization = MESH_OPTIMIZATION::NONE, VERTEX_FORMAT format = VERTEX_FORMAT::FLOAT);
+
+private:
+    struct Shape
+    {
+        std::string Name;
+        GeometryGenerator::MeshData Data;
+    };
+
+    std::vector<Shape> mShapes;
+    size_t mVertexCount = 0;
+    size_t mIndexCount = 0;
+};
@@ -1,5 +1,6 @@
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <unordered_map>
 
 using namespace DirectX;
 
@@ -470,51 +471,51 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 
 void GeometryGenerator::Subdivide(MeshData& mesh)
 {
-	// We create 3 extra vertices for each triangle, e.g. one tri turns into four(equal sized) tris.
-	
-	// We'll do it in a horrible inefficient way first and leave this as a point of improvement for now.
-	MeshData meshCopy = mesh;
+	// Every triangle (v0, v1, v2) turns into four equal sized ones with the same winding: (v0, m0, m2), (m0, m1, m2),
+	// (m2, m1, v2) and (m0, v1, m1), where m0, m1 and m2 are the midpoints of v0v1, v1v2 and v0v2.
+	//
+	// Triangles that share an edge share its midpoint, found through a cache keyed on the edge's (sorted) vertex ids.
+	// The old vertices keep their ids; midpoints are appended.
+	const uint32 nTris = (uint32)(mesh.Indices32.size() / 3);
+
+	// A closed mesh has 3/2 edges per triangle; open ones a few more, which the vectors grow into
+	mesh.Vertices.reserve(mesh.Vertices.size() + nTris * 3 / 2);
+	mesh.Indices32.resize(nTris * 12);
+
+	std::unordered_map<std::uint64_t, uint32> midpoints;
+	midpoints.reserve(nTris * 3 / 2);
+
+	auto midpoint = [&](uint32 a, uint32 b)
+	{
+		const std::uint64_t key = ((std::uint64_t)(std::min)(a, b) << 32) | (std::max)(a, b);
 
-	// Iterating through the indices 3 at a time, since triangle
-	uint32 nTris = (uint32)(meshCopy.Indices32.size() / 3);
+		auto found = midpoints.find(key);
+		if (found != midpoints.end())
+			return found->second;
 
-	mesh.Vertices.resize(0);
-	mesh.Indices32.resize(0);
+		const uint32 m = (uint32)mesh.Vertices.size();
+		mesh.Vertices.push_back(Midpoint(mesh.Vertices[a], mesh.Vertices[b]));
+		midpoints.emplace(key, m);
+		return m;
+	};
 
-	for (uint32 i = 0; i < nTris; ++i)
+	// In place, back to front: triangle i's four replace triangles 4i..4i+3, which have all been read by then
+	for (uint32 i = nTris; i-- > 0;)
 	{
-		Vertex v0 = meshCopy.Vertices[meshCopy.Indices32[i * 3 + 0]];
-		Vertex v1 = meshCopy.Vertices[meshCopy.Indices32[i * 3 + 1]];
-		Vertex v2 = meshCopy.Vertices[meshCopy.Indices32[i * 3 + 2]];
-
-		// Generate the midpoints
-		Vertex m0 = Midpoint(v0, v1);
-		Vertex m1 = Midpoint(v1, v2);
-		Vertex m2 = Midpoint(v0, v2);
-
-		// Vertex order doesn't seem to matter(it shouldn't). Probably messed up indices before.
-		mesh.Vertices.push_back(v0); // 0
-		mesh.Vertices.push_back(m0); // 1
-		mesh.Vertices.push_back(v1); // 2
-		mesh.Vertices.push_back(m1); // 3
-		mesh.Vertices.push_back(v2); // 4
-		mesh.Vertices.push_back(m2); // 5
-
-		mesh.Indices32.push_back(i * 6 + 0);
-		mesh.Indices32.push_back(i * 6 + 1);
-		mesh.Indices32.push_back(i * 6 + 5);
-
-		mesh.Indices32.push_back(i * 6 + 1);
-		mesh.Indices32.push_back(i * 6 + 3);
-		mesh.Indices32.push_back(i * 6 + 5);
-
-		mesh.Indices32.push_back(i * 6 + 5);
-		mesh.Indices32.push_back(i * 6 + 3);
-		mesh.Indices32.push_back(i * 6 + 4);
-
-		mesh.Indices32.push_back(i * 6 + 1);
-		mesh.Indices32.push_back(i * 6 + 2);
-		mesh.Indices32.push_back(i * 6 + 3);
+		const uint32 v0 = mesh.Indices32[i * 3 + 0];
+		const uint32 v1 = mesh.Indices32[i * 3 + 1];
+		const uint32 v2 = mesh.Indices32[i * 3 + 2];
+
+		const uint32 m0 = midpoint(v0, v1);
+		const uint32 m1 = midpoint(v1, v2);
+		const uint32 m2 = midpoint(v0, v2);
+
+		uint32* out = &mesh.Indices32[i * 12];
+
+		out[0] = v0; out[1] = m0; out[2] = m2;
+		out[3] = m0; out[4] = m1; out[5] = m2;
+		out[6] = m2; out[7] = m1; out[8] = v2;
+		out[9] = m0; out[10] = v1; out[11] = m1;
 	}
 }
 
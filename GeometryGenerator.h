@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
@@ -49,7 +50,11 @@ public:
             {
                 mIndices16.resize(Indices32.size());
                 for (size_t i = 0; i < Indices32.size(); ++i)
+                {
+                    // Meshes with more vertices than this need the 32-bit indices
+                    assert(Indices32[i] <= UINT16_MAX);
                     mIndices16[i] = static_cast<uint16>(Indices32[i]);
+                }
             }
 
             return mIndices16;
@@ -0,0 +1,39 @@
+#include "HeadlessRunner.h"
+#include "Simulation.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+Entry point of the standalone build of HeadlessRunner (see CMakeLists.txt here), which has no WinMain. Takes what the
+app takes after -headless: <ticks> [input script] [-simrate <hz>], and -root <dir> for the project directory, the one
+with Models/ in it (the working directory by default).
+*/
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fputs("usage: FlightHeadless <ticks> [input script] [-simrate <hz>] [-root <dir>]\n", stderr);
+		return 1;
+	}
+
+	unsigned long long ticks = strtoull(argv[1], nullptr, 10);
+	std::string script;
+	std::string root = ".";
+	float simulationRate = 120.0f;
+
+	for (int i = 2; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-simrate") == 0 && i + 1 < argc)
+			simulationRate = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-root") == 0 && i + 1 < argc)
+			root = argv[++i];
+		else if (argv[i][0] != '-' && script.empty())
+			script = argv[i];
+	}
+
+	auto level = root + "/Models/" + Simulation::DEFAULT_LEVEL + ".obj";
+	return HeadlessRunner::Run(ticks, script, simulationRate > 0.0f ? simulationRate : 120.0f, level) < 0 ? 1 : 0;
+}
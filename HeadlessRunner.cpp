@@ -0,0 +1,87 @@
+#include "HeadlessRunner.h"
+#include "InputScript.h"
+#include "Platform.h"
+#include "Simulation.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+using namespace std;
+using namespace DirectX;
+
+int HeadlessRunner::Run(uint64_t ticks, const string& script, float stepsPerSecond, const string& level)
+{
+	InputScript input;
+	if (!script.empty())
+	{
+		int result = input.Load(script);
+		if (result < 0)
+		{
+			Report("HeadlessRunner: could not load input script %s (%d)\n", script.c_str(), result);
+			return result;
+		}
+	}
+
+	// Cubes become bodies, everything else terrain; see TestApp::BuildStaticGeometry
+	TriangleBvh terrain;
+	size_t bodyCount = 0;
+	int result = Simulation::LoadTerrain(level, terrain, bodyCount);
+	if (result < 0)
+	{
+		Report("HeadlessRunner: could not read level %s (%d)\n", level.c_str(), result);
+		return result;
+	}
+
+	// As TestApp::InitLights and BuildRenderItems set it up
+	Simulation simulation;
+	simulation.Seed(input.Seed);
+	simulation.SetTerrain(&terrain);
+	simulation.AddLight({ 1.0f, -1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, 0.1f);
+	simulation.AddLight({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, 0.0f);
+	// The cubes start where the file has them, at an identity world
+	for (size_t i = 0; i < bodyCount; ++i)
+		simulation.AddBody(XMMatrixIdentity());
+
+	// Turn camera around
+	simulation.Aircraft().Yaw(XM_PI);
+
+	const float dt = 1.0f / stepsPerSecond;
+
+	uint64_t contacts = 0;
+
+	auto start = chrono::high_resolution_clock::now();
+	for (uint64_t tick = 0; tick < ticks; ++tick)
+	{
+		input.Apply(tick, simulation.Aircraft());
+		simulation.Step(dt);
+		contacts += simulation.Collided() ? 1 : 0;
+	}
+	double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	Report("HeadlessRunner: %llu ticks at %.0f Hz, %zu bodies, %zu terrain triangles, %zu input events in %.3f s: "
+		"%.0f ticks/s\n", (unsigned long long)ticks, stepsPerSecond, bodyCount, terrain.TriangleCount(),
+		input.Events().size(), seconds, seconds > 0.0 ? ticks / seconds : 0.0);
+	Report("HeadlessRunner: %llu steps ended on the terrain; checksum %016llx\n", (unsigned long long)contacts,
+		(unsigned long long)simulation.Checksum());
+
+	return 0;
+}
+
+void HeadlessRunner::Report(const char* format, ...)
+{
+	char buffer[512];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	// Elsewhere DebugOutput goes to stderr, which would only repeat stdout
+#ifdef _WIN32
+	DebugOutput(buffer);
+#endif
+
+	fputs(buffer, stdout);
+	fflush(stdout);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+Steps Simulation with no window and no D3D12 device, to measure and regression test the cost of the simulation on
+machines without a GPU.
+
+Run the app with -headless <ticks> [input script] [-simrate <hz>], or build Headless/CMakeLists.txt, which takes the
+same arguments and needs neither Windows nor MSVC. The scene is TestApp's: the plane, turned around as Initialize does,
+the two lights of InitLights (which don't move, as AnimateLights is off there too), a body for every cube of the level
+and the rest of the level as terrain, loaded with Simulation::LoadTerrain as TestApp loads it. So a flight TestApp records
+with -record flies the same path here and ends on the same checksum. Results go to stdout and the debug output.
+*/
+class HeadlessRunner
+{
+public:
+	// Steps ticks steps of 1 / stepsPerSecond s from the seed of script (an InputScript file, such as TestApp records
+	// with -record; none if empty), feeding its events to the plane, over the level in the OBJ file level. Reports ticks
+	// per second and the Simulation::Checksum at the end. Returns 0, the InputScript::Load error if the script can't
+	// be read or the Simulation::LoadTerrain error if the level can't.
+	static int Run(std::uint64_t ticks, const std::string& script, float stepsPerSecond, const std::string& level);
+
+private:
+	static void Report(const char* format, ...);
+};
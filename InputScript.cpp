@@ -0,0 +1,158 @@
+#include "InputScript.h"
+#include "Plane.h"
+#include "Platform.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+	const struct
+	{
+		const char* Name;
+		InputScript::CONTROL Control;
+	} CONTROL_NAMES[] = {
+		{ "thrust", InputScript::CONTROL::THRUST },
+		{ "reverse", InputScript::CONTROL::REVERSE },
+		{ "pitch", InputScript::CONTROL::PITCH },
+		{ "yaw", InputScript::CONTROL::YAW },
+		{ "roll", InputScript::CONTROL::ROLL },
+		{ "pitchby", InputScript::CONTROL::PITCH_BY },
+		{ "yawby", InputScript::CONTROL::YAW_BY },
+		{ "rollby", InputScript::CONTROL::ROLL_BY },
+		{ "end", InputScript::CONTROL::END }
+	};
+
+	Plane::STEER Steer(float value)
+	{
+		return value > 0.0f ? Plane::STEER::POSITIVE : (value < 0.0f ? Plane::STEER::NEGATIVE : Plane::STEER::NONE);
+	}
+}
+
+int InputScript::Load(const string& filename)
+{
+	ifstream in(filename);
+	if (!in)
+		return -1;
+
+	mEvents.clear();
+	mNext = 0;
+	Seed = Simulation::DEFAULT_SEED;
+
+	string line;
+	for (int lineNumber = 1; getline(in, line); ++lineNumber)
+	{
+		istringstream fields(line);
+		string control;
+		Event e;
+		if (!(fields >> e.Tick))
+		{
+			// Blank, a comment or the seed
+			fields.clear();
+			fields.seekg(0);
+			if (!(fields >> control) || control[0] == '#')
+				continue;
+			if (control == "seed" && fields >> Seed)
+				continue;
+		}
+		else if (fields >> control >> e.Value)
+		{
+			bool known = false;
+			for (auto& c : CONTROL_NAMES)
+			{
+				if (control == c.Name)
+				{
+					e.Control = c.Control;
+					known = true;
+				}
+			}
+
+			if (known && (mEvents.empty() || mEvents.back().Tick <= e.Tick))
+			{
+				mEvents.push_back(e);
+				continue;
+			}
+		}
+
+		char msg[256];
+		snprintf(msg, sizeof(msg), "InputScript: %s line %d is not an event, or out of order\n", filename.c_str(), lineNumber);
+		DebugOutput(msg);
+		return -2;
+	}
+
+	return 0;
+}
+
+int InputScript::Save(const string& filename) const
+{
+	ofstream out(filename);
+	if (!out)
+		return -1;
+
+	out << "seed " << Seed << "\n";
+	for (auto& e : mEvents)
+	{
+		const char* name = "";
+		for (auto& c : CONTROL_NAMES)
+		{
+			if (c.Control == e.Control)
+				name = c.Name;
+		}
+
+		// Mouse look deltas in full, so the replay turns exactly as far
+		char line[128];
+		snprintf(line, sizeof(line), "%llu %s %.9g\n", (unsigned long long)e.Tick, name, e.Value);
+		out << line;
+	}
+
+	return out ? 0 : -1;
+}
+
+void InputScript::Record(const Event& e)
+{
+	assert(mEvents.empty() || mEvents.back().Tick <= e.Tick);
+	mEvents.push_back(e);
+}
+
+void InputScript::Apply(uint64_t tick, Plane& plane)
+{
+	for (; mNext < mEvents.size() && mEvents[mNext].Tick <= tick; ++mNext)
+		Apply(mEvents[mNext], plane);
+}
+
+void InputScript::Apply(const Event& e, Plane& plane)
+{
+	switch (e.Control)
+	{
+	case CONTROL::THRUST:
+		plane.Thrust(e.Value != 0.0f);
+		break;
+	case CONTROL::REVERSE:
+		plane.Reverse();
+		break;
+	case CONTROL::PITCH:
+		plane.Pitch(Steer(e.Value));
+		break;
+	case CONTROL::YAW:
+		plane.Yaw(Steer(e.Value));
+		break;
+	case CONTROL::ROLL:
+		plane.Roll(Steer(e.Value));
+		break;
+	case CONTROL::PITCH_BY:
+		plane.Pitch(e.Value);
+		break;
+	case CONTROL::YAW_BY:
+		plane.Yaw(e.Value);
+		break;
+	case CONTROL::ROLL_BY:
+		plane.Roll(e.Value);
+		break;
+	case CONTROL::END:
+		break;
+	}
+}
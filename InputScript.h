@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Simulation.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Plane controls as a list of events stamped with the simulation tick they happen at, so a flight can be recorded and
+flown again step for step.
+
+One event per line, "<tick> <control> <value>"; blank lines and lines starting with # are skipped:
+
+	0 thrust 1        Thrust(true); 0 for Thrust(false)
+	0 reverse 0       Reverse(), the toggle; the value is ignored
+	120 roll 1        Roll(STEER::POSITIVE); -1 for NEGATIVE, 0 for NONE. pitch and yaw the same
+	300 yawby -0.02   Yaw(-0.02f), in radians, as mouse look does. pitchby and rollby the same
+	3600 end 0        Where the recording stopped; nothing happens
+
+Events must be in tick order. A "seed <n>" line sets Seed.
+*/
+class InputScript
+{
+public:
+	enum class CONTROL
+	{
+		THRUST,
+		REVERSE,
+		PITCH,
+		YAW,
+		ROLL,
+		PITCH_BY,
+		YAW_BY,
+		ROLL_BY,
+		END
+	};
+
+	struct Event
+	{
+		std::uint64_t Tick;
+		CONTROL Control;
+		float Value;
+	};
+
+	// Returns 0, -1 if the file can't be opened or -2 if a line isn't an event
+	int Load(const std::string& filename);
+
+	// Returns 0, or -1 if the file can't be written
+	int Save(const std::string& filename) const;
+
+	// Appends an event; its tick can't be before the last one's
+	void Record(const Event& e);
+
+	// Feeds the events of tick to the plane. Call once for every tick, in increasing order.
+	void Apply(std::uint64_t tick, Plane& plane);
+
+	// Feeds one event to the plane, through the same call the keyboard and mouse handlers make
+	static void Apply(const Event& e, Plane& plane);
+
+	// Whether Apply has fed every event
+	bool Finished() const { return mNext == mEvents.size(); }
+
+	void Rewind() { mNext = 0; }
+
+	const std::vector<Event>& Events() const { return mEvents; }
+
+	// For the Simulation's random numbers, so the spinning objects wobble the same way too
+	std::uint32_t Seed = Simulation::DEFAULT_SEED;
+
+private:
+	std::vector<Event> mEvents;
+	size_t mNext = 0;
+};
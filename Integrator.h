@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <functional>
+#include <vector>
 #include <DirectXMath.h>
 
+// Fixed step RK4 through a std::function. See SchemeIntegrator for the templated version, which the compiler can inline.
 class Integrator
 {
 public:
@@ -20,3 +25,330 @@ private:
 	float dt;
 };
 
+/*
+Stepping schemes for SchemeIntegrator. Each advances pos and vel by dt, given the acceleration a(pos, vel, t) as a
+functor type, so the whole step (acceleration included) can be inlined and the state stays in registers.
+Evaluations is the number of times a step calls the acceleration.
+*/
+namespace IntegrationScheme
+{
+	// First order. Drifts quickly (gains energy on anything that oscillates); mostly here for comparison.
+	struct ExplicitEuler
+	{
+		static const int Evaluations = 1;
+
+		template<typename Acceleration>
+		static void XM_CALLCONV Step(Acceleration& a, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, float dt,
+			DirectX::XMVECTOR& newPos, DirectX::XMVECTOR& newVel)
+		{
+			using namespace DirectX;
+
+			auto acc = a(pos, vel, t);
+			newPos = XMVectorMultiplyAdd(vel, XMVectorReplicate(dt), pos);
+			newVel = XMVectorMultiplyAdd(acc, XMVectorReplicate(dt), vel);
+		}
+	};
+
+	// Symplectic Euler: velocity first, then position with the new velocity. Still first order, but doesn't drift.
+	struct SemiImplicitEuler
+	{
+		static const int Evaluations = 1;
+
+		template<typename Acceleration>
+		static void XM_CALLCONV Step(Acceleration& a, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, float dt,
+			DirectX::XMVECTOR& newPos, DirectX::XMVECTOR& newVel)
+		{
+			using namespace DirectX;
+
+			auto acc = a(pos, vel, t);
+			newVel = XMVectorMultiplyAdd(acc, XMVectorReplicate(dt), vel);
+			newPos = XMVectorMultiplyAdd(newVel, XMVectorReplicate(dt), pos);
+		}
+	};
+
+	// Velocity Verlet, second order. The acceleration depends on velocity (lift, drag), so the second evaluation uses
+	// the half step velocity rather than the end one, which is not known yet.
+	struct VelocityVerlet
+	{
+		static const int Evaluations = 2;
+
+		template<typename Acceleration>
+		static void XM_CALLCONV Step(Acceleration& a, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, float dt,
+			DirectX::XMVECTOR& newPos, DirectX::XMVECTOR& newVel)
+		{
+			using namespace DirectX;
+
+			auto acc0 = a(pos, vel, t);
+			auto halfVel = XMVectorMultiplyAdd(acc0, XMVectorReplicate(0.5f * dt), vel);
+			newPos = XMVectorMultiplyAdd(halfVel, XMVectorReplicate(dt), pos);
+
+			auto acc1 = a(newPos, halfVel, t + dt);
+			newVel = XMVectorMultiplyAdd(acc1, XMVectorReplicate(0.5f * dt), halfVel);
+		}
+	};
+
+	// Classic fourth order Runge-Kutta, the same steps as Integrator::Step
+	struct RK4
+	{
+		static const int Evaluations = 4;
+
+		template<typename Acceleration>
+		static void XM_CALLCONV Step(Acceleration& a, DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, float dt,
+			DirectX::XMVECTOR& newPos, DirectX::XMVECTOR& newVel)
+		{
+			using namespace DirectX;
+
+			auto k1v = a(pos, vel, t) * dt;
+			auto k1x = vel * dt;
+
+			auto k2v = a(pos + k1x / 2.0f, vel + k1v / 2.0f, t + dt / 2.0f) * dt;
+			auto k2x = (vel + k1v / 2.0f) * dt;
+
+			auto k3v = a(pos + k2x / 2.0f, vel + k2v / 2.0f, t + dt / 2.0f) * dt;
+			auto k3x = (vel + k2v / 2.0f) * dt;
+
+			auto k4v = a(pos + k3x, vel + k3v, t + dt) * dt;
+			auto k4x = (vel + k3v) * dt;
+
+			newVel = vel + 1.0f / 6.0f * (k1v + 2.0f * k2v + 2.0f * k3v + k4v);
+			newPos = pos + 1.0f / 6.0f * (k1x + 2.0f * k2x + 2.0f * k3x + k4x);
+		}
+	};
+}
+
+/*
+Fixed step integrator with the scheme and the acceleration resolved at compile time. Acceleration is any functor (a
+lambda, usually) callable as XMVECTOR(FXMVECTOR pos, FXMVECTOR vel, float t); MakeIntegrator deduces its type.
+
+	auto integrator = MakeIntegrator<IntegrationScheme::RK4>([](FXMVECTOR pos, FXMVECTOR vel, float t) { ... }, dt);
+	integrator.Step(pos, vel, t, pos, vel);
+*/
+template<typename Scheme, typename Acceleration>
+class SchemeIntegrator
+{
+public:
+	SchemeIntegrator(const Acceleration& acceleration, float timestep)
+		: mAcceleration(acceleration), dt(timestep)
+	{
+
+	}
+
+	// newPos and newVel may alias pos and vel
+	void XM_CALLCONV Step(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, DirectX::XMVECTOR& newPos, DirectX::XMVECTOR& newVel)
+	{
+		Scheme::Step(mAcceleration, pos, vel, t, dt, newPos, newVel);
+	}
+
+	float Timestep() const { return dt; }
+
+private:
+	Acceleration mAcceleration;
+	float dt;
+};
+
+template<typename Scheme, typename Acceleration>
+SchemeIntegrator<Scheme, Acceleration> MakeIntegrator(const Acceleration& acceleration, float timestep)
+{
+	return SchemeIntegrator<Scheme, Acceleration>(acceleration, timestep);
+}
+
+/*
+Adaptive step integrator: the Dormand-Prince 5(4) embedded pair, stepping with the fifth order solution and using the
+difference to the fourth order one as the error estimate. Steps grow while the motion is smooth and shrink through hard
+manoeuvres, keeping the estimated error of every step within tolerance, relative to the size of the state (and
+absolute near zero).
+
+The last stage of a step is the first of the next one (FSAL), so an accepted step costs six evaluations of the
+acceleration, as long as the next step starts from where the previous one ended. Acceleration is a functor as for
+SchemeIntegrator; a std::function (Plane's, say) works too.
+*/
+template<typename Acceleration>
+class AdaptiveIntegrator
+{
+public:
+	AdaptiveIntegrator(const Acceleration& acceleration, float tolerance, float maxStep = 0.25f)
+		: mAcceleration(acceleration), mTolerance(tolerance), mMaxStep(maxStep), mStep(maxStep / 16.0f)
+	{
+
+	}
+
+	/*
+	Takes one step from t of at most maxStep, retrying with smaller ones until the error is within tolerance. Updates
+	pos and vel and returns the length of the step taken.
+	*/
+	float XM_CALLCONV Step(DirectX::XMVECTOR& pos, DirectX::XMVECTOR& vel, float t, float maxStep)
+	{
+		using namespace DirectX;
+
+		XMVECTOR k1v;
+		if (mFsalValid && fabsf(t - mFsalTime) <= 1e-6f * (std::max)(1.0f, fabsf(t)) && XMVector4Equal(pos, XMLoadFloat4(&mFsalPos)) && XMVector4Equal(vel, XMLoadFloat4(&mFsalVel)))
+		{
+			k1v = XMLoadFloat4(&mFsalAcc);
+		}
+		else
+		{
+			k1v = mAcceleration(pos, vel, t);
+			++mEvaluations;
+		}
+		const XMVECTOR k1x = vel;
+
+		for (;;)
+		{
+			const bool limited = maxStep < mStep;
+			const float h = limited ? maxStep : mStep;
+
+			// Stages. The derivative of the position is the velocity, so only the velocity half needs evaluating.
+			XMVECTOR k2x = vel + h * (1.0f / 5.0f * k1v);
+			XMVECTOR k2v = mAcceleration(pos + h * (1.0f / 5.0f * k1x), k2x, t + 1.0f / 5.0f * h);
+
+			XMVECTOR k3x = vel + h * (3.0f / 40.0f * k1v + 9.0f / 40.0f * k2v);
+			XMVECTOR k3v = mAcceleration(pos + h * (3.0f / 40.0f * k1x + 9.0f / 40.0f * k2x), k3x, t + 3.0f / 10.0f * h);
+
+			XMVECTOR k4x = vel + h * (44.0f / 45.0f * k1v - 56.0f / 15.0f * k2v + 32.0f / 9.0f * k3v);
+			XMVECTOR k4v = mAcceleration(pos + h * (44.0f / 45.0f * k1x - 56.0f / 15.0f * k2x + 32.0f / 9.0f * k3x), k4x,
+				t + 4.0f / 5.0f * h);
+
+			XMVECTOR k5x = vel + h * (19372.0f / 6561.0f * k1v - 25360.0f / 2187.0f * k2v + 64448.0f / 6561.0f * k3v -
+				212.0f / 729.0f * k4v);
+			XMVECTOR k5v = mAcceleration(pos + h * (19372.0f / 6561.0f * k1x - 25360.0f / 2187.0f * k2x +
+				64448.0f / 6561.0f * k3x - 212.0f / 729.0f * k4x), k5x, t + 8.0f / 9.0f * h);
+
+			XMVECTOR k6x = vel + h * (9017.0f / 3168.0f * k1v - 355.0f / 33.0f * k2v + 46732.0f / 5247.0f * k3v +
+				49.0f / 176.0f * k4v - 5103.0f / 18656.0f * k5v);
+			XMVECTOR k6v = mAcceleration(pos + h * (9017.0f / 3168.0f * k1x - 355.0f / 33.0f * k2x +
+				46732.0f / 5247.0f * k3x + 49.0f / 176.0f * k4x - 5103.0f / 18656.0f * k5x), k6x, t + h);
+
+			// Fifth order solution; its derivative at the end is the seventh stage
+			XMVECTOR newVel = vel + h * (35.0f / 384.0f * k1v + 500.0f / 1113.0f * k3v + 125.0f / 192.0f * k4v -
+				2187.0f / 6784.0f * k5v + 11.0f / 84.0f * k6v);
+			XMVECTOR newPos = pos + h * (35.0f / 384.0f * k1x + 500.0f / 1113.0f * k3x + 125.0f / 192.0f * k4x -
+				2187.0f / 6784.0f * k5x + 11.0f / 84.0f * k6x);
+			XMVECTOR k7v = mAcceleration(newPos, newVel, t + h);
+			const XMVECTOR& k7x = newVel;
+
+			mEvaluations += 6;
+
+			// Fifth minus fourth order solution
+			XMVECTOR errPos = h * (71.0f / 57600.0f * k1x - 71.0f / 16695.0f * k3x + 71.0f / 1920.0f * k4x -
+				17253.0f / 339200.0f * k5x + 22.0f / 525.0f * k6x - 1.0f / 40.0f * k7x);
+			XMVECTOR errVel = h * (71.0f / 57600.0f * k1v - 71.0f / 16695.0f * k3v + 71.0f / 1920.0f * k4v -
+				17253.0f / 339200.0f * k5v + 22.0f / 525.0f * k6v - 1.0f / 40.0f * k7v);
+
+			const float err = (std::max)(ErrorRatio(errPos, pos, newPos), ErrorRatio(errVel, vel, newVel));
+
+			// The usual controller: the error of a fifth order step scales with h^5. Grow or shrink by at most 5x.
+			const float factor = err > 0.0f ? (std::min)(5.0f, (std::max)(0.2f, 0.9f * powf(err, -0.2f))) : 5.0f;
+
+			if (err <= 1.0f || h <= mMaxStep * MIN_STEP_FRACTION)
+			{
+				// A step cut short by maxStep says nothing about how long the next one can be, unless it had to shrink anyway
+				mStep = limited ? (std::min)(mStep, h * factor) : (std::min)(mMaxStep, h * factor);
+				++mAcceptedSteps;
+
+				pos = newPos;
+				vel = newVel;
+
+				mFsalValid = true;
+				mFsalTime = t + h;
+				XMStoreFloat4(&mFsalPos, newPos);
+				XMStoreFloat4(&mFsalVel, newVel);
+				XMStoreFloat4(&mFsalAcc, k7v);
+				return h;
+			}
+
+			++mRejectedSteps;
+			mStep = (std::max)(h * factor, mMaxStep * MIN_STEP_FRACTION);
+		}
+	}
+
+	// Advances pos and vel from t by duration, in as many steps as the tolerance calls for
+	void XM_CALLCONV Advance(DirectX::XMVECTOR& pos, DirectX::XMVECTOR& vel, float t, float duration)
+	{
+		const float end = t + duration;
+		while (t < end)
+			t = EndOfStep(t, Step(pos, vel, t, end - t), end);
+	}
+
+	/*
+	Predicts the path from pos and vel at t: positions receives sampleCount positions, interval seconds apart, starting at
+	t + interval. Steps are as long as the tolerance allows, not the interval; samples in between are interpolated
+	(cubic Hermite, from the positions and velocities at both ends of the step).
+	*/
+	void XM_CALLCONV Predict(DirectX::FXMVECTOR pos, DirectX::FXMVECTOR vel, float t, float interval, std::uint32_t sampleCount,
+		std::vector<DirectX::XMFLOAT3>& positions)
+	{
+		using namespace DirectX;
+
+		positions.resize(sampleCount);
+
+		XMVECTOR p0 = pos, v0 = vel;
+		float t0 = t;
+		const float end = t + interval * sampleCount;
+
+		std::uint32_t sample = 0;
+		while (sample < sampleCount)
+		{
+			XMVECTOR p1 = p0, v1 = v0;
+			const float h = Step(p1, v1, t0, end - t0);
+			const float t1 = EndOfStep(t0, h, end);
+
+			for (; sample < sampleCount && (t + interval * (sample + 1) <= t1 || t1 >= end); ++sample)
+			{
+				const float s = (std::min)(1.0f, (t + interval * (sample + 1) - t0) / (t1 - t0));
+				const float s2 = s * s, s3 = s2 * s;
+				XMVECTOR p = (2.0f * s3 - 3.0f * s2 + 1.0f) * p0 + (s3 - 2.0f * s2 + s) * (t1 - t0) * v0 +
+					(-2.0f * s3 + 3.0f * s2) * p1 + (s3 - s2) * (t1 - t0) * v1;
+				XMStoreFloat3(&positions[sample], p);
+			}
+
+			p0 = p1;
+			v0 = v1;
+			t0 = t1;
+		}
+	}
+
+	float StepSize() const { return mStep; }
+
+	// Since construction
+	std::uint32_t Evaluations() const { return mEvaluations; }
+	std::uint32_t AcceptedSteps() const { return mAcceptedSteps; }
+	std::uint32_t RejectedSteps() const { return mRejectedSteps; }
+
+private:
+	// Steps never shrink below this fraction of the largest step, even if that means missing the tolerance
+	static constexpr float MIN_STEP_FRACTION = 1.0f / 65536.0f;
+
+	// Largest ratio of error to what the tolerance allows, over x, y and z
+	float XM_CALLCONV ErrorRatio(DirectX::FXMVECTOR err, DirectX::FXMVECTOR before, DirectX::FXMVECTOR after) const
+	{
+		using namespace DirectX;
+
+		XMVECTOR scale = XMVectorReplicate(mTolerance) * (XMVectorReplicate(1.0f) + XMVectorMax(XMVectorAbs(before), XMVectorAbs(after)));
+		XMVECTOR ratio = XMVectorAbs(err) / scale;
+		return (std::max)(XMVectorGetX(ratio), (std::max)(XMVectorGetY(ratio), XMVectorGetZ(ratio)));
+	}
+
+	// t + h, snapped to end when rounding leaves it just short, so the last step doesn't leave a sliver
+	static float EndOfStep(float t, float h, float end)
+	{
+		const float next = t + h;
+		return end - next <= 1e-6f * (std::max)(1.0f, fabsf(end)) ? end : next;
+	}
+
+	Acceleration mAcceleration;
+	float mTolerance;
+	float mMaxStep;
+	float mStep;
+
+	// First same as last: the acceleration at the end of the last step, and where that was. Reused for a step that
+	// starts from the same state; the time only has to match to rounding, Advance and Predict snap it to their end.
+	bool mFsalValid = false;
+	float mFsalTime = 0.0f;
+	DirectX::XMFLOAT4 mFsalPos;
+	DirectX::XMFLOAT4 mFsalVel;
+	DirectX::XMFLOAT4 mFsalAcc;
+
+	std::uint32_t mEvaluations = 0;
+	std::uint32_t mAcceptedSteps = 0;
+	std::uint32_t mRejectedSteps = 0;
+};
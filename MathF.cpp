@@ -120,4 +120,46 @@ DirectX::XMMATRIX Math::InverseTranspose(DirectX::CXMMATRIX M)
     return DirectX::XMMatrixTranspose(DirectX::XMMatrixInverse(&det, A));
 }
 
+DirectX::XMMATRIX Math::InterpolateTransform(DirectX::CXMMATRIX a, DirectX::CXMMATRIX b, float t)
+{
+    DirectX::XMVECTOR scaleA, rotA, transA, scaleB, rotB, transB;
+    if (!DirectX::XMMatrixDecompose(&scaleA, &rotA, &transA, a) || !DirectX::XMMatrixDecompose(&scaleB, &rotB, &transB, b))
+        return t < 0.5f ? a : b;
+
+    return DirectX::XMMatrixAffineTransformation(
+        DirectX::XMVectorLerp(scaleA, scaleB, t),
+        DirectX::XMVectorZero(),
+        DirectX::XMQuaternionSlerp(rotA, rotB, t),
+        DirectX::XMVectorLerp(transA, transB, t));
+}
+
+DirectX::XMMATRIX XM_CALLCONV Math::RigidInverse(DirectX::FXMMATRIX m)
+{
+    DirectX::XMMATRIX rotation = m;
+    rotation.r[3] = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+
+    DirectX::XMMATRIX inverse = DirectX::XMMatrixTranspose(rotation);
+    inverse.r[3] = DirectX::XMVectorSetW(DirectX::XMVectorNegate(DirectX::XMVector3TransformNormal(m.r[3], inverse)), 1.0f);
+    return inverse;
+}
+
+DirectX::XMMATRIX XM_CALLCONV Math::AffineInverse(DirectX::FXMMATRIX m)
+{
+    // The inverse of the 3x3 with rows a, b, c has columns b x c, c x a and a x b, over the determinant a . (b x c)
+    DirectX::XMVECTOR bc = DirectX::XMVector3Cross(m.r[1], m.r[2]);
+    DirectX::XMVECTOR ca = DirectX::XMVector3Cross(m.r[2], m.r[0]);
+    DirectX::XMVECTOR ab = DirectX::XMVector3Cross(m.r[0], m.r[1]);
+    DirectX::XMVECTOR invDet = DirectX::XMVectorReciprocal(DirectX::XMVector3Dot(m.r[0], bc));
+
+    DirectX::XMMATRIX columns(
+        DirectX::XMVectorMultiply(bc, invDet),
+        DirectX::XMVectorMultiply(ca, invDet),
+        DirectX::XMVectorMultiply(ab, invDet),
+        DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+
+    DirectX::XMMATRIX inverse = DirectX::XMMatrixTranspose(columns);
+    inverse.r[3] = DirectX::XMVectorSetW(DirectX::XMVectorNegate(DirectX::XMVector3TransformNormal(m.r[3], inverse)), 1.0f);
+    return inverse;
+}
+
 
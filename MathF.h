@@ -1,8 +1,10 @@
 #pragma once
 
-#include <Windows.h>
 #include <DirectXMath.h>
+#include <cfloat>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
 
 class Math
 {
@@ -58,6 +60,17 @@ public:
 
 	static DirectX::XMMATRIX InverseTranspose(DirectX::CXMMATRIX);
 
+	// Blends two affine transforms (scale, rotation, translation; no shear) t of the way from a to b, slerping the rotation
+	static DirectX::XMMATRIX InterpolateTransform(DirectX::CXMMATRIX a, DirectX::CXMMATRIX b, float t);
+
+	// Inverse of a rotation followed by a translation (a camera or rigid body; no scale): the transposed rotation and
+	// the translation undone in its frame. No determinant, unlike XMMatrixInverse.
+	static DirectX::XMMATRIX XM_CALLCONV RigidInverse(DirectX::FXMMATRIX m);
+
+	// Inverse of any affine transform (rotation, scale and translation, no projection), from the cross products of its
+	// rows. Cheaper than XMMatrixInverse, which solves for the full 4x4.
+	static DirectX::XMMATRIX XM_CALLCONV AffineInverse(DirectX::FXMMATRIX m);
+
 	static DirectX::XMFLOAT4X4 Identity4x4();
 
 	static DirectX::XMVECTOR RandUnitVec3();
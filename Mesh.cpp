@@ -1,12 +1,17 @@
 #include "Mesh.h"
 #include "Utilities.h"
 #include "FrameResource.h" // for Vertex
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshClusters.h"
+#include "MeshSimplifier.h"
+#include "MeshChunker.h"
 
 #include <iostream>
-#include <map>
 #include <vector>
+#include <chrono>
 
-#include <limits> // std::numeric_limits
+#include <cstring> // memcpy, memcmp
 
 using namespace std;
 using namespace DirectX;
@@ -32,202 +37,587 @@ D3D12_VERTEX_BUFFER_VIEW Mesh::VertexBufferView() const
     return vbv;
 }
 
+UINT Mesh::IndexAt(UINT location) const
+{
+    if (IndexFormat == DXGI_FORMAT_R32_UINT)
+        return static_cast<const std::uint32_t*>(IndexBufferCPU->GetBufferPointer())[location];
+
+    return static_cast<const std::uint16_t*>(IndexBufferCPU->GetBufferPointer())[location];
+}
+
+XMVECTOR Mesh::PositionAt(UINT vertex, const VertexQuantization& quantization) const
+{
+    if (VertexFormat == VERTEX_FORMAT::PACKED)
+        return VertexPacking::UnpackPosition(static_cast<const PackedVertex*>(VertexBufferCPU->GetBufferPointer())[vertex], quantization);
+
+    return XMLoadFloat3(&static_cast<const Vertex*>(VertexBufferCPU->GetBufferPointer())[vertex].Pos);
+}
+
+// Lives here rather than in TriangleBvh.cpp, which then builds without Mesh and D3D (see Headless/CMakeLists.txt)
+void TriangleBvh::Add(const Mesh& mesh, const SubmeshGeometry& submesh, FXMMATRIX world)
+{
+    for (UINT i = 0; i + 2 < submesh.IndexCount; i += 3)
+    {
+        XMVECTOR v[3];
+        for (UINT k = 0; k < 3; ++k)
+        {
+            UINT vertex = submesh.BaseVertexLocation + mesh.IndexAt(submesh.StartIndexLocation + i + k);
+            v[k] = XMVector3TransformCoord(mesh.PositionAt(vertex, submesh.Quantization), world);
+        }
+        Add(v[0], v[1], v[2]);
+    }
+}
+
+const TriangleBvh* Mesh::Bvh(const SubmeshGeometry& submesh) const
+{
+    return submesh.BvhIndex >= 0 ? &Bvhs[submesh.BvhIndex] : nullptr;
+}
+
+void Mesh::BuildBvhs()
+{
+    Bvhs.clear();
+    for (auto& kv : DrawArgs)
+    {
+        auto& sg = kv.second;
+        sg.BvhIndex = -1;
+        if (sg.LodLevel > 0 || sg.IndexCount == 0)
+            continue;
+
+        TriangleBvh bvh;
+        bvh.Add(*this, sg);
+        bvh.Build();
+
+        sg.BvhIndex = static_cast<INT>(Bvhs.size());
+        Bvhs.push_back(move(bvh));
+    }
+}
+
+void Mesh::VisibleRanges(const SubmeshGeometry& submesh, const BoundingFrustum& frustum, FXMVECTOR eye,
+    bool backfaceCulling, vector<IndexRange>& visible) const
+{
+    // The box is tighter than the cluster spheres put together, and rejects the whole lot in one test
+    if (frustum.Contains(submesh.Bounds) == DISJOINT)
+        return;
+
+    if (submesh.ClusterCount == 0)
+    {
+        IndexRange range;
+        range.StartIndexLocation = submesh.StartIndexLocation;
+        range.IndexCount = submesh.IndexCount;
+        visible.push_back(range);
+        return;
+    }
+
+    MeshClusters::Cull(Clusters.data() + submesh.FirstCluster, submesh.ClusterCount, frustum, eye, backfaceCulling, visible);
+}
+
+string Mesh::LodName(const string& submesh, UINT lod)
+{
+    return lod == 0 ? submesh : submesh + "_LOD" + to_string(lod);
+}
+
+string Mesh::ChunkName(const string& submesh, UINT chunk)
+{
+    return submesh + "_CHUNK" + to_string(chunk);
+}
+
 void Mesh::DisposeUploaders()
 {
     VertexBufferUploader = nullptr;
     IndexBufferUploader = nullptr;
 }
 
+namespace
+{
+    /*
+    Layout of a .fmesh file:
+
+        FMeshHeader
+        FMeshSubmesh table, each record followed by its name (NameLength chars, padded to 4 bytes)
+        FMeshCluster table (ClusterCount records)
+        vertex blob (VertexBufferByteSize bytes, Vertex or PackedVertex layout, see VertexFormat)
+        index blob (IndexBufferByteSize bytes, IndexFormat, R16_UINT or R32_UINT)
+
+    Everything is stored exactly as it goes to the GPU, so loading is a matter of pointing into the mapped file.
+    Bump FMESH_VERSION whenever any of this, or the Vertex/PackedVertex structs, change.
+    */
+    const char FMESH_MAGIC[4] = { 'F', 'M', 'S', 'H' };
+    const UINT FMESH_VERSION = 4;
+
+    struct FMeshHeader
+    {
+        char Magic[4];
+        UINT Version;
+        std::uint64_t SourceHash;
+
+        UINT VertexFormat;
+        UINT VertexByteStride;
+        UINT VertexBufferByteSize;
+        UINT IndexFormat;
+        UINT IndexBufferByteSize;
+
+        UINT SubmeshCount;
+        UINT SubmeshOffset;
+        UINT VertexOffset;
+        UINT IndexOffset;
+        UINT ClusterCount;
+        UINT ClusterOffset;
+        UINT Reserved;
+    };
+
+    struct FMeshSubmesh
+    {
+        UINT IndexCount;
+        UINT StartIndexLocation;
+        INT BaseVertexLocation;
+        XMFLOAT3 BoundsCenter;
+        XMFLOAT3 BoundsExtents;
+        VertexQuantization Quantization;
+        UINT FirstCluster;
+        UINT ClusterCount;
+        UINT LodLevel;
+        UINT LodCount;
+        float LodError;
+        UINT NameLength;
+    };
+
+    struct FMeshCluster
+    {
+        UINT StartIndexLocation;
+        UINT IndexCount;
+        XMFLOAT3 BoundsCenter;
+        float BoundsRadius;
+        XMFLOAT3 ConeAxis;
+        float ConeCutoff;
+    };
+
+    static_assert(sizeof(FMeshHeader) == 64, "FMeshHeader layout changed, bump FMESH_VERSION");
+    static_assert(sizeof(FMeshSubmesh) == 108, "FMeshSubmesh layout changed, bump FMESH_VERSION");
+    static_assert(sizeof(FMeshCluster) == 40, "FMeshCluster layout changed, bump FMESH_VERSION");
+
+    UINT VertexStride(VERTEX_FORMAT format)
+    {
+        return format == VERTEX_FORMAT::PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+
+    UINT Align4(UINT size)
+    {
+        return (size + 3) & ~3u;
+    }
+
+    // 64-bit FNV-1a. Only used to notice that a source file changed, so it does not need to be strong.
+    std::uint64_t HashBytes(const char* data, size_t size)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ull;
+        }
+
+        // 0 means "don't care" to LoadFMesh
+        return hash ? hash : 1;
+    }
+}
+
 /*
 Loads a mesh from an OBJ file, including submeshes. 
 
+The parsed result is cached in a .fmesh file next to the OBJ, tagged with a hash of the OBJ contents and the build
+options. As long as neither changes we load that instead, which skips the parsing (and optimizing) entirely.
+
 Returns an integer less than 0 on failure. Returns 0 for success.
 */
-int Mesh::LoadOBJ(wstring filename)
+int Mesh::LoadOBJ(wstring filename, OBJ_LOAD_MODE mode, MESH_OPTIMIZATION optimization, VERTEX_FORMAT format, UINT lodCount,
+    UINT chunkTriangles)
 {
     assert(mD3Device);
     assert(mCommandList);
 
-    vector<XMFLOAT3> positions;
-    vector<XMFLOAT2> texcoords;
-    vector<XMFLOAT3> normals;
-    map<string, int> verts_added;
-    float boundingRadius = 0.0f;
-    
-    float maxX = (std::numeric_limits<float>::lowest)(), maxY = (std::numeric_limits<float>::lowest)(), maxZ = (std::numeric_limits<float>::lowest)(),
-        minX = (std::numeric_limits<float>::max)(), minY = (std::numeric_limits<float>::max)(), minZ = (std::numeric_limits<float>::max)();
-    
-    vector<uint16_t> indices;
+    const wstring cacheName = filename.substr(0, filename.find_last_of(L'.')) + L".fmesh";
+
+    std::uint64_t sourceHash = 0;
+    {
+        MappedFile source(filename);
+        if (!source.Data())
+            return -1;
+
+        sourceHash = HashBytes(source.Data(), source.Size());
+    }
+
+    // The same source optimized or encoded differently is a different mesh
+    sourceHash = sourceHash * 1099511628211ull + (std::uint64_t)optimization;
+    sourceHash = sourceHash * 1099511628211ull + (std::uint64_t)format;
+    sourceHash = sourceHash * 1099511628211ull + (std::uint64_t)lodCount;
+    sourceHash = sourceHash * 1099511628211ull + (std::uint64_t)chunkTriangles;
+
+    if (LoadFMesh(cacheName, sourceHash) == 0)
+        return 0;
+
     vector<Vertex> vertices;
+    vector<uint32_t> indices;
+    int result = ParseOBJ(filename, mode, vertices, indices);
+    if (result < 0)
+        return result;
+
+    // Before optimizing, which then orders the triangles of every chunk for the cache on its own
+    MeshChunker::Split(vertices, indices, DrawArgs, chunkTriangles);
+
+    MeshOptimizer::Optimize(vertices, indices, DrawArgs, optimization);
+
+    // After optimizing: LODs index the vertices where OptimizeVertexFetch left them
+    MeshSimplifier::BuildLods(vertices, indices, DrawArgs, lodCount);
+
+    // After optimizing: clusters are grown in the order the triangles end up in, and must not be reordered afterwards
+    MeshClusters::Build(vertices, indices, DrawArgs, Clusters);
+
+    // We gots verts and indices, only remains to create & fill buffers
+    CreateBuffers(mD3Device.Get(), mCommandList.Get(), vertices, indices, format);
+
+    // Not being able to write the cache is no reason to fail the load
+    if (SaveFMesh(cacheName, sourceHash) < 0)
+        OutputDebugStringA("LoadOBJ: could not write mesh cache\n");
+
+    return result;
+}
 
-    UINT posOffset = 0;
-    UINT texOffset = 0;
-    UINT normOffset = 0;
-    UINT vertexOffset = 0;
+/*
+Parses an OBJ file into CPU side arrays and fills out DrawArgs, without creating any buffers (so no device needed).
+Indices are 32-bit and relative to the BaseVertexLocation of their submesh, ready for CreateBuffers. The parsing itself
+is ObjParser's; every object becomes a submesh.
 
-    string lastObject = "";
+Returns an integer less than 0 on failure. Returns 0 for success.
+*/
+int Mesh::ParseOBJ(const wstring& filename, OBJ_LOAD_MODE mode, vector<Vertex>& vertices, vector<uint32_t>& indices)
+{
+    vertices.clear();
+    indices.clear();
 
-    string line;
-    ifstream obj(filename);
-    if (!obj.is_open())
+    MappedFile file(filename);
+    if (!file.Data())
         return -1;
 
-    OutputDebugStringA("\n");
-    while (getline(obj, line))
-    {
-        OutputDebugStringA(line.c_str());
-        OutputDebugStringA("\n");
-        
-        /*
-        We skip:
-        '#': comment
-        'm': mttlib
-        's': something about smoothing
-        'u': usemtl
-
-        We process:
-        'v': vertex position
-        'vt': vertex texture coord
-        'vn': vertex normal
-        'f': face indices
-        'o': object name
-        */
-        switch (line[0])
-        {
-        case 'v':
-        case 'vt':
-        case 'vn':
-        case 'f':
-        case 'o':
-            break;
-        default:
-            continue; 
-        }
-        
-        auto tokens = split(line, ' ');
-        // Create new object
-        if (tokens[0] == "o")
-        {
-            auto currObject = tokens[1];
-            
-            // Store & update previous object
-            if (lastObject != "")
-            {
-                // Update last objects indexcount since we now know how many indices it has
-                DrawArgs[lastObject].IndexCount = (UINT)indices.size() - DrawArgs[lastObject].IndexCount;
-
-                // Fill out bounding box
-                XMVECTOR pt1{ minX, minY, minZ };
-                XMVECTOR pt2{ maxX, maxY, maxZ };
-                BoundingBox::CreateFromPoints(DrawArgs[lastObject].Bounds, pt1, pt2);
-
-                maxX = (std::numeric_limits<float>::lowest)(), maxY = (std::numeric_limits<float>::lowest)(), maxZ = (std::numeric_limits<float>::lowest)();
-                minX = (std::numeric_limits<float>::max)(), minY = (std::numeric_limits<float>::max)(), minZ = (std::numeric_limits<float>::max)();
-            }
-
-            SubmeshGeometry sg;
-            sg.BaseVertexLocation = 0;// vertices.size();
-            sg.StartIndexLocation = (UINT)indices.size();
-            sg.IndexCount = (UINT)indices.size(); // must be set at end of object read
-            
-            DrawArgs[currObject] = sg;
-            lastObject = currObject;
-        }
+    vector<ObjObject> objects;
+    int result = ObjParser::Parse(file.Data(), file.Data() + file.Size(), mode, vertices, indices, objects);
+    if (result < 0)
+        return result;
+
+    for (auto& object : objects)
+    {
+        SubmeshGeometry sg;
+        sg.IndexCount = object.IndexCount;
+        sg.StartIndexLocation = object.StartIndexLocation;
+        sg.BaseVertexLocation = (INT)object.BaseVertexLocation;
+
+        if (object.BoundsMin.x <= object.BoundsMax.x)
+            BoundingBox::CreateFromPoints(sg.Bounds, XMLoadFloat3(&object.BoundsMin), XMLoadFloat3(&object.BoundsMax));
+
+        DrawArgs[object.Name] = sg;
+    }
+
+    return 0;
+}
+
+/*
+Loads a mesh written by SaveFMesh. The file is mapped and its blobs are copied straight into the buffers.
+
+Returns -1 if the file can't be opened, -2 if it is not a valid .fmesh of the current version,
+-3 if it was built from a different source (hash mismatch). Returns 0 for success.
+*/
+int Mesh::LoadFMesh(const wstring& filename, std::uint64_t sourceHash)
+{
+    assert(mD3Device);
+    assert(mCommandList);
+
+    auto startTime = chrono::high_resolution_clock::now();
+
+    MappedFile file(filename);
+    if (!file.Data())
+        return -1;
+
+    const char* data = file.Data();
+    const size_t size = file.Size();
+
+    if (size < sizeof(FMeshHeader))
+        return -2;
+
+    FMeshHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.Magic, FMESH_MAGIC, sizeof(FMESH_MAGIC)) != 0 || header.Version != FMESH_VERSION)
+        return -2;
 
-            
-        // Vertex position. These come first, so we create a new vertex
-        if (tokens[0] == "v")
+    if ((header.VertexFormat != (UINT)VERTEX_FORMAT::FLOAT && header.VertexFormat != (UINT)VERTEX_FORMAT::PACKED) ||
+        header.VertexByteStride != VertexStride((VERTEX_FORMAT)header.VertexFormat) ||
+        (header.IndexFormat != DXGI_FORMAT_R16_UINT && header.IndexFormat != DXGI_FORMAT_R32_UINT))
+        return -2;
+
+    // Guard against truncated files
+    if ((size_t)header.VertexOffset + header.VertexBufferByteSize > size ||
+        (size_t)header.IndexOffset + header.IndexBufferByteSize > size ||
+        header.SubmeshOffset > size ||
+        (size_t)header.ClusterOffset + (size_t)header.ClusterCount * sizeof(FMeshCluster) > size)
+        return -2;
+
+    if (sourceHash && header.SourceHash != sourceHash)
+        return -3;
+
+    // Draw ranges must stay inside the blobs; the GPU would read past the buffers otherwise
+    const size_t vertexCount = header.VertexBufferByteSize / header.VertexByteStride;
+    const size_t indexCount = header.IndexBufferByteSize / (header.IndexFormat == DXGI_FORMAT_R32_UINT ? 4u : 2u);
+
+    // Read the submesh table before touching any state, so a bad file leaves the mesh as it was
+    unordered_map<string, SubmeshGeometry> drawArgs;
+
+    size_t offset = header.SubmeshOffset;
+    for (UINT i = 0; i < header.SubmeshCount; ++i)
+    {
+        FMeshSubmesh record;
+        if (offset + sizeof(record) > size)
+            return -2;
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (offset + record.NameLength > size)
+            return -2;
+        string name(data + offset, record.NameLength);
+        offset += Align4(record.NameLength);
+
+        SubmeshGeometry sg;
+        sg.IndexCount = record.IndexCount;
+        sg.StartIndexLocation = record.StartIndexLocation;
+        sg.BaseVertexLocation = record.BaseVertexLocation;
+        sg.Bounds.Center = record.BoundsCenter;
+        sg.Bounds.Extents = record.BoundsExtents;
+        sg.Quantization = record.Quantization;
+        sg.FirstCluster = record.FirstCluster;
+        sg.ClusterCount = record.ClusterCount;
+        sg.LodLevel = record.LodLevel;
+        sg.LodCount = record.LodCount;
+        sg.LodError = record.LodError;
+
+        if ((size_t)sg.FirstCluster + sg.ClusterCount > header.ClusterCount ||
+            (size_t)sg.StartIndexLocation + sg.IndexCount > indexCount ||
+            sg.BaseVertexLocation < 0 || (size_t)sg.BaseVertexLocation > vertexCount)
+            return -2;
+
+        drawArgs[name] = sg;
+    }
+
+    vector<MeshCluster> clusters(header.ClusterCount);
+    for (UINT i = 0; i < header.ClusterCount; ++i)
+    {
+        FMeshCluster record;
+        memcpy(&record, data + header.ClusterOffset + i * sizeof(FMeshCluster), sizeof(record));
+
+        if ((size_t)record.StartIndexLocation + record.IndexCount > indexCount)
+            return -2;
+
+        auto& c = clusters[i];
+        c.StartIndexLocation = record.StartIndexLocation;
+        c.IndexCount = record.IndexCount;
+        c.Bounds.Center = record.BoundsCenter;
+        c.Bounds.Radius = record.BoundsRadius;
+        c.ConeAxis = record.ConeAxis;
+        c.ConeCutoff = record.ConeCutoff;
+    }
+
+    for (auto& kv : drawArgs)
+        DrawArgs[kv.first] = kv.second;
+    Clusters = move(clusters);
+
+    UploadBuffers(mD3Device.Get(), mCommandList.Get(), (VERTEX_FORMAT)header.VertexFormat,
+        data + header.VertexOffset, header.VertexBufferByteSize, data + header.IndexOffset, header.IndexBufferByteSize, (DXGI_FORMAT)header.IndexFormat);
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+    char msg[256];
+    sprintf_s(msg, "LoadFMesh: %u submeshes, %u vertices, %u indices in %.2f ms\n",
+        header.SubmeshCount, (UINT)vertexCount, (UINT)indexCount, elapsed * 1000.0);
+    OutputDebugStringA(msg);
+
+    return 0;
+}
+
+/*
+Writes the CPU copies of the buffers and the submesh table to a .fmesh file.
+
+Returns -1 if there is nothing to write, -2 if the file can't be written. Returns 0 for success.
+*/
+int Mesh::SaveFMesh(const wstring& filename, std::uint64_t sourceHash) const
+{
+    if (!VertexBufferCPU || !IndexBufferCPU)
+        return -1;
+
+    // Submesh table first, it determines where the blobs go
+    vector<char> table;
+    for (auto& kv : DrawArgs)
+    {
+        FMeshSubmesh record;
+        record.IndexCount = kv.second.IndexCount;
+        record.StartIndexLocation = kv.second.StartIndexLocation;
+        record.BaseVertexLocation = kv.second.BaseVertexLocation;
+        record.BoundsCenter = kv.second.Bounds.Center;
+        record.BoundsExtents = kv.second.Bounds.Extents;
+        record.Quantization = kv.second.Quantization;
+        record.FirstCluster = kv.second.FirstCluster;
+        record.ClusterCount = kv.second.ClusterCount;
+        record.LodLevel = kv.second.LodLevel;
+        record.LodCount = kv.second.LodCount;
+        record.LodError = kv.second.LodError;
+        record.NameLength = (UINT)kv.first.size();
+
+        const char* bytes = reinterpret_cast<const char*>(&record);
+        table.insert(table.end(), bytes, bytes + sizeof(record));
+        table.insert(table.end(), kv.first.begin(), kv.first.end());
+        table.resize(Align4((UINT)table.size()), 0);
+    }
+
+    vector<FMeshCluster> clusters(Clusters.size());
+    for (size_t i = 0; i < Clusters.size(); ++i)
+    {
+        auto& c = Clusters[i];
+        clusters[i].StartIndexLocation = c.StartIndexLocation;
+        clusters[i].IndexCount = c.IndexCount;
+        clusters[i].BoundsCenter = c.Bounds.Center;
+        clusters[i].BoundsRadius = c.Bounds.Radius;
+        clusters[i].ConeAxis = c.ConeAxis;
+        clusters[i].ConeCutoff = c.ConeCutoff;
+    }
+
+    FMeshHeader header = {};
+    memcpy(header.Magic, FMESH_MAGIC, sizeof(FMESH_MAGIC));
+    header.Version = FMESH_VERSION;
+    header.SourceHash = sourceHash;
+    header.VertexFormat = (UINT)VertexFormat;
+    header.VertexByteStride = VertexByteStride;
+    header.VertexBufferByteSize = VertexBufferByteSize;
+    header.IndexFormat = (UINT)IndexFormat;
+    header.IndexBufferByteSize = IndexBufferByteSize;
+    header.SubmeshCount = (UINT)DrawArgs.size();
+    header.SubmeshOffset = sizeof(FMeshHeader);
+    header.ClusterCount = (UINT)clusters.size();
+    header.ClusterOffset = header.SubmeshOffset + (UINT)table.size();
+    header.VertexOffset = header.ClusterOffset + header.ClusterCount * sizeof(FMeshCluster);
+    header.IndexOffset = header.VertexOffset + Align4(VertexBufferByteSize);
+
+    ofstream out(filename, ios::binary | ios::trunc);
+    if (!out.is_open())
+        return -2;
+
+    const char padding[4] = {};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(table.data(), table.size());
+    out.write(reinterpret_cast<const char*>(clusters.data()), clusters.size() * sizeof(FMeshCluster));
+    out.write(static_cast<const char*>(VertexBufferCPU->GetBufferPointer()), VertexBufferByteSize);
+    out.write(padding, Align4(VertexBufferByteSize) - VertexBufferByteSize);
+    out.write(static_cast<const char*>(IndexBufferCPU->GetBufferPointer()), IndexBufferByteSize);
+
+    return out.good() ? 0 : -2;
+}
+
+void Mesh::CreateBuffers(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+    const vector<Vertex>& vertices, vector<uint32_t>& indices, VERTEX_FORMAT format)
+{
+    // Encode before the index rebasing below; the encoding only depends on which submesh owns which vertex
+    vector<PackedVertex> packed;
+    const void* vertexData = vertices.data();
+    if (format == VERTEX_FORMAT::PACKED)
+    {
+        VertexPacking::Pack(vertices, indices, DrawArgs, packed);
+        vertexData = packed.data();
+    }
+
+    const UINT vbByteSize = (UINT)vertices.size() * VertexStride(format);
+
+    // Find the range of vertices each submesh uses; if any of them spans more than 16 bits can address we need 32-bit indices
+    struct Range
+    {
+        SubmeshGeometry* Submesh;
+        uint32_t Min, Max;
+    };
+
+    vector<Range> ranges;
+    bool fits16 = true;
+    for (auto& kv : DrawArgs)
+    {
+        auto& sg = kv.second;
+        if (sg.IndexCount == 0)
+            continue;
+
+        Range r = { &sg, UINT32_MAX, 0 };
+        for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
         {
-            auto x = (float)::atof(tokens[1].c_str());
-            auto y = (float)::atof(tokens[2].c_str());
-            auto z = (float)::atof(tokens[3].c_str());
-
-            if (x < minX)
-                minX = x;
-            if (x > maxX)
-                maxX = x;
-            if (y < minY)
-                minY = y;
-            if (y > maxY)
-                maxY = y;
-            if (z < minZ)
-                minZ = z;
-            if (z > maxZ)
-                maxZ = z;
-
-            positions.push_back(DirectX::XMFLOAT3(x, y, z));
+            r.Min = (std::min)(r.Min, indices[i]);
+            r.Max = (std::max)(r.Max, indices[i]);
         }
-        // Texture coordinate. All vertices constructed
-        else if (tokens[0] == "vt")
-            texcoords.push_back(XMFLOAT2((float)::atof(tokens[1].c_str()), (float)::atof(tokens[2].c_str())));
-        else if (tokens[0] == "vn")
-            normals.push_back(XMFLOAT3((float)::atof(tokens[1].c_str()), (float)::atof(tokens[2].c_str()), (float)::atof(tokens[3].c_str())));
-        else if (tokens[0] == "f")
+
+        if (r.Max - r.Min > UINT16_MAX)
+            fits16 = false;
+
+        ranges.push_back(r);
+    }
+
+    // No submeshes means the indices address the whole buffer
+    if (ranges.empty())
+    {
+        for (auto idx : indices)
         {
-            // At this point we have collected all necessary data to index. So we can finish constructing the vertices and the indices.
-
-            // Face indices are 1-based in OBJ files
-            // tokens now contains faces of the form vertex_idx / texture_idx / normal_idx 
-            // we ASSUME both texture/normals are exported for now
-                
-            // there are 4 tokens - one is "f", then assuming a triangulated mesh there are 3 others with the indices
-            for (size_t i = 1; i < tokens.size(); ++i)
-            {
-                // Check if we already have this vertex
-                int vertex_id = -1;
-                if (verts_added.count(tokens[i]))
-                    vertex_id = verts_added[tokens[i]];
-                else
-                {
-                    // Construct vertex
-                    auto inds = split(tokens[i], '/');
-                    
-                    Vertex v;
-                    v.Pos = positions[::atoi(inds[0].c_str()) - 1];
-                    v.TexC = texcoords[::atoi(inds[1].c_str()) - 1];
-                    v.Normal = normals[::atoi(inds[2].c_str()) - 1];
-
-                    // Register that we have added it, with its index into the vertex array
-                    verts_added[tokens[i]] = (int)vertices.size();
-                    vertex_id = (int)vertices.size();
-                    vertices.push_back(v);
-                }
-
-                // Now we have the vertex, so add it to the index buffer
-                indices.push_back(vertex_id);
-            }
+            if (idx > UINT16_MAX)
+                fits16 = false;
         }
     }
 
-    // End of file - fix the index count in the last object
-    DrawArgs[lastObject].IndexCount = (UINT)indices.size() - DrawArgs[lastObject].IndexCount;
+    if (!fits16)
+    {
+        UploadBuffers(device, cmdList, format, vertexData, vbByteSize,
+            indices.data(), (UINT)indices.size() * sizeof(uint32_t), DXGI_FORMAT_R32_UINT);
+        return;
+    }
 
-    // Fill out bounding box
-    XMVECTOR pt1{ minX, minY, minZ };
-    XMVECTOR pt2{ maxX, maxY, maxZ };
-    BoundingBox::CreateFromPoints(DrawArgs[lastObject].Bounds, pt1, pt2);
+    // Submeshes that reach past 16 bits get their BaseVertexLocation moved up to their first vertex instead
+    for (auto& r : ranges)
+    {
+        if (r.Max <= UINT16_MAX)
+            continue;
 
-    // Aaand close out
-    obj.close();
-    
-    // We gots verts and indices, only remains to create & fill buffers
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+        auto& sg = *r.Submesh;
+        for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
+            indices[i] -= r.Min;
+        sg.BaseVertexLocation += (INT)r.Min;
+    }
+
+    // Narrow straight into the CPU copy; UploadBuffers then uploads from there
     const UINT ibByteSize = (UINT)indices.size() * sizeof(uint16_t);
+    ThrowIfFailed(D3DCreateBlob(ibByteSize, &IndexBufferCPU));
+    copy(indices.begin(), indices.end(), (uint16_t*)IndexBufferCPU->GetBufferPointer());
 
+    UploadBuffers(device, cmdList, format, vertexData, vbByteSize,
+        IndexBufferCPU->GetBufferPointer(), ibByteSize, DXGI_FORMAT_R16_UINT);
+}
+
+void Mesh::UploadBuffers(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, VERTEX_FORMAT vertexFormat,
+    const void* vertexData, UINT vbByteSize, const void* indexData, UINT ibByteSize, DXGI_FORMAT indexFormat)
+{
     ThrowIfFailed(D3DCreateBlob(vbByteSize, &VertexBufferCPU));
-    CopyMemory(VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+    CopyMemory(VertexBufferCPU->GetBufferPointer(), vertexData, vbByteSize);
 
-    ThrowIfFailed(D3DCreateBlob(ibByteSize, &IndexBufferCPU));
-    CopyMemory(IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+    if (!IndexBufferCPU || indexData != IndexBufferCPU->GetBufferPointer())
+    {
+        ThrowIfFailed(D3DCreateBlob(ibByteSize, &IndexBufferCPU));
+        CopyMemory(IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
+    }
 
-    VertexBufferGPU = Utilities::CreateDefaultBuffer(mD3Device.Get(), mCommandList.Get(), vertices.data(), vbByteSize, VertexBufferUploader);
-    IndexBufferGPU = Utilities::CreateDefaultBuffer(mD3Device.Get(), mCommandList.Get(), indices.data(), ibByteSize, IndexBufferUploader);
+    // The CPU copies are the upload source, so the data is only read from one place
+    VertexBufferGPU = Utilities::CreateDefaultBuffer(device, cmdList, VertexBufferCPU->GetBufferPointer(), vbByteSize, VertexBufferUploader);
+    IndexBufferGPU = Utilities::CreateDefaultBuffer(device, cmdList, IndexBufferCPU->GetBufferPointer(), ibByteSize, IndexBufferUploader);
 
-    VertexByteStride = sizeof(Vertex);
+    VertexFormat = vertexFormat;
+    VertexByteStride = VertexStride(vertexFormat);
     VertexBufferByteSize = vbByteSize;
-    IndexFormat = DXGI_FORMAT_R16_UINT;
+    IndexFormat = indexFormat;
     IndexBufferByteSize = ibByteSize;
 
-    // Success
-    return 0;
-}
\ No newline at end of file
+    // Read through IndexAt and PositionAt, so only once the CPU copies and the formats are in place
+    BuildBvhs();
+}
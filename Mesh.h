@@ -1,6 +1,25 @@
 #pragma once
 
 #include "Utilities.h"
+#include "ObjParser.h"
+#include "TriangleBvh.h"
+
+struct Vertex; // FrameResource.h
+
+/*
+Maps the unorm16 fields of a PackedVertex back to object space: pos = PosOffset + PosScale * unorm(q), same for TexC.
+The layout matches cbQuantization in Common.hlsl, so it goes to the shader as root constants unchanged.
+The defaults are the identity, which is also what float vertices are drawn with.
+*/
+struct VertexQuantization
+{
+    DirectX::XMFLOAT3 PosOffset = { 0.0f, 0.0f, 0.0f };
+    float qpad0 = 0.0f;
+    DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+    float qpad1 = 0.0f;
+    DirectX::XMFLOAT2 TexOffset = { 0.0f, 0.0f };
+    DirectX::XMFLOAT2 TexScale = { 1.0f, 1.0f };
+};
 
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
 // geometries are stored in one vertex and index buffer.  It provides the offsets
@@ -14,6 +33,67 @@ struct SubmeshGeometry
 
     // Bounding box of the geometry defined by this submesh. 
     DirectX::BoundingBox Bounds;
+
+    // Decoding constants for the vertices of this submesh, if the mesh is VERTEX_FORMAT::PACKED
+    VertexQuantization Quantization;
+
+    // This submesh's range in Mesh::Clusters. ClusterCount is 0 if the mesh was not clustered.
+    UINT FirstCluster = 0;
+    UINT ClusterCount = 0;
+
+    // Levels of detail (see MeshSimplifier). A full resolution submesh has LodLevel 0 and LodCount coarser versions of
+    // itself in DrawArgs, named Mesh::LodName(name, 1..LodCount). Those have their LodLevel set, and LodError estimates
+    // how far (in object space) their surface is from the full resolution one.
+    UINT LodLevel = 0;
+    UINT LodCount = 0;
+    float LodError = 0.0f;
+
+    // This submesh's triangle BVH in Mesh::Bvhs, for ray queries; -1 if it has none (levels of detail don't)
+    INT BvhIndex = -1;
+};
+
+/*
+A small run of spatially close triangles within a submesh (see MeshClusters), with what it takes to cull it on its own.
+Its index range lies within the submesh's, so it draws with the submesh's BaseVertexLocation.
+*/
+struct MeshCluster
+{
+    UINT StartIndexLocation = 0;
+    UINT IndexCount = 0;
+
+    // Object space
+    DirectX::BoundingSphere Bounds;
+
+    // Every triangle's (geometric) normal lies within the cone around ConeAxis whose half angle has sine ConeCutoff.
+    // A cutoff of 1 means the triangles face too many ways for the cone to ever cull anything.
+    DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+    float ConeCutoff = 1.0f;
+};
+
+// A run of indices to draw, as passed to DrawIndexedInstanced
+struct IndexRange
+{
+    UINT StartIndexLocation = 0;
+    UINT IndexCount = 0;
+};
+
+// Optional post-processing LoadOBJ can apply to the parsed geometry, see MeshOptimizer
+enum class MESH_OPTIMIZATION
+{
+    NONE,
+    // Reorder triangles for the post-transform vertex cache, then vertices for fetch locality
+    VERTEX_CACHE,
+    // As VERTEX_CACHE, but also order triangle clusters so outward facing ones are drawn first (less overdraw)
+    VERTEX_CACHE_AND_OVERDRAW
+};
+
+// Layout of the vertex buffer
+enum class VERTEX_FORMAT
+{
+    // Vertex, 32 bytes
+    FLOAT,
+    // PackedVertex, 16 bytes. Positions and UVs are quantized per submesh, normals octahedral encoded; see VertexPacking
+    PACKED
 };
 
 class Mesh
@@ -40,6 +120,7 @@ public:
     Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
     // Data about the buffers.
+    VERTEX_FORMAT VertexFormat = VERTEX_FORMAT::FLOAT;
     UINT VertexByteStride = 0;
     UINT VertexBufferByteSize = 0;
     DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -50,16 +131,83 @@ public:
     // the Submeshes individually.
     std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
+    // Triangle clusters of all submeshes, see SubmeshGeometry::FirstCluster
+    std::vector<MeshCluster> Clusters;
+
+    // Triangle BVHs of the full resolution submeshes, see SubmeshGeometry::BvhIndex
+    std::vector<TriangleBvh> Bvhs;
+
     D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const;
 
     D3D12_INDEX_BUFFER_VIEW IndexBufferView()const;
 
+    // Reads an index from the CPU copy of the index buffer, whatever the index format
+    UINT IndexAt(UINT location) const;
+
+    // Reads a vertex position from the CPU copy of the vertex buffer, decoding it if the mesh is packed.
+    // quantization is that of the submesh the vertex belongs to.
+    DirectX::XMVECTOR PositionAt(UINT vertex, const VertexQuantization& quantization) const;
+
+    // The BVH of submesh, in object space; null if it has none
+    const TriangleBvh* Bvh(const SubmeshGeometry& submesh) const;
+
+    // (Re)builds Bvhs from the CPU copies of the buffers. Done whenever the buffers are created or loaded.
+    void BuildBvhs();
+
+    /*
+    Appends the index ranges of submesh that may be visible to visible. frustum and eye are in the object space of the
+    mesh. With backfaceCulling, clusters whose triangles all face away from eye are dropped as well. Submeshes without
+    clusters are tested as a whole, against their Bounds.
+    */
+    void VisibleRanges(const SubmeshGeometry& submesh, const DirectX::BoundingFrustum& frustum, DirectX::FXMVECTOR eye,
+        bool backfaceCulling, std::vector<IndexRange>& visible) const;
+
     // We can free this memory after we finish upload to the GPU.
     void DisposeUploaders();
 
-    int LoadOBJ(std::wstring filename);
+    // Loads an OBJ file, splits submeshes of more than chunkTriangles triangles into spatial chunks (0 keeps them
+    // whole), adds up to lodCount simplified versions of every submesh and splits them all into clusters.
+    // Goes through a compiled .fmesh next to the source file when it is up to date, and (re)writes that cache after
+    // parsing when it is not.
+    int LoadOBJ(std::wstring filename, OBJ_LOAD_MODE mode = OBJ_LOAD_MODE::SERIAL,
+        MESH_OPTIMIZATION optimization = MESH_OPTIMIZATION::NONE, VERTEX_FORMAT format = VERTEX_FORMAT::FLOAT,
+        UINT lodCount = 0, UINT chunkTriangles = 0);
+
+    // DrawArgs name of level of detail lod of submesh. Level 0 is the submesh itself.
+    static std::string LodName(const std::string& submesh, UINT lod);
+
+    // DrawArgs name of the chunk-th chunk MeshChunker split submesh into. The submesh itself is gone from DrawArgs.
+    static std::string ChunkName(const std::string& submesh, UINT chunk);
+
+    // The parsing half of LoadOBJ: fills out DrawArgs, one submesh per object, and returns the geometry, but creates
+    // no buffers. Returns -1 if the file can't be read, otherwise what ObjParser::Parse does.
+    int ParseOBJ(const std::wstring& filename, OBJ_LOAD_MODE mode,
+        std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
+
+    // Compiled mesh files. sourceHash identifies the content the mesh was built from; pass 0 to accept any.
+    int LoadFMesh(const std::wstring& filename, std::uint64_t sourceHash = 0);
+    int SaveFMesh(const std::wstring& filename, std::uint64_t sourceHash) const;
+
+    /*
+    Creates the CPU copies and the GPU buffers (+ uploaders) from the final vertex/index arrays.
+
+    Indices come in as 32-bit, relative to the BaseVertexLocation of their submesh, and DrawArgs must already be filled
+    out. They are stored as 16-bit whenever every submesh spans at most 65536 vertices, rebasing BaseVertexLocation of
+    the submeshes that need it (which modifies indices), and as 32-bit otherwise. IndexFormat reflects the choice.
+    Submesh index ranges must not overlap.
+
+    With VERTEX_FORMAT::PACKED the vertices are encoded first and the Quantization of every submesh is filled out.
+    */
+    void CreateBuffers(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+        const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices, VERTEX_FORMAT format = VERTEX_FORMAT::FLOAT);
 
 private:
+    // Same as above, for buffers that are already in their final format. indexData may be IndexBufferCPU's own storage,
+    // which is then kept as is.
+    void UploadBuffers(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, VERTEX_FORMAT vertexFormat,
+        const void* vertexData, UINT vbByteSize, const void* indexData, UINT ibByteSize, DXGI_FORMAT indexFormat);
+
+
     const Microsoft::WRL::ComPtr<ID3D12Device>& mD3Device = nullptr;
     const Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>& mCommandList = nullptr;
 };
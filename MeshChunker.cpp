@@ -0,0 +1,144 @@
+#include "MeshChunker.h"
+#include "FrameResource.h" // for Vertex
+
+#include <cfloat> // FLT_MAX
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+    struct Triangle
+    {
+        XMFLOAT3 Centroid;
+        UINT FirstIndex; // into the submesh's index range
+    };
+
+    struct Span
+    {
+        size_t Begin, End; // triangles
+    };
+}
+
+/*
+Median splits, so chunks come out within one triangle of the same size. Chunks are emitted depth first, which keeps
+neighbouring chunks next to each other in the index buffer.
+*/
+void MeshChunker::Split(const vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs, UINT maxTriangles)
+{
+    if (maxTriangles == 0)
+        return;
+
+    auto startTime = chrono::high_resolution_clock::now();
+
+    // Sorted, so the same mesh always comes out the same
+    vector<string> names;
+    for (auto& kv : drawArgs)
+    {
+        if (kv.second.LodLevel == 0 && kv.second.IndexCount / 3 > maxTriangles)
+            names.push_back(kv.first);
+    }
+    sort(names.begin(), names.end());
+
+    size_t chunksAdded = 0;
+
+    vector<Triangle> triangles;
+    vector<Span> stack, chunks;
+    vector<uint32_t> reordered;
+
+    for (auto& name : names)
+    {
+        const SubmeshGeometry whole = drawArgs[name];
+        const size_t triCount = whole.IndexCount / 3;
+        const uint32_t* first = indices.data() + whole.StartIndexLocation;
+
+        auto position = [&](uint32_t i) { return XMLoadFloat3(&vertices[i + whole.BaseVertexLocation].Pos); };
+
+        triangles.resize(triCount);
+        for (size_t t = 0; t < triCount; ++t)
+        {
+            XMVECTOR c = (position(first[t * 3]) + position(first[t * 3 + 1]) + position(first[t * 3 + 2])) / 3.0f;
+            XMStoreFloat3(&triangles[t].Centroid, c);
+            triangles[t].FirstIndex = (UINT)t * 3;
+        }
+
+        chunks.clear();
+        stack.clear();
+        stack.push_back({ 0, triCount });
+        while (!stack.empty())
+        {
+            const Span span = stack.back();
+            stack.pop_back();
+
+            if (span.End - span.Begin <= maxTriangles)
+            {
+                chunks.push_back(span);
+                continue;
+            }
+
+            XMVECTOR lo = XMVectorReplicate(FLT_MAX), hi = XMVectorReplicate(-FLT_MAX);
+            for (size_t t = span.Begin; t < span.End; ++t)
+            {
+                XMVECTOR c = XMLoadFloat3(&triangles[t].Centroid);
+                lo = XMVectorMin(lo, c);
+                hi = XMVectorMax(hi, c);
+            }
+
+            XMFLOAT3 size;
+            XMStoreFloat3(&size, hi - lo);
+            const int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+
+            const size_t mid = span.Begin + (span.End - span.Begin) / 2;
+            nth_element(triangles.begin() + span.Begin, triangles.begin() + mid, triangles.begin() + span.End,
+                [axis](const Triangle& a, const Triangle& b) { return (&a.Centroid.x)[axis] < (&b.Centroid.x)[axis]; });
+
+            // Right half first, so the left one comes off the stack (and out as a chunk) first
+            stack.push_back({ mid, span.End });
+            stack.push_back({ span.Begin, mid });
+        }
+
+        reordered.clear();
+        reordered.reserve(whole.IndexCount);
+        for (auto& chunk : chunks)
+        {
+            for (size_t t = chunk.Begin; t < chunk.End; ++t)
+                reordered.insert(reordered.end(), first + triangles[t].FirstIndex, first + triangles[t].FirstIndex + 3);
+        }
+
+        // Leftovers of faces that were not triangles stay at the end, with the last chunk
+        reordered.insert(reordered.end(), first + triCount * 3, first + whole.IndexCount);
+        copy(reordered.begin(), reordered.end(), indices.begin() + whole.StartIndexLocation);
+
+        drawArgs.erase(name);
+
+        for (size_t c = 0; c < chunks.size(); ++c)
+        {
+            SubmeshGeometry sg = whole;
+            sg.StartIndexLocation = whole.StartIndexLocation + (UINT)chunks[c].Begin * 3;
+            sg.IndexCount = (UINT)(chunks[c].End - chunks[c].Begin) * 3;
+            if (c + 1 == chunks.size())
+                sg.IndexCount = whole.StartIndexLocation + whole.IndexCount - sg.StartIndexLocation;
+
+            XMVECTOR lo = XMVectorReplicate(FLT_MAX), hi = XMVectorReplicate(-FLT_MAX);
+            for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
+            {
+                XMVECTOR p = position(indices[i]);
+                lo = XMVectorMin(lo, p);
+                hi = XMVectorMax(hi, p);
+            }
+            BoundingBox::CreateFromPoints(sg.Bounds, lo, hi);
+
+            drawArgs[Mesh::ChunkName(name, (UINT)c)] = sg;
+        }
+
+        chunksAdded += chunks.size();
+    }
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    char msg[256];
+    sprintf_s(msg, "MeshChunker: %zu submeshes split into %zu chunks in %.2f ms\n", names.size(), chunksAdded, elapsed * 1000.0);
+    OutputDebugStringA(msg);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Mesh.h"
+
+struct Vertex; // FrameResource.h
+
+/*
+Splits submeshes that are too large to cull as a whole into spatially compact chunks, each a submesh of its own.
+
+Levels tend to come out of the modelling tool as a handful of objects, one of them often the whole terrain, whose
+bounds then cover the entire level. Chunks keep drawing from the same vertex and index buffers: the triangles of the
+submesh are reordered so that every chunk is a contiguous part of its index range.
+*/
+class MeshChunker
+{
+public:
+    // Default chunk size for levels. Small enough that a chunk's bounds are tight, large enough that the extra draw
+    // calls don't matter.
+    static const UINT MAX_TRIANGLES = 512;
+
+    /*
+    Replaces every submesh in drawArgs with more than maxTriangles triangles by chunks named Mesh::ChunkName(name, i),
+    halving it along the longest axis of its triangle centroids until no chunk has more. Chunks keep the submesh's
+    BaseVertexLocation and share its vertices; their bounds are their own. Indices are relative to the
+    BaseVertexLocation of their submesh, as for MeshOptimizer; run this before it so every chunk is optimized for itself.
+    */
+    static void Split(const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs, UINT maxTriangles = MAX_TRIANGLES);
+};
@@ -0,0 +1,385 @@
+#include "MeshClusters.h"
+#include "MeshOptimizer.h"
+#include "FrameResource.h" // for Vertex
+
+#include <cfloat> // FLT_MAX
+#include <climits> // UINT_MAX
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+const float MeshClusters::MAX_CONE_ANGLE = XM_PI / 3.0f;
+
+namespace
+{
+    /*
+    Greedy region growing: start a cluster next to the previous one (or at the first triangle not yet taken, in index
+    order), then keep adding the neighbour closest to the cluster's centroid. Neighbours whose normal doesn't fit the
+    cone are only taken while the cluster is smaller than MIN_TRIANGLES; past that the cluster ends rather than lose
+    its cone. Clusters left small are merged into a neighbour afterwards where there is room.
+    */
+    void BuildSubmesh(const vector<Vertex>& vertices, vector<uint32_t>& indices, const SubmeshGeometry& sg,
+        vector<MeshCluster>& clusters)
+    {
+        const size_t triCount = sg.IndexCount / 3;
+        if (triCount == 0)
+            return;
+
+        uint32_t* first = indices.data() + sg.StartIndexLocation;
+        uint32_t* last = first + triCount * 3;
+
+        // Work on vertex ids shifted down to 0, like MeshOptimizer
+        const uint32_t minIndex = *min_element(first, last);
+        const UINT vertexCount = *max_element(first, last) - minIndex + 1;
+        const Vertex* base = vertices.data() + sg.BaseVertexLocation + minIndex;
+
+        vector<XMFLOAT3> normals(triCount);
+        vector<XMFLOAT3> centroids(triCount);
+        for (size_t t = 0; t < triCount; ++t)
+        {
+            auto p0 = XMLoadFloat3(&base[first[t * 3 + 0] - minIndex].Pos);
+            auto p1 = XMLoadFloat3(&base[first[t * 3 + 1] - minIndex].Pos);
+            auto p2 = XMLoadFloat3(&base[first[t * 3 + 2] - minIndex].Pos);
+
+            // Geometric normal, facing the way the rasterizer considers front. Degenerate triangles get none.
+            XMStoreFloat3(&normals[t], XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0)));
+            XMStoreFloat3(&centroids[t], (p0 + p1 + p2) / 3.0f);
+        }
+
+        // Flat shaded faces don't share vertices (their normals differ), so neighbours are found by position instead
+        vector<UINT> welded;
+        const UINT positionCount = MeshOptimizer::WeldPositions(base, vertexCount, welded);
+
+        // Position -> triangle adjacency, in compressed rows
+        vector<UINT> adjacencyStart(positionCount + 1, 0);
+        for (auto p = first; p != last; ++p)
+            ++adjacencyStart[welded[*p - minIndex] + 1];
+        for (UINT v = 0; v < positionCount; ++v)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+
+        vector<UINT> adjacency(triCount * 3);
+        {
+            vector<UINT> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < triCount * 3; ++i)
+                adjacency[fill[welded[first[i] - minIndex]]++] = (UINT)(i / 3);
+        }
+
+        const float minDot = cosf(MeshClusters::MAX_CONE_ANGLE);
+
+        // Untaken triangles around each position
+        vector<UINT> live(positionCount);
+        for (UINT v = 0; v < positionCount; ++v)
+            live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+
+        vector<char> taken(triCount, 0);
+        vector<UINT> queued(triCount, UINT_MAX); // last cluster that has the triangle in its candidates
+
+        vector<vector<UINT>> groups; // triangles of each cluster
+        vector<XMFLOAT3> groupCentroidSums;
+        vector<UINT> groupOf(triCount);
+
+        vector<UINT> candidates;
+
+        size_t seed = 0;
+        int nextSeed = -1;
+        for (UINT clusterIndex = 0;; ++clusterIndex)
+        {
+            // Starting where the last cluster left off keeps the untaken triangles in one piece, rather than leaving
+            // islands that can only make small clusters
+            if (nextSeed < 0)
+            {
+                while (seed < triCount && taken[seed])
+                    ++seed;
+                if (seed == triCount)
+                    break;
+                nextSeed = (int)seed;
+            }
+
+            groups.emplace_back();
+            auto& clusterTris = groups.back();
+            candidates.clear();
+            XMVECTOR normalSum = XMVectorZero();
+            XMVECTOR centroidSum = XMVectorZero();
+
+            UINT next = (UINT)nextSeed;
+            while (true)
+            {
+                taken[next] = 1;
+                for (int k = 0; k < 3; ++k)
+                    --live[welded[first[next * 3 + k] - minIndex]];
+                groupOf[next] = clusterIndex;
+                clusterTris.push_back(next);
+                normalSum += XMLoadFloat3(&normals[next]);
+                centroidSum += XMLoadFloat3(&centroids[next]);
+
+                if (clusterTris.size() == MeshClusters::MAX_TRIANGLES)
+                    break;
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    const UINT v = welded[first[next * 3 + k] - minIndex];
+                    for (UINT a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+                    {
+                        const UINT t = adjacency[a];
+                        if (!taken[t] && queued[t] != clusterIndex)
+                        {
+                            queued[t] = clusterIndex;
+                            candidates.push_back(t);
+                        }
+                    }
+                }
+
+                const XMVECTOR axis = XMVector3Normalize(normalSum);
+                const bool hasAxis = XMVectorGetX(XMVector3LengthSq(normalSum)) > 0.0f;
+                const XMVECTOR center = centroidSum / (float)clusterTris.size();
+
+                const bool mustFitCone = clusterTris.size() >= MeshClusters::MIN_TRIANGLES;
+
+                // Closest candidate that fits the cone, and closest overall
+                int best = -1, bestAny = -1;
+                float bestDistance = FLT_MAX, bestAnyDistance = FLT_MAX;
+                for (size_t c = 0; c < candidates.size();)
+                {
+                    const UINT t = candidates[c];
+                    if (taken[t])
+                    {
+                        candidates[c] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    ++c;
+
+                    // Triangles with few untaken neighbours left go first, or they end up in pockets of their own
+                    UINT neighbours = 0;
+                    for (int k = 0; k < 3; ++k)
+                        neighbours += live[welded[first[t * 3 + k] - minIndex]] - 1;
+
+                    float distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&centroids[t]) - center)) * (1.0f + neighbours);
+                    if (distance < bestAnyDistance)
+                    {
+                        bestAnyDistance = distance;
+                        bestAny = (int)t;
+                    }
+
+                    auto n = XMLoadFloat3(&normals[t]);
+                    const bool hasNormal = XMVectorGetX(XMVector3LengthSq(n)) > 0.0f;
+                    if (hasAxis && hasNormal && XMVectorGetX(XMVector3Dot(n, axis)) < minDot)
+                        continue;
+
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = (int)t;
+                    }
+                }
+
+                if (best < 0 && !mustFitCone)
+                    best = bestAny;
+                if (best < 0)
+                    break;
+                next = (UINT)best;
+            }
+
+            const XMVECTOR clusterCenter = centroidSum / (float)clusterTris.size();
+            nextSeed = -1;
+            float seedDistance = FLT_MAX;
+            for (auto t : candidates)
+            {
+                float distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&centroids[t]) - clusterCenter));
+                if (!taken[t] && distance < seedDistance)
+                {
+                    seedDistance = distance;
+                    nextSeed = (int)t;
+                }
+            }
+
+            groupCentroidSums.emplace_back();
+            XMStoreFloat3(&groupCentroidSums.back(), centroidSum);
+        }
+
+        // Growing still leaves pockets between finished clusters that only make small clusters. Fold each into the
+        // nearest neighbouring cluster that has room; its cone may widen, but a cluster that small culls little anyway.
+        for (UINT g = 0; g < groups.size(); ++g)
+        {
+            auto& small = groups[g];
+            if (small.empty() || small.size() >= MeshClusters::MIN_TRIANGLES)
+                continue;
+
+            const XMVECTOR center = XMLoadFloat3(&groupCentroidSums[g]) / (float)small.size();
+
+            int target = -1;
+            float targetDistance = FLT_MAX;
+            for (auto t : small)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    const UINT v = welded[first[t * 3 + k] - minIndex];
+                    for (UINT a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+                    {
+                        const UINT n = groupOf[adjacency[a]];
+                        if (n == g || groups[n].size() + small.size() > MeshClusters::MAX_TRIANGLES)
+                            continue;
+
+                        const XMVECTOR neighbourCenter = XMLoadFloat3(&groupCentroidSums[n]) / (float)groups[n].size();
+                        float distance = XMVectorGetX(XMVector3LengthSq(neighbourCenter - center));
+                        if (distance < targetDistance)
+                        {
+                            targetDistance = distance;
+                            target = (int)n;
+                        }
+                    }
+                }
+            }
+
+            if (target < 0)
+                continue;
+
+            for (auto t : small)
+                groupOf[t] = (UINT)target;
+            groups[target].insert(groups[target].end(), small.begin(), small.end());
+            XMStoreFloat3(&groupCentroidSums[target], XMLoadFloat3(&groupCentroidSums[target]) + XMLoadFloat3(&groupCentroidSums[g]));
+            small.clear();
+        }
+
+        vector<UINT> order; // triangles in cluster order
+        order.reserve(triCount);
+
+        vector<XMFLOAT3> points;
+
+        for (auto& clusterTris : groups)
+        {
+            if (clusterTris.empty())
+                continue;
+
+            // Within the cluster, keep the order the triangles came in
+            sort(clusterTris.begin(), clusterTris.end());
+
+            MeshCluster cluster;
+            cluster.StartIndexLocation = sg.StartIndexLocation + (UINT)order.size() * 3;
+            cluster.IndexCount = (UINT)clusterTris.size() * 3;
+
+            points.clear();
+            XMVECTOR normalSum = XMVectorZero();
+            for (auto t : clusterTris)
+            {
+                for (int k = 0; k < 3; ++k)
+                    points.push_back(base[first[t * 3 + k] - minIndex].Pos);
+                normalSum += XMLoadFloat3(&normals[t]);
+            }
+            BoundingSphere::CreateFromPoints(cluster.Bounds, points.size(), points.data(), sizeof(XMFLOAT3));
+
+            // The tightest cone around the average normal
+            if (XMVectorGetX(XMVector3LengthSq(normalSum)) > 0.0f)
+            {
+                const XMVECTOR axis = XMVector3Normalize(normalSum);
+
+                float minAxisDot = 1.0f;
+                for (auto t : clusterTris)
+                {
+                    auto n = XMLoadFloat3(&normals[t]);
+                    if (XMVectorGetX(XMVector3LengthSq(n)) > 0.0f)
+                        minAxisDot = (std::min)(minAxisDot, XMVectorGetX(XMVector3Dot(n, axis)));
+                }
+
+                // Cones of 90 degrees or more can't cull anything
+                if (minAxisDot > 0.0f)
+                {
+                    XMStoreFloat3(&cluster.ConeAxis, axis);
+                    cluster.ConeCutoff = sqrtf(1.0f - minAxisDot * minAxisDot);
+                }
+            }
+
+            order.insert(order.end(), clusterTris.begin(), clusterTris.end());
+            clusters.push_back(cluster);
+        }
+
+        vector<uint32_t> reordered;
+        reordered.reserve(triCount * 3);
+        for (auto t : order)
+            reordered.insert(reordered.end(), first + t * 3, first + t * 3 + 3);
+
+        copy(reordered.begin(), reordered.end(), first);
+    }
+}
+
+void MeshClusters::Build(const vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs, vector<MeshCluster>& clusters)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+
+    clusters.clear();
+
+    // Index buffer order, so the cluster table does too
+    vector<SubmeshGeometry*> submeshes;
+    for (auto& kv : drawArgs)
+        submeshes.push_back(&kv.second);
+
+    sort(submeshes.begin(), submeshes.end(), [](const SubmeshGeometry* a, const SubmeshGeometry* b)
+    {
+        return a->StartIndexLocation < b->StartIndexLocation;
+    });
+
+    for (auto sg : submeshes)
+    {
+        sg->FirstCluster = (UINT)clusters.size();
+        BuildSubmesh(vertices, indices, *sg, clusters);
+        sg->ClusterCount = (UINT)clusters.size() - sg->FirstCluster;
+    }
+
+    size_t cones = 0;
+    for (auto& c : clusters)
+    {
+        if (c.ConeCutoff < 1.0f)
+            ++cones;
+    }
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    char msg[256];
+    sprintf_s(msg, "MeshClusters: %zu triangles in %zu clusters (%.1f per cluster, %zu with a usable cone) in %.2f ms\n",
+        indices.size() / 3, clusters.size(), clusters.empty() ? 0.0 : indices.size() / 3.0 / clusters.size(), cones, elapsed * 1000.0);
+    OutputDebugStringA(msg);
+}
+
+void MeshClusters::Cull(const MeshCluster* clusters, UINT count, const BoundingFrustum& frustum,
+    FXMVECTOR eye, bool backfaceCulling, vector<IndexRange>& visible)
+{
+    for (UINT i = 0; i < count; ++i)
+    {
+        auto& c = clusters[i];
+
+        if (frustum.Contains(c.Bounds) == DISJOINT)
+            continue;
+
+        if (backfaceCulling && IsBackfacing(c, eye))
+            continue;
+
+        if (!visible.empty() && visible.back().StartIndexLocation + visible.back().IndexCount == c.StartIndexLocation)
+            visible.back().IndexCount += c.IndexCount;
+        else
+        {
+            IndexRange range;
+            range.StartIndexLocation = c.StartIndexLocation;
+            range.IndexCount = c.IndexCount;
+            visible.push_back(range);
+        }
+    }
+}
+
+/*
+All triangles face away if, seen from the eye, the angle between the cone axis and the direction to the bounding sphere
+leaves room for both the cone and the sphere: cos(angle) >= sin(cone) + sin(sphere), which is conservative for
+cos(angle) >= sin(cone + sphere).
+*/
+bool MeshClusters::IsBackfacing(const MeshCluster& cluster, FXMVECTOR eye)
+{
+    if (cluster.ConeCutoff >= 1.0f)
+        return false;
+
+    auto toCenter = XMLoadFloat3(&cluster.Bounds.Center) - eye;
+    float distance = XMVectorGetX(XMVector3Length(toCenter));
+    float d = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&cluster.ConeAxis)));
+
+    return d >= cluster.ConeCutoff * distance + cluster.Bounds.Radius;
+}
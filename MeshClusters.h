@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Mesh.h"
+
+struct Vertex; // FrameResource.h
+
+/*
+Splits submeshes into clusters of up to MAX_TRIANGLES adjacent triangles that face roughly the same way, so that
+frustum and backface culling can work below the granularity of a whole OBJ object.
+
+Like MeshOptimizer this works on the CPU side arrays that go into Mesh::CreateBuffers. Triangles are reordered within
+their submesh so that every cluster is a contiguous index range.
+*/
+class MeshClusters
+{
+public:
+    static const UINT MAX_TRIANGLES = 128;
+
+    // Below this size a cluster takes any neighbouring triangle; past it, only those that fit MAX_CONE_ANGLE.
+    // Too small clusters cost more to cull than they save, whether their cone is any good or not.
+    static const UINT MIN_TRIANGLES = 64;
+
+    // Limit on the angle between a joining triangle's normal and the average normal of the cluster so far.
+    // Tighter cones cull more often, but make for more and smaller clusters.
+    static const float MAX_CONE_ANGLE;
+
+    /*
+    Builds the clusters of every submesh in drawArgs and sets its FirstCluster/ClusterCount. clusters is overwritten.
+    Indices are relative to the BaseVertexLocation of their submesh; submesh index ranges must not overlap.
+    */
+    static void Build(const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs, std::vector<MeshCluster>& clusters);
+
+    /*
+    Appends the index ranges of the clusters that may be visible to visible, merging clusters that are adjacent in the
+    index buffer into one range. frustum and eye are in the space the clusters are in (object space).
+    */
+    static void Cull(const MeshCluster* clusters, UINT count, const DirectX::BoundingFrustum& frustum,
+        DirectX::FXMVECTOR eye, bool backfaceCulling, std::vector<IndexRange>& visible);
+
+    // True if every triangle in the cluster faces away from eye
+    static bool IsBackfacing(const MeshCluster& cluster, DirectX::FXMVECTOR eye);
+};
@@ -0,0 +1,391 @@
+#include "MeshOptimizer.h"
+#include "FrameResource.h" // for Vertex
+
+#include <chrono>
+#include <cstring> // memcpy
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+    // Submeshes in index buffer order, skipping empty ones
+    vector<SubmeshGeometry*> SortedSubmeshes(unordered_map<string, SubmeshGeometry>& drawArgs)
+    {
+        vector<SubmeshGeometry*> submeshes;
+        for (auto& kv : drawArgs)
+        {
+            if (kv.second.IndexCount > 0)
+                submeshes.push_back(&kv.second);
+        }
+
+        sort(submeshes.begin(), submeshes.end(), [](const SubmeshGeometry* a, const SubmeshGeometry* b)
+        {
+            return a->StartIndexLocation < b->StartIndexLocation;
+        });
+
+        return submeshes;
+    }
+
+    struct PositionHash
+    {
+        size_t operator()(const XMFLOAT3& p) const
+        {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+
+    struct PositionEqual
+    {
+        bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const
+        {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+    };
+}
+
+/*
+Each submesh is handled on its own: its indices are shifted down to start at 0 so the per vertex tables stay small,
+optimized, and shifted back.
+*/
+void MeshOptimizer::Optimize(vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs, MESH_OPTIMIZATION optimization)
+{
+    if (optimization == MESH_OPTIMIZATION::NONE)
+        return;
+
+    auto startTime = chrono::high_resolution_clock::now();
+
+    unordered_map<string, VertexCacheStats> before;
+    for (auto& kv : drawArgs)
+        before[kv.first] = AnalyzeVertexCache(indices.data() + kv.second.StartIndexLocation, kv.second.IndexCount);
+
+    vector<size_t> clusters;
+    for (auto& kv : drawArgs)
+    {
+        auto& sg = kv.second;
+        if (sg.IndexCount < 3)
+            continue;
+
+        uint32_t* first = indices.data() + sg.StartIndexLocation;
+        uint32_t* last = first + sg.IndexCount;
+
+        const uint32_t minIndex = *min_element(first, last);
+        const uint32_t maxIndex = *max_element(first, last);
+        for (auto p = first; p != last; ++p)
+            *p -= minIndex;
+
+        const bool overdraw = (optimization == MESH_OPTIMIZATION::VERTEX_CACHE_AND_OVERDRAW);
+
+        clusters.clear();
+        OptimizeVertexCache(first, sg.IndexCount, maxIndex - minIndex + 1, CACHE_SIZE, overdraw ? &clusters : nullptr);
+
+        if (overdraw)
+            OptimizeOverdraw(first, sg.IndexCount, vertices.data() + sg.BaseVertexLocation + minIndex, clusters);
+
+        for (auto p = first; p != last; ++p)
+            *p += minIndex;
+    }
+
+    OptimizeVertexFetch(vertices, indices, drawArgs);
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    char msg[256];
+    sprintf_s(msg, "MeshOptimizer: %zu submeshes, %zu triangles in %.2f ms\n", drawArgs.size(), indices.size() / 3, elapsed * 1000.0);
+    OutputDebugStringA(msg);
+
+    for (auto& kv : drawArgs)
+    {
+        auto after = AnalyzeVertexCache(indices.data() + kv.second.StartIndexLocation, kv.second.IndexCount);
+        auto& b = before[kv.first];
+
+        sprintf_s(msg, "    %s: %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+            kv.first.c_str(), after.Triangles, b.ACMR(), after.ACMR(), b.ATVR(), after.ATVR());
+        OutputDebugStringA(msg);
+    }
+}
+
+MeshOptimizer::VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, UINT cacheSize)
+{
+    VertexCacheStats stats;
+    if (indexCount == 0)
+        return stats;
+
+    const uint32_t minIndex = *min_element(indices, indices + indexCount);
+    const uint32_t maxIndex = *max_element(indices, indices + indexCount);
+
+    // A vertex is in a FIFO cache if fewer than cacheSize misses happened since it was last loaded.
+    // 0 means never loaded, so miss "times" start at 1.
+    vector<UINT> loadedAt(maxIndex - minIndex + 1, 0);
+    UINT time = 1;
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        auto& t = loadedAt[indices[i] - minIndex];
+        if (t == 0)
+            ++stats.Vertices;
+
+        if (t == 0 || time - t > cacheSize)
+        {
+            t = time++;
+            ++stats.Misses;
+        }
+    }
+
+    stats.Triangles = (UINT)(indexCount / 3);
+    return stats;
+}
+
+/*
+Tipsify: fan out around one vertex at a time, emitting all its remaining triangles. Then continue with the neighbour
+that will still be in the cache after its own fan is emitted, preferring the oldest one. If there is none, back
+off to a recently used vertex with triangles left (the dead-end stack), and failing that, to the next such vertex
+in index order.
+*/
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, size_t indexCount, UINT vertexCount, UINT cacheSize, vector<size_t>* clusters)
+{
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0)
+        return;
+
+    // Vertex -> triangle adjacency, in compressed rows
+    vector<UINT> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triCount * 3; ++i)
+        ++adjacencyStart[indices[i] + 1];
+    for (UINT v = 0; v < vertexCount; ++v)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+
+    vector<UINT> adjacency(triCount * 3);
+    {
+        vector<UINT> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < triCount * 3; ++i)
+            adjacency[fill[indices[i]]++] = (UINT)(i / 3);
+    }
+
+    // Triangles not yet emitted, per vertex
+    vector<UINT> live(vertexCount);
+    for (UINT v = 0; v < vertexCount; ++v)
+        live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+
+    vector<UINT> cacheTime(vertexCount, 0);
+    vector<char> emitted(triCount, 0);
+    vector<UINT> deadEnd;
+    vector<UINT> candidates;
+
+    vector<uint32_t> output;
+    output.reserve(triCount * 3);
+
+    UINT time = cacheSize + 1;
+    UINT cursor = 0;
+    int fan = (int)indices[0];
+
+    if (clusters)
+        clusters->push_back(0);
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+
+        // Emit all the triangles around the fanning vertex
+        for (UINT a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a)
+        {
+            const UINT t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+
+            emitted[t] = 1;
+        }
+
+        // Pick the next fanning vertex among the ones we just touched
+        fan = -1;
+        int bestPriority = -1;
+        for (auto v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+
+            // Still in the cache once its own fan has gone through it?
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = (int)(time - cacheTime[v]);
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fan = (int)v;
+            }
+        }
+
+        if (fan >= 0)
+            continue;
+
+        // Dead end
+        while (!deadEnd.empty())
+        {
+            const UINT v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+            {
+                fan = (int)v;
+                break;
+            }
+        }
+
+        while (fan < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                fan = (int)cursor;
+            ++cursor;
+        }
+
+        if (fan >= 0 && clusters)
+            clusters->push_back(output.size());
+    }
+
+    copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, const vector<size_t>& clusters)
+{
+    if (clusters.size() < 2)
+        return;
+
+    struct Cluster
+    {
+        size_t Begin, End;
+        float Score;
+    };
+
+    // Mesh centroid, area weighted
+    XMVECTOR meshCentroid = XMVectorZero();
+    float meshArea = 0.0f;
+
+    vector<Cluster> sorted(clusters.size());
+    vector<XMFLOAT3> clusterCentroids(clusters.size());
+    vector<XMFLOAT3> clusterNormals(clusters.size());
+
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        sorted[c].Begin = clusters[c];
+        sorted[c].End = (c + 1 < clusters.size()) ? clusters[c + 1] : indexCount;
+
+        XMVECTOR centroid = XMVectorZero();
+        XMVECTOR normal = XMVectorZero();
+        float area = 0.0f;
+
+        for (size_t i = sorted[c].Begin; i + 2 < sorted[c].End; i += 3)
+        {
+            auto p0 = XMLoadFloat3(&vertices[indices[i + 0]].Pos);
+            auto p1 = XMLoadFloat3(&vertices[indices[i + 1]].Pos);
+            auto p2 = XMLoadFloat3(&vertices[indices[i + 2]].Pos);
+
+            // Length of the cross product is twice the area, so summing these gives an area weighted normal
+            auto n = XMVector3Cross(p1 - p0, p2 - p0);
+            float a = 0.5f * XMVectorGetX(XMVector3Length(n));
+
+            normal += n;
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            area += a;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+
+        XMStoreFloat3(&clusterCentroids[c], area > 0.0f ? centroid / area : centroid);
+        XMStoreFloat3(&clusterNormals[c], XMVector3Normalize(normal));
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        auto toCluster = XMLoadFloat3(&clusterCentroids[c]) - meshCentroid;
+        sorted[c].Score = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&clusterNormals[c])));
+    }
+
+    stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.Score > b.Score; });
+
+    vector<uint32_t> output;
+    output.reserve(indexCount);
+    for (auto& c : sorted)
+        output.insert(output.end(), indices + c.Begin, indices + c.End);
+
+    copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs)
+{
+    const UINT UNUSED = UINT32_MAX;
+
+    auto submeshes = SortedSubmeshes(drawArgs);
+    if (submeshes.empty())
+        return;
+
+    vector<UINT> remap(vertices.size(), UNUSED);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto sg : submeshes)
+    {
+        uint32_t* first = indices.data() + sg->StartIndexLocation;
+        uint32_t* last = first + sg->IndexCount;
+
+        // New ids, absolute for now
+        UINT newBase = UNUSED;
+        for (auto p = first; p != last; ++p)
+        {
+            const UINT v = *p + sg->BaseVertexLocation;
+            if (remap[v] == UNUSED)
+            {
+                remap[v] = (UINT)reordered.size();
+                reordered.push_back(vertices[v]);
+            }
+
+            *p = remap[v];
+            newBase = (std::min)(newBase, remap[v]);
+        }
+
+        // And back to relative
+        for (auto p = first; p != last; ++p)
+            *p -= newBase;
+        sg->BaseVertexLocation = (INT)newBase;
+    }
+
+    vertices.swap(reordered);
+}
+
+UINT MeshOptimizer::WeldPositions(const Vertex* vertices, UINT vertexCount, vector<UINT>& welded)
+{
+    welded.resize(vertexCount);
+
+    unordered_map<XMFLOAT3, UINT, PositionHash, PositionEqual> positions;
+    positions.reserve(vertexCount);
+
+    UINT positionCount = 0;
+    for (UINT v = 0; v < vertexCount; ++v)
+    {
+        auto result = positions.insert(make_pair(vertices[v].Pos, positionCount));
+        if (result.second)
+            ++positionCount;
+        welded[v] = result.first->second;
+    }
+
+    return positionCount;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Mesh.h"
+
+struct Vertex; // FrameResource.h
+
+/*
+Post-load optimization of indexed triangle lists.
+
+Everything works on the CPU side arrays that go into Mesh::CreateBuffers: 32-bit indices relative to the
+BaseVertexLocation of their submesh. Triangles never move between submeshes, so DrawArgs stay valid
+(apart from BaseVertexLocation, which OptimizeVertexFetch updates).
+*/
+class MeshOptimizer
+{
+public:
+    // FIFO cache size we optimize and measure for. Real hardware is neither FIFO nor this size, but the ordering
+    // that does well here does well there.
+    static const UINT CACHE_SIZE = 16;
+
+    struct VertexCacheStats
+    {
+        UINT Triangles = 0;
+        UINT Vertices = 0; // distinct vertices referenced
+        UINT Misses = 0;
+
+        // Average cache miss ratio, misses per triangle. 0.5 is the best a regular grid can do, 3 the worst.
+        float ACMR() const { return Triangles ? (float)Misses / Triangles : 0.0f; }
+        // Average transform to vertex ratio, misses per vertex. 1 is optimal.
+        float ATVR() const { return Vertices ? (float)Misses / Vertices : 0.0f; }
+    };
+
+    // Runs the passes selected by optimization on every submesh and logs ACMR/ATVR per submesh before and after
+    static void Optimize(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs, MESH_OPTIMIZATION optimization);
+
+    // Simulates a FIFO vertex cache over a triangle list
+    static VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, size_t indexCount, UINT cacheSize = CACHE_SIZE);
+
+    /*
+    Reorders the triangles of a list for the vertex cache (Tipsify, Sander et al. 2007). Vertex ids must be in
+    [0, vertexCount). If clusters is given it receives the index offsets at which the algorithm had to jump to a
+    different part of the mesh; the ranges in between are what OptimizeOverdraw shuffles.
+    */
+    static void OptimizeVertexCache(std::uint32_t* indices, size_t indexCount, UINT vertexCount,
+        UINT cacheSize = CACHE_SIZE, std::vector<size_t>* clusters = nullptr);
+
+    /*
+    Sorts the clusters found by OptimizeVertexCache so that those facing away from the center of the mesh come first.
+    Those tend to occlude the rest, and since clusters are kept intact the cache efficiency barely changes.
+    vertices is what the indices index into.
+    */
+    static void OptimizeOverdraw(std::uint32_t* indices, size_t indexCount, const Vertex* vertices,
+        const std::vector<size_t>& clusters);
+
+    /*
+    Renumbers vertices in the order the submeshes first use them and drops those that are never used, so the vertex
+    fetch walks memory mostly front to back. Updates indices and BaseVertexLocation. Submesh index ranges must not overlap.
+    */
+    static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs);
+
+    /*
+    Gives vertices that share a position (exactly) the same id in welded, numbered from 0 in order of first
+    appearance. Returns the number of distinct positions. Flat shaded and UV seamed surfaces have a vertex per face
+    corner, so this is what connects their triangles to each other.
+    */
+    static UINT WeldPositions(const Vertex* vertices, UINT vertexCount, std::vector<UINT>& welded);
+};
@@ -0,0 +1,538 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "FrameResource.h" // for Vertex
+
+#include <chrono>
+#include <cfloat> // FLT_MAX
+#include <cmath>
+#include <queue>
+
+using namespace std;
+using namespace DirectX;
+
+const float MeshSimplifier::LOD_REDUCTION = 0.5f;
+const float MeshSimplifier::MAX_RELATIVE_ERROR = 0.05f;
+
+namespace
+{
+    // Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of Garland & Heckbert
+    struct Quadric
+    {
+        // a^2, ab, ac, ad, b^2, bc, bd, c^2, cd, d^2
+        double A[10] = {};
+
+        void AddPlane(double a, double b, double c, double d)
+        {
+            A[0] += a * a; A[1] += a * b; A[2] += a * c; A[3] += a * d;
+            A[4] += b * b; A[5] += b * c; A[6] += b * d;
+            A[7] += c * c; A[8] += c * d;
+            A[9] += d * d;
+        }
+
+        void Add(const Quadric& q)
+        {
+            for (int i = 0; i < 10; ++i)
+                A[i] += q.A[i];
+        }
+
+        double Error(const XMFLOAT3& p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            const double e =
+                A[0] * x * x + 2.0 * A[1] * x * y + 2.0 * A[2] * x * z + 2.0 * A[3] * x +
+                A[4] * y * y + 2.0 * A[5] * y * z + 2.0 * A[6] * y +
+                A[7] * z * z + 2.0 * A[8] * z +
+                A[9];
+
+            // Rounding can take it just below 0
+            return (std::max)(e, 0.0);
+        }
+    };
+
+    // Moving position From onto position To. The versions tell whether either has changed since the cost was computed.
+    struct Collapse
+    {
+        double Cost;
+        UINT From, To;
+        UINT FromVersion, ToVersion;
+
+        bool operator>(const Collapse& c) const { return Cost > c.Cost; }
+    };
+
+    struct EdgeRef
+    {
+        UINT A, B; // positions, A < B
+        UINT Triangle;
+
+        bool operator<(const EdgeRef& e) const { return A != e.A ? A < e.A : B < e.B; }
+    };
+
+    XMVECTOR TriangleNormal(FXMVECTOR p0, FXMVECTOR p1, FXMVECTOR p2)
+    {
+        return XMVector3Cross(p1 - p0, p2 - p0);
+    }
+}
+
+void MeshSimplifier::BuildLods(const vector<Vertex>& vertices, vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs, UINT lodCount)
+{
+    lodCount = (std::min)(lodCount, MAX_LODS);
+    if (lodCount == 0)
+        return;
+
+    auto startTime = chrono::high_resolution_clock::now();
+
+    // Sorted, so the same mesh always comes out the same
+    vector<string> names;
+    for (auto& kv : drawArgs)
+    {
+        if (kv.second.LodLevel == 0 && kv.second.IndexCount >= 3)
+            names.push_back(kv.first);
+    }
+    sort(names.begin(), names.end());
+
+    // Positions used by more than one submesh. sharedBy holds the first user, or SHARED.
+    const int UNUSED = -1, SHARED = -2;
+    vector<UINT> welded;
+    vector<int> sharedBy(MeshOptimizer::WeldPositions(vertices.data(), (UINT)vertices.size(), welded), UNUSED);
+    for (size_t s = 0; s < names.size(); ++s)
+    {
+        auto& sg = drawArgs[names[s]];
+        for (UINT i = sg.StartIndexLocation; i < sg.StartIndexLocation + sg.IndexCount; ++i)
+        {
+            auto& user = sharedBy[welded[indices[i] + sg.BaseVertexLocation]];
+            if (user == UNUSED)
+                user = (int)s;
+            else if (user != (int)s)
+                user = SHARED;
+        }
+    }
+
+    const size_t sourceIndexCount = indices.size();
+    size_t lodsAdded = 0;
+
+    vector<size_t> targets;
+    vector<vector<uint32_t>> lods;
+    vector<float> errors;
+    vector<char> locked;
+
+    for (auto& name : names)
+    {
+        const SubmeshGeometry base = drawArgs[name];
+        const size_t indexCount = base.IndexCount / 3 * 3;
+
+        // Shifted down to 0, like MeshOptimizer does
+        vector<uint32_t> local(indices.begin() + base.StartIndexLocation, indices.begin() + base.StartIndexLocation + indexCount);
+        const uint32_t minIndex = *min_element(local.begin(), local.end());
+        const UINT vertexCount = *max_element(local.begin(), local.end()) - minIndex + 1;
+        for (auto& i : local)
+            i -= minIndex;
+
+        locked.resize(vertexCount);
+        for (UINT v = 0; v < vertexCount; ++v)
+            locked[v] = sharedBy[welded[v + base.BaseVertexLocation + minIndex]] == SHARED;
+
+        targets.clear();
+        float fraction = 1.0f;
+        for (UINT l = 0; l < lodCount; ++l)
+        {
+            fraction *= LOD_REDUCTION;
+            targets.push_back((size_t)(indexCount / 3 * fraction) * 3);
+        }
+
+        const float diagonal = 2.0f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&base.Bounds.Extents)));
+
+        Simplify(vertices.data() + base.BaseVertexLocation + minIndex, vertexCount, local.data(), indexCount, locked.data(),
+            targets, MAX_RELATIVE_ERROR * diagonal, lods, errors);
+
+        UINT level = 0;
+        size_t previous = indexCount;
+        for (size_t l = 0; l < lods.size(); ++l)
+        {
+            auto& lod = lods[l];
+            if (lod.empty() || lod.size() > previous * 3 / 4)
+                continue;
+
+            MeshOptimizer::OptimizeVertexCache(lod.data(), lod.size(), vertexCount);
+
+            SubmeshGeometry sg = base;
+            sg.StartIndexLocation = (UINT)indices.size();
+            sg.IndexCount = (UINT)lod.size();
+            sg.FirstCluster = 0;
+            sg.ClusterCount = 0;
+            sg.LodLevel = ++level;
+            sg.LodCount = 0;
+            sg.LodError = errors[l];
+
+            for (auto i : lod)
+                indices.push_back(i + minIndex);
+
+            drawArgs[Mesh::LodName(name, level)] = sg;
+            previous = lod.size();
+        }
+
+        drawArgs[name].LodCount = level;
+        lodsAdded += level;
+    }
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+
+    char msg[256];
+    sprintf_s(msg, "MeshSimplifier: %zu submeshes, %zu LODs adding %zu triangles to %zu in %.2f ms\n",
+        names.size(), lodsAdded, (indices.size() - sourceIndexCount) / 3, sourceIndexCount / 3, elapsed * 1000.0);
+    OutputDebugStringA(msg);
+}
+
+/*
+Costs are kept in a heap with lazy deletion: every position carries a version that changes whenever its quadric does,
+and stale entries are dropped as they come up. The edges around a collapse get fresh entries instead. Whether a
+collapse is allowed depends on the neighbourhood at the time, so that is only checked once it comes up.
+*/
+void MeshSimplifier::Simplify(const Vertex* vertices, UINT vertexCount, const uint32_t* indices, size_t indexCount,
+    const char* lockedVertices, const vector<size_t>& targetIndexCounts, float maxError, vector<vector<uint32_t>>& lods, vector<float>& errors)
+{
+    lods.assign(targetIndexCounts.size(), vector<uint32_t>());
+    errors.assign(targetIndexCounts.size(), 0.0f);
+
+    const size_t triCount = indexCount / 3;
+
+    vector<UINT> welded;
+    const UINT positionCount = MeshOptimizer::WeldPositions(vertices, vertexCount, welded);
+
+    vector<XMFLOAT3> positions(positionCount);
+    for (UINT v = 0; v < vertexCount; ++v)
+        positions[welded[v]] = vertices[v].Pos;
+
+    // The vertices at each position that the triangles use, in compressed rows. Others in the range may belong to a
+    // different submesh.
+    vector<char> used(vertexCount, 0);
+    for (size_t i = 0; i < triCount * 3; ++i)
+        used[indices[i]] = 1;
+
+    vector<UINT> wedgeStart(positionCount + 1, 0);
+    for (UINT v = 0; v < vertexCount; ++v)
+    {
+        if (used[v])
+            ++wedgeStart[welded[v] + 1];
+    }
+    for (UINT p = 0; p < positionCount; ++p)
+        wedgeStart[p + 1] += wedgeStart[p];
+
+    vector<UINT> wedges(wedgeStart[positionCount]);
+    {
+        vector<UINT> fill(wedgeStart.begin(), wedgeStart.end() - 1);
+        for (UINT v = 0; v < vertexCount; ++v)
+        {
+            if (used[v])
+                wedges[fill[welded[v]]++] = v;
+        }
+    }
+
+    vector<uint32_t> corners(indices, indices + triCount * 3);
+    auto cornerPosition = [&](size_t t, int k) { return welded[corners[t * 3 + k]]; };
+
+    // Triangles that are degenerate to begin with have nothing to lose
+    vector<char> triAlive(triCount, 1);
+    size_t aliveTris = triCount;
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        const UINT a = cornerPosition(t, 0), b = cornerPosition(t, 1), c = cornerPosition(t, 2);
+        if (a == b || b == c || a == c)
+        {
+            triAlive[t] = 0;
+            --aliveTris;
+        }
+    }
+
+    vector<vector<UINT>> trisAt(positionCount);
+    vector<Quadric> quadrics(positionCount);
+    vector<EdgeRef> edges;
+    edges.reserve(aliveTris * 3);
+
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        if (!triAlive[t])
+            continue;
+
+        const UINT p[3] = { cornerPosition(t, 0), cornerPosition(t, 1), cornerPosition(t, 2) };
+        for (int k = 0; k < 3; ++k)
+        {
+            trisAt[p[k]].push_back((UINT)t);
+
+            EdgeRef e = { (std::min)(p[k], p[(k + 1) % 3]), (std::max)(p[k], p[(k + 1) % 3]), (UINT)t };
+            edges.push_back(e);
+        }
+
+        XMVECTOR n = TriangleNormal(XMLoadFloat3(&positions[p[0]]), XMLoadFloat3(&positions[p[1]]), XMLoadFloat3(&positions[p[2]]));
+        if (XMVectorGetX(XMVector3LengthSq(n)) == 0.0f)
+            continue;
+
+        XMFLOAT3 plane;
+        XMStoreFloat3(&plane, XMVector3Normalize(n));
+        const double d = -((double)plane.x * positions[p[0]].x + (double)plane.y * positions[p[0]].y + (double)plane.z * positions[p[0]].z);
+        for (int k = 0; k < 3; ++k)
+            quadrics[p[k]].AddPlane(plane.x, plane.y, plane.z, d);
+    }
+
+    sort(edges.begin(), edges.end());
+
+    // Edges with one triangle are borders. Their vertices only move along them, kept in place across by a plane through
+    // the edge at right angles to the triangle. Edges with more than two triangles are too tangled to touch at all.
+    vector<char> border(positionCount, 0);
+    vector<char> locked(positionCount, 0);
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i;
+        while (j < edges.size() && edges[j].A == edges[i].A && edges[j].B == edges[i].B)
+            ++j;
+
+        const UINT a = edges[i].A, b = edges[i].B;
+        if (j - i == 1)
+        {
+            border[a] = border[b] = 1;
+
+            const size_t t = edges[i].Triangle;
+            XMVECTOR pa = XMLoadFloat3(&positions[a]);
+            XMVECTOR n = TriangleNormal(XMLoadFloat3(&positions[cornerPosition(t, 0)]),
+                XMLoadFloat3(&positions[cornerPosition(t, 1)]), XMLoadFloat3(&positions[cornerPosition(t, 2)]));
+            XMVECTOR across = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&positions[b]) - pa, n));
+
+            if (XMVectorGetX(XMVector3LengthSq(across)) > 0.0f)
+            {
+                XMFLOAT3 plane;
+                XMStoreFloat3(&plane, across);
+                const double d = -XMVectorGetX(XMVector3Dot(across, pa));
+                quadrics[a].AddPlane(plane.x, plane.y, plane.z, d);
+                quadrics[b].AddPlane(plane.x, plane.y, plane.z, d);
+            }
+        }
+        else if (j - i > 2)
+        {
+            locked[a] = locked[b] = 1;
+        }
+
+        i = j;
+    }
+
+    if (lockedVertices)
+    {
+        for (UINT v = 0; v < vertexCount; ++v)
+        {
+            if (lockedVertices[v])
+                locked[welded[v]] = 1;
+        }
+    }
+
+    vector<UINT> version(positionCount, 0);
+    vector<char> positionAlive(positionCount, 1);
+    priority_queue<Collapse, vector<Collapse>, greater<Collapse>> heap;
+
+    auto push = [&](UINT from, UINT to)
+    {
+        if (locked[from] || (border[from] && !border[to]))
+            return;
+
+        Quadric q = quadrics[from];
+        q.Add(quadrics[to]);
+
+        Collapse c = { q.Error(positions[to]), from, to, version[from], version[to] };
+        heap.push(c);
+    };
+
+    for (size_t i = 0; i < edges.size(); ++i)
+    {
+        if (i > 0 && edges[i].A == edges[i - 1].A && edges[i].B == edges[i - 1].B)
+            continue;
+
+        push(edges[i].A, edges[i].B);
+        push(edges[i].B, edges[i].A);
+    }
+
+    // Drops the triangles that have died since trisAt[p] was last looked at
+    auto compact = [&](UINT p)
+    {
+        auto& tris = trisAt[p];
+        tris.erase(remove_if(tris.begin(), tris.end(), [&](UINT t) { return !triAlive[t]; }), tris.end());
+    };
+
+    auto hasPosition = [&](UINT t, UINT p)
+    {
+        return cornerPosition(t, 0) == p || cornerPosition(t, 1) == p || cornerPosition(t, 2) == p;
+    };
+
+    auto collectNeighbours = [&](UINT p, vector<UINT>& neighbours)
+    {
+        neighbours.clear();
+        for (auto t : trisAt[p])
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                if (cornerPosition(t, k) != p)
+                    neighbours.push_back(cornerPosition(t, k));
+            }
+        }
+        sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+
+    vector<UINT> fromNeighbours, toNeighbours;
+
+    auto canCollapse = [&](UINT from, UINT to)
+    {
+        compact(from);
+        compact(to);
+
+        size_t shared = 0;
+        for (auto t : trisAt[from])
+        {
+            if (hasPosition(t, to))
+                ++shared;
+        }
+
+        // No longer an edge; or a border vertex leaving its border
+        if (shared == 0 || (border[from] && shared != 1))
+            return false;
+
+        // Link condition: the only positions next to both may be the tips of the triangles on the edge, or the
+        // collapse pinches the surface
+        collectNeighbours(from, fromNeighbours);
+        collectNeighbours(to, toNeighbours);
+
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();)
+        {
+            if (fromNeighbours[i] < toNeighbours[j])
+                ++i;
+            else if (toNeighbours[j] < fromNeighbours[i])
+                ++j;
+            else
+            {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+        if (common > shared)
+            return false;
+
+        // No triangle may flip over (or collapse to a line)
+        const XMVECTOR target = XMLoadFloat3(&positions[to]);
+        for (auto t : trisAt[from])
+        {
+            if (hasPosition(t, to))
+                continue;
+
+            XMVECTOR before[3], after[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                before[k] = XMLoadFloat3(&positions[cornerPosition(t, k)]);
+                after[k] = cornerPosition(t, k) == from ? target : before[k];
+            }
+
+            XMVECTOR n0 = TriangleNormal(before[0], before[1], before[2]);
+            XMVECTOR n1 = TriangleNormal(after[0], after[1], after[2]);
+            if (XMVectorGetX(XMVector3Dot(n0, n1)) <= 0.0f)
+                return false;
+        }
+
+        return true;
+    };
+
+    // The vertex at position p that looks most like vertex v
+    auto closestWedge = [&](UINT v, UINT p)
+    {
+        const Vertex& a = vertices[v];
+
+        UINT best = wedges[wedgeStart[p]];
+        float bestScore = -FLT_MAX;
+        for (UINT w = wedgeStart[p]; w < wedgeStart[p + 1]; ++w)
+        {
+            const Vertex& b = vertices[wedges[w]];
+            const float du = a.TexC.x - b.TexC.x, dv = a.TexC.y - b.TexC.y;
+            const float score = a.Normal.x * b.Normal.x + a.Normal.y * b.Normal.y + a.Normal.z * b.Normal.z - (du * du + dv * dv);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = wedges[w];
+            }
+        }
+
+        return best;
+    };
+
+    const double maxCost = (double)maxError * maxError;
+    double worstCost = 0.0;
+    size_t level = 0;
+
+    auto snapshot = [&]()
+    {
+        auto& lod = lods[level];
+        lod.reserve(aliveTris * 3);
+        for (size_t t = 0; t < triCount; ++t)
+        {
+            if (triAlive[t])
+                lod.insert(lod.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+        }
+
+        errors[level] = (float)sqrt(worstCost);
+        ++level;
+    };
+
+    while (level < targetIndexCounts.size())
+    {
+        if (aliveTris * 3 <= targetIndexCounts[level])
+        {
+            snapshot();
+            continue;
+        }
+
+        if (heap.empty() || heap.top().Cost > maxCost)
+            break;
+
+        const Collapse c = heap.top();
+        heap.pop();
+
+        if (!positionAlive[c.From] || !positionAlive[c.To] || version[c.From] != c.FromVersion || version[c.To] != c.ToVersion)
+            continue;
+
+        if (!canCollapse(c.From, c.To))
+            continue;
+
+        for (auto t : trisAt[c.From])
+        {
+            if (hasPosition(t, c.To))
+            {
+                triAlive[t] = 0;
+                --aliveTris;
+                continue;
+            }
+
+            for (int k = 0; k < 3; ++k)
+            {
+                if (cornerPosition(t, k) == c.From)
+                    corners[t * 3 + k] = closestWedge(corners[t * 3 + k], c.To);
+            }
+            trisAt[c.To].push_back(t);
+        }
+
+        trisAt[c.From].clear();
+        positionAlive[c.From] = 0;
+        quadrics[c.To].Add(quadrics[c.From]);
+        ++version[c.To];
+        compact(c.To);
+
+        worstCost = (std::max)(worstCost, c.Cost);
+
+        // Only the edges at To changed cost; the version bump above retired their old entries
+        collectNeighbours(c.To, toNeighbours);
+        for (auto n : toNeighbours)
+        {
+            push(n, c.To);
+            push(c.To, n);
+        }
+    }
+
+    // Levels not reached before maxError get the mesh as far as it went
+    while (level < targetIndexCounts.size())
+        snapshot();
+}
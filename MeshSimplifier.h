@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Mesh.h"
+
+struct Vertex; // FrameResource.h
+
+/*
+Builds levels of detail by simplifying the triangle lists of submeshes.
+
+Vertices are only ever collapsed onto a neighbouring vertex, never moved or created, so every level of detail indexes
+the vertex buffer the full resolution submesh already uses; a LOD costs index buffer space only.
+*/
+class MeshSimplifier
+{
+public:
+    static const UINT MAX_LODS = 4;
+
+    // Each level of detail aims for this fraction of the triangles of the one before
+    static const float LOD_REDUCTION;
+
+    // Simplification stops before it moves the surface further than this fraction of the submesh's bounding box
+    // diagonal, even if that leaves a level short of its triangle target
+    static const float MAX_RELATIVE_ERROR;
+
+    /*
+    Adds up to lodCount levels of detail for every full resolution submesh in drawArgs. Their triangles are appended to
+    indices and their DrawArgs entries are named Mesh::LodName(name, level). Levels that would not save at least a
+    quarter of the triangles of the one before are skipped, so small or already coarse submeshes get fewer, or none.
+    Positions that more than one submesh uses (the seams between chunks, objects that touch) stay where they are, so
+    neighbours at different levels still meet. Indices are relative to the BaseVertexLocation of their submesh, as for
+    MeshOptimizer.
+    */
+    static void BuildLods(const std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs, UINT lodCount);
+
+    /*
+    Quadric error edge collapse (Garland & Heckbert 1997). Vertex ids must be in [0, vertexCount); vertices that share a
+    position are treated as one, and corners keep the vertex at the new position whose normal and UV match best.
+    Borders only collapse along themselves. Positions with a nonzero entry in lockedVertices (optional, vertexCount
+    long) never move.
+
+    targetIndexCounts must be decreasing. For each of them, lods receives the triangles as they were once simplification
+    got down to that many indices (or stopped at maxError, in object space units) and errors the largest error of any
+    collapse so far: the square root of the summed squared distances to the planes of the original triangles involved.
+    */
+    static void Simplify(const Vertex* vertices, UINT vertexCount, const std::uint32_t* indices, size_t indexCount,
+        const char* lockedVertices, const std::vector<size_t>& targetIndexCounts, float maxError,
+        std::vector<std::vector<std::uint32_t>>& lods, std::vector<float>& errors);
+};
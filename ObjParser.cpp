@@ -0,0 +1,498 @@
+#include "ObjParser.h"
+#include "ObjReader.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+using namespace DirectX;
+
+int ObjParser::Parse(const char* begin, const char* end, OBJ_LOAD_MODE mode, vector<Vertex>& vertices,
+    vector<uint32_t>& indices, vector<ObjObject>& objects)
+{
+    vertices.clear();
+    indices.clear();
+    objects.clear();
+
+    if (mode == OBJ_LOAD_MODE::PARALLEL)
+        return ParseParallel(begin, end, vertices, indices, objects);
+
+    return ParseSerial(begin, end, vertices, indices, objects);
+}
+
+int ObjParser::ParseFile(const string& filename, OBJ_LOAD_MODE mode, vector<Vertex>& vertices,
+    vector<uint32_t>& indices, vector<ObjObject>& objects)
+{
+    // Pull the whole file into memory in one go; the parsers then tokenize it in place.
+    ifstream obj(filename, ios::binary | ios::ate);
+    if (!obj.is_open())
+        return -1;
+
+    vector<char> buffer((size_t)obj.tellg());
+    obj.seekg(0, ios::beg);
+    obj.read(buffer.data(), buffer.size());
+    obj.close();
+
+    return Parse(buffer.data(), buffer.data() + buffer.size(), mode, vertices, indices, objects);
+}
+
+int ObjParser::ParseSerial(const char* begin, const char* end, vector<Vertex>& vertices, vector<uint32_t>& indices,
+    vector<ObjObject>& objects)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+
+    vector<XMFLOAT3> positions;
+    vector<XMFLOAT2> texcoords;
+    vector<XMFLOAT3> normals;
+
+    // A triangulated face has 3 corners; most corners are shared, so this is a generous upper bound
+    const size_t faceCount = ObjReader::Count(begin, end, ObjReader::ELEMENT::FACE);
+    ObjCornerMap verts_added(3 * faceCount);
+
+    // Anything before the first 'o' line goes into an unnamed object
+    objects.resize(1);
+
+    ObjReader reader(begin, end);
+    while (reader.NextLine())
+    {
+        switch (reader.Element())
+        {
+        // Create new object
+        case ObjReader::ELEMENT::OBJECT:
+        {
+            const char* nameBegin;
+            const char* nameEnd;
+            reader.ReadName(nameBegin, nameEnd);
+
+            // Update the last object's index count since we now know how many indices it has
+            objects.back().IndexCount = (UINT)indices.size() - objects.back().StartIndexLocation;
+
+            ObjObject object;
+            object.Name = string(nameBegin, nameEnd);
+            object.StartIndexLocation = (UINT)indices.size();
+            objects.push_back(move(object));
+            break;
+        }
+        // Vertex position. These come first, so we create a new vertex
+        case ObjReader::ELEMENT::POSITION:
+        {
+            XMFLOAT3 p(0.0f, 0.0f, 0.0f);
+            reader.ReadFloat3(p);
+
+            auto& bmin = objects.back().BoundsMin;
+            auto& bmax = objects.back().BoundsMax;
+            bmin = XMFLOAT3(min(bmin.x, p.x), min(bmin.y, p.y), min(bmin.z, p.z));
+            bmax = XMFLOAT3(max(bmax.x, p.x), max(bmax.y, p.y), max(bmax.z, p.z));
+
+            positions.push_back(p);
+            break;
+        }
+        // Texture coordinate. All vertices constructed
+        case ObjReader::ELEMENT::TEXCOORD:
+        {
+            XMFLOAT2 t(0.0f, 0.0f);
+            reader.ReadFloat2(t);
+            texcoords.push_back(t);
+            break;
+        }
+        case ObjReader::ELEMENT::NORMAL:
+        {
+            XMFLOAT3 n(0.0f, 0.0f, 0.0f);
+            reader.ReadFloat3(n);
+            normals.push_back(n);
+            break;
+        }
+        case ObjReader::ELEMENT::FACE:
+        {
+            // At this point we have collected all necessary data to index. So we can finish constructing the vertices and the indices.
+
+            // Face indices are 1-based in OBJ files (negative ones are relative to the end of the list so far)
+            // corners are of the form vertex_idx / texture_idx / normal_idx; texture and normal may be left out
+
+            // assuming a triangulated mesh there are 3 corners per face
+            int vi, ti, ni;
+            while (reader.ReadFaceVertex(vi, ti, ni))
+            {
+                if (!ObjReader::ResolveIndex(vi, (int)positions.size(), vi) || vi < 0 ||
+                    !ObjReader::ResolveIndex(ti, (int)texcoords.size(), ti) ||
+                    !ObjReader::ResolveIndex(ni, (int)normals.size(), ni))
+                    return -2;
+
+                // Check if we already have this vertex; if not, register it with its index into the vertex array
+                bool isNew = false;
+                UINT vertex_id = verts_added.FindOrInsert(vi, ti, ni, (UINT)vertices.size(), isNew);
+                if (vertex_id == ObjCornerMap::INVALID)
+                    return -3;
+                if (isNew)
+                {
+                    // Construct vertex
+                    Vertex v;
+                    v.Pos = positions[vi];
+                    v.TexC = ti >= 0 ? texcoords[ti] : XMFLOAT2(0.0f, 0.0f);
+                    v.Normal = ni >= 0 ? normals[ni] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+                    vertices.push_back(v);
+                }
+
+                // Now we have the vertex, so add it to the index buffer
+                indices.push_back(vertex_id);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // End of file - fix the index count in the last object
+    objects.back().IndexCount = (UINT)indices.size() - objects.back().StartIndexLocation;
+
+    // The unnamed leading object is normally empty
+    if (objects.front().IndexCount == 0)
+        objects.erase(objects.begin());
+
+    // Report parse throughput so cold start regressions are visible in the debug output
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+    char msg[256];
+    snprintf(msg, sizeof(msg), "ObjParser: %zu lines, %zu vertices, %zu indices in %.2f ms (%.0f lines/s)\n",
+        reader.LineCount(), vertices.size(), indices.size(), elapsed * 1000.0, elapsed > 0.0 ? reader.LineCount() / elapsed : 0.0);
+    DebugOutput(msg);
+
+    // Success
+    return 0;
+}
+
+namespace
+{
+    // One object ('o' block) in the file. Its lines may be spread over several pieces.
+    struct ObjSection
+    {
+        string Name;
+        size_t FirstPiece = 0;
+        size_t PieceCount = 0;
+    };
+
+    // A contiguous run of lines belonging to a single object; the unit of work for the worker threads.
+    struct ObjPiece
+    {
+        size_t Section = 0;
+        const char* Begin = nullptr;
+        const char* End = nullptr;
+
+        // Global (0-based) position of the first v/vt/vn line of this piece, and how many of each it holds.
+        // This is what lets us resolve the file-global face indices without looking at the other pieces.
+        UINT PosBase = 0, TexBase = 0, NormBase = 0;
+        UINT PosCount = 0, TexCount = 0, NormCount = 0;
+        UINT FaceCount = 0;
+
+        // Results
+        XMFLOAT3 Min = { FLT_MAX, FLT_MAX, FLT_MAX };
+        XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        vector<Vertex> Vertices;
+        vector<UINT> Indices; // relative to the first vertex of this piece
+        int Error = 0;        // as Parse returns it, if a face of this piece indexes something that isn't there or can't be keyed
+    };
+
+    // Runs f(i) for i in [0, count) on all hardware threads. Blocks until every call has returned.
+    template<typename F>
+    void ParallelFor(size_t count, F f)
+    {
+        atomic<size_t> next(0);
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+                f(i);
+        };
+
+        size_t threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), count);
+        vector<thread> workers;
+        for (size_t i = 1; i < threadCount; ++i)
+            workers.emplace_back(work);
+
+        // The calling thread pitches in as well
+        work();
+
+        for (auto& w : workers)
+            w.join();
+    }
+}
+
+/*
+Parallel variant of Parse.
+
+1) Scan the file once (no number parsing) to find the object boundaries, cutting large objects into
+   several pieces so that even single-object levels spread over all cores. For each piece we note how many v/vt/vn
+   lines precede it, which gives the base for the global 1-based OBJ indices.
+2) Parse all v/vt/vn lines in parallel, straight into their final slot in the global attribute arrays.
+3) Parse the faces in parallel. Each piece deduplicates its own vertices and builds its own index list.
+4) Stitch the pieces together; every object gets indices relative to its BaseVertexLocation.
+
+Results are identical to the serial parser, except that vertices shared between two pieces of the same object are duplicated.
+*/
+int ObjParser::ParseParallel(const char* begin, const char* end, vector<Vertex>& vertices, vector<uint32_t>& indices,
+    vector<ObjObject>& objects)
+{
+    auto startTime = chrono::high_resolution_clock::now();
+
+    const char* data = begin;
+    const size_t size = end - begin;
+
+    // Aim for a few pieces per thread so uneven objects still balance out, but don't bother cutting tiny files up
+    const size_t threadCount = max(1u, thread::hardware_concurrency());
+    const size_t pieceBytes = max<size_t>(size / (4 * threadCount), 64 * 1024);
+
+    //
+    // 1) Find sections
+    //
+    vector<ObjSection> sections(1); // Anything before the first 'o' line goes into an unnamed section
+    vector<ObjPiece> pieces(1);
+    pieces[0].Begin = data;
+
+    UINT posTotal = 0, texTotal = 0, normTotal = 0;
+    size_t lineCount = 0;
+
+    auto startPiece = [&](const char* begin)
+    {
+        pieces.back().End = begin;
+
+        ObjPiece piece;
+        piece.Section = sections.size() - 1;
+        piece.Begin = begin;
+        piece.PosBase = posTotal;
+        piece.TexBase = texTotal;
+        piece.NormBase = normTotal;
+        pieces.push_back(move(piece));
+    };
+
+    {
+        ObjReader reader(data, data + size);
+        while (reader.NextLine())
+        {
+            switch (reader.Element())
+            {
+            case ObjReader::ELEMENT::OBJECT:
+            {
+                const char* nameBegin;
+                const char* nameEnd;
+                reader.ReadName(nameBegin, nameEnd);
+
+                ObjSection section;
+                section.Name = string(nameBegin, nameEnd);
+                sections.push_back(move(section));
+                startPiece(reader.LineStart());
+                break;
+            }
+            case ObjReader::ELEMENT::POSITION:
+                ++pieces.back().PosCount;
+                ++posTotal;
+                break;
+            case ObjReader::ELEMENT::TEXCOORD:
+                ++pieces.back().TexCount;
+                ++texTotal;
+                break;
+            case ObjReader::ELEMENT::NORMAL:
+                ++pieces.back().NormCount;
+                ++normTotal;
+                break;
+            case ObjReader::ELEMENT::FACE:
+                // Cut large objects into several pieces, once the current piece has grown past the target size
+                if ((size_t)(reader.LineStart() - pieces.back().Begin) >= pieceBytes)
+                    startPiece(reader.LineStart());
+                ++pieces.back().FaceCount;
+                break;
+            default:
+                break;
+            }
+        }
+
+        pieces.back().End = data + size;
+        lineCount = reader.LineCount();
+    }
+
+    for (size_t i = 0; i < pieces.size(); ++i)
+    {
+        auto& section = sections[pieces[i].Section];
+        if (section.PieceCount == 0)
+            section.FirstPiece = i;
+        ++section.PieceCount;
+    }
+
+    //
+    // 2) Vertex attributes
+    //
+    vector<XMFLOAT3> positions(posTotal);
+    vector<XMFLOAT2> texcoords(texTotal);
+    vector<XMFLOAT3> normals(normTotal);
+
+    ParallelFor(pieces.size(), [&](size_t i)
+    {
+        auto& piece = pieces[i];
+        auto p = positions.data() + piece.PosBase;
+        auto t = texcoords.data() + piece.TexBase;
+        auto n = normals.data() + piece.NormBase;
+
+        ObjReader reader(piece.Begin, piece.End);
+        while (reader.NextLine())
+        {
+            switch (reader.Element())
+            {
+            case ObjReader::ELEMENT::POSITION:
+                *p = XMFLOAT3(0.0f, 0.0f, 0.0f);
+                reader.ReadFloat3(*p);
+
+                piece.Min.x = min(piece.Min.x, p->x);
+                piece.Min.y = min(piece.Min.y, p->y);
+                piece.Min.z = min(piece.Min.z, p->z);
+                piece.Max.x = max(piece.Max.x, p->x);
+                piece.Max.y = max(piece.Max.y, p->y);
+                piece.Max.z = max(piece.Max.z, p->z);
+                ++p;
+                break;
+            case ObjReader::ELEMENT::TEXCOORD:
+                *t = XMFLOAT2(0.0f, 0.0f);
+                reader.ReadFloat2(*t++);
+                break;
+            case ObjReader::ELEMENT::NORMAL:
+                *n = XMFLOAT3(0.0f, 0.0f, 0.0f);
+                reader.ReadFloat3(*n++);
+                break;
+            default:
+                break;
+            }
+        }
+    });
+
+    //
+    // 3) Faces. Every attribute is in place by now, so pieces may freely reference each other's data.
+    //
+    ParallelFor(pieces.size(), [&](size_t i)
+    {
+        auto& piece = pieces[i];
+        ObjCornerMap verts_added(3 * piece.FaceCount);
+        piece.Indices.reserve(3 * piece.FaceCount);
+
+        // Running attribute counts, needed to resolve negative (relative) indices
+        int posSeen = (int)piece.PosBase;
+        int texSeen = (int)piece.TexBase;
+        int normSeen = (int)piece.NormBase;
+
+        ObjReader reader(piece.Begin, piece.End);
+        while (reader.NextLine())
+        {
+            switch (reader.Element())
+            {
+            case ObjReader::ELEMENT::POSITION:
+                ++posSeen;
+                break;
+            case ObjReader::ELEMENT::TEXCOORD:
+                ++texSeen;
+                break;
+            case ObjReader::ELEMENT::NORMAL:
+                ++normSeen;
+                break;
+            case ObjReader::ELEMENT::FACE:
+            {
+                int vi, ti, ni;
+                while (reader.ReadFaceVertex(vi, ti, ni))
+                {
+                    // Against what precedes the face in the file, as the serial parser checks it
+                    if (!ObjReader::ResolveIndex(vi, posSeen, vi) || vi < 0 ||
+                        !ObjReader::ResolveIndex(ti, texSeen, ti) ||
+                        !ObjReader::ResolveIndex(ni, normSeen, ni))
+                    {
+                        piece.Error = -2;
+                        return;
+                    }
+
+                    bool isNew = false;
+                    UINT vertex_id = verts_added.FindOrInsert(vi, ti, ni, (UINT)piece.Vertices.size(), isNew);
+                    if (vertex_id == ObjCornerMap::INVALID)
+                    {
+                        piece.Error = -3;
+                        return;
+                    }
+                    if (isNew)
+                    {
+                        Vertex v;
+                        v.Pos = positions[vi];
+                        v.TexC = ti >= 0 ? texcoords[ti] : XMFLOAT2(0.0f, 0.0f);
+                        v.Normal = ni >= 0 ? normals[ni] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+                        piece.Vertices.push_back(v);
+                    }
+
+                    piece.Indices.push_back(vertex_id);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    });
+
+    for (auto& piece : pieces)
+    {
+        if (piece.Error < 0)
+            return piece.Error;
+    }
+
+    //
+    // 4) Stitch
+    //
+    size_t vertexTotal = 0;
+    size_t indexTotal = 0;
+    for (auto& piece : pieces)
+    {
+        vertexTotal += piece.Vertices.size();
+        indexTotal += piece.Indices.size();
+    }
+
+    vertices.reserve(vertexTotal);
+    indices.reserve(indexTotal);
+
+    for (auto& section : sections)
+    {
+        ObjObject object;
+        object.Name = section.Name;
+        object.BaseVertexLocation = (UINT)vertices.size();
+        object.StartIndexLocation = (UINT)indices.size();
+
+        for (size_t i = section.FirstPiece; i < section.FirstPiece + section.PieceCount; ++i)
+        {
+            auto& piece = pieces[i];
+
+            // Indices of later pieces are shifted past the vertices of the earlier pieces of the same object
+            const UINT offset = (UINT)vertices.size() - object.BaseVertexLocation;
+            for (auto idx : piece.Indices)
+                indices.push_back(idx + offset);
+            vertices.insert(vertices.end(), piece.Vertices.begin(), piece.Vertices.end());
+
+            auto& bmin = object.BoundsMin;
+            auto& bmax = object.BoundsMax;
+            bmin = XMFLOAT3(min(bmin.x, piece.Min.x), min(bmin.y, piece.Min.y), min(bmin.z, piece.Min.z));
+            bmax = XMFLOAT3(max(bmax.x, piece.Max.x), max(bmax.y, piece.Max.y), max(bmax.z, piece.Max.z));
+        }
+
+        object.IndexCount = (UINT)indices.size() - object.StartIndexLocation;
+
+        // The unnamed leading section is normally empty
+        if (section.Name.empty() && object.IndexCount == 0)
+            continue;
+
+        objects.push_back(move(object));
+    }
+
+    auto elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - startTime).count();
+    char msg[256];
+    snprintf(msg, sizeof(msg), "ObjParser (parallel, %zu pieces): %zu lines, %zu vertices, %zu indices in %.2f ms (%.0f lines/s)\n",
+        pieces.size(), lineCount, vertices.size(), indices.size(), elapsed * 1000.0, elapsed > 0.0 ? lineCount / elapsed : 0.0);
+    DebugOutput(msg);
+
+    return 0;
+}
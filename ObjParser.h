@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <DirectXMath.h>
+#include <cfloat> // FLT_MAX
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Vertex; // Vertex.h
+
+// How LoadOBJ goes about parsing the file
+enum class OBJ_LOAD_MODE
+{
+    // Parse the file front to back on the calling thread
+    SERIAL,
+    // Split the file at object boundaries (and further, for large objects) and parse the pieces on worker threads
+    PARALLEL
+};
+
+/*
+An object ('o' block) of an OBJ file as ObjParser returns it: a range of the indices, relative to BaseVertexLocation, and
+the box around the positions listed in the block. Faces before the first 'o' line make up an object named "".
+*/
+struct ObjObject
+{
+    std::string Name;
+    UINT StartIndexLocation = 0;
+    UINT IndexCount = 0;
+    UINT BaseVertexLocation = 0;
+
+    // Min is above Max if the block lists no positions
+    DirectX::XMFLOAT3 BoundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+    DirectX::XMFLOAT3 BoundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+};
+
+/*
+Turns the text of an OBJ file into deduplicated vertices and triangle list indices, with ObjReader and ObjCornerMap.
+Needs neither D3D12 nor Windows, so Mesh::ParseOBJ and the terrain (see Simulation::LoadTerrain) read levels through
+the same code, in the app and in HeadlessRunner alike.
+*/
+class ObjParser
+{
+public:
+    /*
+    Parses the text in [begin, end). Objects are listed in file order. Corners without a texture coordinate or normal
+    get zero ones. Returns -2 if a face indexes a position, texture coordinate or normal that isn't there, -3 if a
+    face indexes one beyond ObjCornerMap::MAX_INDEX. Returns 0 for success.
+    */
+    static int Parse(const char* begin, const char* end, OBJ_LOAD_MODE mode, std::vector<Vertex>& vertices,
+        std::vector<std::uint32_t>& indices, std::vector<ObjObject>& objects);
+
+    // Reads the whole file and parses it, as Parse. Returns -1 if the file can't be read.
+    static int ParseFile(const std::string& filename, OBJ_LOAD_MODE mode, std::vector<Vertex>& vertices,
+        std::vector<std::uint32_t>& indices, std::vector<ObjObject>& objects);
+
+private:
+    static int ParseSerial(const char* begin, const char* end, std::vector<Vertex>& vertices,
+        std::vector<std::uint32_t>& indices, std::vector<ObjObject>& objects);
+    static int ParseParallel(const char* begin, const char* end, std::vector<Vertex>& vertices,
+        std::vector<std::uint32_t>& indices, std::vector<ObjObject>& objects);
+};
@@ -0,0 +1,391 @@
+#include "ObjReader.h"
+
+#include <cstring> // memchr
+
+using namespace DirectX;
+
+namespace
+{
+    // Exact powers of ten that fit in a double; enough for the 6 decimals Blender writes, and then some.
+    const double Pow10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool IsDigit(char c)
+    {
+        return (unsigned)(c - '0') < 10u;
+    }
+
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+}
+
+bool ObjReader::NextLine()
+{
+    while (mNext < mEnd)
+    {
+        mLineStart = mNext;
+
+        auto nl = static_cast<const char*>(memchr(mNext, '\n', mEnd - mNext));
+        mLineEnd = nl ? nl : mEnd;
+        mNext = nl ? nl + 1 : mEnd;
+        ++mLineCount;
+
+        // Classify on the keyword. Anything we don't recognize is skipped without further inspection.
+        const char* p = mLineStart;
+        const size_t len = mLineEnd - mLineStart;
+        if (len < 2)
+            continue;
+
+        if (p[0] == 'v')
+        {
+            if (p[1] == ' ')
+            {
+                mElement = ELEMENT::POSITION;
+                mCursor = p + 2;
+            }
+            else if (p[1] == 't' && len > 2 && p[2] == ' ')
+            {
+                mElement = ELEMENT::TEXCOORD;
+                mCursor = p + 3;
+            }
+            else if (p[1] == 'n' && len > 2 && p[2] == ' ')
+            {
+                mElement = ELEMENT::NORMAL;
+                mCursor = p + 3;
+            }
+            else
+                continue;
+        }
+        else if (p[0] == 'f' && p[1] == ' ')
+        {
+            mElement = ELEMENT::FACE;
+            mCursor = p + 2;
+        }
+        else if (p[0] == 'o' && p[1] == ' ')
+        {
+            mElement = ELEMENT::OBJECT;
+            mCursor = p + 2;
+        }
+        else
+            continue;
+
+        return true;
+    }
+
+    mElement = ELEMENT::NONE;
+    return false;
+}
+
+size_t ObjReader::Count(const char* begin, const char* end, ELEMENT element)
+{
+    size_t count = 0;
+
+    ObjReader reader(begin, end);
+    while (reader.NextLine())
+    {
+        if (reader.Element() == element)
+            ++count;
+    }
+
+    return count;
+}
+
+void ObjReader::SkipBlanks()
+{
+    while (mCursor < mLineEnd && IsBlank(*mCursor))
+        ++mCursor;
+}
+
+bool ObjReader::ReadFloat(float& out)
+{
+    SkipBlanks();
+
+    auto p = ParseFloat(mCursor, mLineEnd, out);
+    if (!p)
+        return false;
+
+    mCursor = p;
+    return true;
+}
+
+bool ObjReader::ReadFloat2(XMFLOAT2& out)
+{
+    return ReadFloat(out.x) && ReadFloat(out.y);
+}
+
+bool ObjReader::ReadFloat3(XMFLOAT3& out)
+{
+    return ReadFloat(out.x) && ReadFloat(out.y) && ReadFloat(out.z);
+}
+
+bool ObjReader::ResolveIndex(int index, int count, int& resolved)
+{
+    resolved = (index < 0) ? count + index : index - 1;
+    return index == 0 || (resolved >= 0 && resolved < count);
+}
+
+bool ObjReader::ReadFaceVertex(int& v, int& vt, int& vn)
+{
+    SkipBlanks();
+
+    v = vt = vn = 0;
+
+    auto p = ParseInt(mCursor, mLineEnd, v);
+    if (!p)
+        return false;
+
+    // v/vt/vn, v//vn or v/vt
+    if (p < mLineEnd && *p == '/')
+    {
+        ++p;
+        if (p < mLineEnd && *p != '/')
+        {
+            auto q = ParseInt(p, mLineEnd, vt);
+            if (q)
+                p = q;
+        }
+
+        if (p < mLineEnd && *p == '/')
+        {
+            ++p;
+            auto q = ParseInt(p, mLineEnd, vn);
+            if (q)
+                p = q;
+        }
+    }
+
+    mCursor = p;
+    return true;
+}
+
+void ObjReader::ReadName(const char*& begin, const char*& end)
+{
+    SkipBlanks();
+
+    begin = mCursor;
+    end = mLineEnd;
+
+    // Trim trailing whitespace (typically the \r of a CRLF file)
+    while (end > begin && IsBlank(*(end - 1)))
+        --end;
+
+    mCursor = mLineEnd;
+}
+
+const char* ObjReader::ParseInt(const char* p, const char* end, int& out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    if (p >= end || !IsDigit(*p))
+        return nullptr;
+
+    int value = 0;
+    while (p < end && IsDigit(*p))
+        value = value * 10 + (*p++ - '0');
+
+    out = negative ? -value : value;
+    return p;
+}
+
+/*
+Parses [sign] digits [. digits] [e|E [sign] digits].
+
+The mantissa is accumulated as an integer and scaled once at the end, which is exact for everything Blender
+exports (%f, i.e. 6 decimals) and far cheaper than atof, which also has to deal with locales, hex floats, inf/nan...
+*/
+const char* ObjReader::ParseFloat(const char* p, const char* end, float& out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+
+    // Integer part. Digits beyond what a 64-bit mantissa can hold only shift the exponent.
+    while (p < end && IsDigit(*p))
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                ++digits;
+        }
+        else
+            ++exponent;
+
+        ++p;
+        any = true;
+    }
+
+    // Fractional part
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && IsDigit(*p))
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            }
+
+            ++p;
+            any = true;
+        }
+    }
+
+    if (!any)
+        return nullptr;
+
+    // Exponent
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int e = 0;
+        auto q = ParseInt(p + 1, end, e);
+        if (q)
+        {
+            exponent += e;
+            p = q;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0)
+    {
+        // Split very small exponents so we never index outside the table
+        while (exponent < -22)
+        {
+            value /= Pow10[22];
+            exponent += 22;
+        }
+        value /= Pow10[-exponent];
+    }
+    else if (exponent > 0)
+    {
+        while (exponent > 22)
+        {
+            value *= Pow10[22];
+            exponent -= 22;
+        }
+        value *= Pow10[exponent];
+    }
+
+    out = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+ObjCornerMap::ObjCornerMap(size_t expectedCount)
+{
+    size_t capacity = 16;
+    while (capacity < 2 * expectedCount)
+        capacity <<= 1;
+
+    Rehash(capacity);
+}
+
+const int ObjCornerMap::MAX_INDEX;
+const UINT ObjCornerMap::INVALID;
+
+bool ObjCornerMap::Pack(int v, int vt, int vn, std::uint64_t& key)
+{
+    static_assert(MAX_INDEX + 1 == (1 << KEY_BITS) - 1, "MAX_INDEX + 1 must fill KEY_BITS");
+
+    // Larger indices would spill into the neighbouring component, and distinct corners would collide
+    if (v < -1 || vt < -1 || vn < -1 || v > MAX_INDEX || vt > MAX_INDEX || vn > MAX_INDEX)
+        return false;
+
+    // +1 so that missing components (-1) map to 0
+    key = ((std::uint64_t)(v + 1) << (2 * KEY_BITS)) | ((std::uint64_t)(vt + 1) << KEY_BITS) | (std::uint64_t)(vn + 1);
+    return true;
+}
+
+size_t ObjCornerMap::Home(std::uint64_t key) const
+{
+    // Fibonacci hashing; the top bits of the product are well mixed even for sequential keys
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> mShift);
+}
+
+void ObjCornerMap::Rehash(size_t capacity)
+{
+    std::vector<Slot> old;
+    old.swap(mSlots);
+
+    mSlots.assign(capacity, Slot{ EMPTY, 0 });
+    mMask = capacity - 1;
+
+    mShift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1)
+        --mShift;
+
+    for (auto& slot : old)
+    {
+        if (slot.Key == EMPTY)
+            continue;
+
+        size_t i = Home(slot.Key);
+        while (mSlots[i].Key != EMPTY)
+            i = (i + 1) & mMask;
+
+        mSlots[i] = slot;
+    }
+}
+
+UINT ObjCornerMap::FindOrInsert(int v, int vt, int vn, UINT newIndex, bool& inserted)
+{
+    inserted = false;
+
+    std::uint64_t key;
+    if (!Pack(v, vt, vn, key))
+        return INVALID;
+
+    size_t i = Home(key);
+    while (true)
+    {
+        auto& slot = mSlots[i];
+        if (slot.Key == key)
+        {
+            inserted = false;
+            return slot.Value;
+        }
+
+        if (slot.Key == EMPTY)
+            break;
+
+        i = (i + 1) & mMask;
+    }
+
+    // Keep the load factor at or below one half. Rehashing invalidates the probe position, so look it up again.
+    if (2 * (mSize + 1) > mSlots.size())
+    {
+        Rehash(2 * mSlots.size());
+
+        i = Home(key);
+        while (mSlots[i].Key != EMPTY)
+            i = (i + 1) & mMask;
+    }
+
+    mSlots[i].Key = key;
+    mSlots[i].Value = newIndex;
+    ++mSize;
+
+    inserted = true;
+    return newIndex;
+}
@@ -1,9 +1,144 @@
 #pragma once
 
-#include "FrameResource.h" // for Vertex
+#include "Platform.h"
 
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Single pass tokenizer over an in-memory OBJ file.
+
+The reader never copies the buffer and never allocates; it walks it line by line, classifies each line
+and lets the caller pull the numbers out of it in place. The buffer must outlive the reader.
+
+Typical use:
+
+    ObjReader reader(begin, end);
+    while (reader.NextLine())
+    {
+        if (reader.Element() == ObjReader::ELEMENT::POSITION)
+            reader.ReadFloat3(pos);
+        ...
+    }
+*/
 class ObjReader
 {
+public:
+    /*
+    We process:
+    'v': vertex position
+    'vt': vertex texture coord
+    'vn': vertex normal
+    'f': face indices
+    'o': object name
+
+    Everything else ('#' comments, mtllib, usemtl, 's' smoothing groups...) is skipped by NextLine()
+    */
+    enum class ELEMENT
+    {
+        NONE,
+        POSITION,
+        TEXCOORD,
+        NORMAL,
+        FACE,
+        OBJECT
+    };
+
+    ObjReader(const char* begin, const char* end)
+        : mNext(begin), mEnd(end) {};
+
+    // Advances to the next line we care about. Returns false once the buffer is exhausted.
+    bool NextLine();
+
+    ELEMENT Element() const { return mElement; }
+
+    // Number of lines visited so far, including the ones that were skipped
+    size_t LineCount() const { return mLineCount; }
+
+    // Start of the current line, so a caller can remember where an element begins
+    const char* LineStart() const { return mLineStart; }
+
+    // Parse the next number(s) on the current line. Return false if the line runs out of tokens.
+    bool ReadFloat(float&);
+    bool ReadFloat2(DirectX::XMFLOAT2&);
+    bool ReadFloat3(DirectX::XMFLOAT3&);
+
+    // Parse the next face corner of the form v/vt/vn. Indices are returned exactly as written in the file (1-based,
+    // or negative for relative indexing). Missing vt/vn components are returned as 0.
+    bool ReadFaceVertex(int& v, int& vt, int& vn);
+
+    // Turns an index as ReadFaceVertex returns it into a 0-based one among the count elements of its kind read so far,
+    // or -1 if it was missing (0). Returns false if it refers to none of them.
+    static bool ResolveIndex(int index, int count, int& resolved);
+
+    // The object name of an 'o' line, as a range into the buffer.
+    void ReadName(const char*& begin, const char*& end);
 
+    // Counts the lines of the given kind in [begin, end) without parsing them. Used to pre-size containers.
+    static size_t Count(const char* begin, const char* end, ELEMENT element);
+
+    // Number parsing, exposed so other parts of the loader can reuse it.
+    // Both return a pointer past the last consumed character, or nullptr if there was no number at p.
+    static const char* ParseFloat(const char* p, const char* end, float& out);
+    static const char* ParseInt(const char* p, const char* end, int& out);
+
+private:
+    void SkipBlanks();
+
+    ELEMENT mElement = ELEMENT::NONE;
+    size_t mLineCount = 0;
+
+    const char* mLineStart = nullptr;
+    const char* mCursor = nullptr;  // read position within the current line
+    const char* mLineEnd = nullptr; // one past the last character of the current line (excluding newline)
+    const char* mNext = nullptr;    // start of the next line
+    const char* mEnd = nullptr;
 };
 
+/*
+Maps a face corner, i.e. its resolved 0-based (position, texcoord, normal) index triple, to the index of the vertex
+that was built for it.
+
+Open addressing with linear probing over a flat array of (packed key, value) slots. The three indices are packed into
+a single 64-bit key (21 bits each), so a probe is one integer compare and a lookup-or-insert is a single search.
+Missing components (-1) are fine, as every index is stored off by one.
+*/
+class ObjCornerMap
+{
+public:
+    // expectedCount is the number of distinct corners we expect; the table is sized to stay at most half full,
+    // and grows if the estimate was too low.
+    explicit ObjCornerMap(size_t expectedCount);
+
+    // Largest index of each component a key can hold
+    static const int MAX_INDEX = (1 << 21) - 2;
+    static const UINT INVALID = ~0u;
+
+    // Returns the vertex index registered for the corner. If there is none, registers newIndex and sets inserted.
+    // Returns INVALID, registering nothing, if a component is below -1 or above MAX_INDEX.
+    UINT FindOrInsert(int v, int vt, int vn, UINT newIndex, bool& inserted);
+
+    size_t Size() const { return mSize; }
+
+private:
+    static const std::uint64_t EMPTY = 0; // an all-zero key would need every index to be -1
+    static const int KEY_BITS = 21;
+
+    struct Slot
+    {
+        std::uint64_t Key;
+        UINT Value;
+    };
+
+    // False if the indices don't fit a key
+    static bool Pack(int v, int vt, int vn, std::uint64_t& key);
+    size_t Home(std::uint64_t key) const;
+    void Rehash(size_t capacity);
+
+    std::vector<Slot> mSlots;
+    size_t mMask = 0;
+    int mShift = 0;
+    size_t mSize = 0;
+};
@@ -75,16 +75,45 @@ Yaw is about vertical axis (Y)
 Pitch is about transverse axis (X)
 
 */
-void Plane::Update(const Timer& t)
+void Plane::Update(float dt)
 {
 	if (mPitching != STEER::NONE)
-		mPitch += ((mPitching == STEER::POSITIVE) ? 1.0f : -1.0f) * t.DeltaTime();
+		mPitch += ((mPitching == STEER::POSITIVE) ? 1.0f : -1.0f) * dt;
 	if (mYawing != STEER::NONE)
-		mYaw += ((mYawing == STEER::POSITIVE) ? 1.0f : -1.0f) * t.DeltaTime();
+		mYaw += ((mYawing == STEER::POSITIVE) ? 1.0f : -1.0f) * dt;
 	if (mRolling != STEER::NONE)
-		mRoll += ((mRolling == STEER::POSITIVE) ? 1.0f : -1.0f) * t.DeltaTime();
+		mRoll += ((mRolling == STEER::POSITIVE) ? 1.0f : -1.0f) * dt;
 
-	UpdatePosition(); // todo use a dirty flag here; we dont want to needlessly spam these calculations
+	mPrevPos = mPos;
+	mPrevOrientation = mOrientation;
+
+	// Once the plane stops, the drawn state still has to catch up with the last step
+	bool wasMoving = mMoving;
+	mMoving = UpdatePosition(dt);
+	mViewDirty = mViewDirty || wasMoving || mMoving;
+}
+
+void Plane::Interpolate(float alpha)
+{
+	if (!mViewDirty)
+		return;
+
+	auto rot = XMQuaternionSlerp(XMLoadFloat4(&mPrevOrientation), XMLoadFloat4(&mOrientation), alpha);
+	auto pos = XMVectorLerp(XMLoadFloat4(&mPrevPos), XMLoadFloat4(&mPos), alpha);
+
+	// Camera [right, up, forward, pos]; it is a rotation and a translation, so the view is its rigid inverse
+	auto camera = XMMatrixRotationQuaternion(rot);
+	camera.r[3] = XMVectorSetW(pos, 1.0f);
+	XMStoreFloat4x4(&mView, Math::RigidInverse(camera));
+
+	float pAddZ = 10.0f;
+	float pAddY = 5.0f;
+	auto planepos = camera.r[3] + pAddZ * camera.r[2] - pAddY * camera.r[1];
+	auto world = XMMATRIX(-1.0f * camera.r[0], camera.r[1], -1.0f * camera.r[2], planepos);
+	XMStoreFloat4x4(&mModelWorld, world);
+
+	// While moving, every alpha gives a different view
+	mViewDirty = mMoving;
 }
 
 XMMATRIX Plane::View()
@@ -92,20 +121,26 @@ XMMATRIX Plane::View()
 	return DirectX::XMLoadFloat4x4(&mView);
 }
 
+XMMATRIX Plane::ModelWorld()
+{
+	return DirectX::XMLoadFloat4x4(&mModelWorld);
+}
+
 // This is not good. Not good. We assume [v] has xaxis in row0 etc, but the view matrix we STORE(mView) is INVERTED. That's why 
 // regular rendering using this camera works, and yet the shadow rendering doesn't.
 void Plane::SetView(DirectX::XMMATRIX v)
 {
-	// we reconstruct the view every update()
-	auto& x = v.r[0];
-	auto& y = v.r[1];
-	auto& z = v.r[2];
-	auto& pos = v.r[3];
+	auto rot = XMQuaternionNormalize(XMQuaternionRotationMatrix(v));
+	XMStoreFloat4(&mOrientation, rot);
+	XMStoreFloat4(&mPos, XMVectorSetW(v.r[3], 1.0f));
+	UpdateAxes(rot);
 
-	DirectX::XMStoreFloat4(&mAxisX, x);
-	DirectX::XMStoreFloat4(&mAxisY, y);
-	DirectX::XMStoreFloat4(&mAxisZ, z);
-	DirectX::XMStoreFloat4(&mPos, pos);
+	// A jump, not a move: nothing to interpolate from
+	mPrevPos = mPos;
+	mPrevOrientation = mOrientation;
+	mMoving = false;
+	mViewDirty = true;
+	Interpolate(1.0f);
 }
 
 float Plane::X()
@@ -126,69 +161,62 @@ DirectX::XMFLOAT3 Plane::GetPos3f()
 	return { mPos.x, mPos.y, mPos.z };
 }
 
-void Plane::UpdatePosition()
+void Plane::SetPosition(DirectX::FXMVECTOR pos)
 {
-	// Handle rotations first
-	auto xax = DirectX::XMLoadFloat4(&mAxisX);
-	auto yax = DirectX::XMLoadFloat4(&mAxisY);
-	auto zax = DirectX::XMLoadFloat4(&mAxisZ);
-
-	DirectX::XMMATRIX P = DirectX::XMMatrixIdentity();
-	DirectX::XMMATRIX Y = DirectX::XMMatrixIdentity();
-	DirectX::XMMATRIX R = DirectX::XMMatrixIdentity();
-
-	P = DirectX::XMMatrixRotationAxis(xax, mPitch);
-	Y = DirectX::XMMatrixRotationAxis(yax, mYaw);
-	R = DirectX::XMMatrixRotationAxis(zax, mRoll);
-
-	// Experiment with order... or disable all but one?
-	DirectX::XMMATRIX T = P * R * Y;
+	XMStoreFloat4(&mPos, XMVectorSetW(pos, 1.0f));
+	mViewDirty = true;
+}
 
+DirectX::XMFLOAT4 Plane::GetOrientation4f()
+{
+	return mOrientation;
+}
 
-	xax = XMVector3Normalize(XMVector4Transform(xax, T));
-	yax = XMVector3Normalize(XMVector4Transform(yax, T));
-	zax = XMVector3Normalize(XMVector4Transform(zax, T));
+bool Plane::UpdatePosition(float dt)
+{
+	bool rotating = mPitch != 0.0f || mYaw != 0.0f || mRoll != 0.0f;
+	if (!rotating && !mIsAccelerating)
+		return false;
 
-	DirectX::XMStoreFloat4(&mAxisX, xax);
-	DirectX::XMStoreFloat4(&mAxisY, yax);
-	DirectX::XMStoreFloat4(&mAxisZ, zax);
+	// Handle rotations first
+	if (rotating)
+	{
+		// About the plane's own axes, pitch then roll then yaw: q' = P * R * Y * q
+		auto P = XMQuaternionRotationNormal(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), mPitch);
+		auto R = XMQuaternionRotationNormal(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), mRoll);
+		auto Y = XMQuaternionRotationNormal(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), mYaw);
+
+		auto rot = XMQuaternionMultiply(XMQuaternionMultiply(XMQuaternionMultiply(P, R), Y), XMLoadFloat4(&mOrientation));
+		rot = XMQuaternionNormalize(rot);
+		XMStoreFloat4(&mOrientation, rot);
+		UpdateAxes(rot);
+
+		mPitch = 0.0f;
+		mYaw = 0.0f;
+		mRoll = 0.0f;
+	}
 
 	// Update position
 
-	// acceleration modulation hack
-	float accel = 1.1f;
-	auto pos = DirectX::XMLoadFloat4(&mPos);
-
 	if (mIsAccelerating)
 	{
+		float step = mThrustSpeed * dt;
+		auto pos = DirectX::XMLoadFloat4(&mPos);
+		auto zax = DirectX::XMLoadFloat4(&mAxisZ);
 		if (!mIsReversing)
-			pos = DirectX::XMVectorAdd(pos, accel*zax); 
+			pos = DirectX::XMVectorAdd(pos, step*zax);
 		else
-			pos = DirectX::XMVectorSubtract(pos, accel*zax);
+			pos = DirectX::XMVectorSubtract(pos, step*zax);
 		DirectX::XMStoreFloat4(&mPos, pos);
 	}
 
-	// Create view matrix [right, up, forward, pos]
-	DirectX::XMMATRIX view = DirectX::XMMATRIX(xax, yax, zax, pos);
-	auto det = DirectX::XMMatrixDeterminant(view);
-	DirectX::XMStoreFloat4x4(&mView, DirectX::XMMatrixInverse(&det, view)); // maybe dont need transpose if using colmajor but well see
-
-	float pAddZ = 10.0f;
-	float pAddY = 5.0f;
-	auto planepos = pos;
-	planepos += pAddZ * zax;
-	planepos -= pAddY * yax;
-	auto pview = XMMATRIX(-1.0f*xax, yax, -1.0f*zax, planepos);
-
-	if (mPlaneRenderItem)
-		XMStoreFloat4x4(&mPlaneRenderItem->Instance(0).World, pview);
-
-	mPitch = 0.0f;
-	mYaw = 0.0f;
-	mRoll = 0.0f;
+	return true;
 }
 
-void Plane::AddRenderItem(std::shared_ptr<RenderItem> pri)
+void Plane::UpdateAxes(DirectX::FXMVECTOR orientation)
 {
-	mPlaneRenderItem = pri;
+	auto axes = XMMatrixRotationQuaternion(orientation);
+	XMStoreFloat4(&mAxisX, axes.r[0]);
+	XMStoreFloat4(&mAxisY, axes.r[1]);
+	XMStoreFloat4(&mAxisZ, axes.r[2]);
 }
\ No newline at end of file
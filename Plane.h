@@ -1,8 +1,6 @@
 #pragma once
 
-#include "Utilities.h"
-#include "Timer.h"
-#include "RenderItem.h"
+#include "MathF.h"
 #include <functional>
 
 /*
@@ -36,23 +34,35 @@ public:
 	void Reverse(bool);
 	void Reverse();
 
-	void Update(const Timer&);
-	void UpdatePosition();
+	// One fixed simulation step of dt seconds
+	void Update(float dt);
+
+	// Applies the steering gathered since the last call, and dt seconds of thrust. Returns false, without touching
+	// anything, if there was neither.
+	bool UpdatePosition(float dt);
+
+	// Blends the last two simulation steps for drawing: View() and ModelWorld() then show the state alpha of the way
+	// from the step before the last to the last one
+	void Interpolate(float alpha);
 
 	DirectX::XMMATRIX View();
 	void SetView(DirectX::XMMATRIX);
 
+	// World matrix of the plane model, which hangs in front of the camera, as of the last Interpolate
+	DirectX::XMMATRIX ModelWorld();
+
 	DirectX::XMFLOAT3 GetPos3f();
 
+	// Moves the plane to pos after the last step, e.g. back out of the terrain it flew into. Interpolate blends to it
+	// from where the step started.
+	void SetPosition(DirectX::FXMVECTOR pos);
+	DirectX::XMFLOAT4 GetOrientation4f();
+
 	float X();
 	float Y();
 	float Z();
 
-	void AddRenderItem(std::shared_ptr<RenderItem>);
-
 private:
-	std::shared_ptr<RenderItem> mPlaneRenderItem = nullptr;
-
 	STEER mYawing = STEER::NONE;
 	STEER mRolling = STEER::NONE;
 	STEER mPitching = STEER::NONE;
@@ -66,8 +76,23 @@ private:
 
 	DirectX::XMFLOAT4 mPos = { 0.0f, 0.0f, 0.0f, 1.0f };
 
-	DirectX::XMFLOAT4X4 mView;
-	DirectX::XMFLOAT4X4 mPlaneView1;
+	// Orientation quaternion; the camera is [mAxisX, mAxisY, mAxisZ, mPos] and the plane model hangs in front of it
+	DirectX::XMFLOAT4 mOrientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// State after the step before the last, for Interpolate
+	DirectX::XMFLOAT4 mPrevPos = { 0.0f, 0.0f, 0.0f, 1.0f };
+	DirectX::XMFLOAT4 mPrevOrientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// Whether the last step changed the state, and whether mView and mModelWorld are behind it
+	bool mMoving = false;
+	bool mViewDirty = true;
+
+	// As interpolated for drawing
+	DirectX::XMFLOAT4X4 mView = Math::Identity4x4();
+	DirectX::XMFLOAT4X4 mModelWorld = Math::Identity4x4();
+
+	// Rows of the rotation of mOrientation, for the force model
+	void UpdateAxes(DirectX::FXMVECTOR orientation);
 
 	DirectX::XMFLOAT4 mAxisX = { 1.0f, 0.0f, 0.0f, 0.0f};
 	DirectX::XMFLOAT4 mAxisY = { 0.0f, 1.0f, 0.0f, 0.0f };
@@ -83,5 +108,8 @@ private:
 	float mAccelMin = 0.0f;
 	float mAccelMax = 5.0f;
 	float mAccelRate = 1.0f;
+
+	// Units per second under thrust; the 1.1 units a frame it used to move at 60 fps
+	float mThrustSpeed = 66.0f;
 };
 
@@ -0,0 +1,16 @@
+#include "Platform.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+void DebugOutput(const char* msg)
+{
+#ifdef _WIN32
+    OutputDebugStringA(msg);
+#else
+    fputs(msg, stderr);
+#endif
+}
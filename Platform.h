@@ -0,0 +1,11 @@
+#pragma once
+
+/*
+The little the parts that also build without Windows take from it: the simulation, the BVHs and OBJ reading (see
+Headless/CMakeLists.txt). windows.h defines UINT the same way, so both can be included in one translation unit.
+*/
+
+typedef unsigned int UINT;
+
+// OutputDebugStringA on Windows, stderr elsewhere
+void DebugOutput(const char* msg);
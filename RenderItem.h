@@ -55,9 +55,26 @@ struct RenderItem
 	UINT StartIndexLocation = 0;
 	int  BaseVertexLocation = 0;
 
+	// Root constants for decoding the vertices, if Geo is VERTEX_FORMAT::PACKED
+	VertexQuantization Quantization;
+
+	// The submesh above's range in Geo->Clusters; ClusterCount is 0 if it isn't clustered
+	UINT FirstCluster = 0;
+	UINT ClusterCount = 0;
+
+	// Coarser levels of detail of the submesh above, finest first. Drawn in its place when SelectLod picks them.
+	std::vector<SubmeshGeometry> Lods;
+
+	// Triangles of the submesh above in local space, for picking; null if it isn't pickable
+	const TriangleBvh* Bvh = nullptr;
+
 	// Convex hull representation
 	SubmeshGeometry CollisionMesh;
 
+	// Instances in view of each pass, as of the last cull; the first VisibleInstances[pass] of the pass's part of the
+	// instance buffer. Sized by TestApp::BuildFrameResources.
+	std::vector<UINT> VisibleInstances;
+
 public:
 	int Id() const { return mId; }
 	
@@ -83,6 +100,42 @@ public:
 		mInstances.clear();
 	}
 
+	// Picks the coarsest level of detail whose LodError, projected onto the screen at the nearest instance, stays within
+	// maxPixelError. pixelsPerUnit is the height in pixels of a world space unit at distance 1 from eye
+	// (0.5 * viewport height * proj(1, 1)). Returns 0 for the full resolution submesh, k for Lods[k - 1].
+	UINT SelectLod(DirectX::FXMVECTOR eye, float pixelsPerUnit, float maxPixelError) const
+	{
+		if (Lods.empty() || pixelsPerUnit <= 0.0f)
+			return 0;
+
+		auto center = DirectX::XMLoadFloat3(&BoundsB.Center);
+		float radius = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMLoadFloat3(&BoundsB.Extents)));
+
+		// Errors are in local space; distance divided by scale keeps the comparison there
+		float nearest = FLT_MAX;
+		for (auto& inst : mInstances)
+		{
+			auto world = DirectX::XMLoadFloat4x4(&inst.World);
+			float scale = (std::max)((std::max)(
+				DirectX::XMVectorGetX(DirectX::XMVector3Length(world.r[0])),
+				DirectX::XMVectorGetX(DirectX::XMVector3Length(world.r[1]))),
+				DirectX::XMVectorGetX(DirectX::XMVector3Length(world.r[2])));
+
+			auto c = DirectX::XMVector3TransformCoord(center, world);
+			float dist = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(c, eye))) - radius * scale;
+			if (dist <= 0.0f || scale <= 0.0f)
+				return 0;
+
+			nearest = (std::min)(nearest, dist / scale);
+		}
+
+		UINT lod = 0;
+		while (lod < Lods.size() && Lods[lod].LodError * pixelsPerUnit <= maxPixelError * nearest)
+			++lod;
+
+		return lod;
+	}
+
 private:
 	static int nextId;
 
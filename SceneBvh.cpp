@@ -0,0 +1,297 @@
+#include "SceneBvh.h"
+#include "MathF.h"
+
+#include <cfloat> // FLT_MAX
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+UINT SceneBvh::Add(const TriangleBvh* blas, FXMMATRIX world)
+{
+    UINT handle;
+    if (!mFree.empty())
+    {
+        handle = mFree.back();
+        mFree.pop_back();
+    }
+    else
+    {
+        handle = static_cast<UINT>(mInstances.size());
+        mInstances.push_back(Instance());
+    }
+
+    auto& instance = mInstances[handle];
+    instance.Blas = blas;
+    instance.Moved = false;
+    UpdateBounds(instance, world);
+
+    mRebuild = true;
+    return handle;
+}
+
+void SceneBvh::Remove(UINT instance)
+{
+    if (instance >= mInstances.size() || !mInstances[instance].Blas)
+        return;
+
+    mInstances[instance].Blas = nullptr;
+    mFree.push_back(instance);
+    mRebuild = true;
+}
+
+void SceneBvh::Clear()
+{
+    mInstances.clear();
+    mFree.clear();
+    mNodes.clear();
+    mParents.clear();
+    mLeafInstances.clear();
+    mDepth = 0;
+    mCostSum = 0.0;
+    mBuildCost = 0.0f;
+    mRebuild = false;
+    mMoved.clear();
+}
+
+void SceneBvh::SetWorld(UINT instance, FXMMATRIX world)
+{
+    if (instance >= mInstances.size() || !mInstances[instance].Blas)
+        return;
+
+    auto& moved = mInstances[instance];
+    UpdateBounds(moved, world);
+    if (!moved.Moved)
+    {
+        moved.Moved = true;
+        mMoved.push_back(instance);
+    }
+}
+
+void SceneBvh::Update()
+{
+    typedef chrono::high_resolution_clock Clock;
+
+    mStats = UpdateStats();
+    if (!mRebuild && !mMoved.empty())
+    {
+        auto start = Clock::now();
+        Refit();
+        mStats.RefitMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+        mRebuild = Cost() > RebuildCost * mBuildCost;
+    }
+
+    if (mRebuild)
+    {
+        auto start = Clock::now();
+        Build();
+        mStats.RebuildMs = chrono::duration<double, milli>(Clock::now() - start).count();
+        mStats.Rebuilt = true;
+    }
+
+    mStats.Cost = mBuildCost > 0.0f ? Cost() / mBuildCost : 1.0f;
+}
+
+float SceneBvh::Cost() const
+{
+    if (mNodes.empty())
+        return 0.0f;
+
+    float rootArea = BvhTree::HalfArea(mNodes[0].Min, mNodes[0].Max);
+    return rootArea > 0.0f ? static_cast<float>(mCostSum / rootArea) : 0.0f;
+}
+
+bool SceneBvh::RayCast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance, Hit& hit) const
+{
+    return Trace(origin, direction, maxDistance, false, hit);
+}
+
+bool SceneBvh::LineOfSight(FXMVECTOR from, FXMVECTOR to) const
+{
+    // In units of the segment, so that t = 1 is at to
+    Hit hit;
+    return !Trace(from, to - from, 1.0f, true, hit);
+}
+
+bool SceneBvh::GroundDistance(FXMVECTOR position, float maxDistance, float& distance) const
+{
+    Hit hit;
+    if (!Trace(position, XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), maxDistance, false, hit))
+        return false;
+
+    distance = hit.Distance;
+    return true;
+}
+
+void SceneBvh::Build()
+{
+    vector<BvhTree::Primitive> primitives;
+    primitives.reserve(InstanceCount());
+    for (UINT i = 0; i < mInstances.size(); ++i)
+    {
+        auto& instance = mInstances[i];
+        if (!instance.Blas)
+            continue;
+
+        BvhTree::Primitive primitive;
+        primitive.Min = instance.Min;
+        primitive.Max = instance.Max;
+        XMStoreFloat3(&primitive.Centroid, (XMLoadFloat3(&instance.Min) + XMLoadFloat3(&instance.Max)) * 0.5f);
+        primitive.Index = i;
+        primitives.push_back(primitive);
+    }
+
+    mDepth = BvhTree::Build(mNodes, primitives, MAX_LEAF_INSTANCES);
+    BvhTree::Parents(mNodes, mParents);
+
+    mLeafInstances.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i)
+        mLeafInstances[i] = primitives[i].Index;
+
+    mCostSum = 0.0;
+    for (UINT i = 0; i < mNodes.size(); ++i)
+    {
+        auto& node = mNodes[i];
+        mCostSum += BvhTree::NodeCost(node);
+        for (UINT j = node.First; j < node.First + node.Count; ++j)
+            mInstances[mLeafInstances[j]].Leaf = i;
+    }
+    mBuildCost = Cost();
+
+    // Whatever moved is in the new boxes
+    for (UINT handle : mMoved)
+        mInstances[handle].Moved = false;
+    mMoved.clear();
+    mRebuild = false;
+
+    ++mRebuilds;
+}
+
+void SceneBvh::Refit()
+{
+    for (UINT handle : mMoved)
+    {
+        auto& instance = mInstances[handle];
+        instance.Moved = false;
+
+        // Up to the first node that doesn't change: above it, nothing does, at least not on account of this instance
+        for (UINT node = instance.Leaf; node != BvhTree::NO_PARENT && RefitNode(node); node = mParents[node])
+            ;
+    }
+
+    mStats.Moved = static_cast<UINT>(mMoved.size());
+    mMoved.clear();
+    ++mRefits;
+}
+
+bool SceneBvh::RefitNode(UINT index)
+{
+    auto& node = mNodes[index];
+    XMVECTOR mn = XMVectorReplicate(FLT_MAX);
+    XMVECTOR mx = XMVectorReplicate(-FLT_MAX);
+    if (node.Count > 0)
+    {
+        for (UINT j = node.First; j < node.First + node.Count; ++j)
+        {
+            auto& instance = mInstances[mLeafInstances[j]];
+            mn = XMVectorMin(mn, XMLoadFloat3(&instance.Min));
+            mx = XMVectorMax(mx, XMLoadFloat3(&instance.Max));
+        }
+    }
+    else
+    {
+        for (UINT j = node.First; j < node.First + 2; ++j)
+        {
+            mn = XMVectorMin(mn, XMLoadFloat3(&mNodes[j].Min));
+            mx = XMVectorMax(mx, XMLoadFloat3(&mNodes[j].Max));
+        }
+    }
+    ++mStats.Refit;
+
+    XMFLOAT3 newMin, newMax;
+    XMStoreFloat3(&newMin, mn);
+    XMStoreFloat3(&newMax, mx);
+    if (newMin.x == node.Min.x && newMin.y == node.Min.y && newMin.z == node.Min.z &&
+        newMax.x == node.Max.x && newMax.y == node.Max.y && newMax.z == node.Max.z)
+        return false;
+
+    mCostSum -= BvhTree::NodeCost(node);
+    node.Min = newMin;
+    node.Max = newMax;
+    mCostSum += BvhTree::NodeCost(node);
+    return true;
+}
+
+void SceneBvh::UpdateBounds(Instance& instance, FXMMATRIX world)
+{
+    XMStoreFloat4x4(&instance.InvWorld, Math::AffineInverse(world));
+
+    auto& nodes = instance.Blas->Nodes();
+    if (nodes.empty())
+    {
+        // Nothing to hit; an empty box no ray enters
+        instance.Min = { FLT_MAX, FLT_MAX, FLT_MAX };
+        instance.Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        return;
+    }
+
+    // The world box around the transformed object box: its center moves with world, and each of its half extents adds
+    // the absolute value of its axis as world turns and scales it (Arvo, Graphics Gems 1990)
+    auto mn = XMLoadFloat3(&nodes[0].Min);
+    auto mx = XMLoadFloat3(&nodes[0].Max);
+    auto center = XMVector3TransformCoord((mn + mx) * 0.5f, world);
+    auto extents = (mx - mn) * 0.5f;
+    auto worldExtents =
+        XMVectorAbs(world.r[0]) * XMVectorSplatX(extents) +
+        XMVectorAbs(world.r[1]) * XMVectorSplatY(extents) +
+        XMVectorAbs(world.r[2]) * XMVectorSplatZ(extents);
+
+    XMStoreFloat3(&instance.Min, center - worldExtents);
+    XMStoreFloat3(&instance.Max, center + worldExtents);
+}
+
+bool SceneBvh::Trace(FXMVECTOR origin, FXMVECTOR direction, float maxT, bool anyHit, Hit& hit) const
+{
+    float closest = maxT;
+    bool found = false;
+
+    BvhTree::Traverse(mNodes, origin, direction, 0.0f, closest, [&](UINT first, UINT count)
+    {
+        for (UINT i = first; i < first + count; ++i)
+        {
+            UINT handle = mLeafInstances[i];
+            auto& instance = mInstances[handle];
+
+            // Into object space. The direction keeps the scale of world, so t along it is still t along direction.
+            auto invWorld = XMLoadFloat4x4(&instance.InvWorld);
+            auto localOrigin = XMVector3TransformCoord(origin, invWorld);
+            auto localDirection = XMVector3TransformNormal(direction, invWorld);
+
+            if (anyHit)
+            {
+                if (instance.Blas->Occludes(localOrigin, localDirection, closest))
+                {
+                    found = true;
+                    hit.Instance = handle;
+                    return true;
+                }
+                continue;
+            }
+
+            float t;
+            UINT triangle;
+            if (instance.Blas->Intersects(localOrigin, localDirection, closest, t, triangle))
+            {
+                closest = t;
+                found = true;
+                hit.Distance = t;
+                hit.Instance = handle;
+                hit.Triangle = triangle;
+            }
+        }
+        return false;
+    });
+
+    return found;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "TriangleBvh.h"
+
+/*
+The top level of a two level acceleration structure: a BvhTree over the world space boxes of instances, each of which
+places a TriangleBvh (the bottom level, in object space) in the world. Rays are taken into an instance's object space
+when they reach its leaf, so any number of instances can share one TriangleBvh.
+
+Instances that move only need their boxes refit: Update walks up from the leaf of each one that moved, so a frame in
+which a few move costs a few paths to the root, however many instances there are. As they move on, the boxes the tree
+was built over drift apart and rays visit more of them; Update rebuilds once BvhTree::Cost has grown past RebuildCost
+times what it was after the last build. Adding or removing instances rebuilds too. Call Update after changing instances
+and before querying, as the tree is only correct again then.
+*/
+class SceneBvh
+{
+public:
+    // Instances in the tree's leaves
+    static const UINT MAX_LEAF_INSTANCES = 2;
+
+    // Update rebuilds once the tree's BvhTree::Cost is this many times what it was right after the last build
+    float RebuildCost = 1.5f;
+
+    // What the last Update did, and how long it took
+    struct UpdateStats
+    {
+        UINT Moved = 0;         // Instances whose leaves were refit
+        UINT Refit = 0;         // Nodes whose boxes were recomputed
+        bool Rebuilt = false;
+        float Cost = 0.0f;      // BvhTree::Cost after the update, relative to that after the last build
+        double RefitMs = 0.0;
+        double RebuildMs = 0.0;
+    };
+
+    struct Hit
+    {
+        float Distance = 0.0f;  // Along the (unit) ray
+        UINT Instance = 0;      // As returned by Add
+        UINT Triangle = 0;      // Id in the instance's TriangleBvh
+    };
+
+    // Places blas (which has to outlive its use here) in the world with world. Returns a handle that stays valid until
+    // the instance is removed.
+    UINT Add(const TriangleBvh* blas, DirectX::FXMMATRIX world);
+    void Remove(UINT instance);
+    void Clear();
+
+    // Moves an instance; world may be any affine transform
+    void SetWorld(UINT instance, DirectX::FXMMATRIX world);
+
+    // Rebuilds the tree if instances were added or removed, refits it if any only moved, and rebuilds it if the refit
+    // made it too costly
+    void Update();
+    const UpdateStats& LastUpdate() const { return mStats; }
+
+    // Closest hit of the ray origin + t direction, t in [0, maxDistance); direction has to be unit length
+    bool RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance, Hit& hit) const;
+
+    // Whether nothing lies on the segment between from and to
+    bool LineOfSight(DirectX::FXMVECTOR from, DirectX::FXMVECTOR to) const;
+
+    // Height of position above whatever is below it (along -y), if anything is within maxDistance
+    bool GroundDistance(DirectX::FXMVECTOR position, float maxDistance, float& distance) const;
+
+    size_t InstanceCount() const { return mInstances.size() - mFree.size(); }
+    size_t NodeCount() const { return mNodes.size(); }
+    UINT Depth() const { return mDepth; }
+
+    // BvhTree::Cost, kept up to date by refits
+    float Cost() const;
+
+    // Rebuilds and refits since the start, for reporting
+    size_t Rebuilds() const { return mRebuilds; }
+    size_t Refits() const { return mRefits; }
+
+private:
+    struct Instance
+    {
+        const TriangleBvh* Blas = nullptr;  // Null for a removed instance, whose handle is free
+        DirectX::XMFLOAT4X4 InvWorld;
+        DirectX::XMFLOAT3 Min, Max;         // World space box
+        UINT Leaf = 0;                      // Node that holds it
+        bool Moved = false;                 // Since the last Update
+    };
+
+    void Build();
+
+    // Recomputes the boxes from the leaves of the instances in mMoved up to the root
+    void Refit();
+
+    // Recomputes the box of node from its instances or children; returns whether it changed
+    bool RefitNode(UINT node);
+
+    // Recomputes the world box of instance from its Blas and world
+    void UpdateBounds(Instance& instance, DirectX::FXMMATRIX world);
+
+    // Closest hit, or any hit with anyHit, for t in [0, maxT) of origin + t direction
+    bool Trace(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxT, bool anyHit, Hit& hit) const;
+
+    std::vector<Instance> mInstances;
+    std::vector<UINT> mFree;
+
+    std::vector<BvhTree::Node> mNodes;
+    std::vector<UINT> mParents;
+    std::vector<UINT> mLeafInstances;   // Instances in leaf order; leaves index into it
+    UINT mDepth = 0;
+
+    // Sum of BvhTree::NodeCost over the nodes, and Cost right after the last build
+    double mCostSum = 0.0;
+    float mBuildCost = 0.0f;
+
+    bool mRebuild = false;
+    std::vector<UINT> mMoved;
+    UpdateStats mStats;
+    size_t mRebuilds = 0;
+    size_t mRefits = 0;
+};
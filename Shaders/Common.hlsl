@@ -67,6 +67,46 @@ cbuffer cbPass : register(b0)
     Light gLights[MAX_LIGHTS];
 };
 
+//---------------------------------------------------------------------------------------
+// Packed vertices (VERTEX_FORMAT::PACKED). Must match VertexPacking on the CPU side.
+//---------------------------------------------------------------------------------------
+
+// Octahedral unit vector encoding; e in [-1, 1]^2
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += (n.xy >= 0.0f) ? -t : t;
+    return normalize(n);
+}
+
+#ifdef PACKED_VERTEX
+// Per draw, as root constants. Maps the unorm16 position/uv back into the bounds of the submesh being drawn.
+cbuffer cbQuantization : register(b1)
+{
+    float3 gPosOffset;
+    float qpad0;
+    float3 gPosScale;
+    float qpad1;
+    float2 gTexOffset;
+    float2 gTexScale;
+};
+
+struct PackedVertexIn
+{
+    float4 PosQ      : POSITION; // R16G16B16A16_UNORM
+    float2 NormalOct : NORMAL;   // R16G16_SNORM
+    float2 TexQ      : TEXCOORD; // R16G16_UNORM
+};
+
+void UnpackVertex(PackedVertexIn pin, out float3 posL, out float3 normalL, out float2 texC)
+{
+    posL = gPosOffset + gPosScale * pin.PosQ.xyz;
+    normalL = OctDecode(pin.NormalOct);
+    texC = gTexOffset + gTexScale * pin.TexQ;
+}
+#endif
+
 //---------------------------------------------------------------------------------------
 // PCF for shadow mapping.
 //---------------------------------------------------------------------------------------
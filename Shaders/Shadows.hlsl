@@ -15,8 +15,15 @@ struct VertexOut
 	nointerpolation uint MatIndex : MATINDEX;
 };
 
+#ifdef PACKED_VERTEX
+VertexOut VS(PackedVertexIn pin, uint instanceID : SV_InstanceID)
+{
+	VertexIn vin;
+	UnpackVertex(pin, vin.PosL, vin.NormalL, vin.TexC);
+#else
 VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
+#endif
 	VertexOut vout = (VertexOut)0.0f;
 
 	InstanceData idata = gInstanceData[instanceID];
@@ -0,0 +1,138 @@
+#include "Simulation.h"
+#include "ObjParser.h"
+#include "Vertex.h"
+
+using namespace std;
+using namespace DirectX;
+
+constexpr const char* Simulation::DEFAULT_LEVEL;
+
+int Simulation::LoadTerrain(const string& filename, TriangleBvh& terrain, size_t& bodyCount)
+{
+	vector<Vertex> vertices;
+	vector<uint32_t> indices;
+	vector<ObjObject> objects;
+	int result = ObjParser::ParseFile(filename, OBJ_LOAD_MODE::PARALLEL, vertices, indices, objects);
+	if (result < 0)
+		return result;
+
+	bodyCount = 0;
+	for (auto& object : objects)
+	{
+		if (IsSpinning(object.Name))
+			++bodyCount;
+		else
+			terrain.Add(vertices, indices, object);
+	}
+	terrain.Build();
+
+	return 0;
+}
+
+size_t Simulation::AddBody(FXMMATRIX world)
+{
+	Body body;
+	XMStoreFloat4x4(&body.Current, world);
+	body.Previous = body.Current;
+	mBodies.push_back(body);
+	return mBodies.size() - 1;
+}
+
+size_t Simulation::AddLight(const XMFLOAT3& direction, const XMFLOAT3& position, float orbitRate)
+{
+	mLights.push_back({ direction, position, orbitRate });
+	return mLights.size() - 1;
+}
+
+void Simulation::Step(float dt)
+{
+	StepAircraft(dt);
+	StepBodies(dt);
+	StepLights(dt);
+	++mTick;
+}
+
+void Simulation::StepAircraft(float dt)
+{
+	XMFLOAT3 start = mPlane.GetPos3f();
+	mPlane.Update(dt);
+
+	mCollided = false;
+	if (!mTerrain)
+		return;
+
+	// The step moves the plane in a straight line, so one sweep covers it
+	XMFLOAT3 end = mPlane.GetPos3f();
+	auto from = XMLoadFloat3(&start);
+	auto to = XMLoadFloat3(&end);
+	if (!mTerrain->SweepSphere(from, to, AircraftRadius, mContact))
+		return;
+
+	// Stop at the contact, a little off the surface so the next sweep doesn't start out touching it
+	const float skin = 0.01f * AircraftRadius;
+	mPlane.SetPosition(XMVectorLerp(from, to, mContact.Time) + skin * XMLoadFloat3(&mContact.Normal));
+	mCollided = true;
+}
+
+void Simulation::StepBodies(float dt)
+{
+	for (auto& body : mBodies)
+	{
+		// Move cube
+		auto rotup = 2*(int)(mRandom() % 2) - 1;
+
+		// rotate in local space
+		float localRate = 1.0f;
+		auto rotx = XMMatrixRotationX(0.1f*rotup*dt * localRate);
+		auto roty = XMMatrixRotationY(dt * localRate);
+
+		body.Previous = body.Current;
+		XMMATRIX pos = XMLoadFloat4x4(&body.Current);
+		XMStoreFloat4x4(&body.Current, rotx * roty * pos);
+	}
+}
+
+void Simulation::StepLights(float dt)
+{
+	if (!AnimateLights)
+		return;
+
+	for (auto& l : mLights)
+	{
+		if (l.OrbitRate == 0.0f)
+			continue;
+
+		auto rot = XMMatrixRotationY(l.OrbitRate * dt);
+		XMStoreFloat3(&l.Direction, XMVector3TransformNormal(XMLoadFloat3(&l.Direction), rot));
+		XMStoreFloat3(&l.Position, XMVector3TransformCoord(XMLoadFloat3(&l.Position), rot));
+	}
+}
+
+uint64_t Simulation::Checksum()
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* data, size_t size)
+	{
+		auto bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	XMFLOAT3 pos = mPlane.GetPos3f();
+	XMFLOAT4 orientation = mPlane.GetOrientation4f();
+	add(&pos, sizeof(pos));
+	add(&orientation, sizeof(orientation));
+
+	for (auto& body : mBodies)
+		add(&body.Current, sizeof(body.Current));
+	for (auto& l : mLights)
+	{
+		add(&l.Direction, sizeof(l.Direction));
+		add(&l.Position, sizeof(l.Position));
+	}
+
+	return hash;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Plane.h"
+#include "TriangleBvh.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Everything in the scene that moves, with nothing to draw it: the plane, the objects that spin in place and the lights.
+
+TestApp steps it at the fixed simulation rate (see D3Base::Simulate) and draws a blend of the last two steps;
+HeadlessRunner steps it without a window or a device.
+*/
+class Simulation
+{
+public:
+	static const std::uint32_t DEFAULT_SEED = 1;
+
+	// The level TestApp and HeadlessRunner fly, Models/<name>.obj
+	static constexpr const char* DEFAULT_LEVEL = "Level5";
+
+	// Whether an object of the level is one of the cubes that spin in place, a body, rather than terrain
+	static bool IsSpinning(const std::string& objectName) { return objectName.compare(0, 6, "Cube.0") == 0; }
+
+	/*
+	Adds every object of a level's OBJ file but the spinning ones to terrain, read with ObjParser as the app reads the
+	level mesh, and builds it. TestApp and HeadlessRunner both load their terrain here, so the plane collides with the
+	same triangles in either. bodyCount is set to the number of spinning objects. Returns what ObjParser::ParseFile
+	does on failure, 0 otherwise.
+	*/
+	static int LoadTerrain(const std::string& filename, TriangleBvh& terrain, size_t& bodyCount);
+
+	// An object's world matrix after the last two steps
+	struct Body
+	{
+		DirectX::XMFLOAT4X4 Previous;
+		DirectX::XMFLOAT4X4 Current;
+	};
+
+	// A light that orbits the world y axis, position and direction alike
+	struct OrbitingLight
+	{
+		DirectX::XMFLOAT3 Direction;
+		DirectX::XMFLOAT3 Position;
+		float OrbitRate; // radians per second
+	};
+
+	// Both return the index of what was added
+	size_t AddBody(DirectX::FXMMATRIX world);
+	size_t AddLight(const DirectX::XMFLOAT3& direction, const DirectX::XMFLOAT3& position, float orbitRate);
+
+	// One fixed step of dt seconds
+	void Step(float dt);
+
+	// Restarts the random numbers the simulation draws. The same seed and the same controls at the same ticks fly the
+	// same path; see InputScript.
+	void Seed(std::uint32_t seed) { mRandom.seed(seed); }
+
+	Plane& Aircraft() { return mPlane; }
+
+	const Body& GetBody(size_t i) const { return mBodies[i]; }
+	size_t BodyCount() const { return mBodies.size(); }
+
+	const OrbitingLight& GetLight(size_t i) const { return mLights[i]; }
+	size_t LightCount() const { return mLights.size(); }
+
+	// Static geometry the plane collides with, none if null. It has to outlive its use here.
+	void SetTerrain(const TriangleBvh* terrain) { mTerrain = terrain; }
+
+	// Whether the plane flew into the terrain in the last step, and where it touched. It is stopped at the contact.
+	bool Collided() const { return mCollided; }
+	const TriangleBvh::Contact& LastContact() const { return mContact; }
+
+	// Steps taken so far
+	std::uint64_t Tick() const { return mTick; }
+
+	// FNV-1a over the bits of the plane, body and light state after the last step. Two runs that agree on it flew
+	// the same path.
+	std::uint64_t Checksum();
+
+	// Off for now: the lights stay where TestApp::InitLights puts them
+	bool AnimateLights = false;
+
+	// Of the sphere that stands in for the plane against the terrain
+	float AircraftRadius = 1.0f;
+
+private:
+	void StepAircraft(float dt);
+	void StepBodies(float dt);
+	void StepLights(float dt);
+
+	Plane mPlane;
+	std::vector<Body> mBodies;
+	std::vector<OrbitingLight> mLights;
+	std::uint64_t mTick = 0;
+
+	const TriangleBvh* mTerrain = nullptr;
+	bool mCollided = false;
+	TriangleBvh::Contact mContact;
+
+	std::mt19937 mRandom{ DEFAULT_SEED };
+};
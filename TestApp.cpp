@@ -1,15 +1,77 @@
 #include "TestApp.h"
 #include "GeometryGenerator.h"
+#include "GeometryBatchBuilder.h"
 #include "Utilities.h"
 #include "Mesh.h"
+#include "MeshChunker.h"
 
 using namespace DirectX;
 using namespace Microsoft::WRL;
 
+void TestApp::Simulate(float dt)
+{
+	if (mReplaying)
+	{
+		mReplay.Apply(mSimulation.Tick(), mSimulation.Aircraft());
+
+		// The recording ends here; the state has to be what it was when it was recorded
+		if (mReplay.Finished() && mReplay.Events().back().Control == InputScript::CONTROL::END)
+		{
+			mReplaying = false;
+
+			char msg[256];
+			sprintf_s(msg, "Replay: %llu ticks, checksum %016llx\n", (unsigned long long)mSimulation.Tick(),
+				(unsigned long long)mSimulation.Checksum());
+			OutputDebugStringA(msg);
+
+			PostQuitMessage(0);
+			return;
+		}
+	}
+
+	mSimulation.Step(dt);
+}
+
+void TestApp::Record(const std::string& filename)
+{
+	// mRecording keeps the default seed, which the simulation starts from
+	mRecordingFile = filename;
+}
+
+int TestApp::Replay(const std::string& filename)
+{
+	int result = mReplay.Load(filename);
+	if (result < 0)
+	{
+		char msg[512];
+		sprintf_s(msg, "Replay: could not load %s (%d)\n", filename.c_str(), result);
+		OutputDebugStringA(msg);
+		return result;
+	}
+
+	mSimulation.Seed(mReplay.Seed);
+	mReplaying = !mReplay.Events().empty();
+	SetLockstep(true);
+	return result;
+}
+
+void TestApp::Control(InputScript::CONTROL control, float value)
+{
+	// A replay flies the recorded controls only
+	if (mReplaying)
+		return;
+
+	// The event takes effect in the next step, the one the replay feeds it to
+	InputScript::Event e = { mSimulation.Tick(), control, value };
+	if (!mRecordingFile.empty())
+		mRecording.Record(e);
+
+	InputScript::Apply(e, mSimulation.Aircraft());
+}
+
 void TestApp::Update(const Timer& t)
 {
 	OnKeyboardInput(t);
-	mPlane.Update(t);
 
 
 	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % mNumFrameResources;
@@ -24,12 +86,16 @@ void TestApp::Update(const Timer& t)
 	}
 
 
-	UpdateGeometry(t);
+	// Draw the state between the last two simulation steps that this frame falls at
+	mSimulation.Aircraft().Interpolate(mSimulationAlpha);
+	InterpolateGeometry(mSimulationAlpha);
+
 	UpdateInstanceBuffer(t, mDynamicRenderItems);
 	UpdateMaterialBuffer(t);
 	UpdateLights(t);
 	//UpdateShadowPassCB(t); // called in drawshadowmap
 	UpdateMainPassCB(t);
+	CullInstances();
 }
 
 void TestApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -66,73 +132,19 @@ void TestApp::Pick(float x, float y)
 	auto xn = (+2.0f * x / static_cast<float>(mClientWidth) - 1.0f) / mProj(0, 0);
 	auto yn = (-2.0f * y / static_cast<float>(mClientHeight) + 1.0f) / mProj(1, 1);
 
-	// Picking ray is now in view space
-	XMVECTOR rayOrigin = XMVectorSet( 0.0f, 0.0f, 0.0f, 1.0f );
-	XMVECTOR rayDir = XMVectorSet( xn, yn, 1.0f, 0.0f );
+	// Picking ray is now in view space. To world space with V^-1, a rigid transform.
+	auto invView = Math::RigidInverse(mSimulation.Aircraft().View());
+	XMVECTOR rayOrigin = invView.r[3];
+	XMVECTOR rayDir = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(xn, yn, 1.0f, 0.0f), invView));
 
-	// Transform picking ray into each colliding item's local space - V^-1: View --> World
-	auto det = XMMatrixDeterminant(mPlane.View());
-	auto invView = XMMatrixInverse(&det, mPlane.View());
-
-	for (auto category : mPickableRenderItems)
+	// Closest hit over every pickable instance, through the top level of mScene down to the item's triangles
+	SceneBvh::Hit hit;
+	if (mScene.RayCast(rayOrigin, rayDir, Math::Infty, hit))
 	{
-		for (auto& ri : mRenderItems[category])
-		{
-			auto world = XMLoadFloat4x4(&ri->Instance(0).World);
-			det = XMMatrixDeterminant(world);
-			auto invWorld = XMMatrixInverse(&det, world);
-
-			auto toLocal = XMMatrixMultiply(invView, invWorld); // invView* invWorld;
-
-			// ray to local space
-			auto locRayOrigin = XMVector3TransformCoord(rayOrigin, toLocal);
-			auto locRayDir = XMVector3TransformNormal(rayDir, toLocal);
-			locRayDir = XMVector3Normalize(locRayDir);
-
-			// Does our ray intersect the BB?
-
-			// ray parameter at closest collision point
-			float tmin = 0.0f;
-			if (ri->BoundsB.Intersects(locRayOrigin, locRayDir, tmin))
-			{
-				::OutputDebugStringA(ri->Name.c_str());
-
-				// TODO make this optional;
-
-				// We hit the bounding box, but we may not have hit the object itself. 
-				// To find out we do ray-tri intersections
-
-				// The submesh of a given renderitem belongs to a mesh, which stores copies of v/ibuffers
-				auto vertices = (Vertex*)ri->Geo->VertexBufferCPU->GetBufferPointer();
-				auto indices = (std::uint16_t*)ri->Geo->IndexBufferCPU->GetBufferPointer();
-
-				UINT triCount = ri->IndexCount / 3;
-
-				// Keep track of which triangle is the closest; for now we iterate over all tris in the mesh
-				tmin = Math::Infty;
-				for (UINT i = 0; i < triCount; ++i)
-				{
-					auto i0 = indices[ri->StartIndexLocation + i * 3 + 0];
-					auto i1 = indices[ri->StartIndexLocation + i * 3 + 1];
-					auto i2 = indices[ri->StartIndexLocation + i * 3 + 2];
-
-					auto v0 = XMLoadFloat3(&vertices[i0].Pos);
-					auto v1 = XMLoadFloat3(&vertices[i1].Pos);
-					auto v2 = XMLoadFloat3(&vertices[i2].Pos);
-
-					float t = 0.0f;
-
-					if (TriangleTests::Intersects(locRayOrigin, locRayDir, v0, v1, v2, t))
-					{
-						if (t < tmin)
-							tmin = t;
-					}
-				}
-
-				if (tmin != Math::Infty)
-					::OutputDebugStringA("Actual hit");
-			}
-		}
+		auto& picked = mSceneItems[hit.Instance];
+		char msg[256];
+		sprintf_s(msg, "Pick: %s, triangle %u at distance %.2f\n", picked.Item->Name.c_str(), hit.Triangle, hit.Distance);
+		::OutputDebugStringA(msg);
 	}
 }
 
@@ -166,8 +178,8 @@ void TestApp::OnMouseMove(WPARAM btnState, int x, int y)
 		//mCamera.Pitch(dy);
 		//mCamera.RotateY(-dx);
 
-		mPlane.Pitch(dy);
-		mPlane.Yaw(-dx);
+		Control(InputScript::CONTROL::PITCH_BY, dy);
+		Control(InputScript::CONTROL::YAW_BY, -dx);
 	}
 	else if ((btnState & MK_RBUTTON) != 0)
 	{
@@ -192,22 +204,22 @@ void TestApp::OnKeyUp(WPARAM wParam, LPARAM lParam)
 	{
 	case 0x41:
 	case 0x44:
-		mPlane.Roll(Plane::STEER::NONE);
+		Control(InputScript::CONTROL::ROLL, 0.0f);
 		break;
 	case VK_SPACE:
 	case 0x46:
-		mPlane.Pitch(Plane::STEER::NONE);
+		Control(InputScript::CONTROL::PITCH, 0.0f);
 		break;
 	case 0x47:
 		// G
-		mPlane.Yaw(Plane::STEER::NONE);
+		Control(InputScript::CONTROL::YAW, 0.0f);
 		break;
 	case 0x48:
 		// H
-		mPlane.Yaw(Plane::STEER::NONE);
+		Control(InputScript::CONTROL::YAW, 0.0f);
 		break;
 	case VK_BACK:
-		mPlane.Thrust(false);
+		Control(InputScript::CONTROL::THRUST, 0.0f);
 		break;
 	}
 }
@@ -218,37 +230,41 @@ void TestApp::OnKeyDown(WPARAM wParam, LPARAM lParam)
 	{
 	case 0x41:
 		// A
-		mPlane.Roll(Plane::STEER::POSITIVE);
+		Control(InputScript::CONTROL::ROLL, 1.0f);
 		break;
 	case VK_BACK:
-		mPlane.Thrust(true);
+		Control(InputScript::CONTROL::THRUST, 1.0f);
 		break;
 	case VK_DELETE:
-		mPlane.Reverse();
+		Control(InputScript::CONTROL::REVERSE, 0.0f);
 		break;
 	case 0x44:
 		// D
-		mPlane.Roll(Plane::STEER::NEGATIVE);
+		Control(InputScript::CONTROL::ROLL, -1.0f);
 		break;
 	case VK_SPACE:
-		mPlane.Pitch(Plane::STEER::NEGATIVE);
+		Control(InputScript::CONTROL::PITCH, -1.0f);
 		break;
 	case 0x46:
 		// F
-		mPlane.Pitch(Plane::STEER::POSITIVE);
+		Control(InputScript::CONTROL::PITCH, 1.0f);
 		break;
 	case 0x47:
 		// G
 		mDbgFlag = !mDbgFlag;
-		mPlane.Yaw(Plane::STEER::POSITIVE);
+		Control(InputScript::CONTROL::YAW, 1.0f);
 		break;
 	case 0x48:
 		// H
-		mPlane.Yaw(Plane::STEER::NEGATIVE);
+		Control(InputScript::CONTROL::YAW, -1.0f);
+		break;
+	case 0x43:
+		// C
+		LogCullStats();
 		break;
 	case 0x49:
 		// I
-		mPlane.SetView(XMLoadFloat4x4(&mLights[0]->View[0]));
+		mSimulation.Aircraft().SetView(XMLoadFloat4x4(&mLights[0]->View[0]));
 		mProj = mLights[0]->Proj;
 		switch (gIdx)
 		{
@@ -298,31 +314,18 @@ void TestApp::ClearInstances(std::shared_ptr<RenderItem> ri)
 	ri->ClearInstances();
 }
 
-// Todo: test ClearInstances - seems to work well, but yknow.
-void TestApp::UpdateGeometry(const Timer& t)
+void TestApp::InterpolateGeometry(float alpha)
 {
 	auto dbgBoxes = mRenderItems[RENDER_ITEM_TYPE::DEBUG_BOXES][0];
 	ClearInstances(dbgBoxes);
 
-	for (auto& ri : mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC])
+	for (auto& si : mSimulatedInstances)
 	{
-		// Cube?
-		auto iscube = (ri->Name.substr(0, 6) == "Cube.0");
-		if (!iscube)
-			continue;
-
-		// Move cube
-		auto rotup = 2*(rand() % 2) - 1;
-
-		// rotate in local space
-		float localRate = 1.0f;
-		auto rotx = XMMatrixRotationX(0.1f*rotup*t.DeltaTime() * localRate);
-		auto roty = XMMatrixRotationY(t.DeltaTime() * localRate);
-		auto rotz = XMMatrixRotationZ(t.DeltaTime() * localRate);
-		
-		XMMATRIX pos = XMLoadFloat4x4(&ri->Instance(0).World);
-		XMMATRIX npos = rotx * roty * pos;
-		XMStoreFloat4x4(&ri->Instance(0).World, npos);
+		auto& ri = si.Item;
+		auto& body = mSimulation.GetBody(si.Body);
+		XMMATRIX world = Math::InterpolateTransform(XMLoadFloat4x4(&body.Previous), XMLoadFloat4x4(&body.Current), alpha);
+		XMStoreFloat4x4(&ri->Instance(si.Index).World, world);
+		mScene.SetWorld(si.SceneInstance, world);
 
 		// Update debug bounding box
 		InstanceData idata;
@@ -333,11 +336,23 @@ void TestApp::UpdateGeometry(const Timer& t)
 		XMMATRIX bsc = XMMatrixScaling(scaleX, scaleY, scaleZ);
 
 		// Then apply world matrix for render item
-		XMStoreFloat4x4(&idata.World, bsc * btr * npos);
+		XMStoreFloat4x4(&idata.World, bsc * btr * world);
 		dbgBoxes->AddInstance(idata);
 
 		ri->NumFramesDirty = mNumFrameResources;
 	}
+
+	// Only moved, so a refit, unless that leaves the tree too costly to trace
+	mScene.Update();
+
+	auto& stats = mScene.LastUpdate();
+	if (stats.Rebuilt)
+	{
+		char msg[256];
+		sprintf_s(msg, "Scene: refit %u instances (%u nodes) in %.3f ms, rebuilt in %.3f ms\n", stats.Moved, stats.Refit,
+			stats.RefitMs, stats.RebuildMs);
+		OutputDebugStringA(msg);
+	}
 }
 
 void TestApp::Draw(const Timer& t)
@@ -352,7 +367,7 @@ void TestApp::Draw(const Timer& t)
 
 	// use the noshadow variant for the sobel pass(we dont want to have sharp shadow edges!) (?)
 	// this is a little sad since it means ever more multipasses... we should have the option to easily turn this off
-	mCommandList->SetPipelineState(mPSOs["opaque_noshadow"].Get()); 
+	SetPipelineState(mCommandList.Get(), "opaque_noshadow"); 
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -390,10 +405,10 @@ void TestApp::Draw(const Timer& t)
 	mCommandList->SetGraphicsRootDescriptorTable(6, mNullSrv);
 
 	// TODO: put these in an aggregate list
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC]);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC], 0);
 
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mOffscreenRT->Resource(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
@@ -423,7 +438,7 @@ void TestApp::Draw(const Timer& t)
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
 
-	mCommandList->SetPipelineState(mPSOs["opaque"].Get());
+	SetPipelineState(mCommandList.Get(), "opaque");
 
 	// Grab the first shadowmaps, if they exist. They are assumed to be contiguous in memory
 
@@ -443,10 +458,10 @@ void TestApp::Draw(const Timer& t)
 
 	mCommandList->OMSetRenderTargets(1, &mOffscreenRT->Rtv(), true, &DepthStencilView());
 
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC]);
-	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC]);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC], 0);
+	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC], 0);
 
 	//if (mDebugBoundingBoxesEnabled)
 	//{
@@ -454,7 +469,7 @@ void TestApp::Draw(const Timer& t)
 	//	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::DEBUG_BOXES]);
 	//}
 
-	mCommandList->SetPipelineState(mPSOs["envMap"].Get());
+	SetPipelineState(mCommandList.Get(), "envMap");
 	DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::ENVIRONMENT_MAP]);
 
 	//// the PSO/shader here renders out the first flat shadowmap
@@ -514,22 +529,102 @@ void TestApp::DrawFullscreenQuad(ID3D12GraphicsCommandList* cmdList)
 	cmdList->DrawInstanced(6, 1, 0, 0);
 }
 
-void TestApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<std::shared_ptr<RenderItem>>& ritems)
+// Sets one of mPSOs and remembers it, so DrawRenderItems can switch to its packed vertex variant and back
+void TestApp::SetPipelineState(ID3D12GraphicsCommandList* cmdList, const std::string& pso)
+{
+	mCurrPSO = pso;
+	cmdList->SetPipelineState(mPSOs[pso].Get());
+}
+
+void TestApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<std::shared_ptr<RenderItem>>& ritems, UINT pass)
 {
+	bool packed = false;
+
 	for (size_t i = 0; i < ritems.size(); ++i)
 	{
 		auto ri = ritems[i];
 
+		UINT instanceCount = (UINT)ri->InstanceCount();
+		UINT firstInstance = 0;
+		if (pass != UNCULLED)
+		{
+			instanceCount = ri->VisibleInstances[pass];
+			firstInstance = (1 + pass) * ri->MaxInstances;
+		}
+		if (instanceCount == 0)
+			continue;
+
+		// Packed meshes need a different input layout and vertex shader
+		bool riPacked = (ri->Geo->VertexFormat == VERTEX_FORMAT::PACKED);
+		if (riPacked != packed)
+		{
+			auto pso = riPacked ? mCurrPSO + "_packed" : mCurrPSO;
+			assert(mPSOs.count(pso));
+
+			cmdList->SetPipelineState(mPSOs[pso].Get());
+			packed = riPacked;
+		}
+
+		// The full resolution submesh, or the level of detail drawn in its place
+		SubmeshGeometry submesh;
+		submesh.IndexCount = ri->IndexCount;
+		submesh.StartIndexLocation = ri->StartIndexLocation;
+		submesh.BaseVertexLocation = ri->BaseVertexLocation;
+		submesh.Bounds = ri->BoundsB;
+		submesh.Quantization = ri->Quantization;
+		submesh.FirstCluster = ri->FirstCluster;
+		submesh.ClusterCount = ri->ClusterCount;
+
+		UINT lod = ri->SelectLod(XMLoadFloat3(&mLodEye), mLodPixelsPerUnit, mLodPixelError * mLodBias);
+		if (lod > 0)
+			submesh = ri->Lods[lod - 1];
+
+		if (riPacked)
+			cmdList->SetGraphicsRoot32BitConstants(7, sizeof(VertexQuantization) / 4, &submesh.Quantization, 0);
+
 		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
 		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 		
-		// Bind instance buffer
+		// Bind instance buffer, or the pass's part of it. The shaders index it by SV_InstanceID, which doesn't count
+		// StartInstanceLocation, so the view starts at the pass's instances instead.
 		auto ib = mCurrFrameResource->InstanceBuffers[ri->Id()]->Resource();
-		cmdList->SetGraphicsRootShaderResourceView(1, ib->GetGPUVirtualAddress());
 
-		cmdList->DrawIndexedInstanced(ri->IndexCount, (UINT)ri->InstanceCount(), ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		// The camera pass draws clustered submeshes an instance at a time, and of each only the clusters that are in
+		// view and not facing away (opaque PSOs cull back faces). The instances are taken from the unculled part of the
+		// buffer, which is in mInstances order; VisibleRanges rejects the ones out of view. Clusters are in object
+		// space, so the frustum and eye are brought there; BoundingFrustum::Transform takes rigid, uniformly scaled
+		// worlds only, which is what instances have.
+		if (pass == 0 && submesh.ClusterCount > 0)
+		{
+			for (size_t j = 0; j < ri->InstanceCount(); ++j)
+			{
+				XMMATRIX world = XMLoadFloat4x4(&ri->Instance(j).World);
+				XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+
+				BoundingFrustum frustum;
+				mCameraFrustum.Transform(frustum, invWorld);
+				XMVECTOR eye = XMVector3TransformCoord(XMLoadFloat3(&mLodEye), invWorld);
+
+				mVisibleRanges.clear();
+				ri->Geo->VisibleRanges(submesh, frustum, eye, true, mVisibleRanges);
+				if (mVisibleRanges.empty())
+					continue;
+
+				cmdList->SetGraphicsRootShaderResourceView(1, ib->GetGPUVirtualAddress() + j * sizeof(InstanceData));
+				for (auto& range : mVisibleRanges)
+					cmdList->DrawIndexedInstanced(range.IndexCount, 1, range.StartIndexLocation, submesh.BaseVertexLocation, 0);
+			}
+			continue;
+		}
+
+		cmdList->SetGraphicsRootShaderResourceView(1, ib->GetGPUVirtualAddress() + firstInstance * sizeof(InstanceData));
+
+		cmdList->DrawIndexedInstanced(submesh.IndexCount, instanceCount, submesh.StartIndexLocation, submesh.BaseVertexLocation, 0);
 	}
+
+	if (packed)
+		cmdList->SetPipelineState(mPSOs[mCurrPSO].Get());
 }
 
 // Convention: it is the Light classes responsibility to return view matrices that map from world space to view space.
@@ -593,6 +688,8 @@ void TestApp::UpdateShadowPassCB(size_t lightIndex, UINT passIdx = 0)
 
 void TestApp::DrawShadowMaps()
 {
+	mLodBias = mShadowLodBias;
+
 	for (size_t k = 0; k < mLights.size(); ++k)
 	{
 		auto& l = mLights[k];
@@ -633,17 +730,20 @@ void TestApp::DrawShadowMaps()
 			D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1u + k*6 + i) * passCBByteSize;
 			mCommandList->SetGraphicsRootConstantBufferView(2, passCBAddress);
 
-			mCommandList->SetPipelineState(mPSOs["shadowOpaque"].Get());
+			SetPipelineState(mCommandList.Get(), "shadowOpaque");
 
-			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC]);
-			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC]);
-			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC]);
-			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC]);
+			UINT pass = static_cast<UINT>(1 + k*6 + i);
+			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC], pass);
+			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::OPAQUE_STATIC], pass);
+			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC], pass);
+			DrawRenderItems(mCommandList.Get(), mRenderItems[RENDER_ITEM_TYPE::WIREFRAME_STATIC], pass);
 
 			mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sm->Resource(),
 				D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
 		}
 	}
+
+	mLodBias = 1.0f;
 }
 
 void TestApp::BuildSceneBounds()
@@ -655,7 +755,10 @@ void TestApp::BuildSceneBounds()
 // Update both direction/position and info needed for shadow mapping
 void TestApp::UpdateLights(const Timer& t)
 {
-	return;
+	// The lights only move if the simulation animates them
+	if (!mSimulation.AnimateLights)
+		return;
+
 	// Update light data
 	
 	// Transform NDC space [-1,+1]^2 to texture space [0,1]^2
@@ -667,18 +770,15 @@ void TestApp::UpdateLights(const Timer& t)
 
 	// Update shadow data
 	// We need a view/proj matrix to render from each light's POV, as well as near/far planes
-	for (auto& l : mLights)
+	for (size_t i = 0; i < mLights.size(); ++i)
 	{
+		auto& l = mLights[i];
+		auto& moved = mSimulation.GetLight(i);
+
 		if (l->Type == LightType::DIRECTIONAL)
 		{
-			auto rotAngle = 0.1f*t.DeltaTime();
-			auto rotY = XMMatrixRotationY(rotAngle);
-			auto rotX = XMMatrixRotationX(rotAngle);
-			auto rot = XMMatrixMultiply(rotY, rotX);
-
+			l->Light->Direction = moved.Direction;
 			XMVECTOR lightDir = XMLoadFloat3(&l->Light->Direction);
-			lightDir = XMVector4Transform(lightDir, rotY);
-			XMStoreFloat3(&l->Light->Direction, lightDir);
 			XMVECTOR lightPos = -mSceneBoundS.Radius * lightDir;
 			XMVECTOR targetPos = XMLoadFloat3(&mSceneBoundS.Center);
 			XMVECTOR lightUp = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
@@ -712,16 +812,9 @@ void TestApp::UpdateLights(const Timer& t)
 		}
 		else if (l->Type == LightType::SPOT)
 		{
-			auto rotAngle = t.DeltaTime() / 3.0f;
-			auto rotX = XMMatrixRotationY(rotAngle);
-
+			l->Light->Position = moved.Position;
+			l->Light->Direction = moved.Direction;
 			XMVECTOR lightPos = XMLoadFloat3(&l->Light->Position);
-			lightPos = XMVector3Transform(lightPos, rotX);
-			XMStoreFloat3(&l->Light->Position, lightPos);
-
-			auto dir = XMLoadFloat3(&l->Light->Direction);
-			dir = XMVector3Transform(dir, rotX);
-			XMStoreFloat3(&l->Light->Direction, dir);
 
 			auto lightUp = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 			auto targetPos = XMLoadFloat3(&mSceneBoundS.Center);
@@ -762,7 +855,7 @@ void TestApp::UpdateLights(const Timer& t)
 
 void TestApp::UpdateMainPassCB(const Timer& gt)
 {
-	XMMATRIX view = mPlane.View(); // XMLoadFloat4x4(&mLights[0]->View[gIdx]); // mPlane.View();
+	XMMATRIX view = mSimulation.Aircraft().View(); // XMLoadFloat4x4(&mLights[0]->View[gIdx]); // mSimulation.Aircraft().View();
 	XMMATRIX proj = XMLoadFloat4x4(&mProj); // XMLoadFloat4x4(&mLights[0]->Proj[gIdx]); // mProj
 	
 	//auto det = XMMatrixDeterminant(view);
@@ -797,7 +890,13 @@ void TestApp::UpdateMainPassCB(const Timer& gt)
 	for (size_t i = k; i < MaxLights; ++i, ++k)
 		mPassCB.ShadowTransform[k] = Math::Identity4x4();
 
-	mPassCB.EyePosW = mPlane.GetPos3f();
+	mPassCB.EyePosW = mSimulation.Aircraft().GetPos3f();
+
+	mLodEye = mPassCB.EyePosW;
+	mLodPixelsPerUnit = 0.5f * mClientHeight * mProj(1, 1);
+
+	BoundingFrustum::CreateFromMatrix(mCameraFrustum, proj);
+	mCameraFrustum.Transform(mCameraFrustum, invView);
 
 	mPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
 	mPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
@@ -829,13 +928,18 @@ void TestApp::BuildFrameResources()
 	// one for doing regular passes, six for doing shadow passes. 
 	// in a previous iteration of the holy code, these were getting overwritten and giving very strange rendering results
 	const UINT passCount = 1 + 6*(mNumPointLights + mNumDirLights + mNumSpotLights); 
+	mCullStats.assign(passCount, CullStats());
 
-	// each renderitem must have an uploadbuffer of instance data
+	// each renderitem must have an uploadbuffer of instance data: all of its instances, then room for those visible in
+	// each pass. All passes are in one command list, so they can't share the room.
 	std::map<UINT, UINT> rItemInstances;
 	for (auto& categ : mRenderItems)
 	{
 		for (auto& ri: categ.second)
-			rItemInstances[ri->Id()] = ri->MaxInstances;
+		{
+			rItemInstances[ri->Id()] = ri->MaxInstances * (1 + passCount);
+			ri->VisibleInstances.assign(passCount, 0);
+		}
 	}
 
 	for (UINT i = 0; i < mNumFrameResources; ++i)
@@ -909,6 +1013,27 @@ void TestApp::BuildPSOs()
 	};
 	ThrowIfFailed(mD3Device->CreateGraphicsPipelineState(&opaqueNoshadowPsoDesc, IID_PPV_ARGS(&mPSOs["opaque_noshadow"])));
 
+	//
+	// Packed vertex variants of the above. DrawRenderItems switches to "<pso>_packed" for meshes that need it.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePackedPsoDesc = opaquePsoDesc;
+	opaquePackedPsoDesc.InputLayout = { mPackedInputLayout.data(), (UINT)mPackedInputLayout.size() };
+	opaquePackedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["standardVS_packed"]->GetBufferPointer()),
+		mShaders["standardVS_packed"]->GetBufferSize()
+	};
+	ThrowIfFailed(mD3Device->CreateGraphicsPipelineState(&opaquePackedPsoDesc, IID_PPV_ARGS(&mPSOs["opaque_packed"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueNoshadowPackedPsoDesc = opaqueNoshadowPsoDesc;
+	opaqueNoshadowPackedPsoDesc.InputLayout = { mPackedInputLayout.data(), (UINT)mPackedInputLayout.size() };
+	opaqueNoshadowPackedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["standardVS_noshadow_packed"]->GetBufferPointer()),
+		mShaders["standardVS_noshadow_packed"]->GetBufferSize()
+	};
+	ThrowIfFailed(mD3Device->CreateGraphicsPipelineState(&opaqueNoshadowPackedPsoDesc, IID_PPV_ARGS(&mPSOs["opaque_noshadow_packed"])));
+
 	//
 	// PSO for environment mapping
 	//
@@ -1024,6 +1149,15 @@ void TestApp::BuildPSOs()
 	shadowPso.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
 	shadowPso.NumRenderTargets = 0;
 	ThrowIfFailed(mD3Device->CreateGraphicsPipelineState(&shadowPso, IID_PPV_ARGS(&mPSOs["shadowOpaque"])));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowPackedPso = shadowPso;
+	shadowPackedPso.InputLayout = { mPackedInputLayout.data(), (UINT)mPackedInputLayout.size() };
+	shadowPackedPso.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["shadowVS_packed"]->GetBufferPointer()),
+		mShaders["shadowVS_packed"]->GetBufferSize()
+	};
+	ThrowIfFailed(mD3Device->CreateGraphicsPipelineState(&shadowPackedPso, IID_PPV_ARGS(&mPSOs["shadowOpaque_packed"])));
 }
 
 // Lights are expected to be stored in the order directional -> spot -> point.
@@ -1052,6 +1186,9 @@ void TestApp::InitLights()
 	mLights.push_back(dl);
 	mNumDirLights++;
 
+	// Lights move in the simulation, in the same order as mLights; see UpdateLights
+	mSimulation.AddLight(dl->Light->Direction, dl->Light->Position, 0.1f);
+
 	auto pl = std::make_shared<LightPovData>(LightType::POINT, mD3Device, mDsvDescriptorSize);
 	pl->Light->Direction = { 0.0f, 0.0f, 0.0f };
 	pl->Light->Strength = { 0.7f, 0.7f, 0.7f };
@@ -1066,6 +1203,8 @@ void TestApp::InitLights()
 	mLights.push_back(pl);
 	++mNumPointLights;
 
+	mSimulation.AddLight(pl->Light->Direction, pl->Light->Position, 0.0f);
+
 	// keep track of this for the shader. NOTE: depending on how i do things, may have to recompile shader if numlights changes at runtime
 
 	// Write code to make sure light array is sorted in the order dir/spot -> point last. That lets us supply the first descriptor to a textable
@@ -1077,15 +1216,6 @@ bool TestApp::Initialize()
 	if (!D3Base::Initialize())
 		return false;
 	
-	wchar_t buffer[MAX_PATH];
-	GetModuleFileNameW(NULL, buffer, MAX_PATH);
-
-	// Since the exec changes(sometimes its debug, sometimes its release) location, the exec location is not useful.
-	// So we need the project path, or do as recommended, store in user/documents or something like that.
-	mProjectPath = L"F:\\Github\\Flight\\"; // hardcode for now, TODO
-	//mProjectPath = L"D:\\GitHub\\Flight\\";
-
-
 	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
 	mBlurFilter = std::make_unique<BlurFilter>(mD3Device.Get(), mClientWidth, mClientHeight, DXGI_FORMAT_R8G8B8A8_UNORM);
@@ -1102,7 +1232,7 @@ bool TestApp::Initialize()
 	InitLights(); 
 
 	/*
-	mPlane.SetView(XMLoadFloat4x4(&mLights[0]->View[0]));
+	mSimulation.Aircraft().SetView(XMLoadFloat4x4(&mLights[0]->View[0]));
 	mProj = mLights[0]->Proj;
 	*/
 
@@ -1115,6 +1245,7 @@ bool TestApp::Initialize()
 	BuildStaticGeometry();
 	BuildMaterials();
 	BuildRenderItems();
+	BuildScene();
 	BuildFrameResources();
 	BuildDescriptorHeaps();
 	BuildDescriptors();
@@ -1128,7 +1259,7 @@ bool TestApp::Initialize()
 	}
 
 	// Turn camera around
-	mPlane.Yaw(XM_PI);
+	mSimulation.Aircraft().Yaw(XM_PI);
 
 
 	ThrowIfFailed(mCommandList->Close());
@@ -1138,6 +1269,16 @@ bool TestApp::Initialize()
 	// Wait for init to complete
 	FlushCommandQueue();
 
+	// The terrain has been loading since BuildStaticGeometry
+	auto terrainLoaded = mTerrainLoad.get();
+	assert(terrainLoaded >= 0);
+	mSimulation.SetTerrain(&mTerrain);
+
+	char msg[256];
+	sprintf_s(msg, "Terrain: %zu triangles, %zu nodes, depth %u\n", mTerrain.TriangleCount(), mTerrain.NodeCount(),
+		mTerrain.Depth());
+	OutputDebugStringA(msg);
+
 	return true;
 }
 
@@ -1358,7 +1499,7 @@ void TestApp::BuildPostprocessRootSignature()
 void TestApp::BuildRootSignature()
 {
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[7]; 
+	CD3DX12_ROOT_PARAMETER slotRootParameter[8]; 
 
 	// Diffuse textures
 	CD3DX12_DESCRIPTOR_RANGE texTable;
@@ -1387,6 +1528,7 @@ void TestApp::BuildRootSignature()
 	slotRootParameter[4].InitAsDescriptorTable(1, &shdTable); 
 	slotRootParameter[5].InitAsDescriptorTable(1, &envTable);
 	slotRootParameter[6].InitAsDescriptorTable(1, &ptShdTable);
+	slotRootParameter[7].InitAsConstants(sizeof(VertexQuantization) / 4, 1); // packed vertex decoding, set per draw
 
 	auto staticSamplers = GetStaticSamplers();
 
@@ -1482,6 +1624,10 @@ void TestApp::BuildRenderItems()
 	// In case the geometry/mesh has many submeshes, we'll create the corresp renderitems in a loop
 	for (auto& g : mGeometries[mLevel.c_str()]->DrawArgs)
 	{
+		// Levels of detail are drawn through the render item of their full resolution submesh
+		if (g.second.LodLevel > 0)
+			continue;
+
 		auto ri = std::make_shared<RenderItem>(mNumFrameResources);
 
 		idata.World = Math::Identity4x4();
@@ -1494,8 +1640,15 @@ void TestApp::BuildRenderItems()
 		ri->IndexCount = g.second.IndexCount;
 		ri->StartIndexLocation = g.second.StartIndexLocation;
 		ri->BaseVertexLocation = g.second.BaseVertexLocation;
+		ri->Quantization = g.second.Quantization;
+		ri->FirstCluster = g.second.FirstCluster;
+		ri->ClusterCount = g.second.ClusterCount;
 		ri->Name = g.first;
 		ri->BoundsB = g.second.Bounds;
+		ri->Bvh = ri->Geo->Bvh(g.second);
+
+		for (UINT l = 1; l <= g.second.LodCount; ++l)
+			ri->Lods.push_back(ri->Geo->DrawArgs[Mesh::LodName(g.first, l)]);
 
 		// Add debug box
 		// First move/scale boundingbox in local space. The debug box is at the origin and scaled at (1, 1, 1) by default.
@@ -1510,6 +1663,15 @@ void TestApp::BuildRenderItems()
 		box->AddInstance(idata);
 
 		mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC].push_back(ri);
+
+		// The cubes spin, see Simulation::StepBodies
+		if (Simulation::IsSpinning(ri->Name))
+		{
+			SimulatedInstance si;
+			si.Item = ri;
+			si.Body = mSimulation.AddBody(XMLoadFloat4x4(&ri->Instance(0).World));
+			mSimulatedInstances.push_back(si);
+		}
 	}
 
 	//auto plane = mGeometries["Scythe"]->DrawArgs["Plane"];
@@ -1543,137 +1705,85 @@ void TestApp::BuildRenderItems()
 	//box->AddInstance(idata);
 
 	//mRenderItems[RENDER_ITEM_TYPE::OPAQUE_DYNAMIC].push_back(ri);
-	//mPlane.AddRenderItem(ri);
+	//// and each frame, after Interpolate: XMStoreFloat4x4(&ri->Instance(0).World, mSimulation.Aircraft().ModelWorld());
 }
 
-void TestApp::BuildStaticGeometry()
+void TestApp::BuildScene()
 {
-	GeometryGenerator geo;
-	auto box = geo.CreateBox(1.0f, 1.0f, 1.0f, 0);
-	auto grid = geo.CreateGrid(10.0f, 10.0f, 2, 2);
-	auto sphere = geo.CreateSphere(1.0f, 20, 20); // environment map
-	auto sphere2 = geo.CreateSphere(0.5f, 10, 10); // debug to track position of light
-	auto dbgquad = geo.CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f); // we just give ndc coordinates directly(e.g. identity view/world). they live in [-1, 1]^2
-
-	size_t boxVertexOffset = 0;
-	size_t gridVertexOffset = box.Vertices.size();
-	size_t sphereVertexOffset = gridVertexOffset + grid.Vertices.size();
-	size_t sphere2VertexOffset = sphereVertexOffset + sphere.Vertices.size();
-	size_t dbgquadVertexOffset = sphere2VertexOffset + sphere2.Vertices.size();
-
-	size_t boxIndexOffset = 0;
-	size_t gridIndexOffset = box.Indices32.size();
-	size_t sphereIndexOffset = gridIndexOffset + grid.Indices32.size();
-	size_t sphere2IndexOffset = sphereIndexOffset + sphere.Indices32.size();
-	size_t dbgquadIndexOffset = sphere2IndexOffset + sphere2.Indices32.size();
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = (UINT)boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = (INT)boxVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = (UINT)gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = (INT)gridVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = (UINT)sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = (INT)sphereVertexOffset;
-
-	SubmeshGeometry sphere2Submesh;
-	sphere2Submesh.IndexCount = (UINT)sphere2.Indices32.size();
-	sphere2Submesh.StartIndexLocation = (UINT)sphere2IndexOffset;
-	sphere2Submesh.BaseVertexLocation = (INT)sphere2VertexOffset;
-
-	SubmeshGeometry dbgquadSubmesh;
-	dbgquadSubmesh.IndexCount = (UINT)dbgquad.Indices32.size();
-	dbgquadSubmesh.StartIndexLocation = (UINT)dbgquadIndexOffset;
-	dbgquadSubmesh.BaseVertexLocation = (INT)dbgquadVertexOffset;
-
-	auto totalVertices = box.Vertices.size() + grid.Vertices.size() + sphere.Vertices.size() + sphere2.Vertices.size() + dbgquad.Vertices.size();
-
-	std::vector<Vertex> vertices(totalVertices);
-
-	// Copy vertices from generator
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
-	}
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
-	}
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-	}
-	for (size_t i = 0; i < sphere2.Vertices.size(); ++i, ++k)
+	mScene.Clear();
+	mSceneItems.clear();
+
+	for (auto category : mPickableRenderItems)
 	{
-		vertices[k].Pos = sphere2.Vertices[i].Position;
-		vertices[k].Normal = sphere2.Vertices[i].Normal;
-		vertices[k].TexC = sphere2.Vertices[i].TexC;
+		for (auto& ri : mRenderItems[category])
+		{
+			if (!ri->Bvh)
+				continue;
+
+			for (size_t i = 0; i < ri->InstanceCount(); ++i)
+			{
+				UINT handle = mScene.Add(ri->Bvh, XMLoadFloat4x4(&ri->Instance(i).World));
+				if (handle >= mSceneItems.size())
+					mSceneItems.resize(handle + 1);
+				mSceneItems[handle] = { ri.get(), i };
+			}
+		}
 	}
-	for (size_t i = 0; i < dbgquad.Vertices.size(); ++i, ++k)
+
+	for (auto& si : mSimulatedInstances)
 	{
-		vertices[k].Pos = dbgquad.Vertices[i].Position;
-		vertices[k].Normal = dbgquad.Vertices[i].Normal;
-		vertices[k].TexC = dbgquad.Vertices[i].TexC;
+		for (UINT h = 0; h < mSceneItems.size(); ++h)
+		{
+			if (mSceneItems[h].Item == si.Item.get() && mSceneItems[h].Index == si.Index)
+				si.SceneInstance = h;
+		}
 	}
 
-	// Copy verts/indices into one big vbuffer/ibuffer
-	std::vector<uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere2.GetIndices16()), std::end(sphere2.GetIndices16()));
-	indices.insert(indices.end(), std::begin(dbgquad.GetIndices16()), std::end(dbgquad.GetIndices16()));
+	mScene.Update();
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(uint16_t);
+	char msg[256];
+	sprintf_s(msg, "Scene: %zu instances, %zu nodes, depth %u\n", mScene.InstanceCount(), mScene.NodeCount(),
+		mScene.Depth());
+	OutputDebugStringA(msg);
+}
+
+void TestApp::BuildStaticGeometry()
+{
+	GeometryGenerator geo;
+	GeometryBatchBuilder batch;
+	batch.Add("debugBoxes", geo.CreateBox(1.0f, 1.0f, 1.0f, 0));
+	batch.Add("grid", geo.CreateGrid(10.0f, 10.0f, 2, 2));
+	batch.Add("sphere", geo.CreateSphere(1.0f, 20, 20)); // environment map
+	batch.Add("sphere2", geo.CreateSphere(0.5f, 10, 10)); // debug to track position of light
+	batch.Add("dbgQuad", geo.CreateQuad(0.0f, 0.0f, 1.0f, 1.0f, 0.0f)); // we just give ndc coordinates directly(e.g. identity view/world). they live in [-1, 1]^2
 
 	auto geomesh = std::make_unique<Mesh>();
 	geomesh->Name = "shapes";
+	batch.Build(*geomesh, mD3Device.Get(), mCommandList.Get(), MESH_OPTIMIZATION::VERTEX_CACHE);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geomesh->VertexBufferCPU));
-	CopyMemory(geomesh->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geomesh->IndexBufferCPU));
-	CopyMemory(geomesh->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-	
-	geomesh->VertexBufferGPU = Utilities::CreateDefaultBuffer(mD3Device.Get(), mCommandList.Get(), vertices.data(), vbByteSize, geomesh->VertexBufferUploader);
-	geomesh->IndexBufferGPU = Utilities::CreateDefaultBuffer(mD3Device.Get(), mCommandList.Get(), indices.data(), ibByteSize, geomesh->IndexBufferUploader);
-
-	geomesh->VertexByteStride = sizeof(Vertex);
-	geomesh->VertexBufferByteSize = vbByteSize;
-	geomesh->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geomesh->IndexBufferByteSize = ibByteSize;
+	mGeometries[geomesh->Name] = std::move(geomesh);
 
-	geomesh->DrawArgs["debugBoxes"] = boxSubmesh;
-	geomesh->DrawArgs["grid"] = gridSubmesh;
-	geomesh->DrawArgs["sphere"] = sphereSubmesh;
-	geomesh->DrawArgs["sphere2"] = sphere2Submesh;
-	geomesh->DrawArgs["dbgQuad"] = dbgquadSubmesh;
+	auto levelFile = mProjectPath + L"Models//" + std::wstring(mLevel.begin(), mLevel.end()) + L".obj";
 
-	mGeometries[geomesh->Name] = std::move(geomesh);
+	// Everything in the level but the cubes, which spin (see BuildRenderItems). Parsed from the OBJ rather than taken
+	// from the packed mesh, so HeadlessRunner collides with the very same triangles. That reads the level even when
+	// the mesh comes from its .fmesh, so it happens on a worker, and Initialize only waits for it at the end.
+	mTerrainLoad = std::async(std::launch::async, [this](const std::string& filename)
+	{
+		size_t bodyCount = 0;
+		return Simulation::LoadTerrain(filename, mTerrain, bodyCount);
+	}, std::string(levelFile.begin(), levelFile.end()));
 
-	// Let's load the static canyon geometry
+	// Let's load the static canyon geometry. Large objects (the terrain, mostly) are split into chunks, each of which gets a render item.
 	auto m = std::make_unique<Mesh>(mD3Device, mCommandList);
-	auto success = m->LoadOBJ(mProjectPath + L"Models//" + std::wstring(mLevel.begin(), mLevel.end()) + L".obj");
+	auto success = m->LoadOBJ(levelFile, OBJ_LOAD_MODE::PARALLEL, MESH_OPTIMIZATION::VERTEX_CACHE_AND_OVERDRAW, VERTEX_FORMAT::PACKED, 3, MeshChunker::MAX_TRIANGLES);
 	assert(success >= 0);
 	m->Name = mLevel;
+
 	mGeometries[m->Name] = std::move(m);
 
 	auto scythe = std::make_unique<Mesh>(mD3Device, mCommandList);
-	success = scythe->LoadOBJ(mProjectPath + L"Models//Scythe2.obj");
+	success = scythe->LoadOBJ(mProjectPath + L"Models//Scythe2.obj", OBJ_LOAD_MODE::SERIAL, MESH_OPTIMIZATION::VERTEX_CACHE, VERTEX_FORMAT::FLOAT, 3);
 	assert(success >= 0);
 	scythe->Name = "Scythe";
 	mGeometries["Scythe"] = std::move(scythe);
@@ -1692,6 +1802,20 @@ void TestApp::BuildShadersAndInputLayout()
 		"SHADOW", "1",
 		NULL, NULL
 	}; // looks like these things terminate with a null,null macro?
+
+	// Vertex shaders for VERTEX_FORMAT::PACKED meshes
+	const D3D_SHADER_MACRO packedDefines[] =
+	{
+		"PACKED_VERTEX", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO shadowPackedDefines[] =
+	{
+		"SHADOW", "1",
+		"PACKED_VERTEX", "1",
+		NULL, NULL
+	};
 	// TODO fix light numbers
 
 	mShaders["standardVS"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Default.hlsl", shadowDefines, "VS", "vs_5_1");
@@ -1700,6 +1824,9 @@ void TestApp::BuildShadersAndInputLayout()
 	mShaders["standardVS_noshadow"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["opaquePS_noshadow"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
 
+	mShaders["standardVS_packed"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Default.hlsl", shadowPackedDefines, "VS", "vs_5_1");
+	mShaders["standardVS_noshadow_packed"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Default.hlsl", packedDefines, "VS", "vs_5_1");
+
 	mShaders["horzBlurCS"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Blur.hlsl", nullptr, "HorzBlurCS", "cs_5_0");
 	mShaders["vertBlurCS"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Blur.hlsl", nullptr, "VertBlurCS", "cs_5_0");
 
@@ -1716,6 +1843,7 @@ void TestApp::BuildShadersAndInputLayout()
 
 	mShaders["shadowVS"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Shadows.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["shadowOpaquePS"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Shadows.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["shadowVS_packed"] = Utilities::CompileShader(mProjectPath + L"Shaders\\Shadows.hlsl", packedDefines, "VS", "vs_5_1");
 	// One more for alpha testing and so on, but we haven't done transparency yet.
 
 	// TODO: some of my shaders dont accept a normal, and yet interpret pos/texc perfectly fine. how/why?
@@ -1726,6 +1854,14 @@ void TestApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
 	};
 
+	// PackedVertex; the vertex shader decodes it with the root constants in cbQuantization
+	mPackedInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_UNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+	};
+
 
 }
 
@@ -1839,6 +1975,79 @@ void TestApp::UpdateInstanceBuffer(const Timer& t, const std::vector<RENDER_ITEM
 	}
 }
 
+void TestApp::CullInstances()
+{
+	CullPass(0, XMMatrixMultiply(mSimulation.Aircraft().View(), XMLoadFloat4x4(&mProj)));
+
+	for (size_t k = 0; k < mLights.size(); ++k)
+	{
+		auto& l = mLights[k];
+		UINT count = l->Type == LightType::POINT ? 6 : 1;
+		for (UINT i = 0; i < count; ++i)
+			CullPass(static_cast<UINT>(1 + k*6 + i), XMMatrixMultiply(XMLoadFloat4x4(&l->View[i]), XMLoadFloat4x4(&l->Proj)));
+	}
+}
+
+// Same view and projection as UpdateMainPassCB or UpdateShadowPassCB give the pass
+void XM_CALLCONV TestApp::CullPass(UINT pass, FXMMATRIX viewProj)
+{
+	ViewVolume volume(viewProj);
+	CullStats stats;
+
+	for (auto category : mCulledRenderItems)
+	{
+		for (auto& ri : mRenderItems[category])
+		{
+			auto& currInstanceBuffer = mCurrFrameResource->InstanceBuffers[ri->Id()];
+			UINT first = (1 + pass) * ri->MaxInstances;
+			UINT visible = 0;
+
+			for (size_t i = 0; i < ri->InstanceCount(); ++i)
+			{
+				XMMATRIX world = XMLoadFloat4x4(&ri->Instance(i).World);
+				if (!volume.Intersects(ri->BoundsB, world))
+					continue;
+
+				InstanceData data;
+				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+				data.MatIndex = ri->Instance(i).MatIndex;
+				currInstanceBuffer->CopyData(first + visible++, data);
+			}
+
+			ri->VisibleInstances[pass] = visible;
+			stats.Visible += visible;
+			stats.Culled += (UINT)ri->InstanceCount() - visible;
+			if (visible > 0)
+				++stats.Draws;
+			else if (ri->InstanceCount() > 0)
+				++stats.SkippedDraws;
+		}
+	}
+
+	mCullStats[pass] = stats;
+}
+
+void TestApp::LogCullStats()
+{
+	char msg[256];
+	for (UINT pass = 0; pass < mCullStats.size(); ++pass)
+	{
+		auto& stats = mCullStats[pass];
+		if (stats.Visible + stats.Culled == 0)
+			continue;
+
+		if (pass == 0)
+			sprintf_s(msg, "Culling: camera: ");
+		else
+			sprintf_s(msg, "Culling: light %u face %u: ", (pass - 1) / 6, (pass - 1) % 6);
+		OutputDebugStringA(msg);
+
+		sprintf_s(msg, "%u visible, %u culled instances; %u draws, %u skipped\n", stats.Visible, stats.Culled,
+			stats.Draws, stats.SkippedDraws);
+		OutputDebugStringA(msg);
+	}
+}
+
 void TestApp::UpdateMaterialBuffer(const Timer& t)
 {
 	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
@@ -3,31 +3,61 @@
 #include "D3Base.h"
 #include "RenderItem.h"
 #include <DirectXColors.h>
+#include <future>
 #include "FrameResource.h"
 #include "BlurFilter.h"
 #include "SobelFilter.h"
-#include "Plane.h"
+#include "Simulation.h"
+#include "InputScript.h"
 #include "RenderTarget.h"
 #include "Mesh.h"
+#include "SceneBvh.h"
+#include "ViewVolume.h"
 #include "Light.h"
 #include "ShadowMap.h"
 
 #include "Camera.h" // temporary!
+#include "Benchmarks.h"
+#include "HeadlessRunner.h"
 
 class TestApp :
 	public D3Base
 {
 public:
-	TestApp(HINSTANCE hInst);
+	TestApp(HINSTANCE hInst, const std::wstring& projectPath);
 	~TestApp();
 
 	virtual bool Initialize() override;
 
+	// Records the plane controls, to be saved to filename when the app closes
+	void Record(const std::string& filename);
+
+	// Flies the controls of an InputScript file from its seed instead of the keyboard and mouse, one simulation step
+	// per frame, and closes the app at its end. Returns InputScript::Load's result.
+	int Replay(const std::string& filename);
+
+	// Instances of the culled render item categories that survived, and that were culled, in one pass. Draws and
+	// SkippedDraws count render items drawn, and skipped as none of their instances survived.
+	struct CullStats
+	{
+		UINT Visible = 0;
+		UINT Culled = 0;
+		UINT Draws = 0;
+		UINT SkippedDraws = 0;
+	};
+
+	// By pass, numbered as the pass constants: 0 for the camera, 1 + 6k + i for face i of light k. As of the last
+	// Update.
+	const std::vector<CullStats>& PassCullStats() const { return mCullStats; }
+
 private:
 	virtual void OnResize() override;
+	virtual void Simulate(float dt) override;
 	virtual void Update(const Timer& t) override;
 	virtual void Draw(const Timer& t) override;
-	void DrawRenderItems(ID3D12GraphicsCommandList*, const std::vector<std::shared_ptr<RenderItem>>&);
+	void SetPipelineState(ID3D12GraphicsCommandList*, const std::string& pso);
+	// Draws every instance of the render items, or, given a pass, those CullInstances found visible in it
+	void DrawRenderItems(ID3D12GraphicsCommandList*, const std::vector<std::shared_ptr<RenderItem>>&, UINT pass = UNCULLED);
 	void DrawFullscreenQuad(ID3D12GraphicsCommandList*);
 	void DrawShadowMaps();
 
@@ -36,18 +66,27 @@ private:
 	virtual void OnMouseMove(WPARAM btnState, int x, int y) override;
 
 	void OnKeyboardInput(const Timer&);
+
+	// Plane controls from the keyboard and mouse go through here, to be recorded
+	void Control(InputScript::CONTROL control, float value);
 	virtual void OnKeyDown(WPARAM, LPARAM) override;
 	virtual void OnKeyUp(WPARAM, LPARAM) override;
 
 	void ClearInstances(std::shared_ptr<RenderItem>);
 
-	void UpdateGeometry(const Timer&);
+	void InterpolateGeometry(float alpha);
 	void UpdateInstanceBuffer(const Timer&, const std::vector<RENDER_ITEM_TYPE>&);
 	void UpdateMaterialBuffer(const Timer&);
 	void UpdateMainPassCB(const Timer&);
 	void UpdateShadowPassCB(size_t lightIndex, UINT passIndex);
 	void UpdateLights(const Timer&);
 
+	// Writes the instances of the culled render items in view of each pass, compacted, to the pass's part of their
+	// instance buffers. After the camera and the lights moved.
+	void CullInstances();
+	void XM_CALLCONV CullPass(UINT pass, DirectX::FXMMATRIX viewProj);
+	void LogCullStats();
+
 	void LoadTextures();
 	void BuildMaterials();
 
@@ -70,8 +109,13 @@ private:
 
 	void BuildFrameResources();
 	void BuildRenderItems();	
+
+	// Adds every instance of the pickable render items to mScene
+	void BuildScene();
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
 private:
+	static const UINT UNCULLED = ~0u;
+
 	int gIdx = 0;
 	std::map<RENDER_ITEM_TYPE, std::vector<std::shared_ptr<RenderItem>>> mRenderItems;
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
@@ -93,15 +137,17 @@ private:
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D12PipelineState>> mPSOs;
+	std::string mCurrPSO; // last one set through SetPipelineState
 
 	DirectX::BoundingSphere mSceneBoundS;
 
-	std::string mLevel = "Level5";
+	std::string mLevel = Simulation::DEFAULT_LEVEL;
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mNullSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mEnvironmentMapSrv;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mPackedInputLayout;
 
 	std::vector<std::shared_ptr<LightPovData>> mLights;
 	UINT mNumDirLights = 0;
@@ -114,16 +160,51 @@ private:
 	PassConstants mShadowPassCB;
 	UINT mPassShadowOffset = 0;
 
+	// By pass; see PassCullStats
+	std::vector<CullStats> mCullStats;
+
 	bool isWireFrame = false;
 	DirectX::XMFLOAT4X4 mProj = Math::Identity4x4();
 
+	// Level of detail selection, see RenderItem::SelectLod. Shadow passes select from the main camera too, but accept
+	// mShadowLodBias times the error: shadow maps are lower resolution and blur away most of the difference.
+	DirectX::XMFLOAT3 mLodEye = { 0.0f, 0.0f, 0.0f };
+	float mLodPixelsPerUnit = 0.0f;
+	float mLodPixelError = 1.0f;
+	float mShadowLodBias = 4.0f;
+	float mLodBias = 1.0f; // current pass
+
+	// World space, for culling clusters in the camera pass; see DrawRenderItems
+	DirectX::BoundingFrustum mCameraFrustum;
+	std::vector<IndexRange> mVisibleRanges;
+
 	std::unique_ptr<BlurFilter> mBlurFilter;
 	std::unique_ptr<SobelFilter> mSobelFilter;
 	std::unique_ptr<RenderTarget> mOffscreenRT;
 
-	Plane mPlane;
+	Simulation mSimulation;
 	POINT mLastMousePos;
 
+	// The level's static triangles, which the plane collides with. Loaded on a worker while Initialize goes on, see
+	// BuildStaticGeometry; mTerrainLoad has the Simulation::LoadTerrain result.
+	TriangleBvh mTerrain;
+	std::future<int> mTerrainLoad;
+
+	// Every instance of the pickable render items, for ray queries. mSceneItems maps SceneBvh handles back to them.
+	struct SceneItem
+	{
+		const RenderItem* Item = nullptr;
+		size_t Index = 0;
+	};
+	SceneBvh mScene;
+	std::vector<SceneItem> mSceneItems;
+
+	// See Record and Replay
+	InputScript mRecording;
+	std::string mRecordingFile;
+	InputScript mReplay;
+	bool mReplaying = false;
+
 	Camera mCamera;
 
 	// Settings
@@ -140,6 +221,14 @@ private:
 		RENDER_ITEM_TYPE::TRANSPARENT_STATIC
 	};
 
+	// Drawn in every pass, so culled against each; see CullInstances
+	const std::vector<RENDER_ITEM_TYPE> mCulledRenderItems = {
+		RENDER_ITEM_TYPE::OPAQUE_DYNAMIC,
+		RENDER_ITEM_TYPE::OPAQUE_STATIC,
+		RENDER_ITEM_TYPE::WIREFRAME_DYNAMIC,
+		RENDER_ITEM_TYPE::WIREFRAME_STATIC
+	};
+
 	const std::vector<RENDER_ITEM_TYPE> mDynamicRenderItems = {
 		RENDER_ITEM_TYPE::OPAQUE_DYNAMIC,
 		RENDER_ITEM_TYPE::TRANSPARENT_DYNAMIC,
@@ -156,7 +245,17 @@ private:
 	};
 
 	// Member variables belonging to the physics 
-	
+
+	// Instances that move with a Simulation body. InterpolateGeometry blends the body's last two steps into the render
+	// item's instance for drawing.
+	struct SimulatedInstance
+	{
+		std::shared_ptr<RenderItem> Item;
+		size_t Index = 0;
+		size_t Body = 0;
+		UINT SceneInstance = 0;	// In mScene
+	};
+	std::vector<SimulatedInstance> mSimulatedInstances;
 };
 
 // Entry point
@@ -168,10 +267,60 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE prevInst, PSTR cmdLine, int showCm
 
 	try
 	{
-		TestApp ta(hInst);
+		auto projectPath = Utilities::ProjectRoot(cmdLine);
+		if (projectPath.empty())
+		{
+			MessageBox(nullptr, L"Project directory not found, run from inside it or pass -root <dir>", L"Flight", MB_OK);
+			return 0;
+		}
+
+		if (strstr(cmdLine, "-bench"))
+		{
+			Benchmarks::Run(projectPath);
+			return 0;
+		}
+
+		// e.g. -simrate 60
+		float simulationRate = 0.0f;
+		if (auto rate = strstr(cmdLine, "-simrate"))
+			simulationRate = (float)atof(rate + strlen("-simrate"));
+
+		// e.g. -headless 100000 Scripts\\loop.txt; the script is optional, so a following -flag is not taken for it
+		if (auto headless = strstr(cmdLine, "-headless"))
+		{
+			unsigned long long ticks = 0;
+			int read = 0;
+			char script[MAX_PATH] = {};
+			if (sscanf_s(headless + strlen("-headless"), "%llu%n", &ticks, &read) == 1)
+			{
+				const char* rest = headless + strlen("-headless") + read;
+				if (sscanf_s(rest, "%259s", script, (unsigned)_countof(script)) == 1 && script[0] == '-')
+					script[0] = '\0';
+			}
+			auto level = std::string(projectPath.begin(), projectPath.end()) + "Models\\" + Simulation::DEFAULT_LEVEL + ".obj";
+			return HeadlessRunner::Run(ticks, script, simulationRate > 0.0f ? simulationRate : 120.0f, level) < 0 ? 1 : 0;
+		}
+
+		TestApp ta(hInst, projectPath);
 		if (!ta.Initialize())
 			return 0;
 
+		if (simulationRate > 0.0f)
+			ta.SetSimulationRate(simulationRate);
+
+		// e.g. -record flight.txt, then -replay flight.txt
+		char script[MAX_PATH] = {};
+		if (auto record = strstr(cmdLine, "-record"))
+		{
+			if (sscanf_s(record + strlen("-record"), "%259s", script, (unsigned)_countof(script)) == 1)
+				ta.Record(script);
+		}
+		if (auto replay = strstr(cmdLine, "-replay"))
+		{
+			if (sscanf_s(replay + strlen("-replay"), "%259s", script, (unsigned)_countof(script)) != 1 || ta.Replay(script) < 0)
+				return 0;
+		}
+
 		return ta.Run();
 	}
 	catch (DxException& e)
@@ -181,8 +330,22 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE prevInst, PSTR cmdLine, int showCm
 	}
 }
 
-TestApp::TestApp(HINSTANCE hInst) : D3Base(hInst) {};
-TestApp::~TestApp() {};
+TestApp::TestApp(HINSTANCE hInst, const std::wstring& projectPath) : D3Base(hInst), mProjectPath(projectPath) {};
+TestApp::~TestApp()
+{
+	if (!mRecordingFile.empty())
+	{
+		// Where the recording stopped, so the replay stops there too
+		mRecording.Record({ mSimulation.Tick(), InputScript::CONTROL::END, 0.0f });
+		int result = mRecording.Save(mRecordingFile);
+
+		char msg[512];
+		sprintf_s(msg, "Recording: %zu events over %llu ticks %s %s, checksum %016llx\n", mRecording.Events().size(),
+			(unsigned long long)mSimulation.Tick(), result < 0 ? "COULD NOT be saved to" : "saved to",
+			mRecordingFile.c_str(), (unsigned long long)mSimulation.Checksum());
+		OutputDebugStringA(msg);
+	}
+};
 
 void TestApp::OnResize()
 {
@@ -0,0 +1,551 @@
+#include "TriangleBvh.h"
+#include "ObjParser.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat> // FLT_MAX
+#include <cmath>
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+    // Closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+    XMVECTOR XM_CALLCONV ClosestPointOnTriangle(FXMVECTOR p, FXMVECTOR a, FXMVECTOR b, GXMVECTOR c)
+    {
+        auto ab = b - a;
+        auto ac = c - a;
+        auto ap = p - a;
+        float d1 = XMVectorGetX(XMVector3Dot(ab, ap));
+        float d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+        if (d1 <= 0.0f && d2 <= 0.0f)
+            return a;
+
+        auto bp = p - b;
+        float d3 = XMVectorGetX(XMVector3Dot(ab, bp));
+        float d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+        if (d3 >= 0.0f && d4 <= d3)
+            return b;
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return a + d1 / (d1 - d3) * ab;
+
+        auto cp = p - c;
+        float d5 = XMVectorGetX(XMVector3Dot(ab, cp));
+        float d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+        if (d6 >= 0.0f && d5 <= d6)
+            return c;
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return a + d2 / (d2 - d6) * ac;
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+
+        float denom = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    // Smallest root of a t^2 + b t + c in [0, maxT), if there is one
+    bool LowestRoot(float a, float b, float c, float maxT, float& root)
+    {
+        if (a <= 0.0f)
+            return false;
+
+        float det = b * b - 4.0f * a * c;
+        if (det < 0.0f)
+            return false;
+
+        float t = (-b - sqrtf(det)) / (2.0f * a);
+        if (t < 0.0f || t >= maxT)
+            return false;
+
+        root = t;
+        return true;
+    }
+
+    /*
+    Sphere of radius r moving from p along d (t in [0, 1]) against triangle abc. If it touches it before maxT, sets
+    maxT and point to when and where. Face first: if the sphere meets the triangle's plane inside the triangle, that is
+    the first touch. Otherwise it can only be an edge (the sphere meeting a cylinder around it) or a vertex.
+    */
+    bool XM_CALLCONV SweepTriangle(FXMVECTOR p, FXMVECTOR d, float r, const TriangleBvh::Triangle& tri, float& maxT,
+        XMVECTOR& point)
+    {
+        const XMVECTOR v[3] = { XMLoadFloat3(&tri.V0), XMLoadFloat3(&tri.V1), XMLoadFloat3(&tri.V2) };
+
+        // Overlapping already: a hit only if moving in. The distance to a convex shape is convex along the path, so if
+        // it does not fall now it never will.
+        auto closest = ClosestPointOnTriangle(p, v[0], v[1], v[2]);
+        auto away = p - closest;
+        float distSq = XMVectorGetX(XMVector3LengthSq(away));
+        if (distSq <= r * r)
+        {
+            if (distSq > 0.0f && XMVectorGetX(XMVector3Dot(away, d)) >= 0.0f)
+                return false;
+
+            maxT = 0.0f;
+            point = closest;
+            return true;
+        }
+
+        bool hit = false;
+
+        auto n = XMVector3Cross(v[1] - v[0], v[2] - v[0]);
+        float nLengthSq = XMVectorGetX(XMVector3LengthSq(n));
+        if (nLengthSq > 0.0f)
+        {
+            n = n / sqrtf(nLengthSq);
+            float s0 = XMVectorGetX(XMVector3Dot(n, p - v[0]));
+            float sd = XMVectorGetX(XMVector3Dot(n, d));
+
+            // Towards the plane from whichever side we are on
+            if (s0 * sd < 0.0f)
+            {
+                float t = (s0 > 0.0f ? s0 - r : s0 + r) / -sd;
+                if (t >= 0.0f && t < maxT)
+                {
+                    auto center = p + t * d;
+                    auto onPlane = center - n * (s0 + t * sd);
+
+                    // Inside if on the same side of all three edges
+                    bool inside = true;
+                    for (int e = 0; e < 3 && inside; ++e)
+                    {
+                        auto edgeNormal = XMVector3Cross(v[(e + 1) % 3] - v[e], onPlane - v[e]);
+                        inside = XMVectorGetX(XMVector3Dot(edgeNormal, n)) >= 0.0f;
+                    }
+
+                    if (inside)
+                    {
+                        maxT = t;
+                        point = onPlane;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        float dd = XMVectorGetX(XMVector3LengthSq(d));
+
+        for (int i = 0; i < 3; ++i)
+        {
+            // Vertex: |p + t d - v|^2 = r^2
+            auto pv = p - v[i];
+            float t;
+            if (LowestRoot(dd, 2.0f * XMVectorGetX(XMVector3Dot(d, pv)), XMVectorGetX(XMVector3LengthSq(pv)) - r * r,
+                maxT, t))
+            {
+                maxT = t;
+                point = v[i];
+                hit = true;
+            }
+
+            // Edge: distance from p + t d to the edge's line is r, at a point between its ends. Across the edge only,
+            // so that long edges far from the origin don't lose the answer to rounding.
+            auto edge = v[(i + 1) % 3] - v[i];
+            float edgeLength = XMVectorGetX(XMVector3Length(edge));
+            if (edgeLength <= 0.0f)
+                continue;
+
+            auto u = edge / edgeLength;
+            float du = XMVectorGetX(XMVector3Dot(d, u));
+            float pu = XMVectorGetX(XMVector3Dot(pv, u));
+            auto dAcross = d - du * u;
+            auto pAcross = pv - pu * u;
+            if (LowestRoot(XMVectorGetX(XMVector3LengthSq(dAcross)), 2.0f * XMVectorGetX(XMVector3Dot(dAcross, pAcross)),
+                XMVectorGetX(XMVector3LengthSq(pAcross)) - r * r, maxT, t))
+            {
+                float f = (pu + t * du) / edgeLength;
+                if (f >= 0.0f && f <= 1.0f)
+                {
+                    maxT = t;
+                    point = v[i] + f * edge;
+                    hit = true;
+                }
+            }
+        }
+
+        return hit;
+    }
+
+    // Moller-Trumbore, two sided. t is in units of d.
+    bool XM_CALLCONV RayTriangle(FXMVECTOR o, FXMVECTOR d, const TriangleBvh::Triangle& tri, float& t)
+    {
+        auto v0 = XMLoadFloat3(&tri.V0);
+        auto e1 = XMLoadFloat3(&tri.V1) - v0;
+        auto e2 = XMLoadFloat3(&tri.V2) - v0;
+
+        auto pv = XMVector3Cross(d, e2);
+        float det = XMVectorGetX(XMVector3Dot(e1, pv));
+        if (det == 0.0f)
+            return false;
+
+        float invDet = 1.0f / det;
+        auto tv = o - v0;
+        float u = XMVectorGetX(XMVector3Dot(tv, pv)) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        auto qv = XMVector3Cross(tv, e1);
+        float v = XMVectorGetX(XMVector3Dot(d, qv)) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        t = XMVectorGetX(XMVector3Dot(e2, qv)) * invDet;
+        return t >= 0.0f;
+    }
+
+    /*
+    BvhTree::RayBox for LANES rays: whether any of them enters node's box for t in [0, maxT] (its own maxT), and the
+    earliest entry of those that do.
+    */
+    bool PacketBox(const TriangleSimd::Rays& rays, const __m128 invD[3], const TriangleBvh::Node& node, __m128 maxT,
+        float& entry)
+    {
+        const __m128 lo[3] = { _mm_set1_ps(node.Min.x), _mm_set1_ps(node.Min.y), _mm_set1_ps(node.Min.z) };
+        const __m128 hi[3] = { _mm_set1_ps(node.Max.x), _mm_set1_ps(node.Max.y), _mm_set1_ps(node.Max.z) };
+
+        __m128 t0 = _mm_setzero_ps(), t1 = maxT;
+        for (int c = 0; c < 3; ++c)
+        {
+            // A ray parallel to the slab gets -inf and inf if it is inside, and both of one sign if not. NaN, for one
+            // that starts right on its boundary, is ignored by putting it first in min and max.
+            __m128 a = _mm_mul_ps(_mm_sub_ps(lo[c], rays.Origin[c]), invD[c]);
+            __m128 b = _mm_mul_ps(_mm_sub_ps(hi[c], rays.Origin[c]), invD[c]);
+            t0 = _mm_max_ps(_mm_min_ps(a, b), t0);
+            t1 = _mm_min_ps(_mm_max_ps(a, b), t1);
+        }
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+        if (mask == 0)
+            return false;
+
+        float entries[TriangleSimd::LANES];
+        _mm_storeu_ps(entries, t0);
+        entry = FLT_MAX;
+        for (UINT i = 0; i < TriangleSimd::LANES; ++i)
+        {
+            if (mask & (1 << i))
+                entry = (std::min)(entry, entries[i]);
+        }
+        return true;
+    }
+
+    TriangleBvh::Triangle LaneTriangle(const TriangleSimd::Block& block, UINT lane)
+    {
+        TriangleBvh::Triangle t;
+        t.V0 = { block.V0[0][lane], block.V0[1][lane], block.V0[2][lane] };
+        t.V1 = { block.V1[0][lane], block.V1[1][lane], block.V1[2][lane] };
+        t.V2 = { block.V2[0][lane], block.V2[1][lane], block.V2[2][lane] };
+        t.Id = block.Id[lane];
+        return t;
+    }
+
+    void SetContact(FXMVECTOR p, FXMVECTOR d, float t, FXMVECTOR point, const TriangleBvh::Triangle& tri,
+        TriangleBvh::Contact& contact)
+    {
+        auto normal = p + t * d - point;
+        if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+            normal = XMVector3Normalize(normal);
+        else
+            normal = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&tri.V1) - XMLoadFloat3(&tri.V0),
+                XMLoadFloat3(&tri.V2) - XMLoadFloat3(&tri.V0)));
+
+        contact.Time = t;
+        XMStoreFloat3(&contact.Point, point);
+        XMStoreFloat3(&contact.Normal, normal);
+        contact.Triangle = tri.Id;
+    }
+}
+
+void TriangleBvh::Add(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2)
+{
+    Triangle t;
+    XMStoreFloat3(&t.V0, v0);
+    XMStoreFloat3(&t.V1, v1);
+    XMStoreFloat3(&t.V2, v2);
+    t.Id = static_cast<UINT>(mTriangles.size());
+    mTriangles.push_back(t);
+}
+
+void TriangleBvh::Add(const vector<Vertex>& vertices, const vector<uint32_t>& indices, const ObjObject& object)
+{
+    auto position = [&](UINT i) { return XMLoadFloat3(&vertices[object.BaseVertexLocation + indices[i]].Pos); };
+    for (UINT i = object.StartIndexLocation; i + 2 < object.StartIndexLocation + object.IndexCount; i += 3)
+        Add(position(i), position(i + 1), position(i + 2));
+}
+
+void TriangleBvh::Clear()
+{
+    mNodes.clear();
+    mTriangles.clear();
+    mBlocks.clear();
+    mDepth = 0;
+}
+
+void TriangleBvh::Build()
+{
+    mNodes.clear();
+    mDepth = 0;
+    if (mTriangles.empty())
+        return;
+
+    const UINT count = static_cast<UINT>(mTriangles.size());
+    vector<BvhTree::Primitive> primitives(count);
+    for (UINT i = 0; i < count; ++i)
+    {
+        auto& t = mTriangles[i];
+        XMVECTOR v0 = XMLoadFloat3(&t.V0), v1 = XMLoadFloat3(&t.V1), v2 = XMLoadFloat3(&t.V2);
+        XMStoreFloat3(&primitives[i].Min, XMVectorMin(v0, XMVectorMin(v1, v2)));
+        XMStoreFloat3(&primitives[i].Max, XMVectorMax(v0, XMVectorMax(v1, v2)));
+        XMStoreFloat3(&primitives[i].Centroid, (v0 + v1 + v2) * (1.0f / 3.0f));
+        primitives[i].Index = i;
+    }
+
+    mDepth = BvhTree::Build(mNodes, primitives, MAX_LEAF_TRIANGLES);
+
+    // Leaf order
+    vector<Triangle> ordered(count);
+    for (UINT i = 0; i < count; ++i)
+        ordered[i] = mTriangles[primitives[i].Index];
+    mTriangles.swap(ordered);
+
+    // A block per leaf, which the leaf points to from then on
+    mBlocks.clear();
+    for (auto& node : mNodes)
+    {
+        if (node.Count == 0)
+            continue;
+
+        TriangleSimd::Block block = {};
+        block.Count = node.Count;
+        for (UINT lane = 0; lane < node.Count; ++lane)
+        {
+            auto& t = mTriangles[node.First + lane];
+            TriangleSimd::SetLane(block, lane, t.V0, t.V1, t.V2, t.Id);
+        }
+        node.First = static_cast<UINT>(mBlocks.size());
+        mBlocks.push_back(block);
+    }
+}
+
+bool TriangleBvh::Intersects(FXMVECTOR origin, FXMVECTOR direction, float maxT, float& t, UINT& triangle) const
+{
+    float closest = maxT;
+    UINT hit = 0;
+    bool found = false;
+
+    BvhTree::Traverse(mNodes, origin, direction, 0.0f, closest, [&](UINT first, UINT)
+    {
+        auto& block = mBlocks[first];
+        __m128 times;
+        int mask = TriangleSimd::Intersect(block, origin, direction, closest, times);
+        if (mask == 0)
+            return false;
+
+        float laneTimes[TriangleSimd::LANES];
+        _mm_storeu_ps(laneTimes, times);
+        for (UINT lane = 0; lane < TriangleSimd::LANES; ++lane)
+        {
+            if ((mask & (1 << lane)) && laneTimes[lane] < closest)
+            {
+                closest = laneTimes[lane];
+                hit = block.Id[lane];
+                found = true;
+            }
+        }
+        return false;
+    });
+
+    if (!found)
+        return false;
+
+    t = closest;
+    triangle = hit;
+    return true;
+}
+
+int TriangleBvh::Intersects(const TriangleSimd::Rays& rays, __m128 maxT, __m128& t,
+    UINT triangle[TriangleSimd::LANES]) const
+{
+    if (mNodes.empty())
+        return 0;
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 invD[3] = { _mm_div_ps(one, rays.Direction[0]), _mm_div_ps(one, rays.Direction[1]),
+        _mm_div_ps(one, rays.Direction[2]) };
+
+    float closest[TriangleSimd::LANES];
+    _mm_storeu_ps(closest, maxT);
+    int found = 0;
+
+    // As BvhTree::Traverse, for the whole packet: a box is entered if any of the rays enters it
+    struct Entry
+    {
+        UINT Node;
+        float Time;
+    } stack[BvhTree::TRAVERSAL_STACK];
+    int top = 0;
+
+    float entry;
+    if (!PacketBox(rays, invD, mNodes[0], _mm_loadu_ps(closest), entry))
+        return 0;
+    stack[top++] = { 0, entry };
+
+    while (top > 0)
+    {
+        auto next = stack[--top];
+        __m128 current = _mm_loadu_ps(closest);
+        if (next.Time > (std::max)((std::max)(closest[0], closest[1]), (std::max)(closest[2], closest[3])))
+            continue;
+
+        auto& node = mNodes[next.Node];
+        if (node.Count > 0)
+        {
+            auto& block = mBlocks[node.First];
+            for (UINT lane = 0; lane < block.Count; ++lane)
+            {
+                __m128 times;
+                int mask = TriangleSimd::Intersect(rays, block, lane, current, times);
+                if (mask == 0)
+                    continue;
+
+                float rayTimes[TriangleSimd::LANES];
+                _mm_storeu_ps(rayTimes, times);
+                for (UINT ray = 0; ray < TriangleSimd::LANES; ++ray)
+                {
+                    if (mask & (1 << ray))
+                    {
+                        closest[ray] = rayTimes[ray];
+                        triangle[ray] = block.Id[lane];
+                    }
+                }
+                found |= mask;
+                current = _mm_loadu_ps(closest);
+            }
+            continue;
+        }
+
+        float entryL, entryR;
+        bool hitL = PacketBox(rays, invD, mNodes[node.First], current, entryL);
+        bool hitR = PacketBox(rays, invD, mNodes[node.First + 1], current, entryR);
+        if (hitL && hitR)
+        {
+            bool leftFirst = entryL <= entryR;
+            stack[top++] = leftFirst ? Entry{ node.First + 1, entryR } : Entry{ node.First, entryL };
+            stack[top++] = leftFirst ? Entry{ node.First, entryL } : Entry{ node.First + 1, entryR };
+        }
+        else if (hitL)
+            stack[top++] = { node.First, entryL };
+        else if (hitR)
+            stack[top++] = { node.First + 1, entryR };
+    }
+
+    t = _mm_loadu_ps(closest);
+    return found;
+}
+
+bool TriangleBvh::Occludes(FXMVECTOR origin, FXMVECTOR direction, float maxT) const
+{
+    bool occluded = false;
+    BvhTree::Traverse(mNodes, origin, direction, 0.0f, maxT, [&](UINT first, UINT)
+    {
+        __m128 times;
+        occluded = TriangleSimd::Intersect(mBlocks[first], origin, direction, maxT, times) != 0;
+        return occluded;
+    });
+
+    return occluded;
+}
+
+bool TriangleBvh::SweepSphere(FXMVECTOR start, FXMVECTOR end, float radius, Contact& contact) const
+{
+    auto d = end - start;
+    float maxT = 1.0f;
+    Triangle hitTriangle;
+    bool hit = false;
+    XMVECTOR hitPoint = XMVectorZero();
+
+    // Boxes grown by the radius: the sphere's center has to pass through one for the sphere to touch what is inside
+    BvhTree::Traverse(mNodes, start, d, radius, maxT, [&](UINT first, UINT count)
+    {
+        for (UINT lane = 0; lane < count; ++lane)
+        {
+            auto triangle = LaneTriangle(mBlocks[first], lane);
+            if (SweepTriangle(start, d, radius, triangle, maxT, hitPoint))
+            {
+                hitTriangle = triangle;
+                hit = true;
+            }
+        }
+        return false;
+    });
+
+    if (!hit)
+        return false;
+
+    SetContact(start, d, maxT, hitPoint, hitTriangle, contact);
+    return true;
+}
+
+bool TriangleBvh::IntersectsBruteForce(FXMVECTOR origin, FXMVECTOR direction, float maxT, float& t,
+    UINT& triangle) const
+{
+    float closest = maxT;
+    const Triangle* hit = nullptr;
+
+    for (auto& tri : mTriangles)
+    {
+        float d;
+        if (RayTriangle(origin, direction, tri, d) && d < closest)
+        {
+            closest = d;
+            hit = &tri;
+        }
+    }
+
+    if (!hit)
+        return false;
+
+    t = closest;
+    triangle = hit->Id;
+    return true;
+}
+
+bool TriangleBvh::SweepSphereBruteForce(FXMVECTOR start, FXMVECTOR end, float radius, Contact& contact) const
+{
+    auto d = end - start;
+    float maxT = 1.0f;
+    const Triangle* hitTriangle = nullptr;
+    XMVECTOR hitPoint = XMVectorZero();
+
+    for (auto& t : mTriangles)
+    {
+        if (SweepTriangle(start, d, radius, t, maxT, hitPoint))
+            hitTriangle = &t;
+    }
+
+    if (!hitTriangle)
+        return false;
+
+    SetContact(start, d, maxT, hitPoint, *hitTriangle, contact);
+    return true;
+}
+
+BoundingBox TriangleBvh::Bounds() const
+{
+    BoundingBox bounds;
+    if (mNodes.empty())
+    {
+        bounds.Extents = { 0.0f, 0.0f, 0.0f };
+        return bounds;
+    }
+
+    BoundingBox::CreateFromPoints(bounds, XMLoadFloat3(&mNodes[0].Min), XMLoadFloat3(&mNodes[0].Max));
+    return bounds;
+}
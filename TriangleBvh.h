@@ -0,0 +1,107 @@
+#pragma once
+
+#include "BvhTree.h"
+#include "TriangleSimd.h"
+
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class Mesh;
+struct SubmeshGeometry;
+struct ObjObject;
+struct Vertex;
+
+/*
+A bounding volume hierarchy over a static triangle soup, for ray and collision queries against level geometry. Every
+full resolution submesh of a Mesh has one (see Mesh::Bvhs) and TestApp keeps one over the whole level for the plane.
+
+Add the triangles, then Build. The triangles are copied in, so the BVH does not depend on the mesh keeping its CPU
+buffers. See BvhTree for the node layout; the First of a leaf is the index of its block in Blocks, which holds its
+triangles component by component for the TriangleSimd kernels.
+*/
+class TriangleBvh
+{
+public:
+    // Leaves hold at most this many triangles, a TriangleSimd::Block
+    static const UINT MAX_LEAF_TRIANGLES = TriangleSimd::LANES;
+
+    typedef BvhTree::Node Node;
+
+    struct Triangle
+    {
+        DirectX::XMFLOAT3 V0, V1, V2;
+        UINT Id;        // Order in which it was added
+    };
+
+    // Where a swept sphere first touches the triangles
+    struct Contact
+    {
+        float Time = 1.0f;              // Fraction of the sweep, [0, 1]
+        DirectX::XMFLOAT3 Point;        // On the triangle
+        DirectX::XMFLOAT3 Normal;       // Unit, from Point towards the sphere's center at Time
+        UINT Triangle = 0;              // Id of the triangle hit
+    };
+
+    void Add(DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1, DirectX::FXMVECTOR v2);
+
+    // Adds the triangles of submesh as drawn with world: decoded from the mesh's CPU buffers, as Pick reads them
+    void Add(const Mesh& mesh, const SubmeshGeometry& submesh, DirectX::FXMMATRIX world = DirectX::XMMatrixIdentity());
+
+    // Adds the triangles of object as ObjParser returns it, from the vertices and indices it returns alongside
+    void Add(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices, const ObjObject& object);
+
+    // Builds the hierarchy over everything added so far, with BvhTree::Build
+    void Build();
+
+    void Clear();
+
+    /*
+    Finds the closest triangle the ray origin + t direction hits for t in [0, maxT); triangles are two sided. t is in
+    units of direction, which need not be normalized. Subtrees that start beyond the closest hit so far are skipped.
+    Returns false, leaving t and triangle alone, if there is none; triangle is the Id of the one hit.
+    */
+    bool Intersects(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxT, float& t, UINT& triangle) const;
+
+    /*
+    Intersects for a packet of rays, which should start and go in similar directions for any gain over casting them one
+    by one: the packet enters a box if any of its rays does. maxT is per ray. Returns a mask with bit i set if ray i hits
+    something, in which case lane i of t and triangle[i] are as Intersects would set them.
+    */
+    int Intersects(const TriangleSimd::Rays& rays, __m128 maxT, __m128& t, UINT triangle[TriangleSimd::LANES]) const;
+
+    // Intersects against every triangle, one at a time, for checking it
+    bool IntersectsBruteForce(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxT, float& t,
+        UINT& triangle) const;
+
+    // Whether the ray hits any triangle for t in [0, maxT), for line of sight. Stops at the first one found.
+    bool Occludes(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxT) const;
+
+    /*
+    Sweeps a sphere of radius from start to end and finds the first time it touches a triangle, face, edge or vertex.
+    Triangles are two sided. A sphere that already overlaps a triangle at start only hits it if it moves further in,
+    so a body resting on the ground, or backing off from a wall, is free to go. Returns false if nothing is hit.
+    */
+    bool SweepSphere(DirectX::FXMVECTOR start, DirectX::FXMVECTOR end, float radius, Contact& contact) const;
+
+    // The same query against every triangle, for checking SweepSphere
+    bool SweepSphereBruteForce(DirectX::FXMVECTOR start, DirectX::FXMVECTOR end, float radius, Contact& contact) const;
+
+    size_t TriangleCount() const { return mTriangles.size(); }
+    size_t NodeCount() const { return mNodes.size(); }
+    const std::vector<Node>& Nodes() const { return mNodes; }
+    const std::vector<Triangle>& Triangles() const { return mTriangles; }
+    const std::vector<TriangleSimd::Block>& Blocks() const { return mBlocks; }
+
+    // Levels below the root down to the deepest leaf
+    UINT Depth() const { return mDepth; }
+
+    // Of everything in the last Build; empty if there was nothing
+    DirectX::BoundingBox Bounds() const;
+
+private:
+    std::vector<Node> mNodes;
+    std::vector<Triangle> mTriangles;         // In leaf order
+    std::vector<TriangleSimd::Block> mBlocks;
+    UINT mDepth = 0;
+};
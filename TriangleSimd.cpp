@@ -0,0 +1,28 @@
+#include "TriangleSimd.h"
+
+using namespace DirectX;
+
+void TriangleSimd::SetLane(Block& block, UINT lane, const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2, UINT id)
+{
+    const XMFLOAT3* vertices[3] = { &v0, &v1, &v2 };
+    float (*components[3])[LANES] = { block.V0, block.V1, block.V2 };
+    for (int v = 0; v < 3; ++v)
+    {
+        components[v][0][lane] = vertices[v]->x;
+        components[v][1][lane] = vertices[v]->y;
+        components[v][2][lane] = vertices[v]->z;
+    }
+    block.Id[lane] = id;
+}
+
+TriangleSimd::Rays TriangleSimd::MakeRays(const XMFLOAT3* origins, const XMFLOAT3* directions)
+{
+    Rays rays;
+    rays.Origin[0] = _mm_setr_ps(origins[0].x, origins[1].x, origins[2].x, origins[3].x);
+    rays.Origin[1] = _mm_setr_ps(origins[0].y, origins[1].y, origins[2].y, origins[3].y);
+    rays.Origin[2] = _mm_setr_ps(origins[0].z, origins[1].z, origins[2].z, origins[3].z);
+    rays.Direction[0] = _mm_setr_ps(directions[0].x, directions[1].x, directions[2].x, directions[3].x);
+    rays.Direction[1] = _mm_setr_ps(directions[0].y, directions[1].y, directions[2].y, directions[3].y);
+    rays.Direction[2] = _mm_setr_ps(directions[0].z, directions[1].z, directions[2].z, directions[3].z);
+    return rays;
+}
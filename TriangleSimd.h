@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <DirectXMath.h>
+
+#include <xmmintrin.h>
+
+/*
+Moller-Trumbore ray/triangle tests, LANES at a time in SSE registers: one ray against a Block of triangles, or a packet
+of rays that start and go in similar directions (a patch of pixels, say) against one triangle. They do the arithmetic of
+the scalar test of TriangleBvh::IntersectsBruteForce in the same order, so they find the same hits at the same
+distances.
+
+A Block is a TriangleBvh leaf. Lanes past its Count are degenerate, and never hit.
+*/
+class TriangleSimd
+{
+public:
+    static const UINT LANES = 4;
+
+    // LANES triangles, component by component: V0[c][lane] is component c of the first vertex of triangle lane
+    struct Block
+    {
+        float V0[3][LANES];
+        float V1[3][LANES];
+        float V2[3][LANES];
+        UINT Id[LANES];
+        UINT Count;
+    };
+
+    // LANES rays, component by component
+    struct Rays
+    {
+        __m128 Origin[3];
+        __m128 Direction[3];
+    };
+
+    // Puts a triangle in lane of block. Start from a zeroed Block, whose lanes have no area, and fill Count lanes.
+    static void SetLane(Block& block, UINT lane, const DirectX::XMFLOAT3& v0, const DirectX::XMFLOAT3& v1,
+        const DirectX::XMFLOAT3& v2, UINT id);
+
+    // Rays i = 0..LANES-1 from origins[i] along directions[i]
+    static Rays MakeRays(const DirectX::XMFLOAT3* origins, const DirectX::XMFLOAT3* directions);
+
+    /*
+    Tests the ray o + t d against the triangles of block, two sided. Returns a mask with bit lane set if the ray hits
+    triangle lane for t in [0, maxT), whose t is then lane of t; t is in units of d.
+    */
+    static int XM_CALLCONV Intersect(const Block& block, DirectX::FXMVECTOR o, DirectX::FXMVECTOR d, float maxT,
+        __m128& t)
+    {
+        DirectX::XMFLOAT3 of, df;
+        DirectX::XMStoreFloat3(&of, o);
+        DirectX::XMStoreFloat3(&df, d);
+        const __m128 origin[3] = { _mm_set1_ps(of.x), _mm_set1_ps(of.y), _mm_set1_ps(of.z) };
+        const __m128 direction[3] = { _mm_set1_ps(df.x), _mm_set1_ps(df.y), _mm_set1_ps(df.z) };
+
+        __m128 v0[3], v1[3], v2[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            v0[c] = _mm_loadu_ps(block.V0[c]);
+            v1[c] = _mm_loadu_ps(block.V1[c]);
+            v2[c] = _mm_loadu_ps(block.V2[c]);
+        }
+
+        return Kernel(origin, direction, v0, v1, v2, _mm_set1_ps(maxT), t);
+    }
+
+    /*
+    Tests the rays against triangle lane of block, two sided. Returns a mask with bit i set if ray i hits it for t in
+    [0, maxT[i]), whose t is then lane i of t.
+    */
+    static int Intersect(const Rays& rays, const Block& block, UINT lane, __m128 maxT, __m128& t)
+    {
+        __m128 v0[3], v1[3], v2[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            v0[c] = _mm_set1_ps(block.V0[c][lane]);
+            v1[c] = _mm_set1_ps(block.V1[c][lane]);
+            v2[c] = _mm_set1_ps(block.V2[c][lane]);
+        }
+
+        return Kernel(rays.Origin, rays.Direction, v0, v1, v2, maxT, t);
+    }
+
+private:
+    static __m128 Dot(const __m128 a[3], const __m128 b[3])
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+    }
+
+    static void Cross(const __m128 a[3], const __m128 b[3], __m128 r[3])
+    {
+        r[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+        r[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+        r[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+    }
+
+    // Lane by lane; lanes that miss may hold anything in t, NaN included
+    static int Kernel(const __m128 o[3], const __m128 d[3], const __m128 v0[3], const __m128 v1[3], const __m128 v2[3],
+        __m128 maxT, __m128& t)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        __m128 e1[3], e2[3], tv[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            e1[c] = _mm_sub_ps(v1[c], v0[c]);
+            e2[c] = _mm_sub_ps(v2[c], v0[c]);
+            tv[c] = _mm_sub_ps(o[c], v0[c]);
+        }
+
+        __m128 pv[3];
+        Cross(d, e2, pv);
+        __m128 det = Dot(e1, pv);
+        __m128 hit = _mm_cmpneq_ps(det, zero);
+        __m128 invDet = _mm_div_ps(one, det);
+
+        __m128 u = _mm_mul_ps(Dot(tv, pv), invDet);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+        __m128 qv[3];
+        Cross(tv, e1, qv);
+        __m128 v = _mm_mul_ps(Dot(d, qv), invDet);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+        t = _mm_mul_ps(Dot(e2, qv), invDet);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, maxT)));
+
+        return _mm_movemask_ps(hit);
+    }
+};
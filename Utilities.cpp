@@ -1,5 +1,7 @@
 #include "Utilities.h"
 #include <comdef.h>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include <string>
@@ -21,6 +23,37 @@ std::vector<std::string> split(const std::string& str, char delim)
     return words;
 }
 
+MappedFile::MappedFile(const std::wstring& filename)
+{
+    mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+        return;
+
+    // A mapping of size 0 means "the whole file"
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping)
+        return;
+
+    mData = static_cast<const char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData)
+        mSize = (size_t)size.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+        UnmapViewOfFile(mData);
+    if (mMapping)
+        CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+}
+
 DxException::DxException(HRESULT hr, const std::wstring& functionName, const std::wstring& filename, int lineNumber) :
     ErrorCode(hr),
     FunctionName(functionName),
@@ -45,6 +78,55 @@ UINT Utilities::CalcConstantBufferByteSize(UINT byteSize)
     return (byteSize + 255) & ~255;
 }
 
+std::wstring Utilities::ProjectRoot(const char* cmdLine)
+{
+    auto withSlash = [](std::wstring dir)
+    {
+        if (!dir.empty() && dir.back() != L'\\' && dir.back() != L'/')
+            dir += L'\\';
+        return dir;
+    };
+
+    // e.g. -root F:\Github\Flight
+    if (auto root = strstr(cmdLine, "-root"))
+    {
+        char dir[MAX_PATH] = {};
+        if (sscanf_s(root + strlen("-root"), "%259s", dir, (unsigned)_countof(dir)) == 1)
+            return withSlash(std::wstring(dir, dir + strlen(dir)));
+    }
+
+    // The executable moves between build configurations, so try the working directory (the project directory when
+    // started from Visual Studio) first and only then walk up from the executable
+    wchar_t buffer[MAX_PATH] = {};
+    std::wstring starts[2];
+    if (GetCurrentDirectoryW(MAX_PATH, buffer))
+        starts[0] = buffer;
+    if (GetModuleFileNameW(nullptr, buffer, MAX_PATH))
+    {
+        starts[1] = buffer;
+        starts[1].erase((std::min)(starts[1].find_last_of(L"\\/"), starts[1].size()));
+    }
+
+    for (auto dir : starts)
+    {
+        while (!dir.empty())
+        {
+            dir = withSlash(dir);
+            if (GetFileAttributesW((dir + L"Shaders\\Default.hlsl").c_str()) != INVALID_FILE_ATTRIBUTES)
+                return dir;
+
+            // Drop the last component; stop at the drive root
+            dir.pop_back();
+            auto slash = dir.find_last_of(L"\\/");
+            if (slash == std::wstring::npos)
+                break;
+            dir.erase(slash);
+        }
+    }
+
+    return L"";
+}
+
 bool Utilities::IsKeyDown(int vkeyCode)
 {
     return (GetAsyncKeyState(vkeyCode) & 0x8000) != 0;
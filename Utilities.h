@@ -74,6 +74,11 @@ public:
 
     static UINT CalcConstantBufferByteSize(UINT byteSize);
 
+    // Directory holding Shaders\ and Models\, with a trailing backslash. Taken from "-root <dir>" if given, otherwise the
+    // first directory up from the working directory or, failing that, the executable that has Shaders\Default.hlsl.
+    // Empty if none is found.
+    static std::wstring ProjectRoot(const char* cmdLine);
+
     // DX lookatlh behaves strangely... lets try constructing view mat manually
     static DirectX::XMMATRIX XM_CALLCONV LookAt(DirectX::FXMVECTOR, DirectX::FXMVECTOR, DirectX::FXMVECTOR);
 
@@ -95,6 +100,28 @@ public:
 
 std::vector<std::string> split(const std::string&, char delim);
 
+/*
+Read-only memory mapping of an entire file. The view stays valid for the lifetime of the object.
+Data() returns nullptr if the file could not be opened or mapped (or is empty).
+*/
+class MappedFile
+{
+public:
+    MappedFile(const std::wstring& filename);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+private:
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+    const char* mData = nullptr;
+    size_t mSize = 0;
+};
+
 class DxException
 {
 public:
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+/*
+The vertex layouts meshes are built from. Kept apart from FrameResource.h so that the code which builds without D3D12
+(ObjParser, see Headless/CMakeLists.txt) reads levels into the same vertices the app draws.
+*/
+
+struct Vertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+    DirectX::XMFLOAT2 TexC;
+};
+
+// Compressed Vertex for VERTEX_FORMAT::PACKED, half the size. See VertexPacking for the encoding.
+struct PackedVertex
+{
+    std::uint16_t Pos[4];   // R16G16B16A16_UNORM, relative to the submesh bounds. w is unused
+    std::int16_t Normal[2]; // R16G16_SNORM, octahedral
+    std::uint16_t TexC[2];  // R16G16_UNORM, relative to the submesh UV range
+};
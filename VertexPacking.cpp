@@ -0,0 +1,213 @@
+#include "VertexPacking.h"
+#include "FrameResource.h" // for Vertex, PackedVertex
+
+#include <cfloat> // FLT_MAX
+#include <cmath> // fabsf
+
+using namespace std;
+using namespace DirectX;
+
+namespace
+{
+    const float UNORM16_MAX = 65535.0f;
+    const float SNORM16_MAX = 32767.0f;
+
+    inline uint16_t QuantizeUnorm16(float value, float offset, float scale)
+    {
+        if (scale <= 0.0f)
+            return 0;
+
+        float t = (value - offset) / scale;
+        t = (std::min)((std::max)(t, 0.0f), 1.0f);
+        return (uint16_t)(t * UNORM16_MAX + 0.5f);
+    }
+
+    inline float DequantizeUnorm16(uint16_t q, float offset, float scale)
+    {
+        return offset + scale * (q / UNORM16_MAX);
+    }
+
+    inline int16_t QuantizeSnorm16(float value)
+    {
+        value = (std::min)((std::max)(value, -1.0f), 1.0f);
+        return (int16_t)(value * SNORM16_MAX + (value < 0.0f ? -0.5f : 0.5f));
+    }
+
+    inline float DequantizeSnorm16(int16_t q)
+    {
+        // Same as the hardware: -32768 and -32767 both map to -1
+        return (std::max)(q / SNORM16_MAX, -1.0f);
+    }
+
+    inline float SignNotZero(float v)
+    {
+        return v < 0.0f ? -1.0f : 1.0f;
+    }
+
+    // Running min/max of the positions and texcoords of a set of vertices
+    struct VertexBox
+    {
+        XMFLOAT3 PosMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+        XMFLOAT3 PosMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        XMFLOAT2 TexMin = { FLT_MAX, FLT_MAX };
+        XMFLOAT2 TexMax = { -FLT_MAX, -FLT_MAX };
+
+        void Add(const Vertex& v)
+        {
+            PosMin = XMFLOAT3((std::min)(PosMin.x, v.Pos.x), (std::min)(PosMin.y, v.Pos.y), (std::min)(PosMin.z, v.Pos.z));
+            PosMax = XMFLOAT3((std::max)(PosMax.x, v.Pos.x), (std::max)(PosMax.y, v.Pos.y), (std::max)(PosMax.z, v.Pos.z));
+            TexMin = XMFLOAT2((std::min)(TexMin.x, v.TexC.x), (std::min)(TexMin.y, v.TexC.y));
+            TexMax = XMFLOAT2((std::max)(TexMax.x, v.TexC.x), (std::max)(TexMax.y, v.TexC.y));
+        }
+
+        VertexQuantization Quantization() const
+        {
+            VertexQuantization q;
+            if (PosMin.x > PosMax.x)
+                return q; // empty
+
+            q.PosOffset = PosMin;
+            q.PosScale = XMFLOAT3(PosMax.x - PosMin.x, PosMax.y - PosMin.y, PosMax.z - PosMin.z);
+            q.TexOffset = TexMin;
+            q.TexScale = XMFLOAT2(TexMax.x - TexMin.x, TexMax.y - TexMin.y);
+            return q;
+        }
+    };
+}
+
+void VertexPacking::Pack(const vector<Vertex>& vertices, const vector<uint32_t>& indices,
+    unordered_map<string, SubmeshGeometry>& drawArgs, vector<PackedVertex>& packed)
+{
+    const int UNOWNED = -1;
+
+    vector<SubmeshGeometry*> submeshes;
+    for (auto& kv : drawArgs)
+        submeshes.push_back(&kv.second);
+
+    // Submeshes that share vertices (levels of detail and their full resolution submesh, neighbouring chunks) must
+    // share a quantization too, or the vertex would decode differently for each. Those end up in one group.
+    vector<int> group(submeshes.size());
+    for (size_t s = 0; s < submeshes.size(); ++s)
+        group[s] = (int)s;
+
+    auto findGroup = [&](int s)
+    {
+        while (group[s] != s)
+            s = group[s] = group[group[s]];
+        return s;
+    };
+
+    // Which submesh first used each vertex
+    vector<int> owner(vertices.size(), UNOWNED);
+
+    for (size_t s = 0; s < submeshes.size(); ++s)
+    {
+        auto sg = submeshes[s];
+        for (UINT i = sg->StartIndexLocation; i < sg->StartIndexLocation + sg->IndexCount; ++i)
+        {
+            auto& o = owner[indices[i] + sg->BaseVertexLocation];
+            if (o == UNOWNED)
+                o = (int)s;
+            else
+                group[findGroup(o)] = findGroup((int)s);
+        }
+    }
+
+    VertexBox meshBox;
+    for (auto& v : vertices)
+        meshBox.Add(v);
+    const VertexQuantization meshQuantization = meshBox.Quantization();
+
+    vector<VertexBox> boxes(submeshes.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        if (owner[i] != UNOWNED)
+            boxes[findGroup(owner[i])].Add(vertices[i]);
+    }
+
+    for (size_t s = 0; s < submeshes.size(); ++s)
+        submeshes[s]->Quantization = boxes[findGroup((int)s)].Quantization();
+
+    // Vertices no submesh references are never drawn; they only need to be valid
+    packed.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        packed[i] = PackVertex(vertices[i], owner[i] == UNOWNED ? meshQuantization : submeshes[owner[i]]->Quantization);
+}
+
+PackedVertex VertexPacking::PackVertex(const Vertex& v, const VertexQuantization& quantization)
+{
+    auto& q = quantization;
+
+    PackedVertex p;
+    p.Pos[0] = QuantizeUnorm16(v.Pos.x, q.PosOffset.x, q.PosScale.x);
+    p.Pos[1] = QuantizeUnorm16(v.Pos.y, q.PosOffset.y, q.PosScale.y);
+    p.Pos[2] = QuantizeUnorm16(v.Pos.z, q.PosOffset.z, q.PosScale.z);
+    p.Pos[3] = 0;
+
+    auto oct = OctEncode(v.Normal);
+    p.Normal[0] = QuantizeSnorm16(oct.x);
+    p.Normal[1] = QuantizeSnorm16(oct.y);
+
+    p.TexC[0] = QuantizeUnorm16(v.TexC.x, q.TexOffset.x, q.TexScale.x);
+    p.TexC[1] = QuantizeUnorm16(v.TexC.y, q.TexOffset.y, q.TexScale.y);
+
+    return p;
+}
+
+Vertex VertexPacking::UnpackVertex(const PackedVertex& v, const VertexQuantization& quantization)
+{
+    auto& q = quantization;
+
+    Vertex out;
+    XMStoreFloat3(&out.Pos, UnpackPosition(v, q));
+    out.Normal = OctDecode(XMFLOAT2(DequantizeSnorm16(v.Normal[0]), DequantizeSnorm16(v.Normal[1])));
+    out.TexC.x = DequantizeUnorm16(v.TexC[0], q.TexOffset.x, q.TexScale.x);
+    out.TexC.y = DequantizeUnorm16(v.TexC[1], q.TexOffset.y, q.TexScale.y);
+
+    return out;
+}
+
+XMVECTOR VertexPacking::UnpackPosition(const PackedVertex& v, const VertexQuantization& quantization)
+{
+    auto& q = quantization;
+
+    return XMVectorSet(
+        DequantizeUnorm16(v.Pos[0], q.PosOffset.x, q.PosScale.x),
+        DequantizeUnorm16(v.Pos[1], q.PosOffset.y, q.PosScale.y),
+        DequantizeUnorm16(v.Pos[2], q.PosOffset.z, q.PosScale.z),
+        1.0f);
+}
+
+/*
+Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the diagonals onto the outer
+triangles of the [-1, 1]^2 square (Cigolle et al. 2014).
+*/
+XMFLOAT2 VertexPacking::OctEncode(const XMFLOAT3& n)
+{
+    const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 <= 0.0f)
+        return XMFLOAT2(0.0f, 0.0f);
+
+    XMFLOAT2 e(n.x / l1, n.y / l1);
+    if (n.z < 0.0f)
+    {
+        e = XMFLOAT2(
+            (1.0f - fabsf(e.y)) * SignNotZero(e.x),
+            (1.0f - fabsf(e.x)) * SignNotZero(e.y));
+    }
+
+    return e;
+}
+
+// Must match OctDecode in Common.hlsl
+XMFLOAT3 VertexPacking::OctDecode(const XMFLOAT2& e)
+{
+    XMFLOAT3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+
+    const float t = (std::max)(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+
+    XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&n)));
+    return n;
+}
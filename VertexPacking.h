@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Mesh.h"
+
+struct Vertex;       // FrameResource.h
+struct PackedVertex; // FrameResource.h
+
+/*
+Conversion between Vertex and PackedVertex.
+
+Positions and UVs are stored as unorm16 relative to the box spanned by the vertices of their submesh, so the
+precision adapts to the size of each submesh rather than the whole level. Normals are octahedral encoded as
+two snorm16 values, which spreads the precision evenly over the sphere.
+
+Worst case errors, per component:
+    position: 0.5 * PosScale / 65535
+    texcoord: 0.5 * TexScale / 65535
+    normal:   under 0.004 degrees
+*/
+class VertexPacking
+{
+public:
+    /*
+    Encodes vertices into packed and fills out the Quantization of every submesh in drawArgs. Indices are relative to
+    the BaseVertexLocation of their submesh. Submeshes that share vertices, such as levels of detail and their full
+    resolution submesh, get one quantization for all of them.
+    */
+    static void Pack(const std::vector<Vertex>& vertices, const std::vector<std::uint32_t>& indices,
+        std::unordered_map<std::string, SubmeshGeometry>& drawArgs, std::vector<PackedVertex>& packed);
+
+    static PackedVertex PackVertex(const Vertex& v, const VertexQuantization& quantization);
+    static Vertex UnpackVertex(const PackedVertex& v, const VertexQuantization& quantization);
+
+    // Cheaper than UnpackVertex when only the position is needed, e.g. for picking
+    static DirectX::XMVECTOR UnpackPosition(const PackedVertex& v, const VertexQuantization& quantization);
+
+    // Unit vector to [-1, 1]^2 and back. A zero vector encodes as (0, 0), which decodes to +z.
+    static DirectX::XMFLOAT2 OctEncode(const DirectX::XMFLOAT3& n);
+    static DirectX::XMFLOAT3 OctDecode(const DirectX::XMFLOAT2& e);
+};
@@ -0,0 +1,37 @@
+#include "ViewVolume.h"
+
+using namespace DirectX;
+
+ViewVolume::ViewVolume(FXMMATRIX viewProj)
+{
+    // Row vectors: clip = p * viewProj, so each clip coordinate is p dotted with a column
+    XMMATRIX columns = XMMatrixTranspose(viewProj);
+    XMStoreFloat4(&mPlanes[0], columns.r[3] + columns.r[0]);   // Left: x >= -w
+    XMStoreFloat4(&mPlanes[1], columns.r[3] - columns.r[0]);   // Right: x <= w
+    XMStoreFloat4(&mPlanes[2], columns.r[3] + columns.r[1]);   // Bottom: y >= -w
+    XMStoreFloat4(&mPlanes[3], columns.r[3] - columns.r[1]);   // Top: y <= w
+    XMStoreFloat4(&mPlanes[4], columns.r[2]);                  // Near: z >= 0
+    XMStoreFloat4(&mPlanes[5], columns.r[3] - columns.r[2]);   // Far: z <= w
+}
+
+bool XM_CALLCONV ViewVolume::Intersects(const BoundingBox& local, FXMMATRIX world) const
+{
+    // The box's center in world space, and its half extents along its (transformed) axes
+    XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&local.Center), world);
+    XMVECTOR axisX = world.r[0] * local.Extents.x;
+    XMVECTOR axisY = world.r[1] * local.Extents.y;
+    XMVECTOR axisZ = world.r[2] * local.Extents.z;
+
+    for (auto& p : mPlanes)
+    {
+        XMVECTOR plane = XMLoadFloat4(&p);
+
+        // How far the box reaches towards the plane's normal, against where its center is
+        float reach = fabsf(XMVectorGetX(XMVector3Dot(plane, axisX))) + fabsf(XMVectorGetX(XMVector3Dot(plane, axisY))) +
+            fabsf(XMVectorGetX(XMVector3Dot(plane, axisZ)));
+        float distance = XMVectorGetX(XMVector3Dot(plane, center)) + p.w;
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+}
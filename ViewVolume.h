@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Utilities.h"
+
+/*
+The volume a view-projection matrix maps into D3D clip space (-w <= x, y <= w, 0 <= z <= w), as six planes, for culling
+boxes against a render pass: the camera, a spot or directional light, or one face of a point light's cube. The planes
+are read off the matrix's columns (Gribb and Hartmann), so perspective and orthographic projections work alike.
+
+A box is culled if it lies entirely outside one plane. Boxes outside the volume but across a corner of it survive,
+which costs a draw and never a missing object.
+*/
+class ViewVolume
+{
+public:
+    explicit ViewVolume(DirectX::FXMMATRIX viewProj);
+
+    // Whether any part of the box local, transformed by world (any affine transform), may be in the volume
+    bool XM_CALLCONV Intersects(const DirectX::BoundingBox& local, DirectX::FXMMATRIX world) const;
+
+private:
+    // Inward pointing, not normalized: a point p is inside plane i if dot(mPlanes[i], (p, 1)) >= 0
+    DirectX::XMFLOAT4 mPlanes[6];
+};